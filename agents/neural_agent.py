@@ -439,11 +439,13 @@ def _eval_and_score_actions(cache, model, simulator, num_actions, batch_size,
 
         _, sorted_actions = zip(
             *sorted(zip(scores, actions), key=lambda x: (-x[0], tuple(x[1]))))
-        for action in sorted_actions:
-            if (evaluator.get_attempts_for_task(i) >= phyre.MAX_TEST_ATTEMPTS):
-                break
-            status = simulator.simulate_action(task_index,
-                                               action,
-                                               need_images=False).status
+        # The evaluator needs all attempts, not only the ones up to the first
+        # solution, to compute the global metrics.
+        statuses = simulator.evaluate_ranked_actions(
+            task_index,
+            sorted_actions,
+            phyre.MAX_TEST_ATTEMPTS - evaluator.get_attempts_for_task(i),
+            stop_on_solution=False)
+        for status in statuses:
             evaluator.maybe_log_attempt(i, status)
     return evaluator.get_aucess()
@@ -513,20 +513,30 @@ class DQNAgent(AgentWithSimulationCache):
                 statuses = cache.load_simulation_states(task_id)
 
             finetune_data = []
-            for action_id in action_order:
-                if evaluator.get_attempts_for_task(
-                        task_index) >= max_attempts_per_task:
-                    break
-                action = refined_actions[action_id]
-                if refine_iterations > 0:
-                    status = simulator.simulate_action(task_index,
-                                                       action,
-                                                       need_images=False,
-                                                       need_scenes=False).status
-                else:
+            if refine_iterations > 0:
+                # Refined actions are not in the cache. Fine-tuning needs the
+                # statuses of all attempts, so do not stop at the solution.
+                ranked_actions = [
+                    refined_actions[action_id] for action_id in action_order
+                ]
+                ranked_statuses = simulator.evaluate_ranked_actions(
+                    task_index,
+                    ranked_actions,
+                    max_attempts_per_task -
+                    evaluator.get_attempts_for_task(task_index),
+                    stop_on_solution=False)
+                for action, status in zip(ranked_actions, ranked_statuses):
+                    finetune_data.append((task_index, status, action))
+                    evaluator.maybe_log_attempt(task_index, status)
+            else:
+                for action_id in action_order:
+                    if evaluator.get_attempts_for_task(
+                            task_index) >= max_attempts_per_task:
+                        break
+                    action = refined_actions[action_id]
                     status = phyre.SimulationStatus(statuses[action_id])
-                finetune_data.append((task_index, status, action))
-                evaluator.maybe_log_attempt(task_index, status)
+                    finetune_data.append((task_index, status, action))
+                    evaluator.maybe_log_attempt(task_index, status)
             if evaluator.get_attempts_for_task(task_index) == 0:
                 logging.warning('Made 0 attempts for task %s', task_id)
             if finetune_iterations > 0:
@@ -0,0 +1,240 @@
+# Copyright (c) Facebook, Inc. and its affiliates.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+"""Measures memory and allocations of magic_ponies for every output set.
+
+Every (task, outputs, stride) measurement runs in a forked process, so the
+peak RSS of the process is the peak of a single call. For each configuration
+the script reports the number of frames, the size of the returned arrays, the
+peak RSS growth and the peak of allocations traced by tracemalloc (numpy
+buffers, but not native buffers) per frame, and the number of memory blocks
+that tracemalloc sees allocated by the call and still alive while its outputs
+are held, per call. Blocks allocated and freed by the native simulator are not
+visible to tracemalloc; those are counted by allocations_test
+(src/simulator/tests/test_allocations.cpp).
+
+Examples:
+    # Print the table.
+    python benchmark_observation_memory.py
+
+    # Store the results and later fail if any configuration uses more than
+    # 20% more memory per frame or allocates 20% more blocks per call.
+    python benchmark_observation_memory.py --save-baseline /tmp/memory.json
+    python benchmark_observation_memory.py --baseline /tmp/memory.json \
+        --threshold 0.2
+"""
+import itertools
+import json
+import multiprocessing
+import resource
+import sys
+import tracemalloc
+
+import numpy as np
+
+import phyre.action_mappers
+import phyre.loader
+import phyre.simulator
+
+# Peak RSS is measured with page granularity and is affected by the allocator,
+# so small absolute differences are never reported as regressions.
+MIN_REGRESSION_BYTES_PER_FRAME = 4096
+# Block counts vary slightly with interpreter caches.
+MIN_REGRESSION_BLOCKS_PER_CALL = 2
+
+
+def get_tasks(task_ids, num_tasks):
+    if not task_ids:
+        # One task per template from evenly spaced templates.
+        templates = phyre.loader.load_compiled_template_dict()
+        template_ids = sorted(templates)
+        step = max(1, len(template_ids) // num_tasks)
+        task_ids = [
+            sorted(templates[template_id])[0]
+            for template_id in template_ids[::step][:num_tasks]
+        ]
+    return phyre.loader.load_compiled_task_dict(task_ids)
+
+
+def get_user_input(seed):
+    mapper = phyre.action_mappers.ACTION_MAPPERS['ball']()
+    action = mapper.sample(rng=np.random.RandomState(seed=seed))
+    user_input, _ = mapper.action_to_user_input(action)
+    return user_input
+
+
+def _get_output_bytes(output):
+    if output is None:
+        return 0
+    if isinstance(output, np.ndarray):
+        return output.nbytes
+    if hasattr(output, 'nbytes'):
+        return output.nbytes
+    return sum(_get_output_bytes(x) for x in output)
+
+
+def _measure(connection, task, user_input, stride, need_images,
+             need_featurized_objects, need_object_masks):
+    tracemalloc.start()
+    rss_before = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+    _, _, images, objects, masks = phyre.simulator.magic_ponies(
+        task,
+        user_input,
+        stride=stride,
+        need_images=need_images,
+        need_featurized_objects=need_featurized_objects,
+        need_object_masks=need_object_masks)
+    rss_after = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+    _, traced_peak = tracemalloc.get_traced_memory()
+    # Taken while the outputs are alive, so their blocks are counted.
+    snapshot = tracemalloc.take_snapshot().filter_traces(
+        (tracemalloc.Filter(False, tracemalloc.__file__),))
+    traced_blocks = sum(stat.count for stat in snapshot.statistics('filename'))
+    num_frames = len(objects)
+    if need_images:
+        num_frames = len(images)
+    elif need_object_masks:
+        num_frames = len(masks)
+    output_bytes = sum(
+        _get_output_bytes(x) for x in (images, objects, masks)
+        if x is not None)
+    # ru_maxrss is in kilobytes on Linux.
+    connection.send(
+        dict(num_frames=num_frames,
+             output_bytes=output_bytes,
+             peak_rss_bytes=max(0, rss_after - rss_before) * 1024,
+             traced_peak_bytes=traced_peak,
+             traced_blocks=traced_blocks))
+    connection.close()
+
+
+def measure(task, user_input, stride, outputs):
+    """Runs a single magic_ponies call in a forked process."""
+    context = multiprocessing.get_context('fork')
+    receiver, sender = context.Pipe(duplex=False)
+    process = context.Process(target=_measure,
+                              args=(sender, task, user_input, stride) +
+                              outputs)
+    process.start()
+    result = receiver.recv()
+    process.join()
+    if process.exitcode != 0:
+        raise RuntimeError('Measurement failed with exit code %d' %
+                           process.exitcode)
+    return result
+
+
+def get_config_name(outputs, stride):
+    names = ('images', 'objects', 'masks')
+    enabled = [name for name, need in zip(names, outputs) if need]
+    return '%s/stride=%d' % ('+'.join(enabled) or 'none', stride)
+
+
+def main(args):
+    tasks = get_tasks(args.task_ids.split(',') if args.task_ids else None,
+                      args.num_tasks)
+    print('Tasks:', ' '.join(sorted(tasks)))
+    # Serialize once in the parent so that children only run magic_ponies.
+    tasks = {
+        task_id: phyre.simulator.serialize(task)
+        for task_id, task in tasks.items()
+    }
+    user_inputs = [get_user_input(seed) for seed in range(len(tasks))]
+
+    results = {}
+    print('%-32s %8s %14s %14s %14s %14s' %
+          ('config', 'frames', 'output B/fr', 'peak RSS B/fr', 'traced B/fr',
+           'blocks/call'))
+    for outputs in itertools.product((False, True), repeat=3):
+        for stride in args.strides:
+            name = get_config_name(outputs, stride)
+            totals = dict(num_frames=0,
+                          output_bytes=0,
+                          peak_rss_bytes=0,
+                          traced_peak_bytes=0,
+                          traced_blocks=0)
+            for task, user_input in zip(tasks.values(), user_inputs):
+                for key, value in measure(task, user_input, stride,
+                                          outputs).items():
+                    totals[key] += value
+            num_frames = max(1, totals['num_frames'])
+            results[name] = dict(
+                frames=totals['num_frames'],
+                output_bytes_per_frame=totals['output_bytes'] / num_frames,
+                peak_rss_bytes_per_frame=totals['peak_rss_bytes'] / num_frames,
+                traced_peak_bytes_per_frame=totals['traced_peak_bytes'] /
+                num_frames,
+                traced_blocks_per_call=totals['traced_blocks'] / len(tasks))
+            print('%-32s %8d %14.0f %14.0f %14.0f %14.1f' %
+                  (name, results[name]['frames'],
+                   results[name]['output_bytes_per_frame'],
+                   results[name]['peak_rss_bytes_per_frame'],
+                   results[name]['traced_peak_bytes_per_frame'],
+                   results[name]['traced_blocks_per_call']))
+
+    if args.save_baseline:
+        with open(args.save_baseline, 'w') as stream:
+            json.dump(results, stream, indent=2, sort_keys=True)
+        print('Saved baseline to', args.save_baseline)
+
+    if args.baseline:
+        with open(args.baseline) as stream:
+            baseline = json.load(stream)
+        regressions = []
+        for name, result in results.items():
+            if name not in baseline:
+                continue
+            for key, min_regression in (
+                ('peak_rss_bytes_per_frame', MIN_REGRESSION_BYTES_PER_FRAME),
+                ('traced_peak_bytes_per_frame',
+                 MIN_REGRESSION_BYTES_PER_FRAME),
+                ('traced_blocks_per_call', MIN_REGRESSION_BLOCKS_PER_CALL)):
+                if key not in baseline[name]:
+                    continue
+                old, new = baseline[name][key], result[key]
+                if (new > old * (1 + args.threshold) and
+                        new - old > min_regression):
+                    regressions.append('%s %s: %.0f -> %.0f' %
+                                       (name, key, old, new))
+        if regressions:
+            print('Memory or allocation regressions beyond %.0f%%:' %
+                  (100 * args.threshold))
+            for regression in regressions:
+                print('  ' + regression)
+            return 1
+        print('No memory or allocation regressions')
+    return 0
+
+
+if __name__ == '__main__':
+    import argparse
+    parser = argparse.ArgumentParser(
+        description=__doc__,
+        formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--task-ids',
+                        help='Comma separated list of task ids. By default'
+                        ' one task from each of --num-tasks templates')
+    parser.add_argument('--num-tasks', type=int, default=5)
+    parser.add_argument('--strides',
+                        type=int,
+                        nargs='+',
+                        default=[1, phyre.simulator.DEFAULT_STRIDE])
+    parser.add_argument('--baseline',
+                        help='JSON file produced with --save-baseline')
+    parser.add_argument('--threshold',
+                        type=float,
+                        default=0.2,
+                        help='Allowed relative growth of memory per frame'
+                        ' and of allocated blocks per call')
+    parser.add_argument('--save-baseline')
+    sys.exit(main(parser.parse_args()))
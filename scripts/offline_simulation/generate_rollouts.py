@@ -0,0 +1,184 @@
+# Copyright (c) Facebook, Inc. and its affiliates.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+"""Generates a sharded rollout dataset with the native generate_rollouts tool.
+
+The script resolves the task list and the action source into a RolloutJob and
+runs cmake_build/generate_rollouts on it. The output shards can be read with
+phyre.rollout_dataset.RolloutDatasetReader.
+
+Examples:
+    # 100 random actions for every task of the ball tier, fold 0 train set.
+    python generate_rollouts.py --tier ball --eval-setup ball_cross_template \
+        --fold 0 --action-source random --num-actions 100 \
+        --output-prefix /tmp/rollouts/train
+
+    # Up to 10 solving actions from the simulation cache for two tasks.
+    python generate_rollouts.py --tier ball --task-ids 00000:000,00001:000 \
+        --action-source solved --num-actions 10 --output-prefix /tmp/solved
+"""
+import os
+import pathlib
+import subprocess
+
+import numpy as np
+
+import phyre
+import phyre.interface.task.ttypes as task_if
+import phyre.loader
+import phyre.simulator
+
+DEFAULT_BINARY = (pathlib.Path(__file__).resolve().parents[2] / 'cmake_build' /
+                  'generate_rollouts')
+
+
+def get_task_ids(task_ids, eval_setup, fold, subset):
+    if task_ids:
+        if os.path.exists(task_ids):
+            with open(task_ids) as stream:
+                return stream.read().split()
+        return task_ids.split(',')
+    assert eval_setup is not None, 'Either --task-ids or --eval-setup needed'
+    train, dev, test = phyre.get_fold(eval_setup, fold)
+    return dict(train=train, dev=dev, test=test)[subset]
+
+
+def get_actions(tier, task_ids, action_source, num_actions, action_file,
+                seed):
+    """Returns (actions, action_ids, per-task indices into actions)."""
+    if action_source == 'random':
+        mapper = phyre.action_mappers.ACTION_MAPPERS[tier]()
+        rng = np.random.RandomState(seed=seed)
+        actions = np.array(
+            [mapper.sample(rng=rng) for _ in range(num_actions)], 'float32')
+        indices = [list(range(len(actions)))] * len(task_ids)
+        return actions, np.arange(len(actions)), indices
+    if action_source == 'file':
+        actions = np.load(action_file).astype('float32')
+        indices = [list(range(len(actions)))] * len(task_ids)
+        return actions, np.arange(len(actions)), indices
+
+    # Cache-filtered: pick actions with the requested status for every task.
+    cache = phyre.get_default_100k_cache(tier)
+    wanted_status = dict(solved=phyre.SimulationStatus.SOLVED,
+                         unsolved=phyre.SimulationStatus.NOT_SOLVED)
+    wanted_status = wanted_status[action_source]
+    rng = np.random.RandomState(seed=seed)
+    per_task_ids = []
+    for task_id in task_ids:
+        matching = np.flatnonzero(
+            cache.load_simulation_states(task_id) == wanted_status)
+        if len(matching) > num_actions:
+            matching = np.sort(
+                rng.choice(matching, size=num_actions, replace=False))
+        per_task_ids.append(matching)
+    action_ids = np.unique(np.concatenate(per_task_ids + [[]]).astype(int))
+    position = {action_id: i for i, action_id in enumerate(action_ids)}
+    indices = [[position[action_id] for action_id in ids]
+               for ids in per_task_ids]
+    return cache.action_array[action_ids], action_ids, indices
+
+
+def build_job(tier, task_ids, actions, action_ids, indices):
+    mapper = phyre.action_mappers.ACTION_MAPPERS[tier]()
+    user_inputs = []
+    valid = []
+    for action in actions:
+        user_input, is_valid = mapper.action_to_user_input(action)
+        user_inputs.append(user_input)
+        valid.append(is_valid)
+    indices = [[i for i in task_indices if valid[i]] for task_indices in indices]
+    return task_if.RolloutJob(
+        tasks=phyre.loader.load_compiled_task_list(task_ids),
+        userInputs=user_inputs,
+        actionIndices=indices,
+        keepSpaceAroundBodies=mapper.KEEP_SPACE_AROUND_BODIES,
+        actionIds=[int(x) for x in action_ids])
+
+
+def main(args):
+    task_ids = get_task_ids(args.task_ids, args.eval_setup, args.fold,
+                            args.subset)
+    actions, action_ids, indices = get_actions(args.tier, task_ids,
+                                               args.action_source,
+                                               args.num_actions,
+                                               args.action_file, args.seed)
+    job = build_job(args.tier, task_ids, actions, action_ids, indices)
+    print('Tasks: %d, actions: %d, rollouts: %d' %
+          (len(task_ids), len(actions), sum(map(len, job.actionIndices))))
+
+    output_prefix = pathlib.Path(args.output_prefix)
+    output_prefix.parent.mkdir(parents=True, exist_ok=True)
+    job_path = str(output_prefix) + '.job'
+    with open(job_path, 'wb') as stream:
+        stream.write(phyre.simulator.serialize(job))
+
+    cmd = [
+        str(args.binary),
+        '--job=%s' % job_path,
+        '--output_prefix=%s' % output_prefix,
+        '--num_shards=%d' % args.num_shards,
+        '--num_threads=%d' % args.num_threads,
+        '--steps=%d' % args.steps,
+        '--stride=%d' % args.stride,
+        '--resolution=%d' % args.resolution,
+        '--images=%d' % args.images,
+        '--featurized_objects=%d' % args.featurized_objects,
+        '--object_masks=%d' % args.object_masks,
+    ]
+    if args.raw:
+        cmd.append('--raw')
+    subprocess.check_call(cmd)
+
+
+if __name__ == '__main__':
+    import argparse
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('--tier',
+                        choices=phyre.simulation_cache.TIERS,
+                        required=True)
+    parser.add_argument('--task-ids',
+                        help='Comma separated list of task ids or a file with'
+                        ' whitespace separated task ids')
+    parser.add_argument('--eval-setup', choices=phyre.list_eval_setups())
+    parser.add_argument('--fold', type=int, default=0)
+    parser.add_argument('--subset',
+                        choices=('train', 'dev', 'test'),
+                        default='train')
+    parser.add_argument('--action-source',
+                        choices=('random', 'solved', 'unsolved', 'file'),
+                        default='random')
+    parser.add_argument('--num-actions',
+                        type=int,
+                        default=100,
+                        help='Number of random actions or maximum number of'
+                        ' cached actions per task')
+    parser.add_argument('--action-file',
+                        help='.npy file with actions for --action-source=file')
+    parser.add_argument('--seed', type=int, default=0)
+    parser.add_argument('--output-prefix', required=True)
+    parser.add_argument('--num-shards', type=int, default=0)
+    parser.add_argument('--num-threads', type=int, default=0)
+    parser.add_argument('--steps',
+                        type=int,
+                        default=phyre.simulator.DEFAULT_MAX_STEPS)
+    parser.add_argument('--stride',
+                        type=int,
+                        default=phyre.simulator.DEFAULT_STRIDE)
+    parser.add_argument('--resolution', type=int, default=0)
+    parser.add_argument('--images', type=int, default=1)
+    parser.add_argument('--featurized-objects', type=int, default=1)
+    parser.add_argument('--object-masks', type=int, default=0)
+    parser.add_argument('--raw', action='store_true')
+    parser.add_argument('--binary', default=str(DEFAULT_BINARY))
+    main(parser.parse_args())
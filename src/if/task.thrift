@@ -50,6 +50,21 @@ struct TaskCollection {
   1: optional list<Task> tasks,
 }
 
+// Touching pairs of objects for a sequence of frames in a compressed sparse
+// row layout. Objects are indexed in the same order as featurized objects,
+// i.e., scene bodies followed by user input bodies.
+struct ContactGraph {
+  // Edges of frame i are [frameOffsets[i], frameOffsets[i + 1]). The list has
+  // one element more than the number of frames.
+  1: optional list<i32> frameOffsets,
+  // Flattened pairs of object indices, two per edge. The first index in a
+  // pair is always smaller than the second one.
+  2: optional list<i32> edges,
+  // Total normal impulse between the objects of each edge at the last step
+  // in Box2D units (kg * m / s), if requested.
+  3: optional list<double> normalImpulses,
+}
+
 // Return object from task simulation. Some fields may be missing for
 // performance reaons depending on what type of simulation is requested.
 struct TaskSimulation {
@@ -62,6 +77,42 @@ struct TaskSimulation {
   // Number of steps simulation ran for. It matches sizes of the lists if
   // stride is 1.
   4: optional i32 stepsSimulated,
+  // Goal distance signal for every scene in sceneList if requested. See
+  // getGoalDistance in task_validation.h for the definition.
+  5: optional list<double> goalDistanceList,
+  // Touching objects for every scene in sceneList if requested.
+  6: optional ContactGraph contactGraph,
+}
+
+// Scalar statistics of a task simulation computed while stepping. Only the
+// requested statistics are set. All distances are in pixels.
+struct TaskSimulationSummary {
+  1: optional bool isSolution,
+  2: optional i32 stepsSimulated,
+  // First step at which the goal bodies touch, or -1 if they never do.
+  3: optional i32 firstTouchStep,
+  // Minimum distance between the goal bodies over all steps.
+  4: optional double minGoalDistance,
+  // Positions and angles of scene bodies followed by user input bodies after
+  // the last step.
+  5: optional list<scene.Vector> finalPositions,
+  6: optional list<double> finalAngles,
+  // Maximum linear speed of user input bodies in pixels per second.
+  7: optional double maxUserBodySpeed,
+}
+
+// Input for the native rollout generator (src/simulator/generate_rollouts).
+struct RolloutJob {
+  1: optional list<Task> tasks,
+  // User inputs for all actions. Action indices point into this list.
+  2: optional list<scene.UserInput> userInputs,
+  // For each task, the list of actions to simulate.
+  3: optional list<list<i32>> actionIndices,
+  // Whether to keep space around scene bodies when adding user input.
+  4: optional bool keepSpaceAroundBodies,
+  // Action ids stored in the dataset for each user input. Defaults to the
+  // index of the user input.
+  5: optional list<i32> actionIds,
 }
 
 struct TaskSimulationWithMeta {
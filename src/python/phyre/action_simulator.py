@@ -17,9 +17,8 @@ Simulator takes a list of tasks at initialization, builds agent-readable
 representation for them, and provides interface to run simulation in a
 specified action tier.
 """
-from typing import Mapping, Optional, Sequence, Tuple, Union
+from typing import List, Mapping, Optional, Sequence, Tuple, Union
 import enum
-import copy
 
 import numpy as np
 
@@ -79,7 +78,8 @@ class ActionSimulator():
             self,
             tasks: Union[Sequence[task_if.Task], Mapping[str, task_if.Task]],
             action_mapper,
-            no_goals: bool = True):
+            no_goals: bool = True,
+            memo: Optional[phyre.simulator.SimulationMemo] = None):
         if isinstance(tasks, Mapping):
             self._tasks = tuple(tasks.values())
         else:
@@ -91,14 +91,18 @@ class ActionSimulator():
         else:
             self.tier = 'unknown'
         self._action_mapper = action_mapper
-        self._initial_scenes, self._initial_featurized_objects, self._goals = _get_observations(
-            self._tasks, self._action_mapper)
-        if no_goals:
-            self._goals = None
         self._serialized = tuple(
             phyre.simulator.serialize(task) for task in self._tasks)
+        # Rendered and featurized on first access.
+        self._initial_scenes = None
+        self._initial_featurized_objects = None
+        if no_goals:
+            self._goals = None
+        else:
+            self._goals = _get_goals(self._tasks)
         self._keep_spaces = self._action_mapper.KEEP_SPACE_AROUND_BODIES
         self._task_ids = tuple(task.taskId for task in self._tasks)
+        self._memo = memo
 
     def sample(self, valid_only=True, rng=None) -> ActionLike:
         """Sample a random (valid) action from the action space."""
@@ -129,6 +133,7 @@ class ActionSimulator():
 
         uint8 array with shape (task, height, width).
         """
+        self._maybe_init_observations()
         return self._initial_scenes
 
     @property
@@ -138,6 +143,7 @@ class ActionSimulator():
         List (length tasks) of FeaturizedObjects containing float arrays of size
         (number scene objects, OBJECT_FEATURE_SIZE).
         """
+        self._maybe_init_observations()
         return self._initial_featurized_objects
 
     @property
@@ -157,6 +163,11 @@ class ActionSimulator():
         """
         return self._task_ids
 
+    def _maybe_init_observations(self):
+        if self._initial_scenes is None:
+            (self._initial_scenes, self._initial_featurized_objects
+            ) = phyre.simulator.tasks_to_initial_observations(self._serialized)
+
     def _get_user_input(self, action):
         user_input, is_valid = self._action_mapper.action_to_user_input(action)
         return user_input, is_valid
@@ -165,6 +176,21 @@ class ActionSimulator():
             self, task_index, user_input, need_images, need_featurized_objects,
             need_object_masks,stride,) -> Tuple[SimulationStatus, MaybeImages, MaybeObjects]:
         serialzed_task = self._serialized[task_index]
+        if (self._memo is not None and not need_images and
+                not need_featurized_objects and not need_object_masks):
+            # The occlusion check is a part of the memoized call.
+            had_occlusions, summary = (
+                phyre.simulator.simulate_task_summary_memoized(
+                    serialzed_task,
+                    user_input,
+                    self._memo,
+                    keep_space_around_bodies=self._keep_spaces,
+                    skip_occluded=not self._action_mapper.OCCLUSIONS_ALLOWED))
+            if had_occlusions and not self._action_mapper.OCCLUSIONS_ALLOWED:
+                return SimulationStatus.INVALID_INPUT, None, None, None
+            if summary.isSolution:
+                return SimulationStatus.SOLVED, None, None, None
+            return SimulationStatus.NOT_SOLVED, None, None, None
         # FIXME: merge this into single call to simulator.
         if not self._action_mapper.OCCLUSIONS_ALLOWED:
             if phyre.simulator.check_for_occlusions(
@@ -291,41 +317,66 @@ class ActionSimulator():
                                                featurized_objects=objects,
                                                   object_masks=object_masks)
 
-        for modified_user_input in _yield_user_input_neighborhood(user_input):
-            status, _, _, _ = self._simulate_user_input(
-                task_index,
-                modified_user_input,
-                need_images=False,
-                need_featurized_objects=False,
-                need_object_masks=False,
-                stride=stride)
-            if status.is_not_solved():
-                return phyre.simulation.Simulation(
-                    status=SimulationStatus.UNSTABLY_SOLVED,
-                    images=images,
-                    featurized_objects=objects,
-                    object_masks=object_masks)
+        # The neighbors are simulated concurrently and the check stops at the
+        # first unsolved one.
+        if not phyre.simulator.check_solution_stability(
+                self._serialized[task_index],
+                user_input,
+                keep_space_around_bodies=self._keep_spaces,
+                occlusions_allowed=self._action_mapper.OCCLUSIONS_ALLOWED):
+            return phyre.simulation.Simulation(
+                status=SimulationStatus.UNSTABLY_SOLVED,
+                images=images,
+                featurized_objects=objects,
+                object_masks=object_masks)
         return phyre.simulation.Simulation(
             status=SimulationStatus.STABLY_SOLVED,
             images=images,
             featurized_objects=objects,
             object_masks=object_masks)
 
+    def evaluate_ranked_actions(self,
+                                task_index: int,
+                                actions: Sequence[ActionLike],
+                                max_attempts: int,
+                                *,
+                                stop_on_solution: bool = True,
+                                num_threads: int = 0
+                               ) -> List[SimulationStatus]:
+        """Simulates ranked actions the way an evaluation loop does.
+
+        Equivalent to calling simulate_action(task_index, action,
+        need_images=False) for actions in order until max_attempts of them
+        are valid or, if stop_on_solution, until the first one that solves
+        the task. The next num_threads actions are simulated speculatively in
+        parallel and the ones ranked after a solution are discarded, so the
+        result is the same as for the sequential loop.
+
+        Args:
+            task_index: index of the task.
+            actions: actions in the order they should be tried.
+            max_attempts: int, maximum number of valid actions to simulate,
+                e.g., phyre.MAX_TEST_ATTEMPTS.
+            stop_on_solution: whether to stop at the first solution.
+            num_threads: int, number of actions simulated in parallel. If
+                not positive, the number of cores is used.
 
-def _yield_user_input_neighborhood(base_user_input):
-    for dx in (-0.5, 0, 0.5):
-        for dy in (-0.5, 0, 0.5):
-            if dx == 0 and dy == 0:
-                continue
-            user_input = copy.deepcopy(base_user_input)
-            for polygon in user_input.polygons:
-                for v in polygon.vertices:
-                    v.x += dx
-                    v.y += dy
-            for circle in user_input.balls:
-                circle.position.x += dx
-                circle.position.y += dy
-            yield user_input
+        Returns:
+            List of SimulationStatus of the simulated prefix of actions.
+        """
+        user_inputs = []
+        for action in actions:
+            user_input, is_valid = self._get_user_input(action)
+            user_inputs.append(user_input if is_valid else None)
+        statuses = phyre.simulator.evaluate_ranked_user_inputs(
+            self._serialized[task_index],
+            user_inputs,
+            max_attempts,
+            keep_space_around_bodies=self._keep_spaces,
+            occlusions_allowed=self._action_mapper.OCCLUSIONS_ALLOWED,
+            stop_on_solution=stop_on_solution,
+            num_threads=num_threads)
+        return [SimulationStatus(status) for status in statuses]
 
 
 def _encode_goal(task):
@@ -340,35 +391,20 @@ def _encode_goal(task):
     return obj1_code, rel, obj2_code
 
 
-def _get_observations(
-        tasks: Sequence[task_if.Task],
-        action_mapper=None,
-) -> Tuple[np.ndarray, np.ndarray, np.ndarray]:
-    """Encode the initial scene and the goal as arrays.
+def _get_goals(tasks: Sequence[task_if.Task]) -> np.ndarray:
+    """Encode the goals of tasks as an array.
 
     Args:
         task: list of thift tasks.
 
     Returns:
-        A tuple (scenes, objects, goals).
-        scenes: uint8 array with shape (task, height, width).
-        featurized_objects: list (length tasks) of FeaturizedObjects 
-            contianing float arrays of size
-            (number scene objects, OBJECT_FEATURE_SIZE).
         goals: uint8 array with shape (task, 3).
             Each goal is encoded with three numbers: (obj_type1,
                 obj_type2, rel). All three are less than MAX_GOAL. To be more
                 presize, obj_types are less than MAX_OBJECT_TYPE and rel is
                 less than MAX_RELATION.
     """
-    scenes = np.stack(
-        [phyre.simulator.scene_to_raster(task.scene) for task in tasks])
-    featurized_objects = [
-        phyre.simulator.scene_to_featurized_objects(task.scene)
-        for task in tasks
-    ]
-    goals = np.array([_encode_goal(task) for task in tasks], dtype=np.uint8)
-    return (scenes, featurized_objects, goals)
+    return np.array([_encode_goal(task) for task in tasks], dtype=np.uint8)
 
 
 def initialize_simulator(task_ids: Sequence[str],
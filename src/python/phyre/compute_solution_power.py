@@ -13,6 +13,12 @@
 # limitations under the License.
 """A library that computes the power of solutions from evaluation stats for
 a task template.
+
+To recompute stale solution power for all templates with existing eval stats
+run:
+
+  python compute_solution_power.py --template-id all --native
+
 """
 import functools
 import itertools
@@ -29,6 +35,8 @@ import phyre.action_simulator
 import phyre.eval_task_complexity
 import phyre.loader
 import phyre.settings
+import phyre.simulator
+from phyre import simulator_bindings
 
 VERSION = '1'
 SOLUTIONS = 'solutions'
@@ -66,6 +74,42 @@ def get_solution_power(tier, template_id, eval_data):
     return task_solutions, task_ids, tier
 
 
+def get_solution_power_native(tier, template_id, eval_data, num_workers=-1):
+    """Same as get_solution_power, but simulates all pairs in one native call.
+
+    The pairs are simulated on num_workers threads (all cores if not
+    positive).
+    """
+    _, task_path, task_script = phyre.loader.load_task_script(template_id)
+    task_ids = list(eval_data.keys())
+
+    all_sols = set()
+    for task_instance in task_ids:
+        all_sols.update(
+            [tuple(each) for each in eval_data[task_instance][tier][SOLUTIONS]])
+    all_sols = list(all_sols)
+    tasks = [
+        task_script.build_task.get_specific_task(task_instance)
+        for task_instance in task_ids
+    ]
+
+    action_mapper = phyre.action_mappers.get_action_mapper(tier)
+    valid_sols, user_inputs = [], []
+    for sol_i, sol in enumerate(all_sols):
+        user_input, is_valid = action_mapper.action_to_user_input(sol)
+        if is_valid:
+            valid_sols.append(sol_i)
+            user_inputs.append(phyre.simulator.serialize(user_input))
+    task_solutions = np.zeros((len(all_sols), len(task_ids)))
+    if user_inputs and tasks:
+        task_solutions[valid_sols] = simulator_bindings.compute_solution_power(
+            [phyre.simulator.serialize(task) for task in tasks], user_inputs,
+            action_mapper.KEEP_SPACE_AROUND_BODIES,
+            action_mapper.OCCLUSIONS_ALLOWED,
+            phyre.simulator.DEFAULT_MAX_STEPS, num_workers)
+    return task_solutions, task_ids, tier
+
+
 def does_solution_power_need_update(task_path):
     eval_fpath = phyre.eval_task_complexity.get_evaluation_meta_path(task_path)
     sp_fpath = get_solution_power_path(task_path)
@@ -93,6 +137,14 @@ def does_solution_power_need_update(task_path):
             logging.debug('Computed for old task (%s)',
                           solution_power_data.get('task_script_version', '1'))
             return True
+        # Files written before the hash was stored are only checked by
+        # versions.
+        sp_task_script_hash = solution_power_data.get('task_script_hash')
+        if (sp_task_script_hash is not None and
+                sp_task_script_hash != eval_data.get('task_script_hash')):
+            logging.debug('Computed for a different task script (%s)',
+                          sp_task_script_hash)
+            return True
         logging.debug('The solution power results up to date')
         return False
     else:
@@ -103,26 +155,69 @@ def save_solution_power(template_id,
                         eval_meta,
                         eval_data,
                         task_path,
-                        num_workers=-1):
+                        num_workers=-1,
+                        native=False):
     solution_powers = {}
     solution_powers['evaluator_version'] = eval_meta.get(
         'evaluator_version', '1')
     solution_powers['task_script_version'] = eval_meta.get(
         'task_script_version', '1')
-    solution_powers['soltuion_power_version'] = VERSION
-    partial_worker = functools.partial(
-        get_solution_power,
-        template_id=template_id,
-        eval_data=eval_data['eval_stats'],
-    )
-    num_workers = min(num_workers, len(
-        phyre.action_mappers.ACTION_MAPPERS)) if num_workers > 0 else None
-    pool = multiprocessing.Pool(num_workers)
-    results = pool.map(partial_worker, phyre.action_mappers.ACTION_MAPPERS)
-    pool.close()
+    solution_powers['task_script_hash'] = eval_meta.get('task_script_hash')
+    solution_powers['solution_power_version'] = VERSION
+    if native:
+        results = [
+            get_solution_power_native(tier, template_id,
+                                      eval_data['eval_stats'], num_workers)
+            for tier in phyre.action_mappers.ACTION_MAPPERS
+        ]
+    else:
+        partial_worker = functools.partial(
+            get_solution_power,
+            template_id=template_id,
+            eval_data=eval_data['eval_stats'],
+        )
+        num_workers = min(num_workers, len(
+            phyre.action_mappers.ACTION_MAPPERS)) if num_workers > 0 else None
+        pool = multiprocessing.Pool(num_workers)
+        results = pool.map(partial_worker, phyre.action_mappers.ACTION_MAPPERS)
+        pool.close()
     for tier_solution_power, task_ids, tier in results:
         solution_powers[f'{tier}_actions_on_tasks'] = tier_solution_power
         solution_powers['task_ids'] = task_ids
     sp_fpath = get_solution_power_path(task_path)
     logging.info('Saving %s', sp_fpath)
     joblib.dump(solution_powers, sp_fpath, compress=('lzma', 6))
+
+
+def main(template_id, num_workers, native):
+    if template_id == 'all':
+        template_ids = sorted(
+            x.split('.')[0]
+            for x in os.listdir(str(phyre.settings.TASK_EVAL_DIR))
+            if x.endswith('.meta.json'))
+    else:
+        template_ids = [template_id]
+    for template_id in template_ids:
+        _, task_path, _ = phyre.loader.load_task_script(template_id)
+        # Only templates with a changed task script or a new eval stats
+        # version are recomputed.
+        phyre.eval_task_complexity.maybe_recompute_solution_power(
+            template_id, task_path, num_workers, native)
+
+
+if __name__ == '__main__':
+    logging.basicConfig(format=('%(asctime)s %(levelname)-8s'
+                                ' {%(module)s:%(lineno)d} %(message)s'),
+                        level=logging.INFO,
+                        datefmt='%Y-%m-%d %H:%M:%S')
+
+    import argparse
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--template-id',
+                        required=True,
+                        help='Single template-id or "all".')
+    parser.add_argument('--num-workers', type=int, default=-1)
+    parser.add_argument('--native',
+                        action='store_true',
+                        help='Simulate on threads in the simulator library.')
+    main(**vars(parser.parse_args()))
@@ -20,6 +20,9 @@ To compute the stats run:
 
   python eval_task_complexity.py --template-id 00100
 
+Add --native to run the evaluation loop in the simulator library on a pool of
+threads instead of worker processes.
+
 """
 import collections
 import enum
@@ -34,6 +37,7 @@ import signal
 import sys
 
 import joblib
+import numpy as np
 import scipy.stats
 
 import phyre.action_mappers
@@ -41,7 +45,9 @@ import phyre.action_simulator
 import phyre.compute_solution_power
 import phyre.loader
 import phyre.settings
+import phyre.simulator
 import phyre.util
+from phyre import simulator_bindings
 
 CREATOR_HASH = phyre.util.compute_creator_hash()
 
@@ -326,6 +332,92 @@ class TaskEvaller():
             os.rename(tmp_path, checkpoint_path)
 
 
+def _build_action_pool(action_mapper, pool):
+    """Same actions as ActionSimulator.build_discrete_action_space."""
+    rng = np.random.RandomState(seed=1000 + pool)
+    return [action_mapper.sample(rng=rng) for _ in range(ACTION_POOL_SIZE)]
+
+
+class NativeTaskEvaller():
+    """Runs the TaskEvaller loop with simulator_bindings.
+
+    All simulations, including the stability checks, run on a pool of threads
+    in the simulator library. The statistics have the same format as
+    TaskEvaller.result(). Checkpointing is not supported.
+    """
+
+    def __init__(self,
+                 tasks,
+                 min_valid_attempts,
+                 num_workers,
+                 simulate_worker_size,
+                 reject_ball_solvable=False):
+        self._tasks = tasks
+        self._tiers = list(phyre.action_mappers.ACTION_MAPPERS)
+        self._action_mappers = [
+            phyre.action_mappers.get_action_mapper(tier) for tier in self._tiers
+        ]
+        self.min_valid_attempts = min_valid_attempts
+        self.num_workers = num_workers
+        self.simulate_worker_size = simulate_worker_size
+        self.reject_ball_solvable = reject_ball_solvable
+
+    def _get_user_inputs(self, tier_index, pool):
+        action_mapper = self._action_mappers[tier_index]
+        user_inputs = []
+        for action in _build_action_pool(action_mapper, pool):
+            user_input, is_valid = action_mapper.action_to_user_input(action)
+            user_inputs.append(
+                phyre.simulator.serialize(user_input) if is_valid else None)
+        return user_inputs
+
+    def _get_actions(self, tier_index, indices):
+        pools = {}
+        actions = []
+        for index in indices:
+            pool = index // ACTION_POOL_SIZE
+            if pool not in pools:
+                pools[pool] = _build_action_pool(
+                    self._action_mappers[tier_index], pool)
+            actions.append(pools[pool][index % ACTION_POOL_SIZE].tolist())
+        return actions
+
+    def run(self):
+        """Runs evaluation until all (task, tier) pairs are done."""
+        tiers = [(tier, SOLVABILITY_THRESHOLD_PROBS[tier],
+                  mapper.KEEP_SPACE_AROUND_BODIES, mapper.OCCLUSIONS_ALLOWED)
+                 for tier, mapper in zip(self._tiers, self._action_mappers)]
+        results = simulator_bindings.evaluate_task_complexity(
+            [phyre.simulator.serialize(task) for task in self._tasks],
+            tiers,
+            action_pool_provider=self._get_user_inputs,
+            progress_callback=lambda num_simulations: logging.info(
+                'Simulations done: %d', num_simulations),
+            min_valid_attempts=self.min_valid_attempts,
+            chunk_size=self.simulate_worker_size,
+            action_pool_size=ACTION_POOL_SIZE,
+            p_value=P_VALUE,
+            min_solutions=MIN_SOLUTIONS,
+            max_solutions_to_keep=MAX_SOLUTIONS_TO_KEEP,
+            num_threads=self.num_workers,
+            reject_ball_solvable=self.reject_ball_solvable,
+            steps=phyre.simulator.DEFAULT_MAX_STEPS)
+        stats_per_task_tier = {}
+        for result in results:
+            task_id = self._tasks[result['task_index']].taskId
+            tier_index = result['tier_index']
+            stats_per_task_tier[task_id, self._tiers[tier_index]] = dict(
+                status_counts={
+                    phyre.SimulationStatus(status): count
+                    for status, count in result['status_counts'].items()
+                },
+                solutions=self._get_actions(tier_index, result['solutions']),
+                unstable_solutions=self._get_actions(
+                    tier_index, result['unstable_solutions']),
+            )
+        return stats_per_task_tier
+
+
 def load_all_eval_stats(num_workers=None, mode=LoadingMode.FULL):
     """Load all computed up-to-date eval stats.
 
@@ -527,7 +619,10 @@ def init_signal_handler():
     logging.warning('Signal handler installed.')
 
 
-def maybe_recompute_solution_power(template_id, task_path, num_workers):
+def maybe_recompute_solution_power(template_id,
+                                   task_path,
+                                   num_workers,
+                                   native=False):
     if not phyre.compute_solution_power.does_solution_power_need_update(
             task_path):
         return
@@ -543,12 +638,15 @@ def maybe_recompute_solution_power(template_id, task_path, num_workers):
     assert os.path.exists(eval_fpath), (
         f'Eval-stats path does not exist for {task_path}')
     eval_data = joblib.load(eval_fpath)
-    phyre.compute_solution_power.save_solution_power(template_id, eval_meta,
-                                                     eval_data, task_path,
-                                                     num_workers)
+    phyre.compute_solution_power.save_solution_power(template_id,
+                                                     eval_meta,
+                                                     eval_data,
+                                                     task_path,
+                                                     num_workers,
+                                                     native=native)
 
 
-def main(template_id, log_dir, force, interactive, **simulate_kwargs):
+def main(template_id, log_dir, force, interactive, native, **simulate_kwargs):
     if template_id is None:
         assert log_dir is not None, 'Provide --template-id or --log-dir'
         init_signal_handler()
@@ -564,7 +662,8 @@ def main(template_id, log_dir, force, interactive, **simulate_kwargs):
             logging.warning('Oh, wait a sec, force mode, will rewrite')
         else:
             return maybe_recompute_solution_power(
-                template_id, task_path, simulate_kwargs['num_workers'])
+                template_id, task_path, simulate_kwargs['num_workers'],
+                native)
     tasks = task_script.build_task.build_tasks_for_search(template_id)
     logging.info('Built %d task instances.', len(tasks))
     search_params = task_script.build_task.search_params
@@ -576,16 +675,24 @@ def main(template_id, log_dir, force, interactive, **simulate_kwargs):
     else:
         checkpoint_path = None
 
-    evaller = TaskEvaller(
-        tasks,
-        reject_ball_solvable='BALL:GOOD_STABLE' in search_params.excluded_flags,
-        **simulate_kwargs)
-    evaller.maybe_load(checkpoint_path)
-    while not evaller.done():
-        evaller.step()
-        evaller.maybe_save(checkpoint_path)
-
-    eval_stats_task_tier = evaller.result()
+    reject_ball_solvable = ('BALL:GOOD_STABLE'
+                            in search_params.excluded_flags)
+    if native:
+        if checkpoint_path is not None:
+            logging.warning('Checkpoints are not supported in native mode')
+        eval_stats_task_tier = NativeTaskEvaller(
+            tasks, reject_ball_solvable=reject_ball_solvable,
+            **simulate_kwargs).run()
+    else:
+        evaller = TaskEvaller(tasks,
+                              reject_ball_solvable=reject_ball_solvable,
+                              **simulate_kwargs)
+        evaller.maybe_load(checkpoint_path)
+        while not evaller.done():
+            evaller.step()
+            evaller.maybe_save(checkpoint_path)
+
+        eval_stats_task_tier = evaller.result()
     eval_stats = collections.defaultdict(dict)
     for (task_id, tier), stats in eval_stats_task_tier.items():
         stats['status_counts'] = {
@@ -643,7 +750,8 @@ def main(template_id, log_dir, force, interactive, **simulate_kwargs):
         meta,
         eval_data,
         task_path,
-        num_workers=simulate_kwargs['num_workers'])
+        num_workers=simulate_kwargs['num_workers'],
+        native=native)
 
 
 if __name__ == '__main__':
@@ -665,4 +773,8 @@ if __name__ == '__main__':
                         type=int,
                         default=MIN_VALID_ATTEMPTS)
     parser.add_argument('--interactive', action='store_true')
+    parser.add_argument('--native',
+                        action='store_true',
+                        help='Run simulations, including solution power, on'
+                        ' threads in the simulator library.')
     main(**vars(parser.parse_args()))
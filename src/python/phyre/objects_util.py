@@ -19,6 +19,7 @@ import phyre.interface.shared.ttypes as shared_if
 import phyre.interface.shared.constants as shared_constants
 import phyre.simulator
 from phyre import creator
+from phyre import simulator_bindings
 from phyre.creator import constants
 from phyre.creator import shapes as shapes_lib
 from phyre.creator.creator import Body
@@ -83,6 +84,63 @@ def featurized_objects_vector_to_raster(featurized_objects: np.ndarray
         featurized_objects_vector_to_scene(featurized_objects))
 
 
+def featurized_objects_vectors_to_rasters(featurized_objects: np.ndarray,
+                                          num_threads: int = 0
+                                         ) -> np.ndarray:
+    """Convert featurized objects of many frames to color code images natively.
+
+        Same as calling featurized_objects_vector_to_raster for every frame,
+        but the scenes are rebuilt from the features in C++ on num_threads
+        threads, without Python bodies and Thrift scenes.
+
+        Args:
+            featurized_objects: np.ndarray of size
+                (num_frames, num_objects, OBJECT_FEATURE_SIZE)
+            num_threads: int, number of threads. If not positive, the
+                number of cores is used.
+
+        Returns:
+            A np.ndarray of size (num_frames, SCENE_HEIGHT, SCENE_WIDTH) of
+                color codes.
+    """
+    return simulator_bindings.render_featurized_objects(
+        np.asarray(featurized_objects, dtype=np.float32), num_threads)
+
+
+def simulate_featurized_objects(featurized_objects: np.ndarray,
+                                steps: int,
+                                stride: int = 1,
+                                num_threads: int = 0) -> np.ndarray:
+    """Restart the simulation from featurized objects, including velocities.
+
+        The scenes are rebuilt from the features in C++ and simulated on
+        num_threads threads. The result has the same format as the input, but
+        the objects of the user input come after the other objects.
+
+        Args:
+            featurized_objects: np.ndarray of size
+                (num_objects, OBJECT_FEATURE_SIZE) for a single start state
+                or (num_states, num_objects, OBJECT_FEATURE_SIZE).
+            steps: int, number of steps to simulate.
+            stride: int, every stride-th frame is returned.
+            num_threads: int, number of threads. If not positive, the
+                number of cores is used.
+
+        Returns:
+            A np.ndarray of size (num_frames, num_objects, OBJECT_FEATURE_SIZE)
+                for a single start state or (num_states, num_frames,
+                num_objects, OBJECT_FEATURE_SIZE), where num_frames is
+                ceil(steps / stride).
+    """
+    featurized_objects = np.asarray(featurized_objects, dtype=np.float32)
+    single_state = featurized_objects.ndim == 2
+    if single_state:
+        featurized_objects = featurized_objects[None]
+    frames = simulator_bindings.simulate_featurized_objects(
+        featurized_objects, steps, stride, num_threads)
+    return frames[0] if single_state else frames
+
+
 def _object_features_to_values(features):
     featurized_objects = phyre.simulation.FeaturizedObjects(
         phyre.simulation.finalize_featurized_objects(
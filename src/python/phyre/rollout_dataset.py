@@ -0,0 +1,302 @@
+# Copyright (c) Facebook, Inc. and its affiliates.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+"""Columnar on-disk storage for simulation rollouts.
+
+Rollouts are written by the native RolloutDatasetWriter (see
+src/simulator/rollout_dataset.h for the file layout) and read back with
+RolloutDatasetReader, which memory-maps the file and decodes only the columns
+and frames that are requested.
+"""
+from typing import Dict, List, NamedTuple, Optional, Tuple
+import struct
+
+import numpy as np
+
+from phyre import simulator_bindings
+import phyre.simulation
+import phyre.simulator
+
+MAGIC = b'PHYRERD\0'
+VERSION = 1
+
+COLUMN_IMAGES = 0
+COLUMN_FEATURIZED_OBJECTS = 1
+COLUMN_OBJECT_MASKS = 2
+COLUMN_SOLVED_STATES = 3
+
+CODEC_RAW = 0
+CODEC_RLE = 1
+CODEC_DELTA = 2
+
+
+class Column(NamedTuple):
+    codec: int
+    offset: int
+    size: int
+
+
+class RolloutInfo(NamedTuple):
+    task_id: str
+    action_index: int
+    num_frames: int
+    num_objects: int
+    height: int
+    width: int
+    steps_simulated: int
+    is_solution: bool
+    columns: Dict[int, Column]
+
+
+class RolloutDatasetWriter(object):
+    """Simulates tasks and appends the rollouts to a dataset file.
+
+    Usage:
+        with RolloutDatasetWriter(path) as writer:
+            writer.add(task_id, action_index, task, user_input,
+                       need_images=True)
+    """
+
+    def __init__(self, path: str, compress: bool = True, resolution: int = 0):
+        """Creates a new dataset file.
+
+        Args:
+            path: Path to the file to write.
+            compress: If False, all columns are stored without encoding.
+            resolution: If positive, images and masks are resized to this
+                width (height is scaled proportionally).
+        """
+        self._writer = simulator_bindings.RolloutDatasetWriter(
+            path, compress, resolution)
+
+    def add(self,
+            task_id: str,
+            action_index: int,
+            task,
+            user_input,
+            steps=phyre.simulator.DEFAULT_MAX_STEPS,
+            stride=phyre.simulator.DEFAULT_STRIDE,
+            keep_space_around_bodies=True,
+            need_images=True,
+            need_featurized_objects=True,
+            need_object_masks=False) -> bool:
+        """Simulates the task with the user input and stores the rollout.
+
+        Arguments have the same meaning as in simulator.magic_ponies.
+
+        Returns:
+            False if the user input had occlusions. Nothing is stored in this
+            case.
+        """
+        if not isinstance(task, bytes):
+            task = phyre.simulator.serialize(task)
+        if not isinstance(user_input, phyre.simulator.scene_if.UserInput):
+            user_input = phyre.simulator.build_user_input(*user_input)
+        return self._writer.add(task_id, action_index, task,
+                                phyre.simulator.serialize(user_input),
+                                keep_space_around_bodies, steps, stride,
+                                need_images, need_featurized_objects,
+                                need_object_masks)
+
+    @property
+    def num_rollouts(self) -> int:
+        return self._writer.num_rollouts
+
+    def close(self):
+        self._writer.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+
+def _rle_decode(blob: np.ndarray,
+                dtype,
+                start: int = 0,
+                stop: Optional[int] = None) -> np.ndarray:
+    """Decodes elements [start, stop) of a little-endian RLE blob."""
+    num_runs = int(blob[:8].view('<u8')[0])
+    lengths = blob[8:8 + 4 * num_runs].view('<u4')
+    values = blob[8 + 4 * num_runs:].view(dtype)
+    ends = np.cumsum(lengths, dtype=np.int64)
+    total = int(ends[-1]) if num_runs else 0
+    if stop is None:
+        stop = total
+    if start == 0 and stop == total:
+        return np.repeat(values, lengths)
+    if start >= stop:
+        return np.empty([0], dtype)
+    first = int(np.searchsorted(ends, start, side='right'))
+    last = int(np.searchsorted(ends, stop - 1, side='right'))
+    run_lengths = lengths[first:last + 1].astype(np.int64)
+    run_starts = ends[first:last + 1] - run_lengths
+    run_lengths = (np.minimum(ends[first:last + 1], stop) -
+                   np.maximum(run_starts, start))
+    return np.repeat(values[first:last + 1], run_lengths)
+
+
+class RolloutDatasetReader(object):
+    """Random access reader for rollout datasets.
+
+    Rollouts are addressed by (task_id, action_index). Raw columns are
+    returned as read-only views into the memory-mapped file, compressed
+    columns are decoded on access.
+    """
+
+    def __init__(self, path: str):
+        self._data = np.memmap(path, dtype=np.uint8, mode='r')
+        if (len(self._data) < 2 * len(MAGIC) + 16 or
+                bytes(self._data[:len(MAGIC)]) != MAGIC or
+                bytes(self._data[-len(MAGIC):]) != MAGIC):
+            raise ValueError('Not a rollout dataset: %s' % path)
+        version, = struct.unpack_from('<I', self._data, len(MAGIC))
+        if version != VERSION:
+            raise ValueError('Unsupported rollout dataset version: %d' %
+                             version)
+        index_offset, = struct.unpack_from('<Q', self._data,
+                                           len(self._data) - len(MAGIC) - 8)
+        self._rollouts = {}  # type: Dict[Tuple[str, int], RolloutInfo]
+        self._keys = []  # type: List[Tuple[str, int]]
+        self._parse_index(int(index_offset))
+
+    def _parse_index(self, offset):
+        data = self._data
+        num_rollouts, = struct.unpack_from('<I', data, offset)
+        offset += 4
+        for _ in range(num_rollouts):
+            task_id_length, = struct.unpack_from('<H', data, offset)
+            offset += 2
+            task_id = bytes(data[offset:offset + task_id_length]).decode()
+            offset += task_id_length
+            (action_index, num_frames, num_objects, height, width,
+             steps_simulated, is_solution,
+             num_columns) = struct.unpack_from('<6iBB', data, offset)
+            offset += struct.calcsize('<6iBB')
+            columns = {}
+            for _ in range(num_columns):
+                column, codec, column_offset, size = struct.unpack_from(
+                    '<BBQQ', data, offset)
+                offset += struct.calcsize('<BBQQ')
+                columns[column] = Column(codec, column_offset, size)
+            key = (task_id, action_index)
+            self._keys.append(key)
+            self._rollouts[key] = RolloutInfo(task_id, action_index,
+                                              num_frames, num_objects, height,
+                                              width, steps_simulated,
+                                              bool(is_solution), columns)
+
+    def keys(self) -> List[Tuple[str, int]]:
+        """Returns (task_id, action_index) pairs in the order of writing."""
+        return list(self._keys)
+
+    def __len__(self) -> int:
+        return len(self._keys)
+
+    def __contains__(self, key: Tuple[str, int]) -> bool:
+        return key in self._rollouts
+
+    def info(self, task_id: str, action_index: int) -> RolloutInfo:
+        return self._rollouts[(task_id, action_index)]
+
+    def _column(self, info: RolloutInfo, column: int) -> Column:
+        if column not in info.columns:
+            raise KeyError('Column %d is not stored for rollout %s:%d' %
+                           (column, info.task_id, info.action_index))
+        return info.columns[column]
+
+    def _blob(self, column: Column) -> np.ndarray:
+        return self._data[column.offset:column.offset + column.size]
+
+    def _decode_pixels(self, info, column_id, frame_shape, frame=None):
+        column = self._column(info, column_id)
+        frame_size = int(np.prod(frame_shape))
+        if frame is None:
+            start, stop, shape = 0, None, (info.num_frames,) + frame_shape
+        else:
+            start, stop, shape = frame * frame_size, (frame +
+                                                      1) * frame_size, frame_shape
+        blob = self._blob(column)
+        if column.codec == CODEC_RLE:
+            return _rle_decode(blob, np.uint8, start, stop).reshape(shape)
+        stop = len(blob) if stop is None else stop
+        return blob[start:stop].reshape(shape)
+
+    def _decode_features(self, info, frame=None):
+        column = self._column(info, COLUMN_FEATURIZED_OBJECTS)
+        blob = self._blob(column)
+        shape = (info.num_frames, info.num_objects,
+                 phyre.simulator.OBJECT_FEATURE_SIZE)
+        if column.codec == CODEC_DELTA:
+            deltas = _rle_decode(blob, np.dtype('<u4')).reshape(
+                (shape[1], shape[2], shape[0]))
+            features = np.cumsum(deltas, axis=2, dtype=np.uint32).view(
+                np.float32).transpose(2, 0, 1)
+        else:
+            features = blob.view('<f4').reshape(shape)
+        if frame is not None:
+            features = features[frame:frame + 1]
+        features = phyre.simulation.finalize_featurized_objects(features)
+        return features if frame is None else features[0]
+
+    def images(self, task_id: str, action_index: int) -> np.ndarray:
+        """Returns uint8 array (frames, height, width)."""
+        info = self.info(task_id, action_index)
+        return self._decode_pixels(info, COLUMN_IMAGES,
+                                   (info.height, info.width))
+
+    def featurized_objects(self, task_id: str,
+                           action_index: int) -> np.ndarray:
+        """Returns float32 array (frames, objects, OBJECT_FEATURE_SIZE).
+
+        The features are processed with finalize_featurized_objects just like
+        the output of simulator.magic_ponies.
+        """
+        return self._decode_features(self.info(task_id, action_index))
+
+    def object_masks(self, task_id: str, action_index: int) -> np.ndarray:
+        """Returns uint8 array (frames, objects, height, width)."""
+        info = self.info(task_id, action_index)
+        return self._decode_pixels(info, COLUMN_OBJECT_MASKS,
+                                   (info.num_objects, info.height, info.width))
+
+    def solved_states(self, task_id: str, action_index: int) -> np.ndarray:
+        """Returns bool array (frames,)."""
+        info = self.info(task_id, action_index)
+        return self._blob(self._column(info, COLUMN_SOLVED_STATES)).view(
+            np.bool_)
+
+    def frame(self, task_id: str, action_index: int, frame: int
+             ) -> Tuple[Optional[np.ndarray], Optional[np.ndarray],
+                        Optional[np.ndarray]]:
+        """Returns (image, featurized_objects, object_masks) for one frame.
+
+        Only the runs covering the frame are decoded for RLE columns. Columns
+        that were not stored are None.
+        """
+        info = self.info(task_id, action_index)
+        if not 0 <= frame < info.num_frames:
+            raise IndexError('Frame %d is out of range [0, %d)' %
+                             (frame, info.num_frames))
+        image = objects = masks = None
+        if COLUMN_IMAGES in info.columns:
+            image = self._decode_pixels(info, COLUMN_IMAGES,
+                                        (info.height, info.width), frame)
+        if COLUMN_FEATURIZED_OBJECTS in info.columns:
+            objects = self._decode_features(info, frame)
+        if COLUMN_OBJECT_MASKS in info.columns:
+            masks = self._decode_pixels(
+                info, COLUMN_OBJECT_MASKS,
+                (info.num_objects, info.height, info.width), frame)
+        return image, objects, masks
@@ -12,7 +12,7 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 """A thin wrapper around c++ simulator bindings to handle Thrift objects."""
-from typing import List
+from typing import Callable, List, NamedTuple, Optional, Sequence, Tuple
 import copy
 import numpy as np
 from thrift import TSerialization
@@ -28,6 +28,28 @@ DEFAULT_MAX_STEPS = simulator_bindings.DEFAULT_MAX_STEPS
 STEPS_FOR_SOLUTION = simulator_bindings.STEPS_FOR_SOLUTION
 DEFAULT_STRIDE = simulator_bindings.FPS
 OBJECT_FEATURE_SIZE = simulator_bindings.OBJECT_FEATURE_SIZE
+# Flags for simulate_task_summary. Combine with |.
+SUMMARY_FIRST_TOUCH_STEP = simulator_bindings.SUMMARY_FIRST_TOUCH_STEP
+SUMMARY_MIN_GOAL_DISTANCE = simulator_bindings.SUMMARY_MIN_GOAL_DISTANCE
+SUMMARY_FINAL_POSITIONS = simulator_bindings.SUMMARY_FINAL_POSITIONS
+SUMMARY_MAX_USER_BODY_SPEED = simulator_bindings.SUMMARY_MAX_USER_BODY_SPEED
+SUMMARY_ALL = simulator_bindings.SUMMARY_ALL
+
+# Encodings of images returned by magic_ponies. See magic_ponies.
+IMAGE_FORMAT_DENSE = simulator_bindings.IMAGES_DENSE
+IMAGE_FORMAT_DELTA = simulator_bindings.IMAGES_DELTA
+IMAGE_FORMAT_RGB = simulator_bindings.IMAGES_RGB
+IMAGE_FORMAT_RGBA = simulator_bindings.IMAGES_RGBA
+_IMAGE_FORMAT_CHANNELS = {IMAGE_FORMAT_RGB: 3, IMAGE_FORMAT_RGBA: 4}
+
+# Encodings of object masks returned by magic_ponies. See magic_ponies.
+MASK_FORMAT_DENSE = simulator_bindings.MASKS_DENSE
+MASK_FORMAT_BITS = simulator_bindings.MASKS_BITS
+MASK_FORMAT_CROPS = simulator_bindings.MASKS_CROPS
+# Default number of frames per chunk returned by magic_ponies_stream.
+DEFAULT_STREAM_CHUNK_SIZE = 64
+# Default limit on the size of a single chunk returned by magic_ponies_stream.
+DEFAULT_STREAM_MAX_CHUNK_BYTES = 64 * 1024 * 1024
 
 FACTORY = TBinaryProtocol.TBinaryProtocolAcceleratedFactory()
 
@@ -77,11 +99,326 @@ def simulate_scene(scene: scene_if.Scene,
 
 def simulate_task(task: task_if.Task,
                   steps: int = DEFAULT_MAX_STEPS,
-                  stride: int = DEFAULT_STRIDE) -> task_if.TaskSimulation:
-    result = simulator_bindings.simulate_task(serialize(task), steps, stride)
+                  stride: int = DEFAULT_STRIDE,
+                  need_goal_distances: bool = False,
+                  need_contacts: bool = False,
+                  need_contact_impulses: bool = False
+                 ) -> task_if.TaskSimulation:
+    """Simulates the task and returns task_if.TaskSimulation.
+
+    If need_goal_distances is set, goalDistanceList contains a goal distance
+    for every scene in sceneList. The distance is computed natively on the
+    same steps as solvedStateList and is in pixels: the distance between the
+    goal bodies for touching relationships, the penetration depth into the
+    phantom shape for inside relationships (positive when inside), and the
+    signed bounding box gap for directional relationships (positive when the
+    relationship holds). Use get_goal_distances to get it as an array.
+
+    If need_contacts or need_contact_impulses is set, contactGraph contains
+    touching objects for every scene in sceneList. Use get_contact_graph to
+    get it as arrays.
+    """
+    result = simulator_bindings.simulate_task(
+        serialize(task), steps, stride, need_goal_distances,
+        _get_contacts_mode(need_contacts, need_contact_impulses))
     return deserialize(task_if.TaskSimulation(), result)
 
 
+def get_goal_distances(simulation: task_if.TaskSimulation) -> np.ndarray:
+    """Returns goalDistanceList of the simulation as a float32 array."""
+    if simulation.goalDistanceList is None:
+        raise ValueError('Simulation has no goal distances. Use'
+                         ' simulate_task(..., need_goal_distances=True)')
+    return np.array(simulation.goalDistanceList, dtype=np.float32)
+
+
+class ContactGraph(NamedTuple):
+    """Touching objects for a sequence of frames in CSR layout.
+
+    Objects are indexed like featurized objects and object masks. Edges of
+    frame i are edges[frame_offsets[i]:frame_offsets[i + 1]].
+
+    frame_offsets: int32 array of shape (num_frames + 1,).
+    edges: int32 array of shape (num_edges, 2) with object index pairs,
+        the first index is always smaller than the second one.
+    normal_impulses: None or float64 array of shape (num_edges,) with the
+        total normal impulse between the objects in Box2D units.
+    """
+    frame_offsets: np.ndarray
+    edges: np.ndarray
+    normal_impulses: Optional[np.ndarray]
+
+    @property
+    def num_frames(self) -> int:
+        return len(self.frame_offsets) - 1
+
+    def frame(self, index: int) -> np.ndarray:
+        """Returns edges of a single frame as an array (num_edges, 2)."""
+        return self.edges[self.frame_offsets[index]:self.
+                          frame_offsets[index + 1]]
+
+
+class DeltaImages(NamedTuple):
+    """Images stored as the first frame and pixel changes of every next frame.
+
+    keyframe: uint8 array (height, width) with the first frame.
+    frame_offsets: int64 array (num_frames,). Changes of frame i > 0 are
+        [frame_offsets[i - 1], frame_offsets[i]) in changed_pixels and
+        changed_values.
+    changed_pixels: int32 array with flat indices of changed pixels.
+    changed_values: uint8 array with new values of changed pixels.
+    """
+    keyframe: np.ndarray
+    frame_offsets: np.ndarray
+    changed_pixels: np.ndarray
+    changed_values: np.ndarray
+
+    @property
+    def num_frames(self) -> int:
+        return len(self.frame_offsets)
+
+    @property
+    def nbytes(self) -> int:
+        return sum(array.nbytes for array in self)
+
+    def decode(self, begin: int = 0, end: Optional[int] = None) -> np.ndarray:
+        """Returns frames [begin, end) as uint8 array (frames, height, width).
+
+        Decoding is done natively and does not hold the GIL.
+        """
+        if end is None:
+            end = self.num_frames
+        return simulator_bindings.decode_delta_images(*self, begin, end)
+
+
+class CroppedMasks(NamedTuple):
+    """Object masks cropped to the bounding box of every object.
+
+    boxes: int32 array of shape (num_frames, num_objects, 4) with (row,
+        column, height, width) of every crop in image coordinates. Empty
+        masks have zero height and width.
+    offsets: int64 array of shape (num_frames * num_objects + 1,). The crop
+        of object j in frame i is stored in row-major order in
+        data[offsets[k]:offsets[k + 1]] for k = i * num_objects + j.
+    data: uint8 array with all crops.
+    """
+    boxes: np.ndarray
+    offsets: np.ndarray
+    data: np.ndarray
+
+    def crop(self, frame: int, index: int) -> np.ndarray:
+        """Returns the crop of a single object as an array (height, width)."""
+        k = frame * self.boxes.shape[1] + index
+        _, _, height, width = self.boxes[frame, index]
+        return self.data[self.offsets[k]:self.offsets[k + 1]].reshape(
+            (height, width))
+
+
+def expand_bit_masks(packed_masks: np.ndarray, height: int,
+                     width: int) -> np.ndarray:
+    """Converts bit-packed masks to uint8 masks of zeros and ones.
+
+    Args:
+        packed_masks: uint8 array (..., (height * width + 7) // 8) as
+            returned by magic_ponies with MASK_FORMAT_BITS.
+        height, width: size of the scene.
+
+    Returns:
+        uint8 array (..., height, width).
+    """
+    masks = np.unpackbits(packed_masks, axis=-1)[..., :height * width]
+    return masks.reshape(packed_masks.shape[:-1] + (height, width))
+
+
+def expand_cropped_masks(masks: CroppedMasks, height: int,
+                         width: int) -> np.ndarray:
+    """Converts cropped masks to uint8 masks of the full scene size.
+
+    Returns:
+        uint8 array (num_frames, num_objects, height, width) that is equal to
+        the masks returned by magic_ponies with MASK_FORMAT_DENSE.
+    """
+    num_frames, num_objects = masks.boxes.shape[:2]
+    result = np.zeros((num_frames, num_objects, height, width), np.uint8)
+    for frame in range(num_frames):
+        for index in range(num_objects):
+            row, column, crop_height, crop_width = masks.boxes[frame, index]
+            result[frame, index, row:row + crop_height,
+                   column:column + crop_width] = masks.crop(frame, index)
+    return result
+
+
+def _get_contacts_mode(need_contacts: bool,
+                       need_contact_impulses: bool) -> int:
+    if need_contact_impulses:
+        return simulator_bindings.CONTACTS_EDGES_AND_IMPULSES
+    if need_contacts:
+        return simulator_bindings.CONTACTS_EDGES
+    return simulator_bindings.CONTACTS_NONE
+
+
+def get_contact_graph(simulation: task_if.TaskSimulation) -> ContactGraph:
+    """Returns contactGraph of the simulation as a ContactGraph."""
+    graph = simulation.contactGraph
+    if graph is None:
+        raise ValueError('Simulation has no contacts. Use'
+                         ' simulate_task(..., need_contacts=True)')
+    impulses = None
+    if graph.normalImpulses is not None:
+        impulses = np.array(graph.normalImpulses, dtype=np.float64)
+    return ContactGraph(np.array(graph.frameOffsets, dtype=np.int32),
+                        np.array(graph.edges, dtype=np.int32).reshape((-1, 2)),
+                        impulses)
+
+
+def simulate_task_summary(task: task_if.Task,
+                          user_input=None,
+                          steps: int = DEFAULT_MAX_STEPS,
+                          stats: int = SUMMARY_ALL,
+                          keep_space_around_bodies: bool = True
+                         ) -> task_if.TaskSimulationSummary:
+    """Simulates the task and returns scalar statistics of the rollout.
+
+    No scenes are recorded, so this is much cheaper than reducing images or
+    featurized objects returned by magic_ponies.
+
+    Args:
+        task: task_if.Task or bytes with a serialized task.
+        user_input: None, scene_if.UserInput or a triple (points,
+            rectangulars, balls), see magic_ponies.
+        steps: maximum number of steps to simulate for.
+        stats: combination of SUMMARY_* flags. Fields of the result that
+            correspond to statistics that were not requested are None.
+        keep_space_around_bodies: see magic_ponies.
+
+    Returns:
+        task_if.TaskSimulationSummary.
+    """
+    if not isinstance(task, bytes):
+        task = serialize(task)
+    if user_input is None:
+        serialized_user_input = b''
+    else:
+        if not isinstance(user_input, scene_if.UserInput):
+            user_input = build_user_input(*user_input)
+        serialized_user_input = serialize(user_input)
+    result = simulator_bindings.simulate_task_summary(
+        task, serialized_user_input, keep_space_around_bodies, steps, stats)
+    return deserialize(task_if.TaskSimulationSummary(), result)
+
+
+# Memo of simulation results for simulate_task_summary_memoized. Constructed
+# as SimulationMemo(capacity, path=''): capacity is the number of results kept
+# in memory (LRU) and a non-empty path enables an append-only file that
+# persists results across processes and may be shared by concurrent
+# processes. memo.stats() returns a dict with hits, disk_hits, misses, size
+# and disk_size.
+SimulationMemo = simulator_bindings.SimulationMemo
+
+
+def simulate_task_summary_memoized(
+        task,
+        user_input,
+        memo: Optional[SimulationMemo],
+        steps: int = DEFAULT_MAX_STEPS,
+        stats: int = 0,
+        keep_space_around_bodies: bool = True,
+        skip_occluded: bool = False
+) -> Tuple[bool, task_if.TaskSimulationSummary]:
+    """Same as simulate_task_summary, but the result is looked up in the memo.
+
+    Results are keyed by the task and the user bodies after they are merged
+    into the scene, so quantized actions that produce the same bodies are
+    simulated once.
+
+    Args:
+        task: task_if.Task or bytes with a serialized task.
+        user_input: scene_if.UserInput or a triple (points, rectangulars,
+            balls), see magic_ponies.
+        memo: SimulationMemo or None to always simulate.
+        steps: maximum number of steps to simulate for.
+        stats: combination of SUMMARY_* flags.
+        keep_space_around_bodies: see magic_ponies.
+        skip_occluded: if True, inputs with occlusions are not simulated and
+            the summary is not solved.
+
+    Returns:
+        A pair (had_occlusions, task_if.TaskSimulationSummary).
+    """
+    if not isinstance(task, bytes):
+        task = serialize(task)
+    if not isinstance(user_input, scene_if.UserInput):
+        user_input = build_user_input(*user_input)
+    had_occlusions, result = simulator_bindings.simulate_task_summary_memoized(
+        task, serialize(user_input), keep_space_around_bodies, skip_occluded,
+        steps, stats, memo)
+    return had_occlusions, deserialize(task_if.TaskSimulationSummary(), result)
+
+
+def simulate_tasks_as_completed(tasks: Sequence[task_if.Task],
+                                num_workers: int,
+                                callback: Callable[[int, task_if.TaskSimulation],
+                                                   None],
+                                steps: int = DEFAULT_MAX_STEPS,
+                                stride: int = DEFAULT_STRIDE) -> None:
+    """Simulates tasks in parallel and reports each result once it's ready.
+
+    Args:
+        tasks: list of tasks to simulate.
+        num_workers: number of worker processes. If non-positive, tasks are
+            simulated sequentially in the current process.
+        callback: function that is called exactly once for every task with
+            the index of the task in tasks and its task_if.TaskSimulation.
+            The calls happen in the calling thread in the order of
+            completion, not in the input order. The GIL is released while
+            waiting for the workers, so other Python threads keep running.
+        steps: maximum number of steps to simulate for.
+        stride: stride for the returned scenes.
+    """
+
+    def deserializing_callback(index, serialized_simulation):
+        callback(index,
+                 deserialize(task_if.TaskSimulation(), serialized_simulation))
+
+    simulator_bindings.simulate_tasks_as_completed(
+        [serialize(task) for task in tasks], num_workers, steps, stride,
+        deserializing_callback)
+
+
+def get_simulation_stats(reset: bool = False) -> dict:
+    """Returns process-wide counters of simulated rollouts.
+
+    Every simulation run by this process is counted, including the ones
+    started by ActionSimulator. Rollouts simulated in worker processes of
+    simulate_tasks_as_completed are merged once the workers finish.
+
+    Args:
+        reset: if True, the counters are reset to zero atomically with taking
+            the snapshot, so consecutive snapshots do not overlap.
+
+    Returns:
+        A dict with keys:
+            rollouts: dict with the number of rollouts per termination
+                reason: solved_early, max_steps, quiescent (the step limit
+                was reached, but all bodies were at rest at the end) and
+                occluded (the user input had occlusions).
+            steps_simulated, num_bodies, latency_us: histograms of the number
+                of simulated steps, the number of bodies in the world and
+                the wall time of the rollout in microseconds. Each histogram
+                is a dict with count, sum and buckets, where buckets[0]
+                counts zeros and buckets[i] counts values in
+                [2^(i-1), 2^i).
+            call_latency_us: histogram of the wall time of top-level
+                simulation calls in microseconds, e.g., one sample per
+                simulate_tasks_as_completed batch.
+    """
+    return simulator_bindings.get_simulation_stats(reset)
+
+
+def reset_simulation_stats() -> None:
+    simulator_bindings.reset_simulation_stats()
+
+
 def check_for_occlusions(task, user_input, keep_space_around_bodies=True):
     """Returns true if user_input occludes scene objects."""
     if not isinstance(task, bytes):
@@ -95,6 +432,85 @@ def check_for_occlusions(task, user_input, keep_space_around_bodies=True):
             task, points, rectangulars, balls, keep_space_around_bodies)
 
 
+def check_solution_stability(task,
+                             user_input: scene_if.UserInput,
+                             keep_space_around_bodies: bool = True,
+                             occlusions_allowed: bool = False,
+                             steps: int = DEFAULT_MAX_STEPS,
+                             num_threads: int = 0) -> bool:
+    """Checks that a solution is stable to half-pixel shifts.
+
+    Simulates the 8 neighbors of the user input (polygons and balls shifted by
+    half a pixel) concurrently and returns False as soon as one of them does
+    not solve the task. Neighbors that occlude scene objects are ignored
+    unless occlusions_allowed. The user input itself is assumed to solve the
+    task.
+
+    Args:
+        task: task_if.Task or serialized task.
+        user_input: scene_if.UserInput.
+        keep_space_around_bodies: bool, if True extra empty space will be
+            enforced around scene bodies.
+        occlusions_allowed: bool, whether neighbors with occlusions are
+            simulated.
+        steps: int, maximum number of steps to simulate.
+        num_threads: int, number of threads to use. If not positive, every
+            neighbor gets its own thread.
+
+    Returns:
+        bool, whether the solution is stable.
+    """
+    if not isinstance(task, bytes):
+        task = serialize(task)
+    return simulator_bindings.check_solution_stability(
+        task, serialize(user_input), keep_space_around_bodies,
+        occlusions_allowed, steps, num_threads)
+
+
+def evaluate_ranked_user_inputs(task,
+                                user_inputs: Sequence[
+                                    Optional[scene_if.UserInput]],
+                                max_attempts: int,
+                                keep_space_around_bodies: bool = True,
+                                occlusions_allowed: bool = False,
+                                stop_on_solution: bool = True,
+                                steps: int = DEFAULT_MAX_STEPS,
+                                num_threads: int = 0) -> List[int]:
+    """Simulates ranked user inputs in order as an evaluation loop does.
+
+    Inputs are simulated until max_attempts of them are valid or, if
+    stop_on_solution, until the first one solves the task. The next
+    num_threads inputs are simulated speculatively in parallel and the
+    simulations ranked after a solution are cancelled, so the result does not
+    depend on num_threads.
+
+    Args:
+        task: task_if.Task or serialized task.
+        user_inputs: list of scene_if.UserInput or None for invalid actions.
+        max_attempts: int, maximum number of valid inputs to simulate.
+        keep_space_around_bodies: bool, if True extra empty space will be
+            enforced around scene bodies.
+        occlusions_allowed: bool, whether inputs with occlusions are
+            simulated. Otherwise they are invalid.
+        stop_on_solution: bool, whether to stop at the first solution.
+        steps: int, maximum number of steps to simulate.
+        num_threads: int, number of inputs simulated in parallel. If not
+            positive, the number of cores is used.
+
+    Returns:
+        List of int values of SimulationStatus for the simulated prefix of
+        user_inputs.
+    """
+    if not isinstance(task, bytes):
+        task = serialize(task)
+    return simulator_bindings.evaluate_ranked_actions(
+        task, [
+            None if user_input is None else serialize(user_input)
+            for user_input in user_inputs
+        ], keep_space_around_bodies, occlusions_allowed, max_attempts,
+        stop_on_solution, steps, num_threads)
+
+
 def add_user_input_to_scene(scene: scene_if.Scene,
                             user_input: scene_if.UserInput,
                             keep_space_around_bodies: bool = True,
@@ -148,6 +564,15 @@ def scene_to_raster(scene: scene_if.Scene) -> np.ndarray:
     return np.array(pixels).reshape((scene.height, scene.width))
 
 
+def scene_to_rgb(scene: scene_if.Scene, alpha: bool = False) -> np.ndarray:
+    """Convert scene to a uint8 array height x width x 3 (4 if alpha) of colors.
+
+    Same as phyre.vis.observations_to_uint8_rgb(scene_to_raster(scene)), but
+    the colors are looked up while rendering.
+    """
+    return simulator_bindings.render_rgb(serialize(scene), 4 if alpha else 3)
+
+
 def scene_to_featurized_objects(scene):
     """Convert scene to a FeaturizedObjects containing featurs of size
      num_objects x OBJECT_FEATURE_SIZE."""
@@ -159,6 +584,34 @@ def scene_to_featurized_objects(scene):
             np.expand_dims(object_vector, axis=0)))
 
 
+def tasks_to_initial_observations(
+        tasks: Sequence, num_threads: int = 0
+) -> Tuple[np.ndarray, List[phyre.simulation.FeaturizedObjects]]:
+    """Renders and featurizes the initial scenes of tasks natively.
+
+    Same as calling scene_to_raster and scene_to_featurized_objects for the
+    scene of every task, but the scenes are processed on num_threads threads.
+
+    Args:
+        tasks: list of task_if.Task or serialized tasks.
+        num_threads: int, number of threads. If not positive, the number of
+            cores is used.
+
+    Returns:
+        A tuple (images, featurized_objects) of a uint8 array (tasks, height,
+        width) of color codes and a list of FeaturizedObjects for every task.
+    """
+    serialized = [
+        task if isinstance(task, bytes) else serialize(task) for task in tasks
+    ]
+    images, objects = simulator_bindings.get_initial_observations(
+        serialized, num_threads)
+    return images, [
+        phyre.simulation.FeaturizedObjects(features[None])
+        for features in objects
+    ]
+
+
 def _deep_flatten(iterable):
     if isinstance(iterable, (tuple, list, np.ndarray)):
         for i in iterable:
@@ -197,7 +650,11 @@ def magic_ponies(task,
                  with_times=False,
                  need_images=False,
                  need_featurized_objects=False,
-                 need_object_masks=False):
+                 need_object_masks=False,
+                 image_format=IMAGE_FORMAT_DENSE,
+                 object_mask_format=MASK_FORMAT_DENSE,
+                 need_contacts=False,
+                 need_contact_impulses=False):
     """Check a solution for a task and return intermidiate images.
 
     Args:
@@ -221,6 +678,29 @@ def magic_ponies(task,
         need_images: A boolean flag indicating whether images should be returned.
         need_featurized_objects: A boolean flag indicating whether objects should be returned.
         need_object_masks: A boolean flag indicating whether object masks should be returned.
+        image_format: Encoding of images:
+            IMAGE_FORMAT_DENSE: uint8 array of shape (num_steps, height,
+                width).
+            IMAGE_FORMAT_DELTA: DeltaImages with the first frame and the
+                changed pixels for every next frame. Use DeltaImages.decode
+                to get dense frames.
+            IMAGE_FORMAT_RGB, IMAGE_FORMAT_RGBA: uint8 array of shape
+                (num_steps, height, width, 3 or 4) of colors, the same as
+                phyre.vis.observations_to_uint8_rgb of dense frames. The
+                colors are looked up while rendering.
+        object_mask_format: Encoding of object masks:
+            MASK_FORMAT_DENSE: uint8 array of shape (num_steps, num_objects,
+                height, width).
+            MASK_FORMAT_BITS: uint8 array of shape (num_steps, num_objects,
+                (height * width + 7) // 8) with 1 bit per pixel. Use
+                expand_bit_masks to unpack.
+            MASK_FORMAT_CROPS: CroppedMasks with every mask cropped to the
+                bounding box of the object. Use expand_cropped_masks to
+                unpack.
+        need_contacts: A boolean flag indicating whether a ContactGraph with
+            touching objects for every frame should be returned.
+        need_contact_impulses: Same as need_contacts, but the ContactGraph
+            also has normal impulses.
 
     Returns:
         A tuple (is_solved, had_occlusions, images, objects) if with_times is False.
@@ -232,7 +712,10 @@ def magic_ponies(task,
                 if with_times is set.
             simulation_time: time spent inside C++ code to unpack and simulate.
             pack_time: time spent inside C++ code to pack the result.
+        If need_contacts or need_contact_impulses is set, a ContactGraph is
+        inserted after object masks.
     """
+    contacts = _get_contacts_mode(need_contacts, need_contact_impulses)
     if isinstance(task, bytes):
         serialized_task = task
         height, width = creator.SCENE_HEIGHT, creator.SCENE_WIDTH
@@ -244,38 +727,60 @@ def magic_ponies(task,
         """
         isSolved, hadOcclusions, packedImagesArray,
         packedObjectMasksArray, numObjectsPerScene,
-        packedObjectsArray, numObjectsPerScene,
+        packedObjectsArray, numObjectsPerScene, contactGraph,
         simulation_seconds, pack_seconds
         """
-        is_solved, had_occlusions, packed_images, packed_object_masks, num_objects_per_scene, packed_featurized_objects, number_objects, sim_time, pack_time = (
+        is_solved, had_occlusions, packed_images, packed_object_masks, num_objects_per_scene, packed_featurized_objects, number_objects, contact_graph, sim_time, pack_time = (
             simulator_bindings.magic_ponies_general(
                 serialized_task, serialized_user_input,
                 keep_space_around_bodies, steps, stride, need_images,
-                need_featurized_objects, need_object_masks))
+                image_format, need_featurized_objects, need_object_masks,
+                object_mask_format, contacts))
     else:
         points, rectangulars, balls = _prepare_user_input(*user_input)
-        is_solved, had_occlusions, packed_images, packed_object_masks, num_objects_per_scene, packed_featurized_objects, number_objects, sim_time, pack_time = (
+        is_solved, had_occlusions, packed_images, packed_object_masks, num_objects_per_scene, packed_featurized_objects, number_objects, contact_graph, sim_time, pack_time = (
             simulator_bindings.magic_ponies(serialized_task, points,
                                         rectangulars, balls,
                                         keep_space_around_bodies, steps,
                                         stride, need_images,
+                                        image_format,
                                         need_featurized_objects,
-                                        need_object_masks))
+                                        need_object_masks,
+                                        object_mask_format, contacts))
 
-    packed_images = np.array(packed_images, dtype=np.uint8)
-
-    images = packed_images.reshape((-1, height, width))
+    if need_images and image_format == IMAGE_FORMAT_DELTA:
+        images = DeltaImages(*packed_images)
+    else:
+        # The arrays own native buffers, so they are not copied.
+        packed_images = np.asarray(packed_images, dtype=np.uint8)
+        if image_format in _IMAGE_FORMAT_CHANNELS:
+            images = packed_images.reshape(
+                (-1, height, width, _IMAGE_FORMAT_CHANNELS[image_format]))
+        else:
+            images = packed_images.reshape((-1, height, width))
 
     object_masks = None
-    if need_object_masks:
-        packed_object_masks = np.array(packed_object_masks, dtype=np.uint8)
-        num_frames = images.shape[0]
+    if need_object_masks and object_mask_format == MASK_FORMAT_BITS:
+        bytes_per_mask = (height * width + 7) // 8
+        num_frames = len(packed_object_masks) // max(
+            1, num_objects_per_scene * bytes_per_mask)
+        object_masks = packed_object_masks.reshape(
+            (num_frames, num_objects_per_scene, bytes_per_mask))
+    elif need_object_masks and object_mask_format == MASK_FORMAT_CROPS:
+        boxes, offsets, data = packed_object_masks
+        num_frames = len(boxes) // max(1, num_objects_per_scene)
+        object_masks = CroppedMasks(
+            boxes.reshape((num_frames, num_objects_per_scene, 4)), offsets,
+            data)
+    elif need_object_masks:
+        packed_object_masks = np.asarray(packed_object_masks, dtype=np.uint8)
+        num_frames = len(packed_object_masks) // max(
+            1, num_objects_per_scene * height * width)
         object_masks = packed_object_masks.reshape((num_frames, num_objects_per_scene, height, width))
 
-    packed_featurized_objects = np.array(packed_featurized_objects,
-                                         dtype=np.float32)
+    packed_featurized_objects = np.asarray(packed_featurized_objects,
+                                           dtype=np.float32)
 
-    
     if packed_featurized_objects.size == 0:
         # Custom task without any known objects.
         packed_featurized_objects = np.zeros(
@@ -285,10 +790,97 @@ def magic_ponies(task,
             (-1, number_objects, OBJECT_FEATURE_SIZE))
     packed_featurized_objects = phyre.simulation.finalize_featurized_objects(
         packed_featurized_objects)
+    result = (is_solved, had_occlusions, images, packed_featurized_objects,
+              object_masks)
+    if contact_graph is not None:
+        result += (ContactGraph(*contact_graph),)
     if with_times:
-        return is_solved, had_occlusions, images, packed_featurized_objects, object_masks, sim_time, pack_time
-    else:
-        return is_solved, had_occlusions, images, packed_featurized_objects, object_masks
+        result += (sim_time, pack_time)
+    return result
+
+
+class FrameStream(object):
+    """Iterator over chunks of observations of a running simulation.
+
+    Each element is a tuple (images, featurized_objects, object_masks) with
+    the same layout as the corresponding outputs of magic_ponies. Outputs that
+    were not requested are None. The simulation is advanced only when the next
+    chunk is requested, so the peak memory is bounded by a single chunk.
+
+    is_solved and steps_simulated are available once the iterator is
+    exhausted.
+    """
+
+    def __init__(self, stream, need_images, need_featurized_objects,
+                 need_object_masks):
+        self._stream = stream
+        self._need_images = need_images
+        self._need_featurized_objects = need_featurized_objects
+        self._need_object_masks = need_object_masks
+
+    def __iter__(self):
+        for images, objects, object_masks in self._stream:
+            if self._need_featurized_objects:
+                objects = phyre.simulation.finalize_featurized_objects(objects)
+            yield (images if self._need_images else None,
+                   objects if self._need_featurized_objects else None,
+                   object_masks if self._need_object_masks else None)
+
+    @property
+    def had_occlusions(self) -> bool:
+        return self._stream.had_occlusions
+
+    @property
+    def is_solved(self) -> bool:
+        return self._stream.is_solved
+
+    @property
+    def steps_simulated(self) -> int:
+        return self._stream.steps_simulated
+
+    @property
+    def chunk_frames(self) -> int:
+        """Maximum number of frames in a single chunk."""
+        return self._stream.chunk_frames
+
+
+def magic_ponies_stream(task,
+                        user_input,
+                        steps=DEFAULT_MAX_STEPS,
+                        stride=DEFAULT_STRIDE,
+                        keep_space_around_bodies=True,
+                        need_images=True,
+                        need_featurized_objects=False,
+                        need_object_masks=False,
+                        chunk_size=DEFAULT_STREAM_CHUNK_SIZE,
+                        max_chunk_bytes=DEFAULT_STREAM_MAX_CHUNK_BYTES
+                       ) -> FrameStream:
+    """Streaming version of magic_ponies.
+
+    Args:
+        task, user_input, steps, stride, keep_space_around_bodies,
+            need_images, need_featurized_objects, need_object_masks: see
+            magic_ponies.
+        chunk_size: maximum number of frames in a chunk.
+        max_chunk_bytes: maximum size of all arrays in a chunk. The number
+            of frames in a chunk is reduced to fit into the limit, but each
+            chunk has at least one frame. Non-positive value disables the
+            limit.
+
+    Returns:
+        FrameStream that yields tuples (images, featurized_objects,
+        object_masks) with up to chunk_size frames each.
+    """
+    if not isinstance(task, bytes):
+        task = serialize(task)
+    if not isinstance(user_input, scene_if.UserInput):
+        user_input = build_user_input(*user_input)
+    stream = simulator_bindings.magic_ponies_stream(
+        task, serialize(user_input), keep_space_around_bodies, steps, stride,
+        need_images, need_featurized_objects, need_object_masks, chunk_size,
+        max_chunk_bytes)
+    return FrameStream(stream, need_images, need_featurized_objects,
+                       need_object_masks)
 
 
 def batched_magic_ponies(tasks,
@@ -20,6 +20,7 @@ import phyre.action_mappers
 import phyre.action_simulator
 import phyre.creator
 import phyre.loader
+import phyre.simulator
 
 SimulationStatus = phyre.action_simulator.SimulationStatus
 
@@ -43,6 +44,28 @@ def build_task_for_objects(C):
                   relationships=[C.SpatialRelationship.TOUCHING])
 
 
+@phyre.creator.define_task
+def build_task_with_unstable_solution(C):
+
+    # A ball dropped on top of the static ball rolls off to the side of its
+    # offset from the top. Only on the right it lands on the shelf and pushes
+    # the small ball off the shelf onto the floor.
+    floor = C.add('static bar', scale=1.0).set_left(0).set_bottom(0)
+    C.add('static ball', scale=0.1).set_center_x(127.75).set_center_y(100)
+    C.add('static bar', scale=90 / 256).set_left(135).set_bottom(80)
+    target = C.add('dynamic ball',
+                   scale=0.04).set_center_x(200).set_bottom(85.5)
+
+    C.update_task(body1=target,
+                  body2=floor,
+                  relationships=[C.SpatialRelationship.TOUCHING])
+
+
+# A ball of radius 5 at (128, 122), a quarter of a pixel right of the top of
+# the static ball. Neighbors shifted left by half a pixel roll off to the left.
+UNSTABLE_ACTION = [128.5 / 255, 122.5 / 255, 0.1]
+
+
 class ActionSimulatorTest(unittest.TestCase):
 
     def setUp(self):
@@ -52,6 +75,8 @@ class ActionSimulatorTest(unittest.TestCase):
             phyre.loader.load_tasks_from_folder(
                 task_id_list=['00204:000', '00208:000']).values())
         [self._task_object_test] = build_task_for_objects('test_objects')
+        [self._task_unstable_test
+        ] = build_task_with_unstable_solution('test_unstable')
 
     def test_single_ball_tier(self):
         action_simulator = phyre.action_simulator.ActionSimulator(
@@ -82,6 +107,90 @@ class ActionSimulatorTest(unittest.TestCase):
         self.assertEqual(status, simulation.status)
         np.testing.assert_equal(images, simulation.images)
 
+    def test_simulate_stable(self):
+        action_simulator = phyre.action_simulator.ActionSimulator(
+            [self._task_object_test],
+            phyre.action_mappers.SingleBallActionMapper())
+        # The task is solved without any input and the ball is far away.
+        self.assertEqual(
+            action_simulator.simulate_action(0, [0.9, 0.9, 0.1],
+                                             need_images=False,
+                                             stable=True).status,
+            SimulationStatus.STABLY_SOLVED)
+        action_simulator = phyre.action_simulator.ActionSimulator(
+            self._tasks, phyre.action_mappers.SingleBallActionMapper())
+        self.assertEqual(
+            action_simulator.simulate_action(self._task_id, [0.5, 0.5, 0.1],
+                                             need_images=False,
+                                             stable=True).status,
+            SimulationStatus.NOT_SOLVED)
+
+    def test_simulate_unstable(self):
+        action_simulator = phyre.action_simulator.ActionSimulator(
+            [self._task_unstable_test],
+            phyre.action_mappers.SingleBallActionMapper())
+        self.assertEqual(
+            action_simulator.simulate_action(0,
+                                             UNSTABLE_ACTION,
+                                             need_images=False).status,
+            SimulationStatus.SOLVED)
+        self.assertEqual(
+            action_simulator.simulate_action(0,
+                                             UNSTABLE_ACTION,
+                                             need_images=False,
+                                             stable=True).status,
+            SimulationStatus.UNSTABLY_SOLVED)
+
+    def test_check_solution_stability_cancels(self):
+        mapper = phyre.action_mappers.SingleBallActionMapper()
+        user_input, is_valid = mapper.action_to_user_input(UNSTABLE_ACTION)
+        self.assertTrue(is_valid)
+        phyre.simulator.reset_simulation_stats()
+        # With a single thread the neighbors run in order and the first one,
+        # shifted left, fails. The remaining ones are never simulated.
+        self.assertFalse(
+            phyre.simulator.check_solution_stability(
+                self._task_unstable_test,
+                user_input,
+                keep_space_around_bodies=mapper.KEEP_SPACE_AROUND_BODIES,
+                num_threads=1))
+        stats = phyre.simulator.get_simulation_stats(reset=True)
+        self.assertEqual(sum(stats['rollouts'].values()), 1)
+
+        # All neighbors of a stable solution are simulated.
+        user_input, _ = mapper.action_to_user_input([0.9, 0.9, 0.1])
+        self.assertTrue(
+            phyre.simulator.check_solution_stability(
+                self._task_object_test,
+                user_input,
+                keep_space_around_bodies=mapper.KEEP_SPACE_AROUND_BODIES,
+                num_threads=1))
+        stats = phyre.simulator.get_simulation_stats(reset=True)
+        self.assertEqual(sum(stats['rollouts'].values()), 8)
+
+    def test_evaluate_ranked_actions(self):
+        action_simulator = phyre.action_simulator.ActionSimulator(
+            self._tasks, phyre.action_mappers.SingleBallActionMapper())
+        actions = action_simulator.build_discrete_action_space(30)
+        # An invalid action.
+        actions.insert(3, [2.0, 0.5, 0.1])
+        for stop_on_solution in (True, False):
+            expected = []
+            for action in actions:
+                status = action_simulator.simulate_action(
+                    self._task_id, action, need_images=False).status
+                expected.append(status)
+                if (sum(not s.is_invalid() for s in expected) >= 10 or
+                        stop_on_solution and status.is_solved()):
+                    break
+            statuses = action_simulator.evaluate_ranked_actions(
+                self._task_id,
+                actions,
+                10,
+                stop_on_solution=stop_on_solution,
+                num_threads=4)
+            self.assertEqual(statuses, expected)
+
     def test_single_ball_tier_discrete(self):
         action_simulator = phyre.action_simulator.ActionSimulator(
             self._tasks, phyre.action_mappers.SingleBallActionMapper())
@@ -151,6 +260,27 @@ class ActionSimulatorTest(unittest.TestCase):
                         ideal_vector,
                         atol=1e-4))
 
+    def test_initial_observations(self):
+        tasks = self._tasks + [self._task_object_test]
+        action_simulator = phyre.action_simulator.ActionSimulator(
+            tasks, 'ball')
+        scenes = action_simulator.initial_scenes
+        objects = action_simulator.initial_featurized_objects
+        self.assertIs(action_simulator.initial_scenes, scenes)
+        self.assertEqual(scenes.shape, (len(tasks), 256, 256))
+        for i, task in enumerate(tasks):
+            np.testing.assert_array_equal(
+                scenes[i], phyre.simulator.scene_to_raster(task.scene))
+            np.testing.assert_allclose(
+                objects[i].features,
+                phyre.simulator.scene_to_featurized_objects(
+                    task.scene).features,
+                atol=1e-6)
+        for num_threads in (1, 3):
+            images, _ = phyre.simulator.tasks_to_initial_observations(
+                tasks, num_threads=num_threads)
+            np.testing.assert_array_equal(images, scenes)
+
 
 if __name__ == '__main__':
     unittest.main()
@@ -186,6 +186,53 @@ class ObjectUtilTest(unittest.TestCase):
                     phyre.objects_util.featurized_objects_vector_to_scene(
                         object_vec)).features[0]))
 
+    def test_object_vecs_to_rasters(self):
+        _, _, images, featurized_objects = simulator.magic_ponies(
+            self._task_complicated_object_test,
+            self._ball_user_input_big,
+            steps=50,
+            stride=1,
+            need_images=True,
+            need_featurized_objects=True)
+        objects = phyre.simulation.Simulation(
+            featurized_objects=featurized_objects).featurized_objects.features
+        for num_threads in (1, 4):
+            rasters = phyre.objects_util.featurized_objects_vectors_to_rasters(
+                objects, num_threads=num_threads)
+            self.assertEqual(rasters.shape, images.shape)
+            np.testing.assert_array_equal(rasters, images)
+        np.testing.assert_array_equal(
+            rasters[0],
+            phyre.objects_util.featurized_objects_vector_to_raster(objects[0]))
+
+    def test_simulate_featurized_objects(self):
+        _, _, _, featurized_objects = simulator.magic_ponies(
+            self._task_complicated_object_test,
+            self._ball_user_input_big,
+            steps=50,
+            stride=1,
+            need_featurized_objects=True)
+        featurized_objects = phyre.simulation.Simulation(
+            featurized_objects=featurized_objects).featurized_objects
+        objects = featurized_objects.features
+        states = objects[[0, 10, 20]]
+        frames = phyre.objects_util.simulate_featurized_objects(states,
+                                                                steps=20,
+                                                                stride=3)
+        self.assertEqual(frames.shape, (3, 7) + objects.shape[1:])
+        for num_threads in (1, 4):
+            np.testing.assert_array_equal(
+                phyre.objects_util.simulate_featurized_objects(
+                    states[1], steps=20, stride=3, num_threads=num_threads),
+                frames[1])
+        # Static objects stay in place, the rest is moving.
+        static = np.array([
+            color in ('BLACK', 'PURPLE') for color in featurized_objects.colors
+        ])
+        np.testing.assert_allclose(frames[:, -1, static], states[:, static],
+                                   atol=1e-6)
+        self.assertFalse(np.allclose(frames[0, -1], states[0]))
+
 
 if __name__ == '__main__':
     unittest.main()
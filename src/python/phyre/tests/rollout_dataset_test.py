@@ -0,0 +1,98 @@
+# Copyright (c) Facebook, Inc. and its affiliates.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+import os
+import tempfile
+import unittest
+
+import numpy as np
+
+from phyre import creator
+from phyre import rollout_dataset
+from phyre import simulator
+
+
+@creator.define_task
+def build_task(C):
+
+    left = C.add('static bar', scale=0.3).set_bottom(0).set_left(10)
+    right = C.add('dynamic bar', scale=0.3).set_bottom(0.8).set_left(left.right)
+
+    C.update_task(body1=left,
+                  body2=right,
+                  relationships=[C.SpatialRelationship.TOUCHING])
+
+
+class RolloutDatasetTest(unittest.TestCase):
+
+    def setUp(self):
+        [self._task] = build_task('test')
+        self._user_input = simulator.build_user_input(balls=[100, 100, 5])
+        self._tmpdir = tempfile.TemporaryDirectory()
+        self._path = os.path.join(self._tmpdir.name, 'rollouts.bin')
+
+    def tearDown(self):
+        self._tmpdir.cleanup()
+
+    def _check_round_trip(self, compress):
+        steps, stride = 100, 10
+        is_solved, _, images, objects, masks = simulator.magic_ponies(
+            self._task,
+            self._user_input,
+            steps=steps,
+            stride=stride,
+            need_images=True,
+            need_featurized_objects=True,
+            need_object_masks=True)
+        with rollout_dataset.RolloutDatasetWriter(self._path,
+                                                  compress) as writer:
+            for action_index in range(2):
+                self.assertTrue(
+                    writer.add('00000:000',
+                               action_index,
+                               self._task,
+                               self._user_input,
+                               steps=steps,
+                               stride=stride,
+                               need_object_masks=action_index == 0))
+
+        reader = rollout_dataset.RolloutDatasetReader(self._path)
+        self.assertEqual(reader.keys(), [('00000:000', 0), ('00000:000', 1)])
+        info = reader.info('00000:000', 0)
+        self.assertEqual(info.is_solution, is_solved)
+        self.assertEqual(info.num_frames, len(images))
+        np.testing.assert_array_equal(reader.images('00000:000', 0), images)
+        np.testing.assert_array_equal(
+            reader.featurized_objects('00000:000', 0), objects)
+        np.testing.assert_array_equal(reader.object_masks('00000:000', 0),
+                                      masks)
+        with self.assertRaises(KeyError):
+            reader.object_masks('00000:000', 1)
+
+        for frame in (0, len(images) // 2, len(images) - 1):
+            image, frame_objects, frame_masks = reader.frame(
+                '00000:000', 0, frame)
+            np.testing.assert_array_equal(image, images[frame])
+            np.testing.assert_array_equal(frame_objects, objects[frame])
+            np.testing.assert_array_equal(frame_masks, masks[frame])
+        self.assertIsNone(reader.frame('00000:000', 1, 0)[2])
+
+    def test_round_trip_compressed(self):
+        self._check_round_trip(compress=True)
+
+    def test_round_trip_raw(self):
+        self._check_round_trip(compress=False)
+
+
+if __name__ == '__main__':
+    unittest.main()
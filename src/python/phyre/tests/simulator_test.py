@@ -14,6 +14,7 @@
 
 import copy
 import math
+import threading
 import unittest
 import unittest.mock
 
@@ -23,6 +24,7 @@ from phyre.interface.scene import ttypes as scene_if
 from phyre import simulator
 from phyre import creator
 import phyre.objects_util
+import phyre.vis
 
 
 @creator.define_task
@@ -91,6 +93,245 @@ class SimulatorTest(unittest.TestCase):
         # Empty solution should be valid.
         self.assertEqual(result.isSolution, True)
 
+    def test_simulate_task_summary(self):
+        steps = 200
+        result = simulator.simulate_task(self._task, steps=steps, stride=1)
+        summary = simulator.simulate_task_summary(self._task, steps=steps)
+        self.assertEqual(summary.isSolution, result.isSolution)
+        self.assertEqual(summary.stepsSimulated, result.stepsSimulated)
+        self.assertEqual(len(summary.finalPositions), 2)
+        self.assertAlmostEqual(summary.finalPositions[1].y,
+                               result.sceneList[-1].bodies[1].position.y,
+                               places=3)
+        self.assertEqual(summary.maxUserBodySpeed, 0)
+
+        with_input = simulator.simulate_task_summary(
+            self._task,
+            self._ball_user_input,
+            steps=steps,
+            stats=simulator.SUMMARY_FINAL_POSITIONS |
+            simulator.SUMMARY_MAX_USER_BODY_SPEED)
+        self.assertEqual(len(with_input.finalPositions), 3)
+        self.assertGreater(with_input.maxUserBodySpeed, 0)
+        self.assertIsNone(with_input.minGoalDistance)
+        self.assertIsNone(with_input.firstTouchStep)
+
+    def test_simulate_task_summary_memoized(self):
+        memo = simulator.SimulationMemo(capacity=10)
+        expected = simulator.simulate_task_summary(self._task,
+                                                   self._ball_user_input,
+                                                   steps=200,
+                                                   stats=0)
+        for _ in range(2):
+            had_occlusions, summary = simulator.simulate_task_summary_memoized(
+                self._task, self._ball_user_input, memo, steps=200)
+            self.assertFalse(had_occlusions)
+            self.assertEqual(summary.isSolution, expected.isSolution)
+            self.assertEqual(summary.stepsSimulated, expected.stepsSimulated)
+        stats = memo.stats()
+        self.assertEqual(stats['misses'], 1)
+        self.assertEqual(stats['hits'], 1)
+        self.assertEqual(stats['size'], 1)
+
+    def test_simulate_tasks_as_completed(self):
+        tasks = [self._task, self._task_object_test, self._task_jar_test] * 3
+        expected = [
+            simulator.simulate_task(task, steps=100, stride=10)
+            for task in tasks
+        ]
+        calling_thread = threading.get_ident()
+        received = []
+
+        def callback(index, simulation):
+            self.assertEqual(threading.get_ident(), calling_thread)
+            self.assertEqual(simulation, expected[index])
+            received.append(index)
+
+        simulator.simulate_tasks_as_completed(tasks,
+                                              num_workers=2,
+                                              callback=callback,
+                                              steps=100,
+                                              stride=10)
+        self.assertEqual(sorted(received), list(range(len(tasks))))
+
+    def test_simulation_stats(self):
+        simulator.reset_simulation_stats()
+        result = simulator.simulate_task(self._task, steps=200, stride=1)
+        simulator.simulate_scene(self._task.scene, steps=10)
+
+        stats = simulator.get_simulation_stats(reset=True)
+        self.assertEqual(stats['rollouts']['solved_early'], 1)
+        self.assertEqual(sum(stats['rollouts'].values()), 2)
+        self.assertEqual(stats['steps_simulated']['count'], 2)
+        self.assertEqual(stats['steps_simulated']['sum'],
+                         result.stepsSimulated + 10)
+        self.assertEqual(sum(stats['steps_simulated']['buckets']), 2)
+        self.assertEqual(stats['num_bodies']['count'], 2)
+        self.assertEqual(stats['call_latency_us']['count'], 2)
+
+        stats = simulator.get_simulation_stats()
+        self.assertEqual(sum(stats['rollouts'].values()), 0)
+        self.assertEqual(stats['latency_us']['count'], 0)
+        self.assertEqual(stats['call_latency_us']['count'], 0)
+
+    def test_simulate_task_goal_distances(self):
+        result = simulator.simulate_task(self._task, steps=200, stride=10)
+        self.assertIsNone(result.goalDistanceList)
+
+        result = simulator.simulate_task(self._task,
+                                         steps=200,
+                                         stride=10,
+                                         need_goal_distances=True)
+        distances = simulator.get_goal_distances(result)
+        self.assertEqual(distances.dtype, np.float32)
+        self.assertEqual(len(distances), len(result.sceneList))
+        # LEFT_OF always holds in this task.
+        self.assertTrue((distances > -1e-3).all())
+
+    def test_simulate_task_contacts(self):
+        result = simulator.simulate_task(self._task_object_test,
+                                         steps=200,
+                                         stride=1,
+                                         need_contacts=True)
+        graph = simulator.get_contact_graph(result)
+        self.assertEqual(graph.num_frames, len(result.sceneList))
+        self.assertIsNone(graph.normal_impulses)
+        for i, solved in enumerate(result.solvedStateList):
+            edges = graph.frame(i).tolist()
+            self.assertEqual(edges, [[0, 1]] if solved else [])
+
+    def test_magic_ponies_contacts(self):
+        _, _, _, objects, _, graph = simulator.magic_ponies(
+            self._task_object_test, (None, None, None),
+            stride=1,
+            need_featurized_objects=True,
+            need_contact_impulses=True)
+        self.assertEqual(graph.num_frames, len(objects))
+        self.assertEqual(graph.edges.dtype, np.int32)
+        self.assertEqual(graph.edges.shape, (graph.frame_offsets[-1], 2))
+        self.assertEqual(graph.normal_impulses.shape, (len(graph.edges),))
+
+        expected = simulator.get_contact_graph(
+            simulator.simulate_task(self._task_object_test,
+                                    stride=1,
+                                    need_contacts=True))
+        np.testing.assert_array_equal(graph.frame_offsets,
+                                      expected.frame_offsets)
+        np.testing.assert_array_equal(graph.edges, expected.edges)
+
+    def test_magic_ponies_compact_masks(self):
+        kwargs = dict(steps=20, stride=5, need_object_masks=True)
+        _, _, _, _, masks = simulator.magic_ponies(self._task,
+                                                   self._ball_user_input,
+                                                   need_images=True,
+                                                   **kwargs)
+        height, width = masks.shape[2:]
+        _, _, _, _, bit_masks = simulator.magic_ponies(
+            self._task,
+            self._ball_user_input,
+            object_mask_format=simulator.MASK_FORMAT_BITS,
+            **kwargs)
+        self.assertEqual(bit_masks.shape,
+                         masks.shape[:2] + ((height * width + 7) // 8,))
+        np.testing.assert_array_equal(
+            simulator.expand_bit_masks(bit_masks, height, width), masks > 0)
+
+        _, _, _, _, cropped_masks = simulator.magic_ponies(
+            self._task,
+            self._ball_user_input,
+            object_mask_format=simulator.MASK_FORMAT_CROPS,
+            **kwargs)
+        self.assertEqual(cropped_masks.boxes.shape, masks.shape[:2] + (4,))
+        self.assertLess(cropped_masks.data.nbytes, masks.nbytes // 8)
+        np.testing.assert_array_equal(
+            simulator.expand_cropped_masks(cropped_masks, height, width),
+            masks)
+
+    def test_magic_ponies_masks_without_images(self):
+        kwargs = dict(steps=20, stride=5, need_object_masks=True)
+        _, _, images, _, masks = simulator.magic_ponies(self._task,
+                                                        self._ball_user_input,
+                                                        need_images=True,
+                                                        **kwargs)
+        _, _, no_images, _, masks_only = simulator.magic_ponies(
+            self._task, self._ball_user_input, **kwargs)
+        self.assertEqual(no_images.size, 0)
+        self.assertEqual(len(masks), len(images))
+        np.testing.assert_array_equal(masks_only, masks)
+
+        _, _, _, _, no_masks = simulator.magic_ponies(self._task,
+                                                      self._ball_user_input,
+                                                      need_images=True,
+                                                      steps=20,
+                                                      stride=5)
+        self.assertIsNone(no_masks)
+
+    def test_magic_ponies_delta_images(self):
+        kwargs = dict(steps=100, stride=1, need_images=True)
+        _, _, images, _, _ = simulator.magic_ponies(self._task,
+                                                    self._ball_user_input,
+                                                    **kwargs)
+        _, _, delta_images, _, _ = simulator.magic_ponies(
+            self._task,
+            self._ball_user_input,
+            image_format=simulator.IMAGE_FORMAT_DELTA,
+            **kwargs)
+        self.assertEqual(delta_images.num_frames, len(images))
+        self.assertLess(delta_images.nbytes, images.nbytes // 4)
+        np.testing.assert_array_equal(delta_images.decode(), images)
+        np.testing.assert_array_equal(delta_images.decode(10, 20),
+                                      images[10:20])
+
+    def test_decode_corrupt_delta_images(self):
+        keyframe = np.zeros((2, 3), dtype=np.uint8)
+
+        def build(frame_offsets, changed_pixels):
+            return simulator.DeltaImages(
+                keyframe, np.array(frame_offsets, dtype=np.int64),
+                np.array(changed_pixels, dtype=np.int32),
+                np.ones(len(changed_pixels), dtype=np.uint8))
+
+        self.assertEqual(build([0, 1, 2], [5, 0]).decode().shape, (3, 2, 3))
+        for frame_offsets, changed_pixels in (
+            ([0, 1, 2], [6, 0]),  # Pixel outside of the image.
+            ([0, 1, 2], [0, -1]),  # Negative pixel.
+            ([0, 2, 1], [0, 1]),  # Decreasing offsets.
+            ([0, 1, 3], [0, 1]),  # Offsets past the changes.
+            ([-1, 0, 2], [0, 1]),  # Negative offset.
+            ([], [0]),  # Changes without frames.
+        ):
+            with self.assertRaises(RuntimeError):
+                build(frame_offsets, changed_pixels).decode()
+
+    def test_magic_ponies_rgb_images(self):
+        kwargs = dict(steps=30, stride=3, need_images=True)
+        _, _, images, _, _ = simulator.magic_ponies(self._task,
+                                                    self._ball_user_input,
+                                                    **kwargs)
+        expected = np.stack(
+            [phyre.vis.observations_to_uint8_rgb(image) for image in images])
+        _, _, rgb, _, _ = simulator.magic_ponies(
+            self._task,
+            self._ball_user_input,
+            image_format=simulator.IMAGE_FORMAT_RGB,
+            **kwargs)
+        np.testing.assert_array_equal(rgb, expected)
+        _, _, rgba, _, _ = simulator.magic_ponies(
+            self._task,
+            self._ball_user_input,
+            image_format=simulator.IMAGE_FORMAT_RGBA,
+            **kwargs)
+        self.assertEqual(rgba.shape, expected.shape[:-1] + (4,))
+        np.testing.assert_array_equal(rgba[..., :3], expected)
+        np.testing.assert_array_equal(rgba[..., 3], 255)
+        np.testing.assert_array_equal(
+            phyre.vis.observations_to_uint8_rgb(rgb[0], is_solved=True),
+            phyre.vis.observations_to_uint8_rgb(images[0], is_solved=True))
+        np.testing.assert_array_equal(
+            simulator.scene_to_rgb(self._task.scene),
+            phyre.vis.observations_to_uint8_rgb(
+                simulator.scene_to_raster(self._task.scene)))
+
     def test_add_user_input_to_scene(self):
         raise unittest.SkipTest
         scene = simulator.add_user_input_to_scene(self._task.scene,
@@ -174,6 +415,42 @@ class SimulatorTest(unittest.TestCase):
             need_featurized_objects=True)
         self.assertTrue(np.array_equal(scenes, only_scenes))
 
+    def test_magic_ponies_stream(self):
+        steps = 10
+        is_solved, _, images, objects, _ = simulator.magic_ponies(
+            self._task,
+            self._ball_user_input,
+            steps=steps,
+            stride=1,
+            need_images=True,
+            need_featurized_objects=True)
+        stream = simulator.magic_ponies_stream(self._task,
+                                               self._ball_user_input,
+                                               steps=steps,
+                                               stride=1,
+                                               need_featurized_objects=True,
+                                               chunk_size=3)
+        chunks = list(stream)
+        self.assertEqual([len(chunk[0]) for chunk in chunks], [3, 3, 3, 1])
+        self.assertIsNone(chunks[0][2])
+        np.testing.assert_array_equal(
+            np.concatenate([chunk[0] for chunk in chunks]), images)
+        np.testing.assert_allclose(
+            np.concatenate([chunk[1] for chunk in chunks]), objects)
+        self.assertEqual(stream.is_solved, is_solved)
+
+    def test_magic_ponies_stream_memory_limit(self):
+        height, width = self._task.scene.height, self._task.scene.width
+        stream = simulator.magic_ponies_stream(self._task,
+                                               self._ball_user_input,
+                                               steps=10,
+                                               stride=1,
+                                               chunk_size=100,
+                                               max_chunk_bytes=2 * height *
+                                               width)
+        self.assertEqual(stream.chunk_frames, 2)
+        self.assertTrue(all(len(images) <= 2 for images, _, _ in stream))
+
     def test_is_solution_valid(self):
         steps = 200
         assert steps >= simulator.STEPS_FOR_SOLUTION
@@ -63,12 +63,23 @@ def observations_to_float_rgb(scene: np.ndarray,
 def observations_to_uint8_rgb(scene: np.ndarray,
                               user_input: Tuple[Tuple[int, int], ...] = (),
                               is_solved: Optional[bool] = None) -> np.ndarray:
-    """Convert an observation as returned by a simulator to an image."""
-    base_image = WAD_COLORS[scene]
+    """Convert an observation as returned by a simulator to an image.
+
+    The observation is either an array of color codes or an image rendered
+    with IMAGE_FORMAT_RGB or IMAGE_FORMAT_RGBA, which is used as is.
+    """
+    if scene.ndim == 3:
+        # The renderer has looked up the colors and flipped the rows already.
+        base_image = scene[..., :3]
+        if user_input:
+            base_image = base_image[::-1].copy()
+    else:
+        base_image = WAD_COLORS[scene]
     for y, x in user_input:
         if 0 <= x < base_image.shape[1] and 0 <= y < base_image.shape[0]:
             base_image[x, y] = [255, 0, 0]
-    base_image = base_image[::-1]
+    if scene.ndim == 2 or user_input:
+        base_image = base_image[::-1]
     if is_solved is not None:
         color = SOLVE_STATUS_COLORS[int(is_solved)]
         line = np.tile(color.reshape((1, 1, 3)), (5, base_image.shape[1], 1))
@@ -32,7 +32,6 @@ from phyre import loader
 from phyre import settings
 from phyre import simulator
 from phyre import util
-from phyre import vis
 from phyre.interface.scene import ttypes as scene_if
 from phyre.interface.task import ttypes as task_if
 
@@ -401,7 +400,7 @@ def get_task_as_base64_image(task, resize=None):
 
 
 def get_scene_as_base64_image(scene, resize=None):
-    arr = vis.observations_to_uint8_rgb(simulator.scene_to_raster(scene))
+    arr = simulator.scene_to_rgb(scene)
     return get_image_as_base64(arr, resize=resize)
 
 
@@ -28,12 +28,10 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
-// Serialization stuff. Also mostly for multiprocessing.
-#include <thrift/protocol/TBinaryProtocol.h>
-#include <thrift/transport/TBufferTransports.h>
-
 #include "gen-cpp/scene_types.h"
 #include "thrift_box2d_conversion.h"
+// Serialization stuff. Also mostly for multiprocessing.
+#include "thrift_serialization.h"
 #include "utils/timer.h"
 
 using scene::Body;
@@ -43,8 +41,8 @@ using scene::Scene;
 using scene::Shape;
 using scene::Vector;
 
-using apache::thrift::protocol::TBinaryProtocol;
-using apache::thrift::transport::TMemoryBuffer;
+using thrift_serialization::ByteSpan;
+using thrift_serialization::serializeToSpan;
 
 constexpr int kFps = 60;
 constexpr int kBatchSize = 1024;
@@ -147,27 +145,6 @@ void* sharedMalloc(int len) {
 
 void sharedFree(void* p, int len) { munmap(p, len); }
 
-Scene deserialize(const std::vector<uint8_t>& serialized) {
-  std::shared_ptr<TMemoryBuffer> memoryBuffer(new TMemoryBuffer());
-  std::unique_ptr<TBinaryProtocol> protocol(new TBinaryProtocol(memoryBuffer));
-  memoryBuffer->resetBuffer(const_cast<uint8_t*>(serialized.data()),
-                            serialized.size());
-  Scene scene;
-  scene.read(protocol.get());
-  return scene;
-}
-
-std::vector<uint8_t> serialize(const Scene& scene) {
-  std::shared_ptr<TMemoryBuffer> memoryBuffer(new TMemoryBuffer());
-  std::unique_ptr<TBinaryProtocol> protocol(new TBinaryProtocol(memoryBuffer));
-  scene.write(protocol.get());
-
-  uint8_t* buffer;
-  uint32_t sz;
-  memoryBuffer->getBuffer(&buffer, &sz);
-  return std::vector<uint8_t>(buffer, buffer + sz);
-}
-
 inline std::vector<Scene> simulateWithProcesses(
     const std::vector<Scene>& scenes, const int num_steps,
     const size_t num_workers) {
@@ -177,7 +154,7 @@ inline std::vector<Scene> simulateWithProcesses(
   std::vector<uint8_t*> sceneSharedBuffers;
   std::vector<size_t> bufferSizes;
   for (const auto& scene : scenes) {
-    const size_t sz = serialize(scene).size();
+    const size_t sz = serializeToSpan(scene).size;
     bufferSizes.push_back(sz);
     sceneSharedBuffers.push_back(static_cast<uint8_t*>(sharedMalloc(sz)));
   }
@@ -189,11 +166,11 @@ inline std::vector<Scene> simulateWithProcesses(
       // Child.
       for (size_t j = i; j < scenes.size(); j += num_workers) {
         const Scene newScene = simulate(scenes[j], num_steps);
-        const std::vector<uint8_t> serializedNewScene = serialize(newScene);
-        if (serializedNewScene.size() != bufferSizes[j]) {
+        const ByteSpan serializedNewScene = serializeToSpan(newScene);
+        if (serializedNewScene.size != bufferSizes[j]) {
           exit(3);
         }
-        std::copy_n(serializedNewScene.data(), serializedNewScene.size(),
+        std::copy_n(serializedNewScene.data, serializedNewScene.size,
                     sceneSharedBuffers[j]);
       }
       exit(0);
@@ -227,9 +204,8 @@ inline std::vector<Scene> simulateWithProcesses(
   }
   std::vector<Scene> newScenes(scenes.size());
   for (size_t i = 0; i < newScenes.size(); ++i) {
-    std::vector<uint8_t> serialized(sceneSharedBuffers[i],
-                                    sceneSharedBuffers[i] + bufferSizes[i]);
-    newScenes[i] = deserialize(serialized);
+    thrift_serialization::deserializeFrom(sceneSharedBuffers[i],
+                                          bufferSizes[i], &newScenes[i]);
     sharedFree(sceneSharedBuffers[i], bufferSizes[i]);
   }
   return newScenes;
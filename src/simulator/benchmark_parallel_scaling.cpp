@@ -0,0 +1,286 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// Thread-count scaling benchmark for the parallel simulation backends.
+//
+// Simulates batches of tasks from the test data (repeated to fill the batch)
+// with every backend, batch size and number of workers and reports:
+//   - throughput in tasks per second;
+//   - p50 and p99 latency, where the latency of a task is the time from the
+//     start of the batch until its result is available to the caller;
+//   - parallel efficiency, i.e., throughput divided by the number of workers
+//     times the single-worker throughput of the same backend and batch size.
+// Results are printed as a table and optionally written to a CSV file for
+// charting.
+//
+// Backends:
+//   processes     simulateTasksInParallel (fork, results after the batch);
+//   as_completed  simulateTasksAsCompleted (fork, results as they finish);
+//   threads       static round-robin split over std::thread, the scheme of
+//                 simulateWithThreads in benchmark_box2d.cpp;
+//   threads_dyn   std::thread workers taking tasks from a shared counter.
+//
+// Must be run from the root of the repository unless --task_folder is set.
+// Built when CMake is configured with -DPHYRE_BUILD_BENCHMARKS=ON.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+#include "task_io.h"
+#include "task_utils.h"
+
+#include "gen-cpp/task_types.h"
+
+namespace po = boost::program_options;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct BatchResult {
+  double seconds;
+  // Time from the start of the batch until each result was available.
+  std::vector<double> latencies;
+};
+
+// Called once for every task with the time its result became available.
+using DoneCallback = std::function<void(size_t, Clock::time_point)>;
+using Backend = std::function<void(const std::vector<::task::Task>& tasks,
+                                   int numWorkers, int steps,
+                                   const DoneCallback& done)>;
+
+void runProcesses(const std::vector<::task::Task>& tasks, int numWorkers,
+                  int steps, const DoneCallback& done) {
+  const auto simulations =
+      simulateTasksInParallel(tasks, numWorkers, steps, /*stride=*/-1);
+  const auto finished = Clock::now();
+  for (size_t i = 0; i < simulations.size(); ++i) {
+    done(i, finished);
+  }
+}
+
+void runAsCompleted(const std::vector<::task::Task>& tasks, int numWorkers,
+                    int steps, const DoneCallback& done) {
+  simulateTasksAsCompleted(
+      tasks, numWorkers, steps, /*stride=*/-1,
+      [&done](size_t index, ::task::TaskSimulation&&) {
+        done(index, Clock::now());
+      });
+}
+
+// Workers record completion times into their own slots, which are reported
+// after the join. With dynamic set, tasks are taken from a shared counter
+// instead of a static round-robin split.
+void runThreads(const std::vector<::task::Task>& tasks, int numWorkers,
+                int steps, bool dynamic, const DoneCallback& done) {
+  std::vector<Clock::time_point> finished(tasks.size());
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> workers;
+  for (int worker = 0; worker < numWorkers; ++worker) {
+    workers.emplace_back([&, worker]() {
+      if (dynamic) {
+        for (size_t i = next++; i < tasks.size(); i = next++) {
+          simulateTask(tasks[i], steps, /*stride=*/-1);
+          finished[i] = Clock::now();
+        }
+      } else {
+        for (size_t i = worker; i < tasks.size(); i += numWorkers) {
+          simulateTask(tasks[i], steps, /*stride=*/-1);
+          finished[i] = Clock::now();
+        }
+      }
+    });
+  }
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+  for (size_t i = 0; i < tasks.size(); ++i) {
+    done(i, finished[i]);
+  }
+}
+
+BatchResult runBatch(const Backend& backend,
+                     const std::vector<::task::Task>& tasks, int numWorkers,
+                     int steps) {
+  BatchResult result;
+  result.latencies.resize(tasks.size());
+  const auto start = Clock::now();
+  backend(tasks, numWorkers, steps,
+          [&](size_t index, Clock::time_point finished) {
+            result.latencies[index] =
+                std::chrono::duration<double>(finished - start).count();
+          });
+  result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  return result;
+}
+
+double percentile(std::vector<double> values, double fraction) {
+  if (values.empty()) {
+    return 0;
+  }
+  std::sort(values.begin(), values.end());
+  const size_t index = std::min(
+      values.size() - 1, static_cast<size_t>(fraction * values.size()));
+  return values[index];
+}
+
+std::vector<int> parseList(const std::string& text) {
+  std::vector<int> values;
+  std::stringstream stream(text);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    values.push_back(std::stoi(item));
+  }
+  return values;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::string taskFolder;
+  std::string batchSizesFlag;
+  std::string workersFlag;
+  std::string backendsFlag;
+  std::string csvPath;
+  int steps;
+  po::options_description description(
+      "Thread-count scaling benchmark for parallel simulation");
+  description.add_options()("help", "Print this message")(
+      "task_folder",
+      po::value<std::string>(&taskFolder)
+          ->default_value("src/simulator/tests/test_data/task_validation"),
+      "Folder with tasks to simulate")(
+      "batch_sizes",
+      po::value<std::string>(&batchSizesFlag)
+          ->default_value("1,10,100,1000,10000"),
+      "Comma separated batch sizes")(
+      "workers", po::value<std::string>(&workersFlag)->default_value(""),
+      "Comma separated worker counts. Defaults to powers of two up to the"
+      " number of cores and the number of cores")(
+      "backends",
+      po::value<std::string>(&backendsFlag)
+          ->default_value("processes,as_completed,threads,threads_dyn"),
+      "Comma separated backends")(
+      "steps", po::value<int>(&steps)->default_value(kMaxSteps),
+      "Maximum number of simulation steps per task")(
+      "csv", po::value<std::string>(&csvPath)->default_value(""),
+      "Optional path to write the results as CSV");
+  po::variables_map vm;
+  try {
+    po::store(po::parse_command_line(argc, argv, description), vm);
+    if (vm.count("help")) {
+      std::cout << description << std::endl;
+      return 0;
+    }
+    po::notify(vm);
+  } catch (const po::error& e) {
+    std::cerr << e.what() << "\n" << description << std::endl;
+    return 1;
+  }
+
+  std::vector<int> workerCounts = parseList(workersFlag);
+  if (workerCounts.empty()) {
+    const int numCores = std::max(1u, std::thread::hardware_concurrency());
+    for (int workers = 1; workers < numCores; workers *= 2) {
+      workerCounts.push_back(workers);
+    }
+    workerCounts.push_back(numCores);
+  }
+
+  const std::map<std::string, Backend> allBackends = {
+      {"processes", runProcesses},
+      {"as_completed", runAsCompleted},
+      {"threads",
+       [](const std::vector<::task::Task>& tasks, int numWorkers, int steps,
+          const DoneCallback& done) {
+         runThreads(tasks, numWorkers, steps, /*dynamic=*/false, done);
+       }},
+      {"threads_dyn",
+       [](const std::vector<::task::Task>& tasks, int numWorkers, int steps,
+          const DoneCallback& done) {
+         runThreads(tasks, numWorkers, steps, /*dynamic=*/true, done);
+       }},
+  };
+  std::vector<std::string> backendNames;
+  {
+    std::stringstream stream(backendsFlag);
+    std::string name;
+    while (std::getline(stream, name, ',')) {
+      if (allBackends.count(name) == 0) {
+        std::cerr << "Unknown backend: " << name << std::endl;
+        return 1;
+      }
+      backendNames.push_back(name);
+    }
+  }
+
+  std::vector<::task::Task> sourceTasks;
+  for (const int32_t taskId : listTasks(taskFolder.c_str())) {
+    sourceTasks.push_back(getTaskFromId(taskId, taskFolder.c_str()));
+  }
+  if (sourceTasks.empty()) {
+    std::cerr << "No tasks found in " << taskFolder << std::endl;
+    return 1;
+  }
+
+  std::ofstream csv;
+  if (!csvPath.empty()) {
+    csv.open(csvPath);
+    csv << "backend,batch_size,workers,seconds,tasks_per_second,p50_s,p99_s,"
+           "efficiency\n";
+  }
+  printf("%-13s %6s %7s %10s %10s %10s %10s\n", "backend", "batch",
+         "workers", "tasks/s", "p50 s", "p99 s", "efficiency");
+  for (const int batchSize : parseList(batchSizesFlag)) {
+    std::vector<::task::Task> tasks;
+    tasks.reserve(batchSize);
+    for (int i = 0; i < batchSize; ++i) {
+      tasks.push_back(sourceTasks[i % sourceTasks.size()]);
+    }
+    for (const std::string& name : backendNames) {
+      double singleWorkerThroughput = 0;
+      for (const int numWorkers : workerCounts) {
+        const BatchResult result =
+            runBatch(allBackends.at(name), tasks, numWorkers, steps);
+        const double throughput = batchSize / std::max(result.seconds, 1e-9);
+        if (numWorkers == 1 || singleWorkerThroughput == 0) {
+          singleWorkerThroughput = throughput / numWorkers;
+        }
+        const double efficiency =
+            throughput / (numWorkers * singleWorkerThroughput);
+        const double p50 = percentile(result.latencies, 0.5);
+        const double p99 = percentile(result.latencies, 0.99);
+        printf("%-13s %6d %7d %10.1f %10.4f %10.4f %10.2f\n", name.c_str(),
+               batchSize, numWorkers, throughput, p50, p99, efficiency);
+        fflush(stdout);
+        if (csv.is_open()) {
+          csv << name << "," << batchSize << "," << numWorkers << ","
+              << result.seconds << "," << throughput << "," << p50 << ","
+              << p99 << "," << efficiency << "\n";
+        }
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,139 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// Microbenchmark for Thrift serialization of Task, Scene and TaskSimulation.
+//
+// Compares the helpers from thrift_serialization.h (templated protocol,
+// thread-local buffers, borrowed input) with the straightforward approach
+// that allocates a TMemoryBuffer and a virtual TBinaryProtocol on every call
+// and copies the input into a temporary vector before reading.
+//
+// Built when CMake is configured with -DPHYRE_BUILD_BENCHMARKS=ON.
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+
+#include "creator.h"
+#include "task_utils.h"
+#include "thrift_serialization.h"
+
+#include "gen-cpp/scene_types.h"
+#include "gen-cpp/task_types.h"
+
+using ::apache::thrift::protocol::TBinaryProtocol;
+using ::apache::thrift::transport::TMemoryBuffer;
+
+constexpr int kMinIterations = 100;
+constexpr double kMinSeconds = 0.5;
+
+template <class T>
+std::vector<uint8_t> legacySerialize(const T& object) {
+  std::shared_ptr<TMemoryBuffer> memoryBuffer(new TMemoryBuffer());
+  std::unique_ptr<TBinaryProtocol> protocol(new TBinaryProtocol(memoryBuffer));
+  object.write(protocol.get());
+
+  uint8_t* buffer;
+  uint32_t sz;
+  memoryBuffer->getBuffer(&buffer, &sz);
+  return std::vector<uint8_t>(buffer, buffer + sz);
+}
+
+template <class T>
+T legacyDeserialize(const uint8_t* data, size_t size) {
+  const std::vector<uint8_t> serialized(data, data + size);
+  std::shared_ptr<TMemoryBuffer> memoryBuffer(new TMemoryBuffer());
+  std::unique_ptr<TBinaryProtocol> protocol(new TBinaryProtocol(memoryBuffer));
+  memoryBuffer->resetBuffer(const_cast<uint8_t*>(serialized.data()),
+                            serialized.size());
+  T object;
+  object.read(protocol.get());
+  return object;
+}
+
+// Returns mean time per call in microseconds.
+double timePerCall(const std::function<void()>& callback) {
+  callback();
+  int iterations = 0;
+  const auto start = std::chrono::steady_clock::now();
+  double seconds = 0;
+  while (iterations < kMinIterations || seconds < kMinSeconds) {
+    callback();
+    ++iterations;
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                            start)
+                  .count();
+  }
+  return seconds / iterations * 1e6;
+}
+
+template <class T>
+void benchmark(const std::string& name, const T& object) {
+  const std::vector<uint8_t> serialized =
+      thrift_serialization::serialize(object);
+  if (serialized != legacySerialize(object)) {
+    printf("FATAL: serialized %s does not match\n", name.c_str());
+    exit(1);
+  }
+  const double legacyWrite =
+      timePerCall([&]() { legacySerialize(object); });
+  const double newWrite =
+      timePerCall([&]() { thrift_serialization::serializeToSpan(object); });
+  const double legacyRead = timePerCall([&]() {
+    legacyDeserialize<T>(serialized.data(), serialized.size());
+  });
+  const double newRead = timePerCall([&]() {
+    thrift_serialization::deserialize<T>(serialized.data(), serialized.size());
+  });
+  printf("%-16s %9zu %10.2f %10.2f %6.2fx %10.2f %10.2f %6.2fx\n",
+         name.c_str(), serialized.size(), legacyWrite, newWrite,
+         legacyWrite / newWrite, legacyRead, newRead, legacyRead / newRead);
+}
+
+::task::Task buildDemoTask() {
+  std::vector<::scene::Body> bodies;
+  bodies.push_back(buildBox(0, 0, 256, 5, 0, false));
+  for (int i = 0; i < 10; ++i) {
+    bodies.push_back(buildBox(20 + 20 * i, 30 + 15 * i, 10, 10, 5 * i));
+    bodies.push_back(buildCircle(25 + 20 * i, 120 + 10 * i, 4));
+  }
+  ::scene::Scene scene;
+  scene.__set_width(256);
+  scene.__set_height(256);
+  scene.__set_bodies(bodies);
+  ::task::Task task;
+  task.__set_scene(scene);
+  task.__set_bodyId1(1);
+  task.__set_bodyId2(0);
+  task.relationships.push_back(::task::SpatialRelationship::TOUCHING);
+  return task;
+}
+
+int main() {
+  const ::task::Task task = buildDemoTask();
+  const ::task::TaskSimulation simulation =
+      simulateTask(task, kMaxSteps, /*stride=*/kFps);
+
+  printf("Times are in microseconds per call\n");
+  printf("%-16s %9s %10s %10s %7s %10s %10s %7s\n", "object", "bytes",
+         "old write", "new write", "", "old read", "new read", "");
+  benchmark("Task", task);
+  benchmark("Scene", task.scene);
+  benchmark("TaskSimulation", simulation);
+  return 0;
+}
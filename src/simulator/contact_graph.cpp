@@ -0,0 +1,109 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "contact_graph.h"
+
+#include <algorithm>
+
+#include "thrift_box2d_conversion.h"
+
+namespace {
+
+std::vector<int> buildObjectIndices(const std::vector<::scene::Body>& bodies,
+                                    int* nextIndex) {
+  std::vector<int> indices;
+  indices.reserve(bodies.size());
+  for (const ::scene::Body& body : bodies) {
+    indices.push_back(body.shapeType != ::scene::ShapeType::UNDEFINED
+                          ? (*nextIndex)++
+                          : -1);
+  }
+  return indices;
+}
+
+}  // namespace
+
+ContactGraphBuilder::ContactGraphBuilder(const ::scene::Scene& scene,
+                                         const bool withImpulses)
+    : withImpulses_(withImpulses) {
+  int nextIndex = 0;
+  generalObjectIndices_ = buildObjectIndices(scene.bodies, &nextIndex);
+  userObjectIndices_ = buildObjectIndices(scene.user_input_bodies, &nextIndex);
+  graph_.frameOffsets.push_back(0);
+  graph_.__isset.frameOffsets = true;
+  graph_.__isset.edges = true;
+  graph_.__isset.normalImpulses = withImpulses;
+}
+
+void ContactGraphBuilder::addFrame(const b2WorldWithData& world) {
+  const auto getObjectIndex = [this](const b2Body& body) {
+    const Box2dData* data = static_cast<const Box2dData*>(body.GetUserData());
+    if (data == nullptr) {
+      return -1;
+    }
+    switch (data->object_type) {
+      case Box2dData::GENERAL:
+        return generalObjectIndices_.at(data->object_id);
+      case Box2dData::USER:
+        return userObjectIndices_.at(data->object_id);
+      default:
+        return -1;
+    }
+  };
+
+  frameEdges_.clear();
+  for (const b2Contact* contact = world.GetContactList(); contact != nullptr;
+       contact = contact->GetNext()) {
+    if (!contact->IsTouching()) {
+      continue;
+    }
+    const int index1 = getObjectIndex(*contact->GetFixtureA()->GetBody());
+    const int index2 = getObjectIndex(*contact->GetFixtureB()->GetBody());
+    if (index1 < 0 || index2 < 0 || index1 == index2) {
+      continue;
+    }
+    double normalImpulse = 0;
+    if (withImpulses_) {
+      const b2Manifold* manifold = contact->GetManifold();
+      for (int i = 0; i < manifold->pointCount; ++i) {
+        normalImpulse += manifold->points[i].normalImpulse;
+      }
+    }
+    frameEdges_.push_back(Edge{std::min(index1, index2),
+                               std::max(index1, index2), normalImpulse});
+  }
+
+  // Sort the edges to get a deterministic order and merge contacts between
+  // the same objects, e.g., for bodies with several fixtures.
+  std::sort(frameEdges_.begin(), frameEdges_.end(),
+            [](const Edge& a, const Edge& b) {
+              return a.first != b.first ? a.first < b.first
+                                        : a.second < b.second;
+            });
+  for (size_t i = 0; i < frameEdges_.size(); ++i) {
+    const Edge& edge = frameEdges_[i];
+    if (i > 0 && edge.first == frameEdges_[i - 1].first &&
+        edge.second == frameEdges_[i - 1].second) {
+      if (withImpulses_) {
+        graph_.normalImpulses.back() += edge.normalImpulse;
+      }
+      continue;
+    }
+    graph_.edges.push_back(edge.first);
+    graph_.edges.push_back(edge.second);
+    if (withImpulses_) {
+      graph_.normalImpulses.push_back(edge.normalImpulse);
+    }
+  }
+  graph_.frameOffsets.push_back(graph_.edges.size() / 2);
+}
@@ -0,0 +1,61 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef CONTACT_GRAPH_H
+#define CONTACT_GRAPH_H
+
+#include <utility>
+#include <vector>
+
+#include "gen-cpp/scene_types.h"
+#include "gen-cpp/task_types.h"
+
+class b2WorldWithData;
+
+// Collects touching pairs of objects of a simulation frame by frame into a
+// ::task::ContactGraph. Objects are indexed like featurized objects (see
+// featurizeScene): scene bodies followed by user input bodies, skipping
+// bodies with undefined shapes. Contacts with the bounding box are ignored.
+class ContactGraphBuilder {
+ public:
+  // The scene is only used to build the object index and does not have to
+  // outlive the builder.
+  ContactGraphBuilder(const ::scene::Scene& scene, const bool withImpulses);
+
+  // Appends a frame with all touching contacts in the world. Multiple
+  // contacts between the same pair of objects are merged into a single edge.
+  void addFrame(const b2WorldWithData& world);
+
+  int numFrames() const { return graph_.frameOffsets.size() - 1; }
+  const ::task::ContactGraph& graph() const { return graph_; }
+  // Returns the graph. The builder must not be used afterwards.
+  ::task::ContactGraph release() { return std::move(graph_); }
+
+ private:
+  struct Edge {
+    int first;
+    int second;
+    double normalImpulse;
+  };
+
+  // Object index for Box2D bodies created for scene bodies and user input
+  // bodies. -1 for bodies that are not featurized.
+  std::vector<int> generalObjectIndices_;
+  std::vector<int> userObjectIndices_;
+  const bool withImpulses_;
+  ::task::ContactGraph graph_;
+  // Reused between frames to avoid allocations.
+  std::vector<Edge> frameEdges_;
+};
+
+#endif  // CONTACT_GRAPH_H
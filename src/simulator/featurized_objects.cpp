@@ -0,0 +1,388 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "featurized_objects.h"
+
+#include <math.h>
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "creator.h"
+#include "image_to_box2d.h"
+#include "task_utils.h"
+#include "thrift_serialization.h"
+#include "utils/parallel_for.h"
+
+#include "gen-cpp/task_types.h"
+
+namespace {
+
+using Point = std::pair<double, double>;
+
+// Constants of phyre.creator.shapes.
+constexpr double kBallRasterizationBuffer = 0.5;
+constexpr double kBarHeight = kSceneWidth / 50.;
+constexpr double kStandingSticksAngle = 77.5;
+constexpr double kJarBaseRatio = 0.8;
+constexpr double kJarWidthRatio = 1. / 1.2;
+
+// Feature indices, see featurizeBody.
+constexpr int kXIndex = 0;
+constexpr int kYIndex = 1;
+constexpr int kAngleIndex = 2;
+constexpr int kDiameterIndex = 3;
+constexpr int kShapeStartIndex = 4;
+constexpr int kColorStartIndex = kShapeStartIndex + kNumShapes;
+constexpr int kLinearVelocityXIndex = kColorStartIndex + kNumColors;
+constexpr int kLinearVelocityYIndex = kLinearVelocityXIndex + 1;
+constexpr int kAngularVelocityIndex = kLinearVelocityYIndex + 1;
+static_assert(kAngularVelocityIndex + 1 == kObjectFeatureSize);
+
+// Thickness of the walls added by TaskCreator.
+constexpr float kWallThickness = 5;
+
+// _interpolate and _inverse_interpolate for a scale range [0, maxValue].
+double interpolate(double maxValue, double scale) {
+  return (1. - scale) * 0. + scale * maxValue;
+}
+
+double inverseInterpolate(double maxValue, double value) {
+  return value / maxValue;
+}
+
+::scene::Shape buildPolygonShape(const std::vector<Point>& points) {
+  std::vector<::scene::Vector> vertices;
+  vertices.reserve(points.size());
+  for (const auto& [x, y] : points) {
+    vertices.push_back(getVector(x, y));
+  }
+  ::scene::Polygon polygon;
+  polygon.__set_vertices(vertices);
+  ::scene::Shape shape;
+  shape.__set_polygon(polygon);
+  return shape;
+}
+
+// Box._build: top-right, top-left, bottom-left, bottom-right.
+std::vector<Point> buildBoxPoints(double width, double height,
+                                  double denominator) {
+  std::vector<Point> points;
+  for (int i = 0; i < 4; ++i) {
+    const double vx = (1 - 2 * (i == 1 || i == 2)) / denominator * width;
+    const double vy = (1 - 2 * (i == 2 || i == 3)) / denominator * height;
+    points.emplace_back(vx, vy);
+  }
+  return points;
+}
+
+std::vector<::scene::Shape> buildBall(double diameter) {
+  const double scale = inverseInterpolate(
+      kSceneWidth / 2., diameter / 2.0 - kBallRasterizationBuffer);
+  const double radius = interpolate(kSceneWidth / 2., scale);
+  ::scene::Circle circle;
+  circle.__set_radius(static_cast<int>(radius) + kBallRasterizationBuffer);
+  ::scene::Shape shape;
+  shape.__set_circle(circle);
+  return {shape};
+}
+
+std::vector<::scene::Shape> buildBar(double diameter) {
+  const double scale = inverseInterpolate(
+      kSceneWidth, sqrt(diameter * diameter - kBarHeight * kBarHeight));
+  const double width = interpolate(kSceneWidth, scale);
+  return {buildPolygonShape(buildBoxPoints(width, kBarHeight, 2.))};
+}
+
+std::vector<::scene::Shape> buildStandingSticks(double diameter) {
+  const double scale = inverseInterpolate(
+      kSceneWidth, sqrt(diameter * diameter - kBarHeight * kBarHeight));
+  const double width = interpolate(kSceneWidth, scale);
+  const std::vector<Point> bar = buildBoxPoints(width, kBarHeight, 3.);
+  std::vector<::scene::Shape> shapes;
+  for (const double angle : {-kStandingSticksAngle, kStandingSticksAngle}) {
+    const double radian = angle / 180. * M_PI;
+    std::vector<Point> rotated;
+    for (const auto& [x, y] : bar) {
+      rotated.emplace_back(cos(radian) * x - sin(radian) * y,
+                           cos(radian) * y + sin(radian) * x);
+    }
+    shapes.push_back(buildPolygonShape(rotated));
+  }
+  return shapes;
+}
+
+std::array<std::vector<Point>, 3> buildJarPoints(double diameter) {
+  const double baseToWidthRatio = (1.0 - kJarBaseRatio) / 2.0 + kJarBaseRatio;
+  const double widthToHeightRatio = baseToWidthRatio * kJarWidthRatio;
+  const double scale = inverseInterpolate(
+      kSceneWidth,
+      sqrt((diameter * diameter) /
+           (1 + widthToHeightRatio * widthToHeightRatio)));
+  const double height = interpolate(kSceneWidth, scale);
+  const double width = height * kJarWidthRatio;
+  const double thickness =
+      log(height) / log(0.3 * kSceneWidth) * kSceneWidth / 50;
+  const double baseWidth = width * kJarBaseRatio;
+
+  const double base = (width - baseWidth) / 2.;
+  const double hypotenuse = sqrt(height * height + base * base);
+  const double cosine = base / hypotenuse;
+  const double sine = height / hypotenuse;
+  const double xDelta = thickness * sine;
+  const double xDeltaTop = thickness / sine;
+  const double yDelta = thickness * cosine;
+  const double top = height - (thickness / 2);
+  const double bottom = -(thickness / 2);
+  return {
+      buildBoxPoints(baseWidth, thickness, 2.),
+      std::vector<Point>{{-width / 2, top},
+                         {(-baseWidth / 2), bottom},
+                         {(-baseWidth / 2) + xDelta, yDelta + bottom},
+                         {(-width / 2) + xDeltaTop, top}},
+      std::vector<Point>{{width / 2, top},
+                         {(width / 2) - xDeltaTop, top},
+                         {(baseWidth / 2) - xDelta, yDelta + bottom},
+                         {(baseWidth / 2), bottom}},
+  };
+}
+
+std::pair<Point, double> mergeCentroids(const std::vector<Point>& points,
+                                        const std::vector<double>& masses) {
+  double mass = 0;
+  for (const double m : masses) {
+    mass += m;
+  }
+  double x = 0;
+  double y = 0;
+  for (size_t i = 0; i < points.size(); ++i) {
+    x += points[i].first * masses[i] / mass;
+    y += points[i].second * masses[i] / mass;
+  }
+  return {{x, y}, mass};
+}
+
+std::pair<Point, double> getTriangleCentroid(const Point& a, const Point& b,
+                                             const Point& c) {
+  const auto length = [](const Point& p1, const Point& p2) {
+    return sqrt((p1.first - p2.first) * (p1.first - p2.first) +
+                (p1.second - p2.second) * (p1.second - p2.second));
+  };
+  const double x = (a.first + b.first + c.first) / 3;
+  const double y = (a.second + b.second + c.second) / 3;
+  const double ab = length(a, b);
+  const double bc = length(b, c);
+  const double ca = length(c, a);
+  const double p = (ab + bc + ca) / 2;
+  return {{x, y}, sqrt(p * (p - ab) * (p - bc) * (p - ca))};
+}
+
+int argmax(const float* values, int size) {
+  return std::max_element(values, values + size) - values;
+}
+
+// Static walls around the scene in the order TaskCreator adds them: bottom,
+// left, top, right. They are outside of the scene, so they are neither
+// rendered nor featurized.
+std::vector<::scene::Body> buildWalls() {
+  std::vector<::scene::Body> walls = {
+      buildBox(0, -kWallThickness, kSceneWidth, kWallThickness, 0, false),
+      buildBox(-kWallThickness, 0, kWallThickness, kSceneHeight, 0, false),
+      buildBox(0, kSceneHeight, kSceneWidth, kWallThickness, 0, false),
+      buildBox(kSceneWidth, 0, kWallThickness, kSceneHeight, 0, false)};
+  for (::scene::Body& wall : walls) {
+    wall.__set_color(::shared::Color::BLACK);
+  }
+  return walls;
+}
+
+// Shifts featurized jars from the position of the body to the center of mass
+// as finalize_featurized_objects does.
+void shiftJarsToCenterOfMass(int numObjects, float* features) {
+  for (int i = 0; i < numObjects; ++i) {
+    float* object = features + i * kObjectFeatureSize;
+    if (object[kShapeStartIndex + ::scene::ShapeType::JAR - 1] != 1) {
+      continue;
+    }
+    const double offset =
+        getJarCenterOfMassOffset(object[kDiameterIndex] * kSceneWidth);
+    const double angle = object[kAngleIndex] * 2 * M_PI;
+    object[kXIndex] -= offset * sin(angle) / kSceneWidth;
+    object[kYIndex] += offset * cos(angle) / kSceneWidth;
+  }
+}
+
+}  // namespace
+
+std::vector<::scene::Shape> buildShapesFromDiameter(
+    ::scene::ShapeType::type shapeType, double diameter) {
+  switch (shapeType) {
+    case ::scene::ShapeType::BALL:
+      return buildBall(diameter);
+    case ::scene::ShapeType::BAR:
+      return buildBar(diameter);
+    case ::scene::ShapeType::JAR: {
+      std::vector<::scene::Shape> shapes;
+      for (const auto& points : buildJarPoints(diameter)) {
+        shapes.push_back(buildPolygonShape(points));
+      }
+      return shapes;
+    }
+    case ::scene::ShapeType::STANDINGSTICKS:
+      return buildStandingSticks(diameter);
+    default:
+      throw std::runtime_error("Cannot build shapes of undefined type");
+  }
+}
+
+double getJarCenterOfMassOffset(double diameter) {
+  std::vector<Point> points;
+  std::vector<double> masses;
+  for (const auto& p : buildJarPoints(diameter)) {
+    const auto [firstCentroid, firstMass] =
+        getTriangleCentroid(p[0], p[1], p[2]);
+    const auto [secondCentroid, secondMass] =
+        getTriangleCentroid(p[0], p[3], p[2]);
+    const auto [centroid, mass] = mergeCentroids(
+        {firstCentroid, secondCentroid}, {firstMass, secondMass});
+    points.push_back(centroid);
+    masses.push_back(mass);
+  }
+  return mergeCentroids(points, masses).first.second;
+}
+
+::scene::Scene featurizedObjectsToScene(const float* features,
+                                        int numObjects) {
+  std::vector<::scene::Body> bodies = buildWalls();
+  std::vector<::scene::Body> userInputBodies;
+  for (int i = 0; i < numObjects; ++i) {
+    const float* object = features + i * kObjectFeatureSize;
+    const auto shapeType = static_cast<::scene::ShapeType::type>(
+        argmax(object + kShapeStartIndex, kNumShapes) + 1);
+    const auto color = static_cast<::shared::Color::type>(
+        argmax(object + kColorStartIndex, kNumColors) + 1);
+    const double diameter = object[kDiameterIndex] * kSceneWidth;
+    double x = object[kXIndex];
+    double y = object[kYIndex];
+    if (shapeType == ::scene::ShapeType::JAR) {
+      // Back from the center of mass to the position of the body.
+      const double offset = getJarCenterOfMassOffset(diameter);
+      const double angle = object[kAngleIndex] * 2 * M_PI;
+      x += offset * sin(angle) / kSceneWidth;
+      y -= offset * cos(angle) / kSceneWidth;
+    }
+    x *= kSceneWidth;
+    y *= kSceneHeight;
+    ::scene::Body body;
+    // Mirrors shared.USER_BODY_COLOR.
+    const bool isUserInput = color == ::shared::Color::RED;
+    if (isUserInput) {
+      if (shapeType != ::scene::ShapeType::BALL) {
+        throw std::runtime_error("User input objects must be balls");
+      }
+      body = buildCircle(x, y, diameter / 2.0);
+    } else {
+      body.__set_position(getVector(x, y));
+      body.__set_angle(object[kAngleIndex] * 360. / 180. * M_PI);
+      body.__set_shapes(buildShapesFromDiameter(shapeType, diameter));
+      body.__set_color(color);
+      body.__set_diameter(diameter);
+      body.__set_shapeType(shapeType);
+      body.bodyType = (color == ::shared::Color::BLACK ||
+                       color == ::shared::Color::PURPLE)
+                          ? ::scene::BodyType::STATIC
+                          : ::scene::BodyType::DYNAMIC;
+    }
+    if (body.bodyType == ::scene::BodyType::DYNAMIC) {
+      body.__set_linearVelocity(
+          getVector(object[kLinearVelocityXIndex] * kSceneWidth,
+                    object[kLinearVelocityYIndex] * kSceneHeight));
+      body.__set_angularVelocity(object[kAngularVelocityIndex] * 2 * M_PI);
+    }
+    (isUserInput ? userInputBodies : bodies).push_back(body);
+  }
+  ::scene::Scene scene;
+  scene.__set_width(kSceneWidth);
+  scene.__set_height(kSceneHeight);
+  scene.__set_bodies(bodies);
+  scene.__set_user_input_bodies(userInputBodies);
+  return scene;
+}
+
+void renderFeaturizedObjectsTo(const float* features, int numFrames,
+                               int numObjects, int numThreads,
+                               uint8_t* buffer) {
+  const size_t frameSize = kSceneWidth * kSceneHeight;
+  parallelFor(numFrames, getNumThreads(numThreads), [&](size_t frame) {
+    const ::scene::Scene scene = featurizedObjectsToScene(
+        features + frame * numObjects * kObjectFeatureSize, numObjects);
+    renderTo(scene, buffer + frame * frameSize);
+  });
+}
+
+int getNumFeaturizedFrames(int steps, int stride) {
+  if (steps < 0 || stride <= 0) {
+    throw std::runtime_error(
+        "Expected non-negative steps and positive stride, got steps=" +
+        std::to_string(steps) + " and stride=" + std::to_string(stride));
+  }
+  return (steps + stride - 1) / stride;
+}
+
+void simulateFeaturizedObjectsTo(const float* features, int numStates,
+                                 int numObjects, int steps, int stride,
+                                 int numThreads, float* buffer) {
+  if (numStates < 0 || numObjects < 0) {
+    throw std::runtime_error(
+        "Expected non-negative numbers of states and objects");
+  }
+  const int numFrames = getNumFeaturizedFrames(steps, stride);
+  const size_t stateSize = numObjects * kObjectFeatureSize;
+  parallelFor(numStates, getNumThreads(numThreads), [&](size_t state) {
+    const ::scene::Scene scene =
+        featurizedObjectsToScene(features + state * stateSize, numObjects);
+    TaskSimulationStream stream(scene, steps, stride);
+    std::vector<::scene::Scene> scenes;
+    stream.advance(numFrames, &scenes);
+    float* stateBuffer = buffer + state * numFrames * stateSize;
+    for (int frame = 0; frame < numFrames; ++frame) {
+      float* frameBuffer = stateBuffer + frame * stateSize;
+      featurizeScene(scenes.at(frame), frameBuffer);
+      shiftJarsToCenterOfMass(numObjects, frameBuffer);
+    }
+  });
+}
+
+void getInitialObservationsTo(
+    const std::vector<std::string>& serializedTasks, int numThreads,
+    uint8_t* images, std::vector<std::vector<float>>* featurizedObjects) {
+  const size_t numTasks = serializedTasks.size();
+  const size_t imageSize = kSceneWidth * kSceneHeight;
+  featurizedObjects->assign(numTasks, {});
+  parallelFor(numTasks, getNumThreads(numThreads), [&](size_t i) {
+    const std::string& bytes = serializedTasks[i];
+    const ::task::Task task = thrift_serialization::deserialize<::task::Task>(
+        reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size());
+    if (task.scene.width != kSceneWidth || task.scene.height != kSceneHeight) {
+      throw std::runtime_error("Unexpected scene size");
+    }
+    renderTo(task.scene, images + i * imageSize);
+    const int numObjects = getNumObjectsInScene(task.scene);
+    std::vector<float>& features = (*featurizedObjects)[i];
+    features.resize(numObjects * kObjectFeatureSize);
+    featurizeScene(task.scene, features.data());
+    shiftJarsToCenterOfMass(numObjects, features.data());
+  });
+}
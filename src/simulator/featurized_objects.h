@@ -0,0 +1,83 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// Reconstruction of scenes from featurized objects. This is a native version
+// of phyre.objects_util: every object is rebuilt from its shape type and
+// diameter with the same arithmetic as the shape builders in
+// phyre.creator.shapes, so rendered frames match the Python path.
+#ifndef FEATURIZED_OBJECTS_H
+#define FEATURIZED_OBJECTS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "gen-cpp/scene_types.h"
+
+// Mirror phyre.creator.constants.
+constexpr int kSceneWidth = 256;
+constexpr int kSceneHeight = 256;
+
+// Shapes built by phyre.creator.shapes for the shape type with the default
+// sizes for the diameter, e.g., Jar.build(diameter=diameter).
+std::vector<::scene::Shape> buildShapesFromDiameter(
+    ::scene::ShapeType::type shapeType, double diameter);
+
+// Distance from the position of a jar to its center of mass along the jar
+// axis, i.e., Jar.center_of_mass(diameter=diameter)[1].
+double getJarCenterOfMassOffset(double diameter);
+
+// Inverse of featurizeScene for numObjects featurized objects in the format of
+// the Python API, i.e., with jar positions shifted to the center of mass (see
+// phyre.simulation.finalize_featurized_objects). Objects with the user input
+// color become user input balls and the rest become scene bodies after the
+// walls of TaskCreator. Dynamic bodies get the velocities from the features.
+::scene::Scene featurizedObjectsToScene(const float* features, int numObjects);
+
+// Renders every frame of (numFrames, numObjects, kObjectFeatureSize) features
+// into a (numFrames, kSceneHeight, kSceneWidth) buffer, the same as
+// phyre.objects_util.featurized_objects_vector_to_raster for every frame.
+// Frames are rendered on numThreads threads (non-positive means
+// std::thread::hardware_concurrency()).
+void renderFeaturizedObjectsTo(const float* features, int numFrames,
+                               int numObjects, int numThreads,
+                               uint8_t* buffer);
+
+// Number of scenes recorded by a scene simulation, i.e., ceil(steps / stride).
+// Throws std::runtime_error unless steps is non-negative and stride is
+// positive.
+int getNumFeaturizedFrames(int steps, int stride);
+
+// Restarts the physics from numStates featurized states (numStates,
+// numObjects, kObjectFeatureSize), including velocities, and simulates each of
+// them for the given number of steps on numThreads threads (non-positive
+// means std::thread::hardware_concurrency()). Writes the features of every
+// stride-th scene to a (numStates, getNumFeaturizedFrames(steps, stride),
+// numObjects, kObjectFeatureSize) buffer in the same format as the input.
+// Scene bodies precede user input balls in the output as in featurizeScene.
+// Throws std::runtime_error on invalid arguments before simulating anything.
+void simulateFeaturizedObjectsTo(const float* features, int numStates,
+                                 int numObjects, int steps, int stride,
+                                 int numThreads, float* buffer);
+
+// Renders and featurizes the scenes of serialized tasks on numThreads threads
+// (non-positive means std::thread::hardware_concurrency()), the same as
+// phyre.simulator.scene_to_raster and scene_to_featurized_objects do. The
+// scenes must be kSceneWidth x kSceneHeight. Writes the images to a (tasks,
+// kSceneHeight, kSceneWidth) buffer and the (objects, kObjectFeatureSize)
+// features of every task to featurizedObjects.
+void getInitialObservationsTo(
+    const std::vector<std::string>& serializedTasks, int numThreads,
+    uint8_t* images, std::vector<std::vector<float>>* featurizedObjects);
+
+#endif  // FEATURIZED_OBJECTS_H
@@ -0,0 +1,96 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// Command line generator of rollout datasets (see rollout_generator.h).
+//
+// The job file is usually produced by
+// scripts/offline_simulation/generate_rollouts.py, which resolves tiers,
+// task lists and action sources.
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include <boost/program_options.hpp>
+
+#include "rollout_generator.h"
+#include "task_io.h"
+#include "task_utils.h"
+
+namespace po = boost::program_options;
+
+int main(int argc, char** argv) {
+  std::string jobPath;
+  RolloutGeneratorOptions options;
+  bool raw;
+  po::options_description description("Generates rollout datasets");
+  description.add_options()("help", "Print this message")(
+      "job", po::value<std::string>(&jobPath)->required(),
+      "Path to a serialized RolloutJob")(
+      "output_prefix", po::value<std::string>(&options.outputPrefix)->required(),
+      "Shards are written to <output_prefix>-SSSSS-of-NNNNN.rollouts")(
+      "num_shards", po::value<int>(&options.numShards)->default_value(0),
+      "Number of output shards. Defaults to 4 shards per thread")(
+      "num_threads", po::value<int>(&options.numThreads)->default_value(0),
+      "Number of worker threads. Defaults to the number of cores")(
+      "steps", po::value<int>(&options.steps)->default_value(kMaxSteps),
+      "Maximum number of simulation steps")(
+      "stride", po::value<int>(&options.stride)->default_value(kFps),
+      "Record every stride-th frame")(
+      "resolution",
+      po::value<int>(&options.datasetOptions.resolution)->default_value(0),
+      "Width of stored images and masks. 0 keeps the scene resolution")(
+      "images", po::value<bool>(&options.needImages)->default_value(true),
+      "Store images")("featurized_objects",
+                      po::value<bool>(&options.needFeaturizedObjects)
+                          ->default_value(true),
+                      "Store featurized objects")(
+      "object_masks",
+      po::value<bool>(&options.needObjectMasks)->default_value(false),
+      "Store object masks")("raw", po::bool_switch(&raw),
+                            "Store all columns without compression");
+
+  po::variables_map vm;
+  try {
+    po::store(po::parse_command_line(argc, argv, description), vm);
+    if (vm.count("help")) {
+      std::cout << description << std::endl;
+      return 0;
+    }
+    po::notify(vm);
+  } catch (const po::error& e) {
+    std::cerr << e.what() << "\n" << description << std::endl;
+    return 1;
+  }
+
+  if (options.numThreads <= 0) {
+    options.numThreads =
+        std::max(1u, std::thread::hardware_concurrency());
+  }
+  if (options.numShards <= 0) {
+    options.numShards = 4 * options.numThreads;
+  }
+  if (raw) {
+    options.datasetOptions.images = ColumnCodec::RAW;
+    options.datasetOptions.featurizedObjects = ColumnCodec::RAW;
+    options.datasetOptions.objectMasks = ColumnCodec::RAW;
+  }
+
+  try {
+    generateRollouts(getRolloutJobFromPath(jobPath), options);
+  } catch (const std::exception& e) {
+    std::cerr << "Failed to generate rollouts: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,124 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "image_delta.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+DeltaImageEncoder::DeltaImageEncoder(const int height, const int width)
+    : previous_(height * width), current_(height * width) {
+  images_.height = height;
+  images_.width = width;
+}
+
+void DeltaImageEncoder::addFrame() {
+  if (images_.frameOffsets.empty()) {
+    images_.keyframe = current_;
+  } else {
+    const int size = current_.size();
+    for (int i = 0; i < size; ++i) {
+      if (current_[i] != previous_[i]) {
+        images_.changedPixels.push_back(i);
+        images_.changedValues.push_back(current_[i]);
+      }
+    }
+  }
+  images_.frameOffsets.push_back(images_.changedPixels.size());
+  std::swap(previous_, current_);
+}
+
+void decodeDeltaImages(const DeltaEncodedImages& images, const int begin,
+                       const int end, uint8_t* buffer) {
+  decodeDeltaImages(images.keyframe.data(), images.keyframe.size(),
+                    images.frameOffsets.data(), images.numFrames(),
+                    images.changedPixels.data(), images.changedValues.data(),
+                    images.changedPixels.size(), begin, end, buffer);
+}
+
+void checkDeltaImages(const size_t imageSize, const int64_t* frameOffsets,
+                      const int numFrames, const int32_t* changedPixels,
+                      const int64_t numChanges) {
+  if (numFrames == 0) {
+    if (numChanges != 0) {
+      throw std::runtime_error("Changed pixels without frames");
+    }
+    return;
+  }
+  if (frameOffsets[0] != 0) {
+    throw std::runtime_error("The first frame offset must be 0");
+  }
+  for (int frame = 1; frame < numFrames; ++frame) {
+    if (frameOffsets[frame] < frameOffsets[frame - 1]) {
+      throw std::runtime_error("Frame offsets decrease at frame " +
+                               std::to_string(frame));
+    }
+  }
+  if (frameOffsets[numFrames - 1] != numChanges) {
+    throw std::runtime_error(
+        "The last frame offset must be the number of changes, got " +
+        std::to_string(frameOffsets[numFrames - 1]) + " and " +
+        std::to_string(numChanges));
+  }
+  for (int64_t i = 0; i < numChanges; ++i) {
+    if (changedPixels[i] < 0 ||
+        static_cast<size_t>(changedPixels[i]) >= imageSize) {
+      throw std::runtime_error("Changed pixel " +
+                               std::to_string(changedPixels[i]) +
+                               " is outside of the image");
+    }
+  }
+}
+
+void decodeDeltaImages(const uint8_t* keyframe, const size_t imageSize,
+                       const int64_t* frameOffsets, const int numFrames,
+                       const int32_t* changedPixels,
+                       const uint8_t* changedValues, const int64_t numChanges,
+                       const int begin, const int end, uint8_t* buffer) {
+  if (begin < 0 || end > numFrames || begin > end) {
+    throw std::runtime_error("Invalid frame range [" + std::to_string(begin) +
+                             ", " + std::to_string(end) + ") for " +
+                             std::to_string(numFrames) + " frames");
+  }
+  if (begin == end) {
+    return;
+  }
+  const auto applyChanges = [=](int frame, uint8_t* image) {
+    const int64_t first = frameOffsets[frame - 1];
+    const int64_t last = frameOffsets[frame];
+    if (first < 0 || first > last || last > numChanges) {
+      throw std::runtime_error("Invalid offsets of frame " +
+                               std::to_string(frame));
+    }
+    for (int64_t i = first; i < last; ++i) {
+      const int32_t pixel = changedPixels[i];
+      if (pixel < 0 || static_cast<size_t>(pixel) >= imageSize) {
+        throw std::runtime_error("Changed pixel " + std::to_string(pixel) +
+                                 " is outside of the image");
+      }
+      image[pixel] = changedValues[i];
+    }
+  };
+  // The first output frame is reconstructed in place and then every next
+  // frame starts as a copy of the previous one.
+  std::copy(keyframe, keyframe + imageSize, buffer);
+  for (int frame = 1; frame <= begin; ++frame) {
+    applyChanges(frame, buffer);
+  }
+  for (int frame = begin + 1; frame < end; ++frame) {
+    uint8_t* image = buffer + (frame - begin) * imageSize;
+    std::copy(image - imageSize, image, image);
+    applyChanges(frame, image);
+  }
+}
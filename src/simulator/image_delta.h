@@ -0,0 +1,88 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef IMAGE_DELTA_H
+#define IMAGE_DELTA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Temporal delta encoding of a sequence of images of the same size. The first
+// image (keyframe) is stored densely and every following image is stored as
+// the list of pixels that differ from the previous image. Consecutive frames
+// of a simulation differ in a few pixels, so this is much smaller than storing
+// every frame once objects slow down.
+struct DeltaEncodedImages {
+  int height = 0;
+  int width = 0;
+  // The first image. Empty if there are no images.
+  std::vector<uint8_t> keyframe;
+  // One element per image. Changes of image i > 0 relative to image i - 1
+  // are [frameOffsets[i - 1], frameOffsets[i]) in changedPixels and
+  // changedValues. frameOffsets[0] is always 0.
+  std::vector<int64_t> frameOffsets;
+  // Flat pixel indices (row * width + column) and new values of changes.
+  std::vector<int32_t> changedPixels;
+  std::vector<uint8_t> changedValues;
+
+  int numFrames() const { return frameOffsets.size(); }
+};
+
+// Builds DeltaEncodedImages frame by frame. Only the previous frame is kept
+// in addition to the output.
+class DeltaImageEncoder {
+ public:
+  DeltaImageEncoder(const int height, const int width);
+
+  // Returns a buffer of height * width pixels to render the next frame into.
+  // The buffer is valid until the next call to addFrame().
+  uint8_t* nextFrameBuffer() { return current_.data(); }
+  // Appends the frame that was rendered into nextFrameBuffer().
+  void addFrame();
+
+  const DeltaEncodedImages& images() const { return images_; }
+  // Returns the encoded images. The encoder must not be used afterwards.
+  DeltaEncodedImages release() { return std::move(images_); }
+
+ private:
+  DeltaEncodedImages images_;
+  std::vector<uint8_t> previous_;
+  std::vector<uint8_t> current_;
+};
+
+// Decodes frames [begin, end) into buffer that has to have at least
+// (end - begin) * height * width elements. Frames before begin are replayed
+// without being copied.
+void decodeDeltaImages(const DeltaEncodedImages& images, const int begin,
+                       const int end, uint8_t* buffer);
+
+// Same as above for arrays owned by the caller, e.g., numpy arrays, with
+// numChanges elements in changedPixels and changedValues. Throws
+// std::runtime_error if a replayed frame has invalid offsets or a changed
+// pixel outside of the image.
+void decodeDeltaImages(const uint8_t* keyframe, const size_t imageSize,
+                       const int64_t* frameOffsets, const int numFrames,
+                       const int32_t* changedPixels,
+                       const uint8_t* changedValues, const int64_t numChanges,
+                       const int begin, const int end, uint8_t* buffer);
+
+// Checks all frames of caller-owned arrays up front: frameOffsets must start
+// at 0, must not decrease and must end at numChanges, and every changed pixel
+// must be in [0, imageSize). Throws std::runtime_error otherwise.
+void checkDeltaImages(const size_t imageSize, const int64_t* frameOffsets,
+                      const int numFrames, const int32_t* changedPixels,
+                      const int64_t numChanges);
+
+#endif  // IMAGE_DELTA_H
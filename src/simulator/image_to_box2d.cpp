@@ -14,6 +14,10 @@
 #include <math.h>
 #include <algorithm>
 #include <cmath>
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include <b2Polygon.h>
@@ -35,11 +39,58 @@ using std::vector;
 
 namespace {
 
-// Simple wrapper over the output buffer.
+// Simple wrapper over the output buffer. Flipped arrays store rows from top
+// to bottom, i.e., row y is stored at height - 1 - y.
 template <class T>
 struct Array2d {
   T* data;
   const int width, height;
+  const bool flipped = false;
+
+  T* row(int y) const { return data + (flipped ? height - 1 - y : y) * width; }
+};
+
+// Mirrors phyre.vis.WAD_COLORS.
+constexpr uint8_t kWadColors[][3] = {
+    {255, 255, 255},     // White.
+    {0xf3, 0x4f, 0x46},  // Red.
+    {0x6b, 0xce, 0xbb},  // Green.
+    {0x18, 0x77, 0xf2},  // Blue.
+    {0x4b, 0x4a, 0xa4},  // Purple.
+    {0xb9, 0xca, 0xd2},  // Gray.
+    {0, 0, 0},           // Black.
+    {0xfc, 0xdf, 0xe3},  // Light red.
+};
+constexpr int kNumWadColors = sizeof(kWadColors) / sizeof(kWadColors[0]);
+
+// Pixel of an RGB (kChannels = 3) or RGBA (kChannels = 4) image.
+template <int kChannels>
+struct ColorPixel {
+  uint8_t channels[kChannels];
+};
+static_assert(sizeof(ColorPixel<3>) == 3);
+static_assert(sizeof(ColorPixel<4>) == 4);
+
+// Converts color codes to pixels of the buffer, so that the palette lookup
+// happens once per body and not once per pixel.
+template <class T>
+struct PixelTraits {
+  static T fromColor(int color) { return static_cast<T>(color); }
+};
+
+template <int kChannels>
+struct PixelTraits<ColorPixel<kChannels>> {
+  static ColorPixel<kChannels> fromColor(int color) {
+    if (color < 0 || color >= kNumWadColors) {
+      throw std::runtime_error("Unknown color: " + std::to_string(color));
+    }
+    ColorPixel<kChannels> pixel;
+    std::copy_n(kWadColors[color], 3, pixel.channels);
+    if (kChannels == 4) {
+      pixel.channels[3] = 255;
+    }
+    return pixel;
+  }
 };
 
 // ##################
@@ -121,7 +172,7 @@ void fillConvexPoly(const std::vector<Vector>& v, const T color,
     const int leftXInt = std::max<int>(0, std::lrint(leftX));
     const int rightXInt = std::min<int>(width, std::lrint(rightX));
     if (leftXInt < rightXInt) {
-      auto start = array->data + y * width;
+      T* start = array->row(y);
       std::fill(&start[leftXInt], &start[rightXInt], color);
     }
   }
@@ -130,7 +181,7 @@ void fillConvexPoly(const std::vector<Vector>& v, const T color,
 template <class T>
 inline void recomputeLeftRight(const float radius_squared, const int y,
                                const float center_x, const float center_y,
-                               const uint8_t color, int* left, int* right,
+                               const T color, int* left, int* right,
                                Array2d<T>* array) {
   auto sq = [](float x) { return x * x; };
 
@@ -142,13 +193,12 @@ inline void recomputeLeftRight(const float radius_squared, const int y,
   const int right_int = std::min<int>(array->width - 1, *right - 1);
 
   if (left_int <= right_int && 0 <= y && y < array->height) {
-    std::fill_n(array->data + y * array->width + left_int,
-                right_int - left_int + 1, color);
+    std::fill_n(array->row(y) + left_int, right_int - left_int + 1, color);
   }
 }
 
 template <class T>
-void draw_circle(float center_x, float center_y, float radius, uint8_t color,
+void draw_circle(float center_x, float center_y, float radius, const T color,
                  Array2d<T>* array) {
   center_x -= 0.5;
   center_y -= 0.5;
@@ -180,29 +230,50 @@ std::vector<IntVector> filterPointsOutsideCanvass(
   }
   return goodPoints;
 }
+// Draws a single body on top of the array. Bodies with color 0 are skipped.
+template <class T>
+void drawBody(const Body& body, Array2d<T>* array) {
+  if (body.color == 0) {
+    return;
+  }
+  const T color = PixelTraits<T>::fromColor(body.color);
+  for (const ::scene::Shape& shape : body.shapes) {
+    if (shape.__isset.polygon == true) {
+      const auto vertices = getAbsolutePolygon(shape.polygon.vertices,
+                                               body.position, body.angle);
+      fillConvexPoly(vertices, color, array);
+    } else if (shape.__isset.circle == true) {
+      draw_circle(body.position.x, body.position.y, shape.circle.radius,
+                  color, array);
+    } else {
+      // Siliently ignore.
+    }
+  }
+}
+
 // Renders user bodies into an Image.
 template <class T>
 void renderSceneBodies(const std::vector<Body>& bodies, int height, int width,
                        T* data) {
-  std::fill_n(data, width * height, 0);
+  std::fill_n(data, width * height,
+              PixelTraits<T>::fromColor(::shared::Color::WHITE));
   Array2d<T> array = {data, width, height};
-
   for (const Body& body : bodies) {
-    if (body.color == 0) {
-      continue;
-    }
-    const T color = body.color;
-    for (const ::scene::Shape& shape : body.shapes) {
-      if (shape.__isset.polygon == true) {
-        const auto vertices = getAbsolutePolygon(shape.polygon.vertices,
-                                                 body.position, body.angle);
-        fillConvexPoly(vertices, color, &array);
-      } else if (shape.__isset.circle == true) {
-        draw_circle(body.position.x, body.position.y, shape.circle.radius,
-                    color, &array);
-      } else {
-        // Siliently ignore.
-      }
+    drawBody(body, &array);
+  }
+}
+
+// Renders scene bodies followed by user input bodies without copying them
+// into a single list.
+template <class T>
+void renderSceneBodies(const ::scene::Scene& scene, T* data,
+                       bool flipped = false) {
+  std::fill_n(data, scene.width * scene.height,
+              PixelTraits<T>::fromColor(::shared::Color::WHITE));
+  Array2d<T> array = {data, scene.width, scene.height, flipped};
+  for (const auto* bodies : {&scene.bodies, &scene.user_input_bodies}) {
+    for (const Body& body : *bodies) {
+      drawBody(body, &array);
     }
   }
 }
@@ -265,6 +336,440 @@ bool doesPolygonOccludeBody(const ::scene::AbsoluteConvexPolygon& polygon,
   return false;
 }
 
+// ##################
+// Free draw vectorization
+// ##################
+
+// Pixels closer than this to a body are occupied, i.e., every pixel that
+// touches a body is occupied.
+constexpr int kOcclusionMarginPixels = 1;
+// Additional gap between drawn objects and bodies if keepSpaceAroundBodies is
+// set.
+constexpr int kSpaceAroundBodiesPixels = 1;
+// Maximum distance between a contour and its simplification.
+constexpr float kContourTolerancePixels = 1.0;
+// Maximum relative difference between the area of a contour and the total
+// area of its convex decomposition.
+constexpr float kDecompositionAreaTolerance = 1e-3;
+
+// Pixels covered by bodies in the free draw canvas.
+class OccupancyMask {
+ public:
+  // Pixels within margin pixels of the bodies are occupied.
+  OccupancyMask(std::initializer_list<const std::vector<Body>*> bodyLists,
+                int margin, int height, int width)
+      : values_(height * width, 0),
+        height_(height),
+        width_(width),
+        margin_(margin) {
+    Array2d<uint8_t> mask = {values_.data(), width, height};
+    for (const auto* bodies : bodyLists) {
+      markBodies(*bodies, &mask);
+    }
+  }
+
+  // Checks the neighbourhood of the pixel instead of dilating the whole
+  // canvas, as only a few pixels are ever queried. Pixels outside of the
+  // canvas are free.
+  bool isOccupied(int x, int y) const {
+    if (x < 0 || x >= width_ || y < 0 || y >= height_) {
+      return false;
+    }
+    const int endX = std::min(width_ - 1, x + margin_);
+    const int endY = std::min(height_ - 1, y + margin_);
+    for (int nearY = std::max(0, y - margin_); nearY <= endY; ++nearY) {
+      for (int nearX = std::max(0, x - margin_); nearX <= endX; ++nearX) {
+        if (values_[nearY * width_ + nearX] == kBodyPixel) {
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  // Appends the first occurrence of every point that is not occupied to
+  // cleanPoints. The points must be inside the canvas. Returns false if some
+  // points were occupied.
+  bool removeOccupiedPoints(const std::vector<IntVector>& points,
+                            std::vector<IntVector>* cleanPoints) {
+    bool good = true;
+    for (const IntVector& p : points) {
+      uint8_t& pixel = values_[p.y * width_ + p.x];
+      if (pixel == kPointPixel) {
+        continue;
+      }
+      if (pixel == kBodyPixel || isOccupied(p.x, p.y)) {
+        good = false;
+      } else {
+        pixel = kPointPixel;
+        cleanPoints->push_back(p);
+      }
+    }
+    return good;
+  }
+
+ private:
+  static constexpr uint8_t kBodyPixel = 1;
+  static constexpr uint8_t kPointPixel = 2;
+
+  // Marks all pixels covered by any shape of the bodies regardless of color.
+  // Pixels with polygon vertices are marked as well so that bodies thinner
+  // than a pixel are not missed.
+  static void markBodies(const std::vector<Body>& bodies,
+                         Array2d<uint8_t>* mask) {
+    for (const Body& body : bodies) {
+      for (const ::scene::Shape& shape : body.shapes) {
+        if (shape.__isset.polygon == true) {
+          const auto vertices = getAbsolutePolygon(shape.polygon.vertices,
+                                                   body.position, body.angle);
+          fillConvexPoly(vertices, kBodyPixel, mask);
+          for (const ::scene::Vector& v : vertices) {
+            const int x = std::floor(v.x), y = std::floor(v.y);
+            if (x >= 0 && x < mask->width && y >= 0 && y < mask->height) {
+              mask->data[y * mask->width + x] = kBodyPixel;
+            }
+          }
+        } else if (shape.__isset.circle == true) {
+          draw_circle(body.position.x, body.position.y, shape.circle.radius,
+                      kBodyPixel, mask);
+        }
+      }
+    }
+  }
+
+  std::vector<uint8_t> values_;
+  const int height_, width_, margin_;
+};
+
+// Groups unique points into 8-connected components. Components are ordered
+// by their first point and at most maxComponents are returned.
+std::vector<std::vector<IntVector>> getConnectedComponents(
+    const std::vector<IntVector>& points, int height, int width,
+    size_t maxComponents) {
+  std::vector<uint8_t> pending(height * width, 0);
+  for (const IntVector& p : points) {
+    pending[p.y * width + p.x] = 1;
+  }
+  std::vector<std::vector<IntVector>> components;
+  for (const IntVector& start : points) {
+    if (pending[start.y * width + start.x] == 0) {
+      continue;
+    }
+    if (components.size() == maxComponents) {
+      break;
+    }
+    pending[start.y * width + start.x] = 0;
+    components.emplace_back(1, start);
+    std::vector<IntVector>& component = components.back();
+    // The component doubles as the queue of the breadth first search.
+    for (size_t i = 0; i < component.size(); ++i) {
+      const int x0 = component[i].x, y0 = component[i].y;
+      for (int y = std::max(0, y0 - 1); y <= std::min(height - 1, y0 + 1);
+           ++y) {
+        for (int x = std::max(0, x0 - 1); x <= std::min(width - 1, x0 + 1);
+             ++x) {
+          if (pending[y * width + x] != 0) {
+            pending[y * width + x] = 0;
+            component.push_back(getIntVector(x, y));
+          }
+        }
+      }
+    }
+  }
+  return components;
+}
+
+// Binary image of a single component with a border of empty pixels.
+class ComponentGrid {
+ public:
+  explicit ComponentGrid(const std::vector<IntVector>& pixels) {
+    int minX = pixels[0].x, maxX = pixels[0].x;
+    int minY = pixels[0].y, maxY = pixels[0].y;
+    for (const IntVector& p : pixels) {
+      minX = std::min(minX, p.x);
+      maxX = std::max(maxX, p.x);
+      minY = std::min(minY, p.y);
+      maxY = std::max(maxY, p.y);
+    }
+    x0 = minX - 1;
+    y0 = minY - 1;
+    width = maxX - minX + 3;
+    height = maxY - minY + 3;
+    values.assign(width * height, 0);
+    for (const IntVector& p : pixels) {
+      values[(p.y - y0) * width + p.x - x0] = 1;
+    }
+  }
+
+  // Coordinates are relative to the grid.
+  bool get(int x, int y) const {
+    return x >= 0 && x < width && y >= 0 && y < height &&
+           values[y * width + x] != 0;
+  }
+
+  // Removes pinches, i.e., 2x2 blocks where only diagonal pixels are set, by
+  // setting one more pixel in each of them. Free pixels are preferred to
+  // occupied ones. Afterwards the component is 4-connected and its outer
+  // boundary is a simple polygon.
+  void closePinches(const OccupancyMask& occupancy) {
+    auto isFree = [&](int x, int y) {
+      return !occupancy.isOccupied(x + x0, y + y0);
+    };
+    for (bool changed = true; changed;) {
+      changed = false;
+      for (int y = 0; y + 1 < height; ++y) {
+        for (int x = 0; x + 1 < width; ++x) {
+          const bool bottomLeft = get(x, y), bottomRight = get(x + 1, y);
+          const bool topLeft = get(x, y + 1), topRight = get(x + 1, y + 1);
+          if (bottomLeft == topRight && bottomRight == topLeft &&
+              bottomLeft != bottomRight) {
+            // Candidates are the two empty pixels of the block.
+            const int firstX = bottomLeft ? x + 1 : x;
+            const int secondX = bottomLeft ? x : x + 1;
+            if (isFree(firstX, y) || !isFree(secondX, y + 1)) {
+              values[y * width + firstX] = 1;
+            } else {
+              values[(y + 1) * width + secondX] = 1;
+            }
+            changed = true;
+          }
+        }
+      }
+    }
+  }
+
+  // Follows the outer boundary along pixel edges with the component on the
+  // left and returns its corners in absolute coordinates in counter-clockwise
+  // order. Holes are ignored.
+  std::vector<::scene::Vector> traceOuterContour() const {
+    // Directions in counter-clockwise order: right, up, left, down.
+    static constexpr int kDx[] = {1, 0, -1, 0};
+    static constexpr int kDy[] = {0, 1, 0, -1};
+    // The bottom left corner of the lowest leftmost pixel is a corner of the
+    // outer boundary with the boundary going right.
+    int startX = 0, startY = 0;
+    for (int i = 0; i < width * height; ++i) {
+      if (values[i] != 0) {
+        startX = i % width;
+        startY = i / width;
+        break;
+      }
+    }
+    std::vector<::scene::Vector> contour;
+    contour.push_back(getVector(startX + x0, startY + y0));
+    int x = startX, y = startY, direction = 0;
+    while (true) {
+      x += kDx[direction];
+      y += kDy[direction];
+      if (x == startX && y == startY) {
+        break;
+      }
+      // Pixels ahead of the corner on the left and on the right of the
+      // current direction.
+      const int left = (direction + 1) % 4;
+      const bool leftAhead =
+          get(x + ((kDx[direction] + kDx[left] - 1) >> 1),
+              y + ((kDy[direction] + kDy[left] - 1) >> 1));
+      const bool rightAhead =
+          get(x + ((kDx[direction] - kDx[left] - 1) >> 1),
+              y + ((kDy[direction] - kDy[left] - 1) >> 1));
+      int next = direction;
+      if (!leftAhead) {
+        next = left;
+      } else if (rightAhead) {
+        next = (direction + 3) % 4;
+      }
+      if (next != direction) {
+        contour.push_back(getVector(x + x0, y + y0));
+        direction = next;
+      }
+    }
+    return contour;
+  }
+
+ private:
+  int x0, y0, width, height;
+  std::vector<uint8_t> values;
+};
+
+template <class Point>
+float getSignedArea(const std::vector<Point>& polygon) {
+  float area = 0;
+  for (size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++) {
+    area += polygon[j].x * polygon[i].y - polygon[i].x * polygon[j].y;
+  }
+  return area / 2;
+}
+
+// Douglas-Peucker simplification of the chain points[first..last].
+void markSimplifiedChain(const std::vector<::scene::Vector>& points,
+                         size_t first, size_t last, float squareTolerance,
+                         std::vector<bool>* keep) {
+  float maxSquareDistance = 0;
+  size_t farthest = first;
+  for (size_t i = first + 1; i < last; ++i) {
+    const float squareDistance = geometry::squareDistanceToSegment(
+        points[first], points[last], points[i]);
+    if (squareDistance > maxSquareDistance) {
+      maxSquareDistance = squareDistance;
+      farthest = i;
+    }
+  }
+  if (maxSquareDistance > squareTolerance) {
+    (*keep)[farthest] = true;
+    markSimplifiedChain(points, first, farthest, squareTolerance, keep);
+    markSimplifiedChain(points, farthest, last, squareTolerance, keep);
+  }
+}
+
+// Simplifies a closed contour so that no removed corner is further than
+// tolerance from the result.
+std::vector<::scene::Vector> simplifyContour(
+    const std::vector<::scene::Vector>& contour, float tolerance) {
+  if (tolerance <= 0 || contour.size() <= 4) {
+    return contour;
+  }
+  // Split the contour into two chains at the corner farthest from the first.
+  size_t farthest = 0;
+  for (size_t i = 1; i < contour.size(); ++i) {
+    if (geometry::squareDistance(contour[0], contour[i]) >
+        geometry::squareDistance(contour[0], contour[farthest])) {
+      farthest = i;
+    }
+  }
+  std::vector<::scene::Vector> closed(contour);
+  closed.push_back(contour[0]);
+  std::vector<bool> keep(closed.size(), false);
+  keep[0] = keep[farthest] = true;
+  const float squareTolerance = tolerance * tolerance;
+  markSimplifiedChain(closed, 0, farthest, squareTolerance, &keep);
+  markSimplifiedChain(closed, farthest, contour.size(), squareTolerance,
+                      &keep);
+  std::vector<::scene::Vector> simplified;
+  for (size_t i = 0; i < contour.size(); ++i) {
+    if (keep[i]) {
+      simplified.push_back(contour[i]);
+    }
+  }
+  if (simplified.size() < 3) {
+    return contour;
+  }
+  return simplified;
+}
+
+// Splits a simple polygon into counter-clockwise convex polygons that Box2D
+// accepts. Returns false if the polygon could not be decomposed completely.
+bool decomposeIntoConvexPolygons(
+    const std::vector<::scene::Vector>& polygon,
+    std::vector<std::vector<::scene::Vector>>* pieces) {
+  std::vector<float32> xs, ys;
+  xs.reserve(polygon.size());
+  ys.reserve(polygon.size());
+  for (const ::scene::Vector& v : polygon) {
+    xs.push_back(v.x);
+    ys.push_back(v.y);
+  }
+  b2Polygon input(xs.data(), ys.data(), polygon.size());
+  // A triangulation has at most n - 2 triangles.
+  std::vector<b2Polygon> results(polygon.size());
+  const int32 numResults =
+      DecomposeConvex(&input, results.data(), results.size());
+  if (numResults <= 0) {
+    return false;
+  }
+  // The triangulation may stop early on degenerate input.
+  float totalArea = 0;
+  for (int32 i = 0; i < numResults; ++i) {
+    std::vector<::scene::Vector> piece;
+    piece.reserve(results[i].nVertices);
+    for (int32 j = 0; j < results[i].nVertices; ++j) {
+      piece.push_back(getVector(results[i].x[j], results[i].y[j]));
+    }
+    float area = getSignedArea(piece);
+    if (area < 0) {
+      std::reverse(piece.begin(), piece.end());
+      area = -area;
+    }
+    totalArea += area;
+    pieces->push_back(std::move(piece));
+  }
+  const float expectedArea = std::abs(getSignedArea(polygon));
+  return std::abs(totalArea - expectedArea) <=
+         kDecompositionAreaTolerance * expectedArea;
+}
+
+bool doPolygonsOccludeBodies(
+    const std::vector<std::vector<::scene::Vector>>& polygons,
+    std::initializer_list<const std::vector<Body>*> bodyLists) {
+  for (const auto& vertices : polygons) {
+    double minX = vertices[0].x, maxX = vertices[0].x;
+    double minY = vertices[0].y, maxY = vertices[0].y;
+    for (const ::scene::Vector& v : vertices) {
+      minX = std::min(minX, v.x);
+      maxX = std::max(maxX, v.x);
+      minY = std::min(minY, v.y);
+      maxY = std::max(maxY, v.y);
+    }
+    ::scene::AbsoluteConvexPolygon polygon;
+    polygon.__set_vertices(vertices);
+    for (const auto* bodies : bodyLists) {
+      for (const Body& body : *bodies) {
+        // Cheap rejection with the bounding circle of the body.
+        double radius = 0;
+        for (const ::scene::Shape& shape : body.shapes) {
+          if (shape.__isset.polygon == true) {
+            for (const ::scene::Vector& v : shape.polygon.vertices) {
+              radius = std::max(radius, std::hypot(v.x, v.y));
+            }
+          } else if (shape.__isset.circle == true) {
+            radius = std::max(radius, shape.circle.radius);
+          }
+        }
+        const double dx =
+            std::max({minX - body.position.x, body.position.x - maxX, 0.});
+        const double dy =
+            std::max({minY - body.position.y, body.position.y - maxY, 0.});
+        if (dx * dx + dy * dy > radius * radius) {
+          continue;
+        }
+        if (doesPolygonOccludeBody(polygon, body)) {
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+// Builds a single body from convex polygons in absolute coordinates. The body
+// is positioned at the mean of all vertices.
+Body buildCompoundPolygonBody(
+    const std::vector<std::vector<::scene::Vector>>& polygons) {
+  double centerX = 0, centerY = 0;
+  int numVertices = 0;
+  for (const auto& polygon : polygons) {
+    for (const ::scene::Vector& v : polygon) {
+      centerX += v.x;
+      centerY += v.y;
+      ++numVertices;
+    }
+  }
+  centerX /= numVertices;
+  centerY /= numVertices;
+  std::vector<::scene::Shape> shapes(polygons.size());
+  for (size_t i = 0; i < polygons.size(); ++i) {
+    ::scene::Polygon relativePolygon;
+    for (const ::scene::Vector& v : polygons[i]) {
+      relativePolygon.vertices.push_back(
+          getVector(v.x - centerX, v.y - centerY));
+    }
+    shapes[i].__set_polygon(relativePolygon);
+  }
+  Body body = buildPolygon(centerX, centerY, shapes[0].polygon.vertices);
+  body.__set_shapes(shapes);
+  return body;
+}
+
 }  // namespace
 
 ::scene::Image render(const std::vector<Body>& sceneBodies, const int height,
@@ -279,17 +784,106 @@ bool doesPolygonOccludeBody(const ::scene::AbsoluteConvexPolygon& polygon,
 }
 
 ::scene::Image render(const ::scene::Scene& scene) {
-  std::vector<Body> bodies = scene.bodies;
-  bodies.insert(bodies.end(), scene.user_input_bodies.begin(),
-                scene.user_input_bodies.end());
-  return render(bodies, scene.height, scene.width);
+  ::scene::Image result;
+  result.__set_height(scene.height);
+  result.__set_width(scene.width);
+  result.values.resize(scene.width * scene.height);
+  renderSceneBodies(scene, result.values.data());
+  result.__isset.values = true;
+  return result;
 }
 
 void renderTo(const ::scene::Scene& scene, uint8_t* buffer) {
-  std::vector<Body> bodies = scene.bodies;
-  bodies.insert(bodies.end(), scene.user_input_bodies.begin(),
-                scene.user_input_bodies.end());
-  renderSceneBodies(bodies, scene.height, scene.width, buffer);
+  renderSceneBodies(scene, buffer);
+}
+
+void renderRgbTo(const ::scene::Scene& scene, int numChannels,
+                 uint8_t* buffer) {
+  if (numChannels == 3) {
+    renderSceneBodies(scene, reinterpret_cast<ColorPixel<3>*>(buffer),
+                      /*flipped=*/true);
+  } else if (numChannels == 4) {
+    renderSceneBodies(scene, reinterpret_cast<ColorPixel<4>*>(buffer),
+                      /*flipped=*/true);
+  } else {
+    throw std::runtime_error("Expected 3 or 4 channels, got " +
+                             std::to_string(numChannels));
+  }
+}
+
+void renderObjectMasksTo(const ::scene::Scene& scene, uint8_t* buffer) {
+  const int imageSize = scene.width * scene.height;
+  std::fill_n(buffer, imageSize * getNumObjectsInScene(scene), 0);
+  int currentObjectIndex = 0;
+  for (const auto* bodies : {&scene.bodies, &scene.user_input_bodies}) {
+    for (const Body& body : *bodies) {
+      if (body.shapeType == ::scene::ShapeType::UNDEFINED) {
+        continue;
+      }
+      // Each body is drawn directly into its own mask.
+      Array2d<uint8_t> mask = {buffer + currentObjectIndex * imageSize,
+                               scene.width, scene.height};
+      drawBody(body, &mask);
+      currentObjectIndex++;
+    }
+  }
+}
+
+void packMaskBits(const uint8_t* mask, const int size, uint8_t* buffer) {
+  const int numFullBytes = size / 8;
+  for (int i = 0; i < numFullBytes; ++i, mask += 8) {
+    buffer[i] = (mask[0] != 0) << 7 | (mask[1] != 0) << 6 |
+                (mask[2] != 0) << 5 | (mask[3] != 0) << 4 |
+                (mask[4] != 0) << 3 | (mask[5] != 0) << 2 |
+                (mask[6] != 0) << 1 | (mask[7] != 0);
+  }
+  if (size % 8 != 0) {
+    uint8_t last = 0;
+    for (int bit = 0; bit < size % 8; ++bit) {
+      last |= (mask[bit] != 0) << (7 - bit);
+    }
+    buffer[numFullBytes] = last;
+  }
+}
+
+MaskBox getMaskBoundingBox(const uint8_t* mask, const int height,
+                           const int width) {
+  int minRow = height, maxRow = -1, minColumn = width, maxColumn = -1;
+  for (int row = 0; row < height; ++row) {
+    const uint8_t* line = mask + row * width;
+    int first = 0;
+    while (first < width && line[first] == 0) {
+      ++first;
+    }
+    if (first == width) {
+      continue;
+    }
+    int last = width - 1;
+    while (line[last] == 0) {
+      --last;
+    }
+    minRow = std::min(minRow, row);
+    maxRow = row;
+    minColumn = std::min(minColumn, first);
+    maxColumn = std::max(maxColumn, last);
+  }
+  if (maxRow < 0) {
+    return MaskBox{0, 0, 0, 0};
+  }
+  return MaskBox{minRow, minColumn, maxRow - minRow + 1,
+                 maxColumn - minColumn + 1};
+}
+
+int getNumObjectsInScene(const ::scene::Scene& scene) {
+  int numObjects = 0;
+  for (const auto* bodies : {&scene.bodies, &scene.user_input_bodies}) {
+    for (const Body& body : *bodies) {
+      if (body.shapeType != ::scene::ShapeType::UNDEFINED) {
+        ++numObjects;
+      }
+    }
+  }
+  return numObjects;
 }
 
 bool isPointInsideBody(const ::scene::Vector& pPoint, const Body& pBody) {
@@ -388,27 +982,92 @@ bool mergeUserInputIntoScene(const ::scene::UserInput& userInput,
       filterPointsOutsideCanvass(input_points, height, width);
   good = good && (goodInputPoints.size() == input_points.size());
 
-  // TODO: re-implement free draw input without opencv.
+  // Balls and polygons added above are treated as scene bodies.
+  const int margin = kOcclusionMarginPixels +
+                     (keepSpaceAroundBodies ? kSpaceAroundBodiesPixels : 0);
+  const std::vector<Body> noBodies;
+  const std::vector<Body>& obstacles = allowOcclusions ? noBodies : sceneBodies;
+  const std::vector<Body>& addedBodies = allowOcclusions ? noBodies : *bodies;
+  OccupancyMask occupancy({&obstacles, &addedBodies}, margin, height, width);
+  std::vector<IntVector> cleanPoints;
+  good = occupancy.removeOccupiedPoints(goodInputPoints, &cleanPoints) && good;
+
+  const auto components =
+      getConnectedComponents(cleanPoints, height, width, kMaxUserObjects);
+  size_t numComponentPoints = 0;
+  for (const auto& component : components) {
+    numComponentPoints += component.size();
+  }
+  good = good && (numComponentPoints == cleanPoints.size());
+
+  for (const auto& component : components) {
+    ComponentGrid grid(component);
+    grid.closePinches(occupancy);
+    const std::vector<::scene::Vector> contour = grid.traceOuterContour();
+    // Prefer the simplified contour, but fall back to the exact one if the
+    // simplification cannot be decomposed or cuts into other bodies.
+    std::vector<std::vector<::scene::Vector>> polygons;
+    bool decomposed = false, occludes = false;
+    for (const float tolerance : {kContourTolerancePixels, 0.f}) {
+      polygons.clear();
+      if (!decomposeIntoConvexPolygons(simplifyContour(contour, tolerance),
+                                       &polygons)) {
+        continue;
+      }
+      decomposed = true;
+      occludes = doPolygonsOccludeBodies(polygons, {&sceneBodies, bodies});
+      if (!occludes) {
+        break;
+      }
+    }
+    if (!decomposed) {
+      good = false;
+      continue;
+    }
+    if (occludes) {
+      good = false;
+      if (!allowOcclusions) {
+        continue;
+      }
+    }
+    bodies->push_back(buildCompoundPolygonBody(polygons));
+  }
   return good;
 }
 
+void addUserInputToScene(const ::scene::UserInput& userInput,
+                         bool keepSpaceAroundBodies, bool allowOcclusions,
+                         ::scene::Scene* scene) {
+  std::vector<Body> userInputBodies;
+  const bool good = mergeUserInputIntoScene(
+      userInput, scene->bodies, keepSpaceAroundBodies, allowOcclusions,
+      scene->height, scene->width, &userInputBodies);
+  scene->__set_user_input_status(
+      good ? ::scene::UserInputStatus::NO_OCCLUSIONS
+           : ::scene::UserInputStatus::HAD_OCCLUSIONS);
+  scene->user_input_bodies = std::move(userInputBodies);
+  scene->__isset.user_input_bodies = true;
+}
+
 vector<IntVector> cleanUpPoints(const vector<IntVector>& input_points,
                                 const vector<Body>& sceneBodies,
                                 const unsigned height, const unsigned width) {
-  // TODO: re-implement without opencv.
+  OccupancyMask occupancy({&sceneBodies}, kOcclusionMarginPixels, height,
+                          width);
   vector<IntVector> points;
+  occupancy.removeOccupiedPoints(
+      filterPointsOutsideCanvass(input_points, height, width), &points);
   return points;
 }
 
 void featurizeScene(const ::scene::Scene& scene, float* buffer) {
   int writeIndex = 0;
-  std::vector<Body> bodies = scene.bodies;
-  bodies.insert(bodies.end(), scene.user_input_bodies.begin(),
-                scene.user_input_bodies.end());
-  for (const Body& body : bodies) {
-    if (body.shapeType != ::scene::ShapeType::UNDEFINED) {
-      featurizeBody(body, scene.height, scene.width, buffer + writeIndex);
-      writeIndex += kObjectFeatureSize;
+  for (const auto* bodies : {&scene.bodies, &scene.user_input_bodies}) {
+    for (const Body& body : *bodies) {
+      if (body.shapeType != ::scene::ShapeType::UNDEFINED) {
+        featurizeBody(body, scene.height, scene.width, buffer + writeIndex);
+        writeIndex += kObjectFeatureSize;
+      }
     }
   }
 }
@@ -14,11 +14,15 @@
 #ifndef IMAGE_TO_BOX2D_H
 #define IMAGE_TO_BOX2D_H
 
+#include <cstddef>
 #include <utility>
 #include <vector>
 
 #include "gen-cpp/scene_types.h"
 
+// Maximum number of objects created from points of a single user input.
+constexpr size_t kMaxUserObjects = 10;
+
 // Clean user input and convert to a list of Body objects.
 // Balls are added first as is if they don't occlude with sceneBodies.
 // Polygons are added as is if they don't occlude with sceneBodies and balls
@@ -26,9 +30,13 @@
 // Points are cleaned, vectorized and then added.
 // Several steps of clearning are performed:
 // - points outside of scene are removed;
-// - points that are inside or close to the sceneBodies are removed;
-// - points at the top of the very top of  scene are removed;
+// - unless allowOcclusions is set, points that touch sceneBodies, balls or
+//   polygons are removed. If keepSpaceAroundBodies is set, points next to
+//   them are removed as well;
 // - only points within kMaxUserObjects first connected components are kept.
+// Each 8-connected component of the remaining points becomes a single body
+// whose shapes are a convex decomposition of the outline of the component.
+// Holes in components are filled.
 // Returns true if all objects and points were converted, and false if some
 // objects or points were removed.
 bool mergeUserInputIntoScene(const ::scene::UserInput& userInput,
@@ -61,6 +69,13 @@ inline std::vector<::scene::Body> mergeUserInputIntoScene(
                                  allowOcclusions, height, width);
 }
 
+// Converts user input into bodies and stores them in scene->user_input_bodies.
+// scene->user_input_status is set to HAD_OCCLUSIONS if some of the input was
+// dropped.
+void addUserInputToScene(const ::scene::UserInput& userInput,
+                         bool keepSpaceAroundBodies, bool allowOcclusions,
+                         ::scene::Scene* scene);
+
 ::scene::Image render(const std::vector<::scene::Body>& sceneBodies,
                       const int height, const int width);
 
@@ -71,10 +86,44 @@ inline std::vector<::scene::Body> mergeUserInputIntoScene(
 // least scene.width * scene.height elements.
 void renderTo(const ::scene::Scene& scene, uint8_t* buffer);
 
+// Renders scene and user bodies from the scene into an RGB (numChannels = 3)
+// or RGBA (numChannels = 4) image with the colors of phyre.vis.WAD_COLORS.
+// Rows are stored from top to bottom, so the image is the same as
+// phyre.vis.observations_to_uint8_rgb of the image from renderTo. The buffer
+// has to have at least scene.width * scene.height * numChannels elements.
+void renderRgbTo(const ::scene::Scene& scene, int numChannels,
+                 uint8_t* buffer);
+
+// Renders each object of the scene into a separate image. Objects are ordered
+// as in featurizeScene. The buffer has to have at least
+// getNumObjectsInScene(scene) * scene.width * scene.height elements.
+void renderObjectMasksTo(const ::scene::Scene& scene, uint8_t* buffer);
+
+// Packs non-zero pixels of a mask with size elements into (size + 7) / 8
+// bytes. Bits are stored most significant first, i.e., the layout of
+// numpy.packbits.
+void packMaskBits(const uint8_t* mask, const int size, uint8_t* buffer);
+
+// Tight bounding box of non-zero pixels of a mask in buffer coordinates.
+// Empty masks have zero height and width.
+struct MaskBox {
+  int row;
+  int column;
+  int height;
+  int width;
+};
+MaskBox getMaskBoundingBox(const uint8_t* mask, const int height,
+                           const int width);
+
+// Number of scene and user bodies that have a defined shape type, i.e., the
+// number of objects produced by featurizeScene.
+int getNumObjectsInScene(const ::scene::Scene& scene);
+
 bool isPointInsideBody(const ::scene::Vector& pPoint,
                        const ::scene::Body& pBody);
 
-// Exposed for testing. Removes points that occludes with bodies in the scene.
+// Exposed for testing. Removes points that are outside of the canvas or touch
+// bodies in the scene, and duplicate points.
 std::vector<::scene::IntVector> cleanUpPoints(
     const std::vector<::scene::IntVector>& input_points,
     const std::vector<::scene::Body>& sceneBodies, const unsigned height,
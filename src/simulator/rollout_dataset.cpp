@@ -0,0 +1,378 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "rollout_dataset.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+
+#include "image_to_box2d.h"
+#include "task_utils.h"
+
+namespace {
+
+constexpr size_t kColumnAlignment = 8;
+
+// Appends an integer, enum or float as little-endian regardless of the host.
+template <class T>
+void appendLittleEndian(std::vector<uint8_t>* blob, const T& value) {
+  uint64_t bits;
+  if constexpr (std::is_floating_point_v<T>) {
+    static_assert(sizeof(T) == sizeof(uint32_t));
+    uint32_t floatBits;
+    std::memcpy(&floatBits, &value, sizeof(floatBits));
+    bits = floatBits;
+  } else {
+    bits = static_cast<uint64_t>(value);
+  }
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    blob->push_back(static_cast<uint8_t>(bits >> (8 * i)));
+  }
+}
+
+template <class T>
+T readLittleEndian(const uint8_t* data) {
+  uint64_t bits = 0;
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    bits |= static_cast<uint64_t>(data[i]) << (8 * i);
+  }
+  return static_cast<T>(bits);
+}
+
+template <class T>
+std::vector<uint8_t> rleEncodeImpl(const T* data, size_t size) {
+  std::vector<uint32_t> lengths;
+  std::vector<T> values;
+  for (size_t i = 0; i < size; ++i) {
+    if (!values.empty() && values.back() == data[i] &&
+        lengths.back() != UINT32_MAX) {
+      ++lengths.back();
+    } else {
+      values.push_back(data[i]);
+      lengths.push_back(1);
+    }
+  }
+  std::vector<uint8_t> blob;
+  blob.reserve(sizeof(uint64_t) +
+               lengths.size() * (sizeof(uint32_t) + sizeof(T)));
+  appendLittleEndian(&blob, static_cast<uint64_t>(lengths.size()));
+  for (const uint32_t length : lengths) {
+    appendLittleEndian(&blob, length);
+  }
+  for (const T& value : values) {
+    appendLittleEndian(&blob, value);
+  }
+  return blob;
+}
+
+template <class T>
+std::vector<T> rleDecodeImpl(const std::vector<uint8_t>& blob) {
+  if (blob.size() < sizeof(uint64_t)) {
+    throw std::runtime_error("Truncated RLE blob");
+  }
+  const uint64_t numRuns = readLittleEndian<uint64_t>(blob.data());
+  if (blob.size() !=
+      sizeof(uint64_t) + numRuns * (sizeof(uint32_t) + sizeof(T))) {
+    throw std::runtime_error("Malformed RLE blob");
+  }
+  const uint8_t* lengths = blob.data() + sizeof(uint64_t);
+  const uint8_t* values = lengths + numRuns * sizeof(uint32_t);
+  std::vector<T> result;
+  for (uint64_t i = 0; i < numRuns; ++i) {
+    const uint32_t length =
+        readLittleEndian<uint32_t>(lengths + i * sizeof(uint32_t));
+    const T value = readLittleEndian<T>(values + i * sizeof(T));
+    result.insert(result.end(), length, value);
+  }
+  return result;
+}
+
+void resizeNearest(const uint8_t* src, int srcHeight, int srcWidth,
+                   uint8_t* dst, int dstHeight, int dstWidth) {
+  for (int y = 0; y < dstHeight; ++y) {
+    const uint8_t* srcRow =
+        src + static_cast<size_t>((2 * y + 1) * srcHeight / (2 * dstHeight)) *
+                  srcWidth;
+    for (int x = 0; x < dstWidth; ++x) {
+      dst[y * dstWidth + x] = srcRow[(2 * x + 1) * srcWidth / (2 * dstWidth)];
+    }
+  }
+}
+
+// Returns numFrames frames of `channels` planes each, where render(i, buffer)
+// draws frame i at the scene resolution. Planes are resized to height x width
+// if needed.
+template <class RenderFn>
+std::vector<uint8_t> renderFrames(int numFrames, int channels, int height,
+                                  int width, int sceneHeight, int sceneWidth,
+                                  RenderFn render) {
+  const size_t planeSize = static_cast<size_t>(height) * width;
+  std::vector<uint8_t> pixels(planeSize * channels * numFrames);
+  if (height == sceneHeight && width == sceneWidth) {
+    for (int i = 0; i < numFrames; ++i) {
+      render(i, pixels.data() + i * channels * planeSize);
+    }
+    return pixels;
+  }
+  const size_t scenePlaneSize = static_cast<size_t>(sceneHeight) * sceneWidth;
+  std::vector<uint8_t> fullPixels(scenePlaneSize * channels);
+  for (int i = 0; i < numFrames; ++i) {
+    render(i, fullPixels.data());
+    for (int c = 0; c < channels; ++c) {
+      resizeNearest(fullPixels.data() + c * scenePlaneSize, sceneHeight,
+                    sceneWidth, pixels.data() + (i * channels + c) * planeSize,
+                    height, width);
+    }
+  }
+  return pixels;
+}
+
+}  // namespace
+
+std::vector<uint8_t> rleEncode(const uint8_t* data, size_t size) {
+  return rleEncodeImpl(data, size);
+}
+
+std::vector<uint8_t> rleEncode(const uint32_t* data, size_t size) {
+  return rleEncodeImpl(data, size);
+}
+
+std::vector<uint8_t> rleDecodeUint8(const std::vector<uint8_t>& blob) {
+  return rleDecodeImpl<uint8_t>(blob);
+}
+
+std::vector<uint32_t> rleDecodeUint32(const std::vector<uint8_t>& blob) {
+  return rleDecodeImpl<uint32_t>(blob);
+}
+
+std::vector<uint8_t> deltaEncodeFeatures(const float* data, int numFrames,
+                                         int numObjects) {
+  const size_t numSeries = static_cast<size_t>(numObjects) * kObjectFeatureSize;
+  std::vector<uint32_t> deltas(numSeries * numFrames);
+  for (size_t series = 0; series < numSeries; ++series) {
+    uint32_t previous = 0;
+    for (int frame = 0; frame < numFrames; ++frame) {
+      uint32_t current;
+      std::memcpy(&current, data + frame * numSeries + series, sizeof(current));
+      deltas[series * numFrames + frame] = current - previous;
+      previous = current;
+    }
+  }
+  return rleEncode(deltas.data(), deltas.size());
+}
+
+std::vector<float> deltaDecodeFeatures(const std::vector<uint8_t>& blob,
+                                       int numFrames, int numObjects) {
+  const size_t numSeries = static_cast<size_t>(numObjects) * kObjectFeatureSize;
+  const std::vector<uint32_t> deltas = rleDecodeUint32(blob);
+  if (deltas.size() != numSeries * numFrames) {
+    throw std::runtime_error("Delta blob does not match the rollout shape");
+  }
+  std::vector<float> features(deltas.size());
+  for (size_t series = 0; series < numSeries; ++series) {
+    uint32_t current = 0;
+    for (int frame = 0; frame < numFrames; ++frame) {
+      current += deltas[series * numFrames + frame];
+      std::memcpy(&features[frame * numSeries + series], &current,
+                  sizeof(current));
+    }
+  }
+  return features;
+}
+
+RolloutDatasetWriter::RolloutDatasetWriter(
+    const std::string& path, const RolloutDatasetOptions& options)
+    : options_(options), out_(path, std::ios::binary | std::ios::trunc) {
+  if (!out_) {
+    throw std::runtime_error("Cannot open rollout dataset for writing: " +
+                             path);
+  }
+  if (options_.resolution < 0) {
+    throw std::runtime_error("Resolution must be non-negative");
+  }
+  if (options_.images == ColumnCodec::DELTA ||
+      options_.objectMasks == ColumnCodec::DELTA) {
+    throw std::runtime_error("DELTA codec is only supported for features");
+  }
+  std::vector<uint8_t> header(kRolloutDatasetMagic,
+                              kRolloutDatasetMagic +
+                                  sizeof(kRolloutDatasetMagic));
+  appendLittleEndian(&header, kRolloutDatasetVersion);
+  appendLittleEndian(&header, static_cast<uint32_t>(0));  // Reserved.
+  writeBytes(header.data(), header.size());
+}
+
+RolloutDatasetWriter::~RolloutDatasetWriter() {
+  if (!closed_) {
+    try {
+      close();
+    } catch (const std::exception&) {
+      // Destructors must not throw. Call close() explicitly to see errors.
+    }
+  }
+}
+
+void RolloutDatasetWriter::writeBytes(const void* data, size_t size) {
+  out_.write(reinterpret_cast<const char*>(data), size);
+  if (!out_) {
+    throw std::runtime_error("Failed to write rollout dataset");
+  }
+  offset_ += size;
+}
+
+RolloutDatasetWriter::ColumnEntry RolloutDatasetWriter::writeColumn(
+    RolloutColumn column, ColumnCodec codec, const std::vector<uint8_t>& blob) {
+  static const char kPadding[kColumnAlignment] = {0};
+  writeBytes(kPadding, (kColumnAlignment - offset_ % kColumnAlignment) %
+                           kColumnAlignment);
+  ColumnEntry entry{column, codec, offset_, blob.size()};
+  writeBytes(blob.data(), blob.size());
+  return entry;
+}
+
+void RolloutDatasetWriter::addSimulation(
+    const std::string& taskId, int actionIndex,
+    const ::task::TaskSimulation& simulation, bool needImages,
+    bool needFeaturizedObjects, bool needObjectMasks) {
+  {
+    // Fail early instead of rendering a rollout that cannot be written.
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (closed_) {
+      throw std::runtime_error("Rollout dataset is already closed");
+    }
+  }
+  if (taskId.size() > UINT16_MAX) {
+    throw std::runtime_error("Task id is too long: " + taskId);
+  }
+  const auto& scenes = simulation.sceneList;
+  IndexEntry entry;
+  entry.taskId = taskId;
+  entry.actionIndex = actionIndex;
+  entry.numFrames = scenes.size();
+  entry.numObjects = scenes.empty() ? 0 : getNumObjectsInScene(scenes[0]);
+  const int sceneHeight = scenes.empty() ? 0 : scenes[0].height;
+  const int sceneWidth = scenes.empty() ? 0 : scenes[0].width;
+  entry.height = sceneHeight;
+  entry.width = sceneWidth;
+  if (options_.resolution > 0 && sceneWidth > 0) {
+    entry.width = options_.resolution;
+    entry.height = std::max(
+        1, (sceneHeight * options_.resolution + sceneWidth / 2) / sceneWidth);
+  }
+  entry.stepsSimulated = simulation.stepsSimulated;
+  entry.isSolution = simulation.isSolution;
+
+  // Columns are rendered and encoded without the lock, so that concurrent
+  // calls only wait for each other's writes.
+  struct EncodedColumn {
+    RolloutColumn column;
+    ColumnCodec codec;
+    std::vector<uint8_t> blob;
+  };
+  std::vector<EncodedColumn> columns;
+  const auto encodePixels = [](ColumnCodec codec,
+                               std::vector<uint8_t>&& pixels) {
+    if (codec == ColumnCodec::RLE) {
+      return rleEncode(pixels.data(), pixels.size());
+    }
+    return std::move(pixels);
+  };
+
+  if (needImages) {
+    std::vector<uint8_t> pixels = renderFrames(
+        entry.numFrames, 1, entry.height, entry.width, sceneHeight,
+        sceneWidth,
+        [&scenes](int i, uint8_t* buffer) { renderTo(scenes[i], buffer); });
+    columns.push_back({RolloutColumn::IMAGES, options_.images,
+                       encodePixels(options_.images, std::move(pixels))});
+  }
+  if (needFeaturizedObjects) {
+    const size_t sceneSize = entry.numObjects * kObjectFeatureSize;
+    std::vector<float> features(sceneSize * scenes.size());
+    for (size_t i = 0; i < scenes.size(); ++i) {
+      featurizeScene(scenes[i], features.data() + i * sceneSize);
+    }
+    std::vector<uint8_t> blob;
+    if (options_.featurizedObjects == ColumnCodec::DELTA) {
+      blob = deltaEncodeFeatures(features.data(), entry.numFrames,
+                                 entry.numObjects);
+    } else if (options_.featurizedObjects == ColumnCodec::RLE) {
+      throw std::runtime_error("RLE codec is not supported for features");
+    } else {
+      blob.reserve(features.size() * sizeof(float));
+      for (const float value : features) {
+        appendLittleEndian(&blob, value);
+      }
+    }
+    columns.push_back({RolloutColumn::FEATURIZED_OBJECTS,
+                       options_.featurizedObjects, std::move(blob)});
+  }
+  if (needObjectMasks) {
+    std::vector<uint8_t> pixels = renderFrames(
+        entry.numFrames, entry.numObjects, entry.height, entry.width,
+        sceneHeight, sceneWidth, [&scenes](int i, uint8_t* buffer) {
+          renderObjectMasksTo(scenes[i], buffer);
+        });
+    columns.push_back({RolloutColumn::OBJECT_MASKS, options_.objectMasks,
+                       encodePixels(options_.objectMasks, std::move(pixels))});
+  }
+  columns.push_back({RolloutColumn::SOLVED_STATES, ColumnCodec::RAW,
+                     std::vector<uint8_t>(simulation.solvedStateList.begin(),
+                                          simulation.solvedStateList.end())});
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (closed_) {
+    throw std::runtime_error("Rollout dataset is already closed");
+  }
+  for (const EncodedColumn& column : columns) {
+    entry.columns.push_back(
+        writeColumn(column.column, column.codec, column.blob));
+  }
+  index_.push_back(std::move(entry));
+}
+
+void RolloutDatasetWriter::close() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (closed_) {
+    return;
+  }
+  const uint64_t indexOffset = offset_;
+  std::vector<uint8_t> index;
+  appendLittleEndian(&index, static_cast<uint32_t>(index_.size()));
+  for (const IndexEntry& entry : index_) {
+    appendLittleEndian(&index, static_cast<uint16_t>(entry.taskId.size()));
+    index.insert(index.end(), entry.taskId.begin(), entry.taskId.end());
+    for (int32_t value : {entry.actionIndex, entry.numFrames, entry.numObjects,
+                          entry.height, entry.width, entry.stepsSimulated}) {
+      appendLittleEndian(&index, value);
+    }
+    appendLittleEndian(&index, static_cast<uint8_t>(entry.isSolution));
+    appendLittleEndian(&index, static_cast<uint8_t>(entry.columns.size()));
+    for (const ColumnEntry& column : entry.columns) {
+      appendLittleEndian(&index, column.column);
+      appendLittleEndian(&index, column.codec);
+      appendLittleEndian(&index, column.offset);
+      appendLittleEndian(&index, column.size);
+    }
+  }
+  appendLittleEndian(&index, indexOffset);
+  index.insert(index.end(), kRolloutDatasetMagic,
+               kRolloutDatasetMagic + sizeof(kRolloutDatasetMagic));
+  writeBytes(index.data(), index.size());
+  // Not before the write, so that a failed close() is not mistaken for a
+  // successful one on a retry.
+  closed_ = true;
+  out_.close();
+}
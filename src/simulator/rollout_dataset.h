@@ -0,0 +1,151 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// Chunked columnar storage for simulation rollouts.
+//
+// A dataset file is a sequence of rollouts followed by an index. Each rollout
+// is stored as a set of independent columns (images, featurized objects,
+// object masks, solved states), so a reader can load a single column of a
+// single rollout without touching the rest of the file. All integers and
+// floats, including the elements of arrays, are encoded as little-endian
+// regardless of the host. The layout is:
+//
+//   char magic[8] = "PHYRERD"; uint32 version; uint32 reserved;
+//   column blobs, each starting at an 8-byte aligned offset;
+//   index:
+//     uint32 numRollouts;
+//     for each rollout:
+//       uint16 taskIdLength; char taskId[taskIdLength];
+//       int32 actionIndex, numFrames, numObjects, height, width,
+//             stepsSimulated;
+//       uint8 isSolution; uint8 numColumns;
+//       for each column: uint8 column; uint8 codec; uint64 offset, size;
+//   uint64 indexOffset; char magic[8] = "PHYRERD".
+//
+// Codecs:
+//   RAW: the array as is. Readers can map it directly.
+//   RLE: uint64 numRuns; uint32 runLengths[numRuns]; T values[numRuns].
+//   DELTA: featurized objects are transposed to (objects, features, frames),
+//     the bit patterns of floats are replaced with differences to the previous
+//     frame (modulo 2^32) and the result is stored with RLE. Static objects
+//     and constant features therefore collapse into single runs of zeros. The
+//     encoding is lossless.
+#ifndef ROLLOUT_DATASET_H
+#define ROLLOUT_DATASET_H
+
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "gen-cpp/task_types.h"
+
+constexpr char kRolloutDatasetMagic[8] = "PHYRERD";
+constexpr uint32_t kRolloutDatasetVersion = 1;
+
+enum class RolloutColumn : uint8_t {
+  IMAGES = 0,              // uint8 (frames, height, width).
+  FEATURIZED_OBJECTS = 1,  // float32 (frames, objects, kObjectFeatureSize).
+  OBJECT_MASKS = 2,        // uint8 (frames, objects, height, width).
+  SOLVED_STATES = 3,       // uint8 (frames,).
+};
+
+enum class ColumnCodec : uint8_t {
+  RAW = 0,
+  RLE = 1,
+  DELTA = 2,
+};
+
+struct RolloutDatasetOptions {
+  ColumnCodec images = ColumnCodec::RLE;
+  ColumnCodec featurizedObjects = ColumnCodec::DELTA;
+  ColumnCodec objectMasks = ColumnCodec::RLE;
+  // If positive, images and masks are resized to this width with
+  // nearest-neighbor sampling. The height is scaled proportionally.
+  int resolution = 0;
+};
+
+class RolloutDatasetWriter {
+ public:
+  explicit RolloutDatasetWriter(
+      const std::string& path,
+      const RolloutDatasetOptions& options = RolloutDatasetOptions());
+  // Closes the file if close() was not called.
+  ~RolloutDatasetWriter();
+
+  RolloutDatasetWriter(const RolloutDatasetWriter&) = delete;
+  RolloutDatasetWriter& operator=(const RolloutDatasetWriter&) = delete;
+
+  // Renders and featurizes every scene of the simulation and appends the
+  // requested columns as a new rollout. Solved states are always stored.
+  // Thread-safe: rendering and encoding run concurrently, only the writes of
+  // the encoded columns are serialized.
+  void addSimulation(const std::string& taskId, int actionIndex,
+                     const ::task::TaskSimulation& simulation,
+                     bool needImages, bool needFeaturizedObjects,
+                     bool needObjectMasks);
+
+  // Writes the index. No rollouts can be added afterwards. If writing fails,
+  // the writer is not marked as closed, so a repeated close() reports the
+  // failure again instead of returning silently.
+  void close();
+
+  size_t numRollouts() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return index_.size();
+  }
+
+ private:
+  struct ColumnEntry {
+    RolloutColumn column;
+    ColumnCodec codec;
+    uint64_t offset;
+    uint64_t size;
+  };
+  struct IndexEntry {
+    std::string taskId;
+    int32_t actionIndex;
+    int32_t numFrames;
+    int32_t numObjects;
+    int32_t height;
+    int32_t width;
+    int32_t stepsSimulated;
+    bool isSolution;
+    std::vector<ColumnEntry> columns;
+  };
+
+  ColumnEntry writeColumn(RolloutColumn column, ColumnCodec codec,
+                          const std::vector<uint8_t>& blob);
+  void writeBytes(const void* data, size_t size);
+
+  const RolloutDatasetOptions options_;
+  // Guards the file and the index.
+  mutable std::mutex mutex_;
+  std::ofstream out_;
+  uint64_t offset_ = 0;
+  bool closed_ = false;
+  std::vector<IndexEntry> index_;
+};
+
+// Exposed for testing.
+std::vector<uint8_t> rleEncode(const uint8_t* data, size_t size);
+std::vector<uint8_t> rleEncode(const uint32_t* data, size_t size);
+std::vector<uint8_t> rleDecodeUint8(const std::vector<uint8_t>& blob);
+std::vector<uint32_t> rleDecodeUint32(const std::vector<uint8_t>& blob);
+std::vector<uint8_t> deltaEncodeFeatures(const float* data, int numFrames,
+                                         int numObjects);
+std::vector<float> deltaDecodeFeatures(const std::vector<uint8_t>& blob,
+                                       int numFrames, int numObjects);
+
+#endif  // ROLLOUT_DATASET_H
@@ -0,0 +1,154 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "rollout_generator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <exception>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "image_to_box2d.h"
+#include "task_utils.h"
+#include "utils/timer.h"
+
+#include "gen-cpp/scene_types.h"
+
+namespace {
+
+struct WorkItem {
+  int taskIndex;
+  int actionIndex;
+};
+
+// Simulates all items of a single shard and returns the number of rollouts
+// written. Inputs with occlusions are skipped.
+int writeShard(const ::task::RolloutJob& job, const std::vector<WorkItem>& items,
+               size_t begin, size_t end, const std::string& path,
+               const RolloutGeneratorOptions& options) {
+  RolloutDatasetWriter writer(path, options.datasetOptions);
+  for (size_t i = begin; i < end; ++i) {
+    const WorkItem& item = items[i];
+    ::task::Task task = job.tasks[item.taskIndex];
+    addUserInputToScene(job.userInputs[item.actionIndex],
+                        job.keepSpaceAroundBodies,
+                        /*allow_occlusions=*/false, &task.scene);
+    if (task.scene.user_input_status ==
+        ::scene::UserInputStatus::HAD_OCCLUSIONS) {
+      continue;
+    }
+    const ::task::TaskSimulation simulation =
+        simulateTask(task, options.steps, options.stride);
+    const int actionId = job.__isset.actionIds
+                             ? job.actionIds[item.actionIndex]
+                             : item.actionIndex;
+    writer.addSimulation(task.taskId, actionId, simulation,
+                         options.needImages, options.needFeaturizedObjects,
+                         options.needObjectMasks);
+  }
+  writer.close();
+  return writer.numRollouts();
+}
+
+std::vector<WorkItem> listWorkItems(const ::task::RolloutJob& job) {
+  if (job.actionIndices.size() != job.tasks.size()) {
+    throw std::runtime_error(
+        "RolloutJob must have a list of actions for every task");
+  }
+  if (job.__isset.actionIds &&
+      job.actionIds.size() != job.userInputs.size()) {
+    throw std::runtime_error(
+        "RolloutJob must have an action id for every user input");
+  }
+  std::vector<WorkItem> items;
+  for (size_t taskIndex = 0; taskIndex < job.tasks.size(); ++taskIndex) {
+    for (int actionIndex : job.actionIndices[taskIndex]) {
+      if (actionIndex < 0 ||
+          static_cast<size_t>(actionIndex) >= job.userInputs.size()) {
+        throw std::runtime_error("Action index is out of range: " +
+                                 std::to_string(actionIndex));
+      }
+      items.push_back(WorkItem{static_cast<int>(taskIndex), actionIndex});
+    }
+  }
+  return items;
+}
+
+}  // namespace
+
+std::string getShardPath(const std::string& prefix, int shard, int numShards) {
+  char suffix[64];
+  snprintf(suffix, sizeof(suffix), "-%05d-of-%05d.rollouts", shard, numShards);
+  return prefix + suffix;
+}
+
+int generateRollouts(const ::task::RolloutJob& job,
+                     const RolloutGeneratorOptions& options) {
+  const std::vector<WorkItem> items = listWorkItems(job);
+  const int numShards = options.numShards;
+  if (numShards <= 0) {
+    throw std::runtime_error("Number of shards must be positive");
+  }
+  const int numThreads = std::max(1, std::min(options.numThreads, numShards));
+  std::cout << "Simulating " << items.size() << " rollouts into " << numShards
+            << " shards using " << numThreads << " threads" << std::endl;
+
+  SimpleTimer timer;
+  std::atomic<int> nextShard(0);
+  std::atomic<int> numRollouts(0);
+  std::mutex mutex;
+  std::exception_ptr error;
+  const auto worker = [&]() {
+    for (int shard = nextShard++; shard < numShards; shard = nextShard++) {
+      const size_t begin = items.size() * shard / numShards;
+      const size_t end = items.size() * (shard + 1) / numShards;
+      const std::string path =
+          getShardPath(options.outputPrefix, shard, numShards);
+      try {
+        const int written = writeShard(job, items, begin, end, path, options);
+        numRollouts += written;
+        std::lock_guard<std::mutex> lock(mutex);
+        std::cout << "Wrote " << written << " rollouts to " << path
+                  << std::endl;
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+        // Stop handing out shards to all workers.
+        nextShard = numShards;
+        return;
+      }
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int i = 0; i < numThreads; ++i) {
+    threads.emplace_back(worker);
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  const double seconds = timer.GetSeconds();
+  std::cout << "Done: " << numRollouts << " rollouts in " << seconds
+            << " seconds (" << numRollouts / std::max(seconds, 1e-9)
+            << " rollouts/s)" << std::endl;
+  return numRollouts;
+}
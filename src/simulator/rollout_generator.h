@@ -0,0 +1,52 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// Multi-threaded generation of rollout datasets.
+//
+// The (task, action) pairs of a RolloutJob (tasks, user inputs for all actions
+// and the list of actions to simulate for every task) are split into
+// contiguous shards and each shard is written into its own rollout dataset
+// file (see rollout_dataset.h). Worker threads pick shards from a shared
+// counter, so each shard is written by a single thread and no locking is
+// needed on the hot path. Use more shards than threads to balance the load.
+#ifndef ROLLOUT_GENERATOR_H
+#define ROLLOUT_GENERATOR_H
+
+#include <string>
+
+#include "rollout_dataset.h"
+
+#include "gen-cpp/task_types.h"
+
+struct RolloutGeneratorOptions {
+  std::string outputPrefix;
+  int numShards = 1;
+  int numThreads = 1;
+  int steps = 0;
+  int stride = 1;
+  bool needImages = true;
+  bool needFeaturizedObjects = true;
+  bool needObjectMasks = false;
+  RolloutDatasetOptions datasetOptions;
+};
+
+// Returns <prefix>-SSSSS-of-NNNNN.rollouts.
+std::string getShardPath(const std::string& prefix, int shard, int numShards);
+
+// Simulates all actions of the job, writes options.numShards shards and
+// returns the number of rollouts written. Inputs with occlusions are skipped.
+// Throws the first error of any worker after all workers have stopped.
+int generateRollouts(const ::task::RolloutJob& job,
+                     const RolloutGeneratorOptions& options);
+
+#endif  // ROLLOUT_GENERATOR_H
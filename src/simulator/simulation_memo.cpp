@@ -0,0 +1,397 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "simulation_memo.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "image_to_box2d.h"
+#include "thrift_serialization.h"
+
+namespace {
+
+constexpr uint64_t kFnvPrime = 1099511628211ULL;
+constexpr uint64_t kCheckMultiplier = 0x9E3779B97F4A7C15ULL;
+constexpr size_t kHeaderSize =
+    sizeof(kSimulationMemoMagic) + sizeof(kSimulationMemoVersion);
+// uint64 hash; uint64 check; uint8 hadOcclusions; uint32 size.
+constexpr size_t kRecordHeaderSize = 8 + 8 + 1 + 4;
+
+void putLittleEndian(uint64_t value, int numBytes, std::string* out) {
+  for (int i = 0; i < numBytes; ++i) {
+    out->push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+  }
+}
+
+uint64_t getLittleEndian(const uint8_t* data, int numBytes) {
+  uint64_t value = 0;
+  for (int i = 0; i < numBytes; ++i) {
+    value |= static_cast<uint64_t>(data[i]) << (8 * i);
+  }
+  return value;
+}
+
+SimulationKey extendKey(const SimulationKey& key, const void* data,
+                        size_t size) {
+  return {hashBytes(data, size, key.hash),
+          hashBytesCheck(data, size, key.check)};
+}
+
+// Values are hashed in the file byte order, so keys do not depend on the
+// host.
+SimulationKey extendKey(const SimulationKey& key, uint64_t value,
+                        int numBytes) {
+  std::string bytes;
+  putLittleEndian(value, numBytes, &bytes);
+  return extendKey(key, bytes.data(), bytes.size());
+}
+
+std::string getErrorMessage(const std::string& message,
+                            const std::string& path) {
+  return message + ": " + path + ": " + std::strerror(errno);
+}
+
+// Advisory lock of the whole file that is shared by all processes.
+class FileLock {
+ public:
+  FileLock(int fd, int operation, const std::string& path) : fd_(fd) {
+    while (flock(fd_, operation) != 0) {
+      if (errno != EINTR) {
+        throw std::runtime_error(
+            getErrorMessage("Cannot lock simulation memo", path));
+      }
+    }
+  }
+  ~FileLock() { flock(fd_, LOCK_UN); }
+
+  FileLock(const FileLock&) = delete;
+  FileLock& operator=(const FileLock&) = delete;
+
+ private:
+  const int fd_;
+};
+
+// Returns false if the file ends before size bytes are read.
+bool readAt(int fd, void* data, size_t size, uint64_t offset) {
+  uint8_t* bytes = static_cast<uint8_t*>(data);
+  while (size > 0) {
+    const ssize_t numRead = pread(fd, bytes, size, offset);
+    if (numRead < 0 && errno == EINTR) {
+      continue;
+    }
+    if (numRead <= 0) {
+      return false;
+    }
+    bytes += numRead;
+    size -= numRead;
+    offset += numRead;
+  }
+  return true;
+}
+
+// Appends the bytes with O_APPEND. Must be called under the exclusive lock,
+// so that records of different processes do not interleave.
+bool append(int fd, const std::string& bytes) {
+  const char* data = bytes.data();
+  size_t size = bytes.size();
+  while (size > 0) {
+    const ssize_t numWritten = write(fd, data, size);
+    if (numWritten < 0 && errno == EINTR) {
+      continue;
+    }
+    if (numWritten <= 0) {
+      return false;
+    }
+    data += numWritten;
+    size -= numWritten;
+  }
+  return true;
+}
+
+uint64_t getFileSize(int fd, const std::string& path) {
+  struct stat status;
+  if (fstat(fd, &status) != 0) {
+    throw std::runtime_error(
+        getErrorMessage("Cannot stat simulation memo", path));
+  }
+  return status.st_size;
+}
+
+int openMemoFile(const std::string& path) {
+  const int fd =
+      open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    throw std::runtime_error(
+        getErrorMessage("Cannot open simulation memo", path));
+  }
+  return fd;
+}
+
+}  // namespace
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  uint64_t hash = seed;
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ bytes[i]) * kFnvPrime;
+  }
+  return hash;
+}
+
+uint64_t hashBytesCheck(const void* data, size_t size, uint64_t seed) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  uint64_t hash = seed ^ (size * kCheckMultiplier);
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash + bytes[i] + 1) * kCheckMultiplier;
+    hash ^= hash >> 32;
+  }
+  return hash;
+}
+
+SimulationKey getBytesKey(const void* data, size_t size) {
+  return {hashBytes(data, size), hashBytesCheck(data, size)};
+}
+
+SimulationKey getSimulationKey(const SimulationKey& taskKey,
+                               const ::scene::Scene& sceneWithInput, int steps,
+                               unsigned stats, bool skipOccluded) {
+  const bool hadOcclusions = sceneWithInput.user_input_status ==
+                             ::scene::UserInputStatus::HAD_OCCLUSIONS;
+  // Only the merged bodies matter, not the raw input.
+  ::scene::Scene userBodies;
+  userBodies.__set_user_input_bodies(sceneWithInput.user_input_bodies);
+  const auto span = thrift_serialization::serializeToSpan(userBodies);
+  SimulationKey key = extendKey(taskKey, span.data, span.size);
+  key = extendKey(key, hadOcclusions, 1);
+  key = extendKey(key, static_cast<uint32_t>(steps), 4);
+  key = extendKey(key, stats, 4);
+  if (hadOcclusions) {
+    key = extendKey(key, skipOccluded, 1);
+  }
+  return key;
+}
+
+SimulationMemo::SimulationMemo(size_t capacity, const std::string& path)
+    : capacity_(capacity), path_(path) {
+  if (path_.empty()) {
+    return;
+  }
+  fd_ = openMemoFile(path_);
+  pid_ = getpid();
+  try {
+    FileLock lock(fd_, LOCK_EX, path_);
+    if (getFileSize(fd_, path_) == 0) {
+      std::string header(kSimulationMemoMagic, sizeof(kSimulationMemoMagic));
+      putLittleEndian(kSimulationMemoVersion, 4, &header);
+      if (!append(fd_, header)) {
+        throw std::runtime_error(
+            getErrorMessage("Cannot create simulation memo", path_));
+      }
+    }
+    uint8_t header[kHeaderSize];
+    if (!readAt(fd_, header, kHeaderSize, 0) ||
+        std::memcmp(header, kSimulationMemoMagic,
+                    sizeof(kSimulationMemoMagic)) != 0 ||
+        getLittleEndian(header + sizeof(kSimulationMemoMagic), 4) !=
+            kSimulationMemoVersion) {
+      throw std::runtime_error("Not a simulation memo: " + path_);
+    }
+    fileSize_ = kHeaderSize;
+    indexNewRecords(/*truncate=*/true);
+  } catch (...) {
+    close(fd_);
+    throw;
+  }
+}
+
+SimulationMemo::~SimulationMemo() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+void SimulationMemo::indexNewRecords(bool truncate) {
+  const uint64_t size = getFileSize(fd_, path_);
+  uint64_t offset = fileSize_;
+  uint8_t header[kRecordHeaderSize];
+  while (offset + kRecordHeaderSize <= size &&
+         readAt(fd_, header, kRecordHeaderSize, offset)) {
+    const uint64_t hash = getLittleEndian(header, 8);
+    const uint64_t check = getLittleEndian(header + 8, 8);
+    const uint64_t recordSize = getLittleEndian(header + 17, 4);
+    if (offset + kRecordHeaderSize + recordSize > size) {
+      break;
+    }
+    diskIndex_[hash] = {check, offset};
+    offset += kRecordHeaderSize + recordSize;
+  }
+  if (truncate && offset != size && ftruncate(fd_, offset) != 0) {
+    throw std::runtime_error(
+        getErrorMessage("Cannot truncate simulation memo", path_));
+  }
+  fileSize_ = offset;
+  stats_.diskSize = diskIndex_.size();
+}
+
+void SimulationMemo::reopenAfterFork() {
+  if (fd_ < 0 || pid_ == getpid()) {
+    return;
+  }
+  // The inherited descriptor shares its file offset and flock() with the
+  // parent and the siblings, so locking it would not exclude them. The
+  // indexed prefix stays valid as the file is append-only.
+  close(fd_);
+  fd_ = -1;
+  fd_ = openMemoFile(path_);
+  pid_ = getpid();
+}
+
+std::optional<MemoizedSimulation> SimulationMemo::lookup(
+    const SimulationKey& key) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto memoryIt = memoryIndex_.find(key.hash);
+  if (memoryIt != memoryIndex_.end() && memoryIt->second->first == key) {
+    entries_.splice(entries_.begin(), entries_, memoryIt->second);
+    ++stats_.hits;
+    return memoryIt->second->second;
+  }
+  reopenAfterFork();
+  if (fd_ < 0) {
+    ++stats_.misses;
+    return std::nullopt;
+  }
+  FileLock fileLock(fd_, LOCK_SH, path_);
+  indexNewRecords(/*truncate=*/false);
+  const auto diskIt = diskIndex_.find(key.hash);
+  if (diskIt == diskIndex_.end() || diskIt->second.check != key.check) {
+    ++stats_.misses;
+    return std::nullopt;
+  }
+  uint8_t header[kRecordHeaderSize];
+  if (!readAt(fd_, header, kRecordHeaderSize, diskIt->second.offset) ||
+      getLittleEndian(header, 8) != key.hash ||
+      getLittleEndian(header + 8, 8) != key.check) {
+    throw std::runtime_error("Corrupted simulation memo: " + path_);
+  }
+  std::vector<uint8_t> bytes(getLittleEndian(header + 17, 4));
+  if (!readAt(fd_, bytes.data(), bytes.size(),
+              diskIt->second.offset + kRecordHeaderSize)) {
+    throw std::runtime_error("Corrupted simulation memo: " + path_);
+  }
+  MemoizedSimulation simulation;
+  simulation.hadOcclusions = header[16];
+  thrift_serialization::deserializeFrom(bytes.data(), bytes.size(),
+                                        &simulation.summary);
+  insertToMemory(key, simulation);
+  ++stats_.diskHits;
+  return simulation;
+}
+
+void SimulationMemo::insert(const SimulationKey& key,
+                            const MemoizedSimulation& simulation) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  insertToMemory(key, simulation);
+  reopenAfterFork();
+  if (fd_ < 0) {
+    return;
+  }
+  FileLock fileLock(fd_, LOCK_EX, path_);
+  indexNewRecords(/*truncate=*/true);
+  const auto it = diskIndex_.find(key.hash);
+  if (it != diskIndex_.end() && it->second.check == key.check) {
+    return;
+  }
+  const auto span = thrift_serialization::serializeToSpan(simulation.summary);
+  std::string record;
+  record.reserve(kRecordHeaderSize + span.size);
+  putLittleEndian(key.hash, 8, &record);
+  putLittleEndian(key.check, 8, &record);
+  putLittleEndian(simulation.hadOcclusions, 1, &record);
+  putLittleEndian(span.size, 4, &record);
+  record.append(reinterpret_cast<const char*>(span.data), span.size);
+  if (!append(fd_, record)) {
+    throw std::runtime_error(
+        getErrorMessage("Failed to write simulation memo", path_));
+  }
+  diskIndex_[key.hash] = {key.check, fileSize_};
+  fileSize_ += record.size();
+  stats_.diskSize = diskIndex_.size();
+}
+
+void SimulationMemo::insertToMemory(const SimulationKey& key,
+                                    const MemoizedSimulation& simulation) {
+  if (capacity_ == 0) {
+    return;
+  }
+  const auto it = memoryIndex_.find(key.hash);
+  if (it != memoryIndex_.end()) {
+    *it->second = {key, simulation};
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return;
+  }
+  entries_.emplace_front(key, simulation);
+  memoryIndex_[key.hash] = entries_.begin();
+  if (entries_.size() > capacity_) {
+    memoryIndex_.erase(entries_.back().first.hash);
+    entries_.pop_back();
+  }
+  stats_.size = entries_.size();
+}
+
+SimulationMemoStats SimulationMemo::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+void SimulationMemo::clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  entries_.clear();
+  memoryIndex_.clear();
+  stats_.size = 0;
+}
+
+MemoizedSimulation simulateTaskSummaryMemoized(
+    const ::task::Task& task, const SimulationKey& taskKey,
+    const ::scene::UserInput& userInput, bool keepSpaceAroundBodies,
+    bool skipOccluded, int steps, unsigned stats, SimulationMemo* memo) {
+  ::task::Task taskWithInput = task;
+  addUserInputToScene(userInput, keepSpaceAroundBodies,
+                      /*allowOcclusions=*/false, &taskWithInput.scene);
+  const SimulationKey key = getSimulationKey(taskKey, taskWithInput.scene,
+                                             steps, stats, skipOccluded);
+  if (memo != nullptr) {
+    if (auto simulation = memo->lookup(key)) {
+      return *std::move(simulation);
+    }
+  }
+  MemoizedSimulation simulation;
+  simulation.hadOcclusions = taskWithInput.scene.user_input_status ==
+                             ::scene::UserInputStatus::HAD_OCCLUSIONS;
+  if (simulation.hadOcclusions && skipOccluded) {
+    simulation.summary.__set_isSolution(false);
+    simulation.summary.__set_stepsSimulated(0);
+  } else {
+    simulation.summary = simulateTaskSummary(taskWithInput, steps, stats);
+  }
+  if (memo != nullptr) {
+    memo->insert(key, simulation);
+  }
+  return simulation;
+}
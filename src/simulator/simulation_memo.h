@@ -0,0 +1,165 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// Memoization of simulation results.
+//
+// Action mappers quantize user inputs, so many distinct actions produce the
+// same user bodies. Results are therefore keyed by the hash of the task and
+// the user bodies after merging them into the scene, not by the action. Keys
+// hold two independent 64-bit hashes: the first one indexes the memo and the
+// second one is stored next to the result and verified on every hit, so that
+// a collision of the first hash is a miss and not a wrong result.
+//
+// A memo has a bounded in-memory LRU tier and an optional append-only file
+// tier that persists across processes. Several processes may share a file:
+// records are appended under an exclusive flock() with O_APPEND, and records
+// appended by other processes are indexed before every file lookup and
+// insert. flock() locks belong to an open() of the file, so only separate
+// open()s exclude each other; a memo used in a child after fork() reopens
+// its file there instead of sharing the parent's descriptor. Integers in the file are encoded as little-endian regardless of the
+// host. The layout is:
+//
+//   char magic[8] = "PHYREMM"; uint32 version;
+//   records:
+//     uint64 hash; uint64 check; uint8 hadOcclusions; uint32 size;
+//     char summary[size];  // Serialized TaskSimulationSummary.
+//
+// A truncated last record (e.g., after a crash) is dropped by the next writer.
+#ifndef SIMULATION_MEMO_H
+#define SIMULATION_MEMO_H
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "gen-cpp/scene_types.h"
+#include "gen-cpp/task_types.h"
+#include "task_utils.h"
+
+constexpr char kSimulationMemoMagic[8] = "PHYREMM";
+constexpr uint32_t kSimulationMemoVersion = 2;
+
+// 64-bit FNV-1a. Unlike std::hash, the value is stable across processes, so
+// it can be used for the file tier.
+uint64_t hashBytes(const void* data, size_t size,
+                   uint64_t seed = 14695981039346656037ULL);
+
+// A multiplicative 64-bit hash that is independent of hashBytes. Used for the
+// check half of the keys.
+uint64_t hashBytesCheck(const void* data, size_t size, uint64_t seed = 0);
+
+struct SimulationKey {
+  uint64_t hash = 0;
+  uint64_t check = 0;
+
+  bool operator==(const SimulationKey& other) const {
+    return hash == other.hash && check == other.check;
+  }
+};
+
+// Key of the bytes, e.g., of a serialized task.
+SimulationKey getBytesKey(const void* data, size_t size);
+
+// Key of a simulation of the task with user input. taskKey is the key of the
+// task without user input (e.g., getBytesKey of the serialized task) and
+// sceneWithInput is the task scene after addUserInputToScene. skipOccluded
+// only changes the key of inputs with occlusions.
+SimulationKey getSimulationKey(const SimulationKey& taskKey,
+                               const ::scene::Scene& sceneWithInput, int steps,
+                               unsigned stats, bool skipOccluded);
+
+struct MemoizedSimulation {
+  bool hadOcclusions = false;
+  ::task::TaskSimulationSummary summary;
+};
+
+struct SimulationMemoStats {
+  int64_t hits = 0;
+  int64_t diskHits = 0;
+  int64_t misses = 0;
+  // Number of entries in the memory and file tiers.
+  int64_t size = 0;
+  int64_t diskSize = 0;
+};
+
+// Thread-safe memo. A capacity of 0 disables the memory tier and an empty path
+// disables the file tier.
+class SimulationMemo {
+ public:
+  explicit SimulationMemo(size_t capacity, const std::string& path = "");
+  ~SimulationMemo();
+
+  SimulationMemo(const SimulationMemo&) = delete;
+  SimulationMemo& operator=(const SimulationMemo&) = delete;
+
+  // Looks up the memory tier and then the file tier. File hits are promoted
+  // to the memory tier. An entry with the same hash but a different check is
+  // a miss.
+  std::optional<MemoizedSimulation> lookup(const SimulationKey& key);
+  // Adds the result to the memory tier and appends it to the file. Existing
+  // keys are not overwritten in the file.
+  void insert(const SimulationKey& key, const MemoizedSimulation& simulation);
+
+  SimulationMemoStats stats() const;
+  // Drops the memory tier. The file is kept.
+  void clear();
+
+ private:
+  struct DiskEntry {
+    uint64_t check;
+    uint64_t offset;
+  };
+
+  void insertToMemory(const SimulationKey& key,
+                      const MemoizedSimulation& simulation);
+  // Indexes the records appended to the file since the last call. Must be
+  // called under a file lock. If truncate is set (requires the exclusive
+  // lock), a truncated last record is dropped.
+  void indexNewRecords(bool truncate);
+  // Reopens the file if the memo was opened by another process, i.e., before
+  // a fork(). Must be called under mutex_.
+  void reopenAfterFork();
+
+  const size_t capacity_;
+  const std::string path_;
+  mutable std::mutex mutex_;
+  // Most recently used first.
+  std::list<std::pair<SimulationKey, MemoizedSimulation>> entries_;
+  std::unordered_map<uint64_t, decltype(entries_)::iterator> memoryIndex_;
+  // The last record of every hash in the file.
+  std::unordered_map<uint64_t, DiskEntry> diskIndex_;
+  int fd_ = -1;
+  // Process that opened fd_.
+  pid_t pid_ = 0;
+  // Size of the indexed prefix of the file.
+  uint64_t fileSize_ = 0;
+  SimulationMemoStats stats_;
+};
+
+// Same as simulateTaskSummary for the task with user input, but repeated
+// requests are served from the memo if it is not null. If skipOccluded is set
+// and the input has occlusions, the task is not simulated and the summary only
+// has isSolution = false and stepsSimulated = 0.
+MemoizedSimulation simulateTaskSummaryMemoized(
+    const ::task::Task& task, const SimulationKey& taskKey,
+    const ::scene::UserInput& userInput, bool keepSpaceAroundBodies,
+    bool skipOccluded, int steps, unsigned stats, SimulationMemo* memo);
+
+#endif  // SIMULATION_MEMO_H
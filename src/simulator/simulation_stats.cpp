@@ -0,0 +1,129 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "simulation_stats.h"
+
+#include <atomic>
+
+namespace {
+
+int64_t readCounter(std::atomic<int64_t>* counter, bool reset) {
+  return reset ? counter->exchange(0, std::memory_order_relaxed)
+               : counter->load(std::memory_order_relaxed);
+}
+
+class AtomicHistogram {
+ public:
+  void add(int64_t value) {
+    int bucket = 0;
+    uint64_t rest = value > 0 ? value : 0;
+    while (rest != 0 && bucket + 1 < kNumStatsBuckets) {
+      rest >>= 1;
+      ++bucket;
+    }
+    buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+  }
+
+  void merge(const StatsHistogram& histogram) {
+    for (int i = 0; i < kNumStatsBuckets; ++i) {
+      buckets_[i].fetch_add(histogram.buckets[i], std::memory_order_relaxed);
+    }
+    count_.fetch_add(histogram.count, std::memory_order_relaxed);
+    sum_.fetch_add(histogram.sum, std::memory_order_relaxed);
+  }
+
+  StatsHistogram read(bool reset) {
+    StatsHistogram histogram;
+    for (int i = 0; i < kNumStatsBuckets; ++i) {
+      histogram.buckets[i] = readCounter(&buckets_[i], reset);
+    }
+    histogram.count = readCounter(&count_, reset);
+    histogram.sum = readCounter(&sum_, reset);
+    return histogram;
+  }
+
+ private:
+  std::array<std::atomic<int64_t>, kNumStatsBuckets> buckets_ = {};
+  std::atomic<int64_t> count_{0};
+  std::atomic<int64_t> sum_{0};
+};
+
+struct StatsRegistry {
+  std::array<std::atomic<int64_t>, kNumTerminationReasons> rollouts = {};
+  AtomicHistogram stepsSimulated;
+  AtomicHistogram numBodies;
+  AtomicHistogram latencyMicros;
+  AtomicHistogram callLatencyMicros;
+};
+
+StatsRegistry& getRegistry() {
+  static StatsRegistry registry;
+  return registry;
+}
+
+// Number of ScopedSimulationCall objects alive in this thread.
+thread_local int callDepth = 0;
+
+}  // namespace
+
+void recordSimulationStats(TerminationReason reason, int64_t stepsSimulated,
+                           int64_t numBodies, int64_t latencyMicros) {
+  StatsRegistry& registry = getRegistry();
+  registry.rollouts[static_cast<int>(reason)].fetch_add(
+      1, std::memory_order_relaxed);
+  registry.stepsSimulated.add(stepsSimulated);
+  registry.numBodies.add(numBodies);
+  registry.latencyMicros.add(latencyMicros);
+}
+
+SimulationStats getSimulationStats(bool reset) {
+  StatsRegistry& registry = getRegistry();
+  SimulationStats stats;
+  for (int i = 0; i < kNumTerminationReasons; ++i) {
+    stats.rollouts[i] = readCounter(&registry.rollouts[i], reset);
+  }
+  stats.stepsSimulated = registry.stepsSimulated.read(reset);
+  stats.numBodies = registry.numBodies.read(reset);
+  stats.latencyMicros = registry.latencyMicros.read(reset);
+  stats.callLatencyMicros = registry.callLatencyMicros.read(reset);
+  return stats;
+}
+
+void mergeSimulationStats(const SimulationStats& stats) {
+  StatsRegistry& registry = getRegistry();
+  for (int i = 0; i < kNumTerminationReasons; ++i) {
+    registry.rollouts[i].fetch_add(stats.rollouts[i],
+                                   std::memory_order_relaxed);
+  }
+  registry.stepsSimulated.merge(stats.stepsSimulated);
+  registry.numBodies.merge(stats.numBodies);
+  registry.latencyMicros.merge(stats.latencyMicros);
+  registry.callLatencyMicros.merge(stats.callLatencyMicros);
+}
+
+void resetSimulationStats() { getSimulationStats(/*reset=*/true); }
+
+ScopedSimulationCall::ScopedSimulationCall()
+    : outermost_(callDepth++ == 0),
+      startTime_(std::chrono::steady_clock::now()) {}
+
+ScopedSimulationCall::~ScopedSimulationCall() {
+  --callDepth;
+  if (outermost_) {
+    const auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - startTime_);
+    getRegistry().callLatencyMicros.add(latency.count());
+  }
+}
@@ -0,0 +1,92 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef SIMULATION_STATS_H
+#define SIMULATION_STATS_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+// Process-wide counters of the simulation workload. Every finished
+// TaskSimulationStream (and so every simulateTask, simulateScene, etc. call)
+// records a rollout. Updates are lock-free. Worker processes of
+// simulateTasksInParallel and simulateTasksAsCompleted send their counters
+// back to the parent, where they are merged once the workers finish.
+
+// Why a rollout stopped.
+enum class TerminationReason {
+  // The task was solved before the step limit.
+  SOLVED_EARLY = 0,
+  // The step limit was reached while some bodies were still moving.
+  MAX_STEPS = 1,
+  // The step limit was reached, but all bodies were at rest at the end, i.e.,
+  // the tail of the rollout did not change anything.
+  QUIESCENT = 2,
+  // The user input had occlusions. Such rollouts are simulated, but their
+  // results are discarded by the callers.
+  OCCLUDED = 3,
+};
+constexpr int kNumTerminationReasons = 4;
+
+// Histogram with power of two buckets: bucket 0 counts zeros and bucket i > 0
+// counts values in [2^(i - 1), 2^i). The last bucket is open-ended.
+constexpr int kNumStatsBuckets = 32;
+struct StatsHistogram {
+  std::array<int64_t, kNumStatsBuckets> buckets = {};
+  int64_t count = 0;
+  int64_t sum = 0;
+};
+
+struct SimulationStats {
+  std::array<int64_t, kNumTerminationReasons> rollouts = {};
+  StatsHistogram stepsSimulated;
+  // Number of Box2D bodies in the world.
+  StatsHistogram numBodies;
+  // Wall time from the creation of the world to the end of the rollout.
+  StatsHistogram latencyMicros;
+  // Wall time of top-level simulation calls, e.g., a whole batch of
+  // simulateTasksInParallel. Calls made by other simulation calls are not
+  // counted separately.
+  StatsHistogram callLatencyMicros;
+};
+
+void recordSimulationStats(TerminationReason reason, int64_t stepsSimulated,
+                           int64_t numBodies, int64_t latencyMicros);
+
+// Adds counters collected elsewhere, e.g., in a worker process.
+void mergeSimulationStats(const SimulationStats& stats);
+
+// Records the latency of the enclosing simulation call on destruction, unless
+// the thread is already inside another call. Processes forked by a call
+// inherit its scope, as their time is part of the call.
+class ScopedSimulationCall {
+ public:
+  ScopedSimulationCall();
+  ~ScopedSimulationCall();
+
+  ScopedSimulationCall(const ScopedSimulationCall&) = delete;
+  ScopedSimulationCall& operator=(const ScopedSimulationCall&) = delete;
+
+ private:
+  const bool outermost_;
+  const std::chrono::steady_clock::time_point startTime_;
+};
+
+// Returns the current values. If reset is set, the counters are reset to zero
+// at the same time, so that no update is lost between consecutive snapshots.
+SimulationStats getSimulationStats(bool reset = false);
+
+void resetSimulationStats();
+
+#endif  // SIMULATION_STATS_H
@@ -14,57 +14,64 @@
 #include <pybind11/numpy.h>
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
+#include <algorithm>
 #include <chrono>
+#include <map>
 #include <memory>
+#include <optional>
+#include <string>
+#include <tuple>
 #include <vector>
 
-#include <thrift/protocol/TBinaryProtocol.h>
-#include <thrift/transport/TBufferTransports.h>
-
 #include "creator.h"
+#include "featurized_objects.h"
 #include "gen-cpp/scene_types.h"
 #include "gen-cpp/task_types.h"
+#include "image_delta.h"
 #include "image_to_box2d.h"
+#include "rollout_dataset.h"
+#include "simulation_memo.h"
+#include "simulation_stats.h"
+#include "task_complexity.h"
 #include "task_utils.h"
 #include "thrift_box2d_conversion.h"
+#include "thrift_serialization.h"
 #include "utils/timer.h"
 
-using ::apache::thrift::protocol::TBinaryProtocol;
-using ::apache::thrift::transport::TMemoryBuffer;
 using ::scene::Image;
 using ::scene::Scene;
 using ::scene::UserInput;
 using ::scene::UserInputStatus;
 using ::task::Task;
 using ::task::TaskSimulation;
+using ::task::TaskSimulationSummary;
 namespace py = pybind11;
 
 namespace {
 
 template <class T>
 T deserialize(const py::bytes &serializedBytes) {
+  // Reads directly from the memory of the bytes object.
   py::buffer_info info(py::buffer(serializedBytes).request());
-  const unsigned char *data = reinterpret_cast<const unsigned char *>(info.ptr);
-  size_t length = static_cast<size_t>(info.size);
-
-  std::shared_ptr<TMemoryBuffer> memoryBuffer(new TMemoryBuffer());
-  std::unique_ptr<TBinaryProtocol> protocol(new TBinaryProtocol(memoryBuffer));
-  memoryBuffer->resetBuffer(const_cast<unsigned char *>(data), length);
-  T object;
-  object.read(protocol.get());
-  return object;
+  return thrift_serialization::deserialize<T>(
+      reinterpret_cast<const uint8_t *>(info.ptr),
+      static_cast<size_t>(info.size));
 }
 
 template <class T>
 py::bytes serialize(const T &object) {
-  std::shared_ptr<TMemoryBuffer> memoryBuffer(new TMemoryBuffer());
-  std::unique_ptr<TBinaryProtocol> protocol(new TBinaryProtocol(memoryBuffer));
-  object.write(protocol.get());
-
-  unsigned char *buffer;
-  uint32_t sz;
-  memoryBuffer->getBuffer(&buffer, &sz);
-  return py::bytes(reinterpret_cast<const char *>(buffer), sz);
+  const thrift_serialization::ByteSpan span =
+      thrift_serialization::serializeToSpan(object);
+  return py::bytes(reinterpret_cast<const char *>(span.data), span.size);
+}
+
+py::dict statsHistogramToDict(const StatsHistogram &histogram) {
+  py::dict result;
+  result["buckets"] = std::vector<int64_t>(histogram.buckets.begin(),
+                                           histogram.buckets.end());
+  result["count"] = histogram.count;
+  result["sum"] = histogram.sum;
+  return result;
 }
 
 UserInput buildUserInputObject(
@@ -105,31 +112,6 @@ UserInput buildUserInputObject(
   return user_input;
 }
 
-void addUserInputToScene(const UserInput &user_input,
-                         bool keep_space_around_bodies, bool allow_occlusions,
-                         ::scene::Scene *scene) {
-  std::vector<::scene::Body> user_input_bodies;
-  const bool good = mergeUserInputIntoScene(
-      user_input, scene->bodies, keep_space_around_bodies, allow_occlusions,
-      scene->height, scene->width, &user_input_bodies);
-  scene->__set_user_input_status(good ? UserInputStatus::NO_OCCLUSIONS
-                                      : UserInputStatus::HAD_OCCLUSIONS);
-  scene->__set_user_input_bodies(user_input_bodies);
-}
-
-int getNumObjectsInScene(const Scene &scene) {
-  int numObjects = 0;
-  std::vector<::scene::Body> bodies = scene.bodies;
-  bodies.insert(bodies.end(), scene.user_input_bodies.begin(),
-                scene.user_input_bodies.end());
-  for (::scene::Body &body : bodies) {
-    if (body.shapeType != ::scene::ShapeType::UNDEFINED) {
-      ++numObjects;
-    }
-  }
-  return numObjects;
-}
-
 int getNumObjects(const TaskSimulation &simulation) {
   const auto &scenes = simulation.sceneList;
   if (scenes.empty()) {
@@ -145,92 +127,203 @@ bool hadSimulationOcclusions(const TaskSimulation &simulation) {
              : scenes[0].user_input_status == UserInputStatus::HAD_OCCLUSIONS;
 }
 
+// Returns a numpy array that takes ownership of the vector data without
+// copying it.
+template <class T>
+py::array_t<T> moveToArray(std::vector<T> &&data,
+                           const std::vector<ssize_t> &shape) {
+  auto *owned = new std::vector<T>(std::move(data));
+  py::capsule freeWhenDone(owned, [](void *f) {
+    delete reinterpret_cast<std::vector<T> *>(f);
+  });
+  std::vector<ssize_t> strides(shape.size(), sizeof(T));
+  for (int i = static_cast<int>(shape.size()) - 2; i >= 0; --i) {
+    strides[i] = strides[i + 1] * shape[i + 1];
+  }
+  return py::array_t<T>(shape, strides, owned->data(), freeWhenDone);
+}
 
-void renderAllObjectMasksTo(const Scene &scene, uint8_t *bufferStart) {
-  const int imageSize = scene.width * scene.height;
-  int currentObjectIndex = 0;
-
-  // 辅助函数，用于渲染单个物体
-  auto renderSingleBody = [&](const ::scene::Body& body) {
-      // 创建一个只包含当前物体的临时场景
-      ::scene::Scene singleObjectScene;
-      singleObjectScene.__set_width(scene.width);
-      singleObjectScene.__set_height(scene.height);
-      singleObjectScene.bodies.push_back(body);
-
-      auto singleObjectImage = render(singleObjectScene);
+// Returns None or a tuple (frame_offsets, edges, normal_impulses) of numpy
+// arrays with the contact graph. normal_impulses is None if not requested.
+py::object contactGraphToArrays(TaskSimulation *simulation) {
+  if (!simulation->__isset.contactGraph) {
+    return py::none();
+  }
+  ::task::ContactGraph &graph = simulation->contactGraph;
+  const ssize_t numFrames = graph.frameOffsets.size();
+  const ssize_t numEdges = graph.edges.size() / 2;
+  py::object normalImpulses = py::none();
+  if (graph.__isset.normalImpulses) {
+    normalImpulses = moveToArray(std::move(graph.normalImpulses), {numEdges});
+  }
+  return py::make_tuple(
+      moveToArray(std::move(graph.frameOffsets), {numFrames}),
+      moveToArray(std::move(graph.edges), {numEdges, 2}), normalImpulses);
+}
 
-      // 计算当前物体掩码的写入位置
-      uint8_t* currentMaskBuffer = bufferStart + currentObjectIndex * imageSize;
+// Encodings of object masks returned by magic_ponies.
+enum ObjectMaskFormat {
+  // Byte per pixel, the full canvas for every object.
+  kMasksDense = 0,
+  // Bit per pixel, (height * width + 7) / 8 bytes for every object.
+  kMasksBits = 1,
+  // Byte per pixel within the tight bounding box of every object.
+  kMasksCrops = 2,
+};
 
-      // 检查渲染尺寸并复制
-      if (singleObjectImage.values.size() == imageSize) {
-          std::copy(singleObjectImage.values.begin(), singleObjectImage.values.end(), currentMaskBuffer);
-      } else {
-          fprintf(stderr, "Warning: Rendered object mask size mismatch. Expected %d, got %zu. Filling with 0.\n",
-                  imageSize, singleObjectImage.values.size());
-          std::fill(currentMaskBuffer, currentMaskBuffer + imageSize, 0);
+// Renders object masks for all scenes and encodes them with kMasksBits or
+// kMasksCrops. For kMasksBits returns a flat array with packed masks. For
+// kMasksCrops returns a tuple (boxes, offsets, data): boxes is an int32 array
+// (num_masks, 4) with (row, column, height, width) of every crop and the crop
+// of mask i is stored in row-major order in data[offsets[i]:offsets[i + 1]].
+py::object packCompactObjectMasks(const std::vector<Scene> &scenes,
+                                  int numSceneObjects, int height, int width,
+                                  int format) {
+  const int imageSize = height * width;
+  const ssize_t numMasks = scenes.size() * numSceneObjects;
+  // Masks of a single scene. Reused for all scenes.
+  std::vector<uint8_t> masks(numSceneObjects * imageSize);
+  if (format == kMasksBits) {
+    const int bytesPerMask = (imageSize + 7) / 8;
+    std::vector<uint8_t> packed(numMasks * bytesPerMask);
+    for (size_t i = 0; i < scenes.size(); ++i) {
+      renderObjectMasksTo(scenes[i], masks.data());
+      for (int object = 0; object < numSceneObjects; ++object) {
+        packMaskBits(masks.data() + object * imageSize, imageSize,
+                     packed.data() +
+                         (i * numSceneObjects + object) * bytesPerMask);
       }
-      currentObjectIndex++;
-  };
-
-  for (const auto& body : scene.bodies) {
-      // 跳过无效形状的物体
-      if (body.shapeType != ::scene::ShapeType::UNDEFINED) {
-          renderSingleBody(body);
+    }
+    return moveToArray(std::move(packed), {numMasks * bytesPerMask});
+  }
+  if (format != kMasksCrops) {
+    throw std::runtime_error("Unknown object mask format: " +
+                             std::to_string(format));
+  }
+  std::vector<int32_t> boxes;
+  boxes.reserve(numMasks * 4);
+  std::vector<int64_t> offsets;
+  offsets.reserve(numMasks + 1);
+  offsets.push_back(0);
+  std::vector<uint8_t> data;
+  for (const Scene &scene : scenes) {
+    renderObjectMasksTo(scene, masks.data());
+    for (int object = 0; object < numSceneObjects; ++object) {
+      const uint8_t *mask = masks.data() + object * imageSize;
+      const MaskBox box = getMaskBoundingBox(mask, height, width);
+      boxes.insert(boxes.end(), {box.row, box.column, box.height, box.width});
+      for (int row = box.row; row < box.row + box.height; ++row) {
+        const uint8_t *line = mask + row * width + box.column;
+        data.insert(data.end(), line, line + box.width);
       }
+      offsets.push_back(data.size());
+    }
   }
+  const ssize_t dataSize = data.size();
+  return py::make_tuple(moveToArray(std::move(boxes), {numMasks, 4}),
+                        moveToArray(std::move(offsets), {numMasks + 1}),
+                        moveToArray(std::move(data), {dataSize}));
+}
 
-  for (const auto& body : scene.user_input_bodies) {
-      if (body.shapeType != ::scene::ShapeType::UNDEFINED) {
-          renderSingleBody(body);
-      }
+// Encodings of images returned by magic_ponies.
+enum ImageFormat {
+  // Every frame is stored densely.
+  kImagesDense = 0,
+  // The first frame and changed pixels for every next frame (see
+  // image_delta.h).
+  kImagesDelta = 1,
+  // Every frame is stored densely as colors (see renderRgbTo).
+  kImagesRgb = 2,
+  kImagesRgba = 3,
+};
+
+// Number of bytes per pixel of dense image formats.
+int getImageChannels(int image_format) {
+  switch (image_format) {
+    case kImagesDense:
+      return 1;
+    case kImagesRgb:
+      return 3;
+    case kImagesRgba:
+      return 4;
   }
+  throw std::runtime_error("Unknown image format: " +
+                           std::to_string(image_format));
 }
 
+// Renders all scenes with delta encoding and returns a tuple (keyframe,
+// frame_offsets, changed_pixels, changed_values) of numpy arrays.
+py::tuple renderDeltaImages(const std::vector<Scene> &scenes, int height,
+                            int width) {
+  DeltaImageEncoder encoder(height, width);
+  for (const Scene &scene : scenes) {
+    renderTo(scene, encoder.nextFrameBuffer());
+    encoder.addFrame();
+  }
+  DeltaEncodedImages images = encoder.release();
+  const ssize_t numChanges = images.changedPixels.size();
+  const ssize_t numFrames = images.frameOffsets.size();
+  const ssize_t keyframeHeight = images.keyframe.empty() ? 0 : height;
+  return py::make_tuple(
+      moveToArray(std::move(images.keyframe), {keyframeHeight, width}),
+      moveToArray(std::move(images.frameOffsets), {numFrames}),
+      moveToArray(std::move(images.changedPixels), {numChanges}),
+      moveToArray(std::move(images.changedValues), {numChanges}));
+}
 
 auto magic_ponies(const py::bytes &serialized_task, const UserInput &user_input,
                   bool keep_space_around_bodies, int steps, int stride,
-                  bool need_images, bool need_featurized_objects, bool need_object_masks) {
+                  bool need_images, int image_format,
+                  bool need_featurized_objects, bool need_object_masks,
+                  int object_mask_format, int contacts) {
   SimpleTimer timer;
   Task task = deserialize<Task>(serialized_task);
   addUserInputToScene(user_input, keep_space_around_bodies,
                       /*allow_occlusions=*/false, &task.scene);
-  auto simulation = simulateTask(task, steps, stride);
+  auto simulation =
+      simulateTask(task, steps, stride, /*need_goal_distances=*/false,
+                   static_cast<ContactOutput>(contacts));
 
   const double simulation_seconds = timer.GetSeconds();
   const bool isSolved = simulation.isSolution;
   const bool hadOcclusions = hadSimulationOcclusions(simulation);
 
-  const int numImagesTotal = need_images ? simulation.sceneList.size() : 0;
+  const bool needDeltaImages = need_images && image_format == kImagesDelta;
+  const int imageChannels =
+      need_images && !needDeltaImages ? getImageChannels(image_format) : 1;
+  const int numImagesTotal =
+      need_images && !needDeltaImages ? simulation.sceneList.size() : 0;
   const int numScenesTotal =
       need_featurized_objects ? simulation.sceneList.size() : 0;
 
   const int imageSize = task.scene.width * task.scene.height;
-  uint8_t *packedImages = new uint8_t[imageSize * numImagesTotal];
-
+  const int64_t imageBytes = static_cast<int64_t>(imageSize) * imageChannels;
   const int numSceneObjects = getNumObjects(simulation);
-  // 添加物体掩码处理
-  uint8_t *packedObjectMasks = new uint8_t[imageSize * numImagesTotal * numSceneObjects];
-  
-  if (numImagesTotal > 0 && packedImages != nullptr) {
-    int imageWriteIndex = 0; // packedImages 的写入索引
-    int sceneIndex = 0;      // 当前处理的场景索引
-    for (const Scene &scene : simulation.sceneList) {
-      renderTo(scene, packedImages + imageWriteIndex);
-      imageWriteIndex += imageSize;
-
-      if (need_object_masks && packedObjectMasks != nullptr) {
-        // 计算当前场景所有掩码的起始写入位置
-        uint8_t* currentSceneMasksBuffer = packedObjectMasks + sceneIndex * numSceneObjects * imageSize;
-        // 调用新函数处理当前场景的所有掩码
-        renderAllObjectMasksTo(scene, currentSceneMasksBuffer);
-      }
-      sceneIndex++; // 处理下一个场景
+  const bool needDenseMasks =
+      need_object_masks && object_mask_format == kMasksDense;
+  const int numMaskScenesTotal =
+      needDenseMasks ? simulation.sceneList.size() : 0;
+  // Buffers are sized by the requested outputs only, so that e.g. masks do
+  // not cost anything unless requested.
+  const int64_t objectMasksSize =
+      static_cast<int64_t>(imageSize) * numSceneObjects * numMaskScenesTotal;
+  uint8_t *packedImages = new uint8_t[imageBytes * numImagesTotal];
+  uint8_t *packedObjectMasks = new uint8_t[objectMasksSize];
+  for (int i = 0; i < numImagesTotal; ++i) {
+    uint8_t *image = packedImages + i * imageBytes;
+    if (imageChannels == 1) {
+      renderTo(simulation.sceneList[i], image);
+    } else {
+      renderRgbTo(simulation.sceneList[i], imageChannels, image);
     }
   }
+  for (int i = 0; i < numMaskScenesTotal; ++i) {
+    renderObjectMasksTo(
+        simulation.sceneList[i],
+        packedObjectMasks + static_cast<int64_t>(i) * numSceneObjects *
+                                imageSize);
+  }
 
-  
   float *packedVectorizedBodies =
       new float[numSceneObjects * kObjectFeatureSize * numScenesTotal];
   if (numScenesTotal > 0) {
@@ -251,30 +344,150 @@ auto magic_ponies(const py::bytes &serialized_task, const UserInput &user_input,
     auto *foo = reinterpret_cast<float *>(f);
     delete[] foo;
   });
-  // 添加物体掩码内存管理
   py::capsule freeObjectMasksWhenDone(packedObjectMasks, [](void *f) {
     auto *foo = reinterpret_cast<uint8_t *>(f);
     delete[] foo;
   });
 
-  auto packedImagesArray =
-      py::array_t<uint8_t>({numImagesTotal * imageSize},  // shape
+  py::object packedImagesArray =
+      py::array_t<uint8_t>({numImagesTotal * imageBytes},  // shape
                            {sizeof(uint8_t)}, packedImages, freeImagesWhenDone);
+  if (needDeltaImages) {
+    packedImagesArray = renderDeltaImages(simulation.sceneList,
+                                          task.scene.height, task.scene.width);
+  }
   auto packedObjectsArray = py::array_t<float>(
       {numScenesTotal * numSceneObjects * kObjectFeatureSize},  // shape
       {sizeof(float)}, packedVectorizedBodies, freeObjectsWhenDone);
 
-  auto packedObjectMasksArray = need_object_masks ?
-      py::array_t<uint8_t>({numImagesTotal * numSceneObjects * imageSize},  // shape
-                          {sizeof(uint8_t)}, packedObjectMasks, freeObjectMasksWhenDone) :
-      py::array_t<uint8_t>(0);
-    
+  py::object packedObjectMasksArray = py::array_t<uint8_t>(
+      {objectMasksSize},  // shape
+      {sizeof(uint8_t)}, packedObjectMasks, freeObjectMasksWhenDone);
+  if (need_object_masks && !needDenseMasks) {
+    packedObjectMasksArray = packCompactObjectMasks(
+        simulation.sceneList, numSceneObjects, task.scene.height,
+        task.scene.width, object_mask_format);
+  }
+
+  const py::object contactGraph = contactGraphToArrays(&simulation);
+
   const double pack_seconds = timer.GetSeconds();
   return std::make_tuple(isSolved, hadOcclusions, packedImagesArray,
     packedObjectMasksArray, numSceneObjects,
-    packedObjectsArray, numSceneObjects,
+    packedObjectsArray, numSceneObjects, contactGraph,
     simulation_seconds, pack_seconds);
 }
+
+// Simulates a task with user input and yields observations in chunks of at
+// most chunkFrames frames. The chunk size is additionally capped so that a
+// single chunk does not take more than maxChunkBytes bytes.
+class FrameStream {
+ public:
+  FrameStream(Task task, const UserInput &user_input,
+              bool keep_space_around_bodies, int steps, int stride,
+              bool need_images, bool need_featurized_objects,
+              bool need_object_masks, int chunk_size, int64_t max_chunk_bytes)
+      : task_(std::move(task)),
+        needImages_(need_images),
+        needFeaturizedObjects_(need_featurized_objects),
+        needObjectMasks_(need_object_masks) {
+    if (chunk_size <= 0) {
+      throw std::runtime_error("Chunk size must be positive");
+    }
+    addUserInputToScene(user_input, keep_space_around_bodies,
+                        /*allow_occlusions=*/false, &task_.scene);
+    hadOcclusions_ =
+        task_.scene.user_input_status == UserInputStatus::HAD_OCCLUSIONS;
+    numSceneObjects_ = getNumObjectsInScene(task_.scene);
+
+    const int64_t imageSize = task_.scene.width * task_.scene.height;
+    const int64_t bytesPerFrame =
+        (needImages_ ? imageSize : 0) +
+        (needObjectMasks_ ? imageSize * numSceneObjects_ : 0) +
+        (needFeaturizedObjects_
+             ? sizeof(float) * kObjectFeatureSize * numSceneObjects_
+             : 0);
+    chunkFrames_ = chunk_size;
+    if (bytesPerFrame > 0 && max_chunk_bytes > 0) {
+      chunkFrames_ = std::max<int64_t>(
+          1, std::min<int64_t>(chunk_size, max_chunk_bytes / bytesPerFrame));
+    }
+    stream_.reset(new TaskSimulationStream(task_, steps, stride));
+  }
+
+  // Returns a tuple (images, featurized_objects, object_masks) with arrays of
+  // shapes (frames, height, width), (frames, objects, feature_size), and
+  // (frames, objects, height, width). Arrays that were not requested have
+  // zero frames.
+  py::tuple next() {
+    scenes_.clear();
+    {
+      py::gil_scoped_release release;
+      stream_->advance(chunkFrames_, &scenes_);
+    }
+    if (scenes_.empty()) {
+      throw py::stop_iteration();
+    }
+    const ssize_t numFrames = scenes_.size();
+    const ssize_t height = task_.scene.height;
+    const ssize_t width = task_.scene.width;
+    const ssize_t imageSize = height * width;
+
+    py::array_t<uint8_t> images({needImages_ ? numFrames : 0, height, width});
+    py::array_t<float> objects(
+        {needFeaturizedObjects_ ? numFrames : 0,
+         static_cast<ssize_t>(numSceneObjects_),
+         static_cast<ssize_t>(kObjectFeatureSize)});
+    py::array_t<uint8_t> masks(
+        {needObjectMasks_ ? numFrames : 0,
+         static_cast<ssize_t>(numSceneObjects_), height, width});
+    uint8_t *imagesData = images.mutable_data();
+    float *objectsData = objects.mutable_data();
+    uint8_t *masksData = masks.mutable_data();
+    {
+      py::gil_scoped_release release;
+      for (ssize_t i = 0; i < numFrames; ++i) {
+        if (needImages_) {
+          renderTo(scenes_[i], imagesData + i * imageSize);
+        }
+        if (needFeaturizedObjects_) {
+          featurizeScene(scenes_[i], objectsData + i * numSceneObjects_ *
+                                                       kObjectFeatureSize);
+        }
+        if (needObjectMasks_) {
+          renderObjectMasksTo(scenes_[i],
+                                 masksData + i * numSceneObjects_ * imageSize);
+        }
+      }
+    }
+    return py::make_tuple(images, objects, masks);
+  }
+
+  bool done() const { return stream_->done(); }
+
+  bool isSolved() const {
+    if (!stream_->done()) {
+      throw std::runtime_error("The stream has not been exhausted yet");
+    }
+    return stream_->isSolution();
+  }
+
+  int stepsSimulated() const { return stream_->stepsSimulated(); }
+  bool hadOcclusions() const { return hadOcclusions_; }
+  int numSceneObjects() const { return numSceneObjects_; }
+  int chunkFrames() const { return chunkFrames_; }
+
+ private:
+  Task task_;
+  const bool needImages_;
+  const bool needFeaturizedObjects_;
+  const bool needObjectMasks_;
+  bool hadOcclusions_;
+  int numSceneObjects_;
+  int chunkFrames_;
+  std::unique_ptr<TaskSimulationStream> stream_;
+  std::vector<Scene> scenes_;
+};
 }  // namespace
 
 PYBIND11_MODULE(simulator_bindings, m) {
@@ -342,26 +555,115 @@ PYBIND11_MODULE(simulator_bindings, m) {
 
   m.def(
       "simulate_task",
-      [](const py::bytes &task, int steps, int stride) {
+      [](const py::bytes &task, int steps, int stride,
+         bool need_goal_distances, int contacts) {
         const TaskSimulation results =
-            simulateTask(deserialize<Task>(task), steps, stride);
+            simulateTask(deserialize<Task>(task), steps, stride,
+                         need_goal_distances,
+                         static_cast<ContactOutput>(contacts));
         return serialize(results);
       },
+      py::arg("task"), py::arg("steps"), py::arg("stride"),
+      py::arg("need_goal_distances") = false, py::arg("contacts") = 0,
       "Produce TaskSimulation");
 
+  m.attr("IMAGES_DENSE") = static_cast<int>(kImagesDense);
+  m.attr("IMAGES_DELTA") = static_cast<int>(kImagesDelta);
+  m.attr("IMAGES_RGB") = static_cast<int>(kImagesRgb);
+  m.attr("IMAGES_RGBA") = static_cast<int>(kImagesRgba);
+
+  m.def(
+      "decode_delta_images",
+      [](py::array_t<uint8_t, py::array::c_style> keyframe,
+         py::array_t<int64_t, py::array::c_style> frame_offsets,
+         py::array_t<int32_t, py::array::c_style> changed_pixels,
+         py::array_t<uint8_t, py::array::c_style> changed_values, int begin,
+         int end) {
+        if (keyframe.ndim() != 2) {
+          throw std::runtime_error("Keyframe must have two dimensions");
+        }
+        if (frame_offsets.ndim() != 1 || changed_pixels.ndim() != 1 ||
+            changed_values.ndim() != 1 ||
+            changed_pixels.size() != changed_values.size()) {
+          throw std::runtime_error("Inconsistent delta encoded images");
+        }
+        const ssize_t height = keyframe.shape(0);
+        const ssize_t width = keyframe.shape(1);
+        // Arrays come from the caller, so check them with the GIL held
+        // before anything is written.
+        checkDeltaImages(height * width, frame_offsets.data(),
+                         frame_offsets.size(), changed_pixels.data(),
+                         changed_pixels.size());
+        py::array_t<uint8_t> images(
+            {static_cast<ssize_t>(std::max(end - begin, 0)), height, width});
+        uint8_t *imagesData = images.mutable_data();
+        {
+          py::gil_scoped_release release;
+          decodeDeltaImages(keyframe.data(), height * width,
+                            frame_offsets.data(), frame_offsets.size(),
+                            changed_pixels.data(), changed_values.data(),
+                            changed_pixels.size(), begin, end, imagesData);
+        }
+        return images;
+      },
+      "Decodes frames [begin, end) of delta encoded images returned by"
+      " magic_ponies and returns an array (frames, height, width)");
+
+  m.attr("MASKS_DENSE") = static_cast<int>(kMasksDense);
+  m.attr("MASKS_BITS") = static_cast<int>(kMasksBits);
+  m.attr("MASKS_CROPS") = static_cast<int>(kMasksCrops);
+
+  m.attr("CONTACTS_NONE") = static_cast<int>(ContactOutput::NONE);
+  m.attr("CONTACTS_EDGES") = static_cast<int>(ContactOutput::EDGES);
+  m.attr("CONTACTS_EDGES_AND_IMPULSES") =
+      static_cast<int>(ContactOutput::EDGES_AND_IMPULSES);
+
+  m.attr("SUMMARY_FIRST_TOUCH_STEP") = kSummaryFirstTouchStep;
+  m.attr("SUMMARY_MIN_GOAL_DISTANCE") = kSummaryMinGoalDistance;
+  m.attr("SUMMARY_FINAL_POSITIONS") = kSummaryFinalPositions;
+  m.attr("SUMMARY_MAX_USER_BODY_SPEED") = kSummaryMaxUserBodySpeed;
+  m.attr("SUMMARY_ALL") = kSummaryAll;
+
+  m.def(
+      "simulate_task_summary",
+      [](const py::bytes &serialized_task,
+         const py::bytes &serialized_user_input, bool keep_space_around_bodies,
+         int steps, unsigned stats) {
+        Task task = deserialize<Task>(serialized_task);
+        const bool hasUserInput = py::len(serialized_user_input) > 0;
+        const UserInput user_input =
+            hasUserInput ? deserialize<UserInput>(serialized_user_input)
+                         : UserInput();
+        TaskSimulationSummary summary;
+        {
+          py::gil_scoped_release release;
+          if (hasUserInput) {
+            addUserInputToScene(user_input, keep_space_around_bodies,
+                                /*allow_occlusions=*/false, &task.scene);
+          }
+          summary = simulateTaskSummary(task, steps, stats);
+        }
+        return serialize(summary);
+      },
+      "Simulates the task with optional user input (empty bytes for none)"
+      " and returns a serialized TaskSimulationSummary with the requested"
+      " statistics");
+
   m.def(
     "magic_ponies",
     [](const py::bytes &serialized_task, py::array_t<int32_t> points,
         const std::vector<float> &rectangulars_vertices_flatten,
         const std::vector<float> &balls_flatten, bool keep_space_around_bodies,
         int steps, int stride, bool need_images,
-        bool need_featurized_objects, bool need_object_masks = false) {
+        int image_format,
+        bool need_featurized_objects, bool need_object_masks,
+        int object_mask_format, int contacts) {
       const UserInput user_input = buildUserInputObject(
           points, rectangulars_vertices_flatten, balls_flatten);
       return magic_ponies(serialized_task, user_input,
                           keep_space_around_bodies, steps, stride,
-                          need_images, need_featurized_objects,
-                          need_object_masks);
+                          need_images, image_format, need_featurized_objects,
+                          need_object_masks, object_mask_format, contacts);
     },
     "Runs simulation for a batch of tasks and inputs and returns a list of"
     " isSolved statuses, list of hadOcclusion statuses, number of steps"
@@ -373,18 +675,126 @@ PYBIND11_MODULE(simulator_bindings, m) {
       [](const py::bytes &serialized_task,
           const py::bytes &serialized_user_input,
           bool keep_space_around_bodies, int steps, int stride, bool need_images,
-          bool need_featurized_objects, bool need_object_masks = false) {
+        int image_format,
+          bool need_featurized_objects, bool need_object_masks,
+        int object_mask_format, int contacts) {
         return magic_ponies(serialized_task,
                             deserialize<UserInput>(serialized_user_input),
                             keep_space_around_bodies, steps, stride,
-                            need_images, need_featurized_objects,
-                            need_object_masks);
+                            need_images, image_format,
+                            need_featurized_objects, need_object_masks,
+                            object_mask_format, contacts);
       },
       "Runs simulation for a batch of tasks and inputs and returns a list of"
       " isSolved statuses, list of hadOcclusion statuses, number of steps"
       " within each simulation, packed flatten array of images, object masks and timing"
       " info.");
 
+  py::class_<FrameStream>(m, "FrameStream")
+      .def(
+          "__iter__", [](FrameStream &self) -> FrameStream & { return self; },
+          py::return_value_policy::reference_internal)
+      .def("__next__", &FrameStream::next)
+      .def_property_readonly("done", &FrameStream::done)
+      .def_property_readonly("is_solved", &FrameStream::isSolved)
+      .def_property_readonly("had_occlusions", &FrameStream::hadOcclusions)
+      .def_property_readonly("steps_simulated", &FrameStream::stepsSimulated)
+      .def_property_readonly("num_scene_objects",
+                             &FrameStream::numSceneObjects)
+      .def_property_readonly("chunk_frames", &FrameStream::chunkFrames);
+
+  m.def(
+      "simulate_tasks_as_completed",
+      [](const std::vector<py::bytes> &serialized_tasks, int num_workers,
+         int steps, int stride, py::function callback) {
+        std::vector<Task> tasks;
+        tasks.reserve(serialized_tasks.size());
+        for (const py::bytes &serialized_task : serialized_tasks) {
+          tasks.push_back(deserialize<Task>(serialized_task));
+        }
+        // Other Python threads run while this one waits for the workers. The
+        // GIL is only taken back for the callback.
+        py::gil_scoped_release release;
+        simulateTasksAsCompleted(
+            tasks, num_workers, steps, stride,
+            [&callback](size_t index, TaskSimulation &&simulation) {
+              const thrift_serialization::ByteSpan span =
+                  thrift_serialization::serializeToSpan(simulation);
+              py::gil_scoped_acquire acquire;
+              callback(index, py::bytes(reinterpret_cast<const char *>(
+                                            span.data),
+                                        span.size));
+            });
+      },
+      "Simulates a batch of tasks using a pool of worker processes and calls"
+      " callback(index, serialized_task_simulation) as soon as each"
+      " simulation is finished");
+
+  m.def(
+      "magic_ponies_stream",
+      [](const py::bytes &serialized_task,
+         const py::bytes &serialized_user_input,
+         bool keep_space_around_bodies, int steps, int stride, bool need_images,
+         bool need_featurized_objects, bool need_object_masks, int chunk_size,
+         int64_t max_chunk_bytes) {
+        return new FrameStream(
+            deserialize<Task>(serialized_task),
+            deserialize<UserInput>(serialized_user_input),
+            keep_space_around_bodies, steps, stride, need_images,
+            need_featurized_objects, need_object_masks, chunk_size,
+            max_chunk_bytes);
+      },
+      "Runs simulation for a task with user input and returns an iterator"
+      " over chunks of images, featurized objects and object masks. The"
+      " simulation is advanced lazily as chunks are consumed.");
+
+  py::class_<RolloutDatasetWriter>(m, "RolloutDatasetWriter")
+      .def(py::init([](const std::string &path, bool compress,
+                       int resolution) {
+             RolloutDatasetOptions options;
+             options.resolution = resolution;
+             if (!compress) {
+               options.images = ColumnCodec::RAW;
+               options.featurizedObjects = ColumnCodec::RAW;
+               options.objectMasks = ColumnCodec::RAW;
+             }
+             return new RolloutDatasetWriter(path, options);
+           }),
+           py::arg("path"), py::arg("compress") = true,
+           py::arg("resolution") = 0)
+      .def(
+          "add",
+          [](RolloutDatasetWriter &self, const std::string &task_id,
+             int action_index, const py::bytes &serialized_task,
+             const py::bytes &serialized_user_input,
+             bool keep_space_around_bodies, int steps, int stride,
+             bool need_images, bool need_featurized_objects,
+             bool need_object_masks) {
+            Task task = deserialize<Task>(serialized_task);
+            const UserInput user_input =
+                deserialize<UserInput>(serialized_user_input);
+            // addSimulation locks the writer, so threads sharing it do not
+            // need the GIL to serialize appends.
+            py::gil_scoped_release release;
+            addUserInputToScene(user_input, keep_space_around_bodies,
+                                /*allow_occlusions=*/false, &task.scene);
+            if (task.scene.user_input_status ==
+                UserInputStatus::HAD_OCCLUSIONS) {
+              return false;
+            }
+            const TaskSimulation simulation =
+                simulateTask(task, steps, stride);
+            self.addSimulation(task_id, action_index, simulation, need_images,
+                               need_featurized_objects, need_object_masks);
+            return true;
+          },
+          "Simulates the task with the user input and appends the rollout to"
+          " the dataset. Returns False and writes nothing if the input had"
+          " occlusions.")
+      .def("close", &RolloutDatasetWriter::close)
+      .def_property_readonly("num_rollouts",
+                             &RolloutDatasetWriter::numRollouts);
+
   m.def(
       "render",
       [](const py::bytes &scene) {
@@ -395,6 +805,107 @@ PYBIND11_MODULE(simulator_bindings, m) {
       },
       "Produce Image");
 
+  m.def(
+      "render_rgb",
+      [](const py::bytes &scene, int num_channels) {
+        const Scene sceneObj = deserialize<Scene>(scene);
+        py::array_t<uint8_t> image({static_cast<ssize_t>(sceneObj.height),
+                                    static_cast<ssize_t>(sceneObj.width),
+                                    static_cast<ssize_t>(num_channels)});
+        renderRgbTo(sceneObj, num_channels, image.mutable_data());
+        return image;
+      },
+      "Renders a scene into an array (height, width, num_channels) of RGB or"
+      " RGBA colors with rows from top to bottom");
+
+  m.def(
+      "render_featurized_objects",
+      [](py::array_t<float, py::array::c_style | py::array::forcecast>
+             featurized_objects,
+         int num_threads) {
+        if (featurized_objects.ndim() != 3 ||
+            featurized_objects.shape(2) != kObjectFeatureSize) {
+          throw std::runtime_error(
+              "Featurized objects must have shape (frames, objects, "
+              "OBJECT_FEATURE_SIZE)");
+        }
+        const ssize_t numFrames = featurized_objects.shape(0);
+        const ssize_t numObjects = featurized_objects.shape(1);
+        py::array_t<uint8_t> images({numFrames,
+                                     static_cast<ssize_t>(kSceneHeight),
+                                     static_cast<ssize_t>(kSceneWidth)});
+        uint8_t *imagesData = images.mutable_data();
+        {
+          py::gil_scoped_release release;
+          renderFeaturizedObjectsTo(featurized_objects.data(), numFrames,
+                                    numObjects, num_threads, imagesData);
+        }
+        return images;
+      },
+      "Renders an array (frames, objects, OBJECT_FEATURE_SIZE) of featurized"
+      " objects on num_threads threads and returns an array (frames, height,"
+      " width) of color codes");
+
+  m.def(
+      "simulate_featurized_objects",
+      [](py::array_t<float, py::array::c_style | py::array::forcecast>
+             featurized_objects,
+         int steps, int stride, int num_threads) {
+        if (featurized_objects.ndim() != 3 ||
+            featurized_objects.shape(2) != kObjectFeatureSize) {
+          throw std::runtime_error(
+              "Featurized objects must have shape (states, objects, "
+              "OBJECT_FEATURE_SIZE)");
+        }
+        const ssize_t numStates = featurized_objects.shape(0);
+        const ssize_t numObjects = featurized_objects.shape(1);
+        // Validates steps and stride before anything is allocated.
+        const int numFrames = getNumFeaturizedFrames(steps, stride);
+        py::array_t<float> result({numStates, static_cast<ssize_t>(numFrames),
+                                   numObjects,
+                                   static_cast<ssize_t>(kObjectFeatureSize)});
+        float *resultData = result.mutable_data();
+        {
+          py::gil_scoped_release release;
+          simulateFeaturizedObjectsTo(featurized_objects.data(), numStates,
+                                      numObjects, steps, stride, num_threads,
+                                      resultData);
+        }
+        return result;
+      },
+      "Simulates every state of an array (states, objects,"
+      " OBJECT_FEATURE_SIZE) of featurized objects for steps steps on"
+      " num_threads threads and returns an array (states, frames, objects,"
+      " OBJECT_FEATURE_SIZE) of every stride-th frame");
+
+  m.def(
+      "get_initial_observations",
+      [](const std::vector<std::string> &serializedTasks, int num_threads) {
+        py::array_t<uint8_t> images(
+            {static_cast<ssize_t>(serializedTasks.size()),
+             static_cast<ssize_t>(kSceneHeight),
+             static_cast<ssize_t>(kSceneWidth)});
+        uint8_t *imagesData = images.mutable_data();
+        std::vector<std::vector<float>> featurizedObjects;
+        {
+          py::gil_scoped_release release;
+          getInitialObservationsTo(serializedTasks, num_threads, imagesData,
+                                   &featurizedObjects);
+        }
+        py::list objects;
+        for (std::vector<float> &features : featurizedObjects) {
+          const ssize_t numObjects = features.size() / kObjectFeatureSize;
+          objects.append(moveToArray(
+              std::move(features),
+              {numObjects, static_cast<ssize_t>(kObjectFeatureSize)}));
+        }
+        return py::make_tuple(images, objects);
+      },
+      "Renders and featurizes the scenes of serialized tasks on num_threads"
+      " threads and returns a tuple (images, featurized_objects) of an array"
+      " (tasks, height, width) of color codes and a list of arrays (objects,"
+      " OBJECT_FEATURE_SIZE) with jars shifted to the center of mass");
+
   m.def(
       "featurize_scene",
       [](const py::bytes &scene) {
@@ -406,6 +917,271 @@ PYBIND11_MODULE(simulator_bindings, m) {
       },
       "Convert Scene to featurized matrix of object vectors");
 
+  m.def(
+      "get_simulation_stats",
+      [](bool reset) {
+        const SimulationStats stats = getSimulationStats(reset);
+        py::dict rollouts;
+        rollouts["solved_early"] = stats.rollouts[static_cast<int>(
+            TerminationReason::SOLVED_EARLY)];
+        rollouts["max_steps"] =
+            stats.rollouts[static_cast<int>(TerminationReason::MAX_STEPS)];
+        rollouts["quiescent"] =
+            stats.rollouts[static_cast<int>(TerminationReason::QUIESCENT)];
+        rollouts["occluded"] =
+            stats.rollouts[static_cast<int>(TerminationReason::OCCLUDED)];
+        py::dict result;
+        result["rollouts"] = rollouts;
+        result["steps_simulated"] = statsHistogramToDict(stats.stepsSimulated);
+        result["num_bodies"] = statsHistogramToDict(stats.numBodies);
+        result["latency_us"] = statsHistogramToDict(stats.latencyMicros);
+        result["call_latency_us"] =
+            statsHistogramToDict(stats.callLatencyMicros);
+        return result;
+      },
+      py::arg("reset") = false,
+      "Returns process-wide counters of simulated rollouts. If reset is set,"
+      " the counters are atomically reset to zero.");
+
+  m.def("reset_simulation_stats", &resetSimulationStats,
+        "Resets process-wide counters of simulated rollouts.");
+
+  py::class_<SimulationMemo>(m, "SimulationMemo")
+      .def(py::init<size_t, const std::string &>(), py::arg("capacity"),
+           py::arg("path") = "",
+           "Memo of simulation results with an LRU tier of the given"
+           " capacity and an optional append-only file tier.")
+      .def("stats",
+           [](const SimulationMemo &self) {
+             const SimulationMemoStats stats = self.stats();
+             py::dict result;
+             result["hits"] = stats.hits;
+             result["disk_hits"] = stats.diskHits;
+             result["misses"] = stats.misses;
+             result["size"] = stats.size;
+             result["disk_size"] = stats.diskSize;
+             return result;
+           })
+      .def("clear", &SimulationMemo::clear,
+           "Drops the memory tier. The file is kept.");
+
+  m.def(
+      "simulate_task_summary_memoized",
+      [](const py::bytes &serialized_task,
+         const py::bytes &serialized_user_input,
+         bool keep_space_around_bodies, bool skip_occluded, int steps,
+         unsigned stats, SimulationMemo *memo) {
+        const std::string task_bytes = serialized_task;
+        const Task task = deserialize<Task>(serialized_task);
+        const UserInput user_input =
+            deserialize<UserInput>(serialized_user_input);
+        MemoizedSimulation simulation;
+        {
+          py::gil_scoped_release release;
+          const SimulationKey task_key =
+              getBytesKey(task_bytes.data(), task_bytes.size());
+          simulation = simulateTaskSummaryMemoized(
+              task, task_key, user_input, keep_space_around_bodies,
+              skip_occluded, steps, stats, memo);
+        }
+        return std::make_tuple(simulation.hadOcclusions,
+                               serialize(simulation.summary));
+      },
+      py::arg("serialized_task"), py::arg("serialized_user_input"),
+      py::arg("keep_space_around_bodies"), py::arg("skip_occluded"),
+      py::arg("steps"), py::arg("stats"), py::arg("memo"),
+      "Same as simulate_task_summary with user input, but the result is"
+      " looked up in the memo first. Inputs that produce the same bodies"
+      " share the result. Returns (had_occlusions, serialized summary). If"
+      " skip_occluded is set, occluding inputs are not simulated. memo may"
+      " be None.");
+
+  m.def(
+      "evaluate_task_complexity",
+      [](const std::vector<py::bytes> &serialized_tasks,
+         const std::vector<std::tuple<std::string, double, bool, bool>> &tiers,
+         py::function action_pool_provider, py::object progress_callback,
+         int64_t min_valid_attempts, int chunk_size, int action_pool_size,
+         double p_value, int64_t min_solutions, size_t max_solutions_to_keep,
+         int num_threads, bool reject_ball_solvable, int steps) {
+        std::vector<Task> tasks;
+        tasks.reserve(serialized_tasks.size());
+        for (const py::bytes &serialized_task : serialized_tasks) {
+          tasks.push_back(deserialize<Task>(serialized_task));
+        }
+        std::vector<ActionTier> actionTiers;
+        for (const auto &[name, threshold, keepSpace, occlusionsAllowed] :
+             tiers) {
+          actionTiers.push_back(
+              ActionTier{name, threshold, keepSpace, occlusionsAllowed});
+        }
+        TaskComplexityOptions options;
+        options.minValidAttempts = min_valid_attempts;
+        options.chunkSize = chunk_size;
+        options.actionPoolSize = action_pool_size;
+        options.pValue = p_value;
+        options.minSolutions = min_solutions;
+        options.maxSolutionsToKeep = max_solutions_to_keep;
+        options.numThreads = num_threads;
+        options.rejectBallSolvable = reject_ball_solvable;
+        options.steps = steps;
+        // The provider is only called from this thread between the parallel
+        // phases of a step.
+        const auto provider = [&action_pool_provider](size_t tierIndex,
+                                                      int pool) {
+          py::gil_scoped_acquire acquire;
+          std::vector<std::optional<UserInput>> actions;
+          const auto items = action_pool_provider(tierIndex, pool)
+                                 .cast<std::vector<py::object>>();
+          for (const py::object &item : items) {
+            if (item.is_none()) {
+              actions.emplace_back();
+            } else {
+              actions.emplace_back(
+                  deserialize<UserInput>(item.cast<py::bytes>()));
+            }
+          }
+          return actions;
+        };
+        TaskComplexityEvaluator evaluator(std::move(tasks),
+                                          std::move(actionTiers), provider,
+                                          options);
+        {
+          py::gil_scoped_release release;
+          while (!evaluator.step()) {
+            if (!progress_callback.is_none()) {
+              py::gil_scoped_acquire acquire;
+              progress_callback(evaluator.numSimulations());
+            }
+          }
+        }
+        py::list results;
+        const auto &stats = evaluator.stats();
+        for (size_t task = 0; task < stats.size(); ++task) {
+          for (size_t tier = 0; tier < stats[task].size(); ++tier) {
+            const TaskTierStats &tierStats = stats[task][tier];
+            // The SOLVED counter is always zero, as in the Python evaller.
+            std::map<int, int64_t> statusCounts;
+            for (int i = 0; i < kNumActionStatuses; ++i) {
+              statusCounts[i - 1] = tierStats.statusCounts[i];
+            }
+            py::dict result;
+            result["task_index"] = task;
+            result["tier_index"] = tier;
+            result["status_counts"] = statusCounts;
+            result["solutions"] = tierStats.solutions;
+            result["unstable_solutions"] = tierStats.unstableSolutions;
+            results.append(result);
+          }
+        }
+        return results;
+      },
+      py::arg("tasks"), py::arg("tiers"), py::arg("action_pool_provider"),
+      py::arg("progress_callback"), py::arg("min_valid_attempts"),
+      py::arg("chunk_size"), py::arg("action_pool_size"), py::arg("p_value"),
+      py::arg("min_solutions"), py::arg("max_solutions_to_keep"),
+      py::arg("num_threads"), py::arg("reject_ball_solvable"),
+      py::arg("steps"),
+      "Estimates solvability of every (task, tier) pair by random search on"
+      " a pool of threads. tiers is a list of (name, solvability_threshold,"
+      " keep_space_around_bodies, occlusions_allowed). action_pool_provider"
+      "(tier_index, pool) returns a list of serialized user inputs (None for"
+      " invalid actions). progress_callback(num_simulations) is called after"
+      " every step unless None. Returns a list of dicts with status_counts,"
+      " solutions and unstable_solutions (action indices) for every pair.");
+
+  m.def(
+      "check_solution_stability",
+      [](const py::bytes &serialized_task,
+         const py::bytes &serialized_user_input,
+         bool keep_space_around_bodies, bool occlusions_allowed, int steps,
+         int num_threads) {
+        const Task task = deserialize<Task>(serialized_task);
+        const UserInput user_input =
+            deserialize<UserInput>(serialized_user_input);
+        const ActionTier tier{"", 0, keep_space_around_bodies,
+                              occlusions_allowed};
+        py::gil_scoped_release release;
+        return checkSolutionStability(task, user_input, tier, steps,
+                                      num_threads) ==
+               ActionStatus::STABLY_SOLVED;
+      },
+      "Simulates the 8 neighbors of a solution concurrently and returns"
+      " whether none of them is not solved. The remaining simulations are"
+      " cancelled as soon as one neighbor fails. num_threads <= 0 means one"
+      " thread per neighbor.");
+
+  m.def(
+      "compute_solution_power",
+      [](const std::vector<py::bytes> &serialized_tasks,
+         const std::vector<py::bytes> &serialized_user_inputs,
+         bool keep_space_around_bodies, bool occlusions_allowed, int steps,
+         int num_threads) {
+        std::vector<Task> tasks;
+        tasks.reserve(serialized_tasks.size());
+        for (const py::bytes &serialized_task : serialized_tasks) {
+          tasks.push_back(deserialize<Task>(serialized_task));
+        }
+        std::vector<UserInput> userInputs;
+        userInputs.reserve(serialized_user_inputs.size());
+        for (const py::bytes &serialized_user_input : serialized_user_inputs) {
+          userInputs.push_back(deserialize<UserInput>(serialized_user_input));
+        }
+        const ActionTier tier{"", 0, keep_space_around_bodies,
+                              occlusions_allowed};
+        py::array_t<uint8_t> solved({static_cast<ssize_t>(userInputs.size()),
+                                     static_cast<ssize_t>(tasks.size())});
+        {
+          py::gil_scoped_release release;
+          const std::vector<uint8_t> matrix = computeSolutionPower(
+              tasks, userInputs, tier, steps, num_threads);
+          std::copy(matrix.begin(), matrix.end(), solved.mutable_data());
+        }
+        return solved;
+      },
+      "Simulates every user input on every task using num_threads threads"
+      " and returns an array (user inputs, tasks) with 1 for solved pairs");
+
+  m.def(
+      "evaluate_ranked_actions",
+      [](const py::bytes &serialized_task,
+         const std::vector<py::object> &serialized_user_inputs,
+         bool keep_space_around_bodies, bool occlusions_allowed,
+         int64_t max_attempts, bool stop_on_solution, int steps,
+         int num_threads) {
+        const Task task = deserialize<Task>(serialized_task);
+        std::vector<std::optional<UserInput>> userInputs;
+        userInputs.reserve(serialized_user_inputs.size());
+        for (const py::object &item : serialized_user_inputs) {
+          if (item.is_none()) {
+            userInputs.emplace_back();
+          } else {
+            userInputs.emplace_back(
+                deserialize<UserInput>(item.cast<py::bytes>()));
+          }
+        }
+        const ActionTier tier{"", 0, keep_space_around_bodies,
+                              occlusions_allowed};
+        std::vector<ActionStatus> statuses;
+        {
+          py::gil_scoped_release release;
+          statuses = evaluateRankedUserInputs(task, userInputs, tier,
+                                              max_attempts, stop_on_solution,
+                                              steps, num_threads);
+        }
+        std::vector<int> result;
+        result.reserve(statuses.size());
+        for (const ActionStatus status : statuses) {
+          result.push_back(static_cast<int>(status));
+        }
+        return result;
+      },
+      "Simulates ranked serialized user inputs (None for invalid actions)"
+      " in order until max_attempts of them are valid or, if"
+      " stop_on_solution, until the first solution. The next num_threads"
+      " inputs are simulated speculatively in parallel. Returns the statuses"
+      " of the inputs the sequential loop would simulate, in rank order.");
+
   // This function is left here to suppress odd weak-reference warning in
   // Thrift. It's not doing anything useful.
   m.def(
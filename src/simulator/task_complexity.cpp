@@ -0,0 +1,478 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "task_complexity.h"
+
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+
+#include "image_to_box2d.h"
+#include "utils/parallel_for.h"
+
+namespace {
+
+// Shift of the neighbor actions in the stability check, in pixels.
+constexpr double kNeighborShift = 0.5;
+// Relative contribution below which tail terms of the binomial distribution
+// are dropped.
+constexpr double kTailTolerance = 1e-17;
+constexpr double kTrivialSolvedFraction = 0.1;
+constexpr char kBallTierName[] = "ball";
+
+double binomialLogPmf(int64_t k, int64_t n, double logP, double log1mP) {
+  return lgamma(n + 1.0) - lgamma(k + 1.0) - lgamma(n - k + 1.0) + k * logP +
+         (n - k) * log1mP;
+}
+
+// P(X >= k). Terms decay geometrically above the mean, so the sum is stopped
+// once they become negligible.
+double binomialUpperTail(int64_t k, int64_t n, double p) {
+  const double logP = log(p), log1mP = log1p(-p);
+  const double mean = n * p;
+  double sum = 0;
+  for (int64_t j = std::max<int64_t>(k, 0); j <= n; ++j) {
+    const double term = exp(binomialLogPmf(j, n, logP, log1mP));
+    sum += term;
+    if (j > mean && term <= sum * kTailTolerance) {
+      break;
+    }
+  }
+  return sum;
+}
+
+// P(X <= k).
+double binomialLowerTail(int64_t k, int64_t n, double p) {
+  const double logP = log(p), log1mP = log1p(-p);
+  const double mean = n * p;
+  double sum = 0;
+  for (int64_t j = std::min(k, n); j >= 0; --j) {
+    const double term = exp(binomialLogPmf(j, n, logP, log1mP));
+    sum += term;
+    if (j < mean && term <= sum * kTailTolerance) {
+      break;
+    }
+  }
+  return sum;
+}
+
+double clampProbability(double value) {
+  return std::min(1.0, std::max(0.0, value));
+}
+
+// A range of consecutive actions of a (task, tier) pair.
+struct Chunk {
+  size_t taskIndex;
+  size_t tierIndex;
+  int64_t start;
+  const std::vector<std::optional<::scene::UserInput>>* pool;
+  size_t poolOffset;
+};
+
+}  // namespace
+
+double binomialTestGreater(int64_t successes, int64_t trials, double p) {
+  if (successes <= 0) {
+    return 1;
+  }
+  if (successes > trials || p <= 0) {
+    return 0;
+  }
+  if (p >= 1) {
+    return 1;
+  }
+  // Sum the smaller tail to avoid cancellation.
+  if (successes > trials * p) {
+    return clampProbability(binomialUpperTail(successes, trials, p));
+  }
+  return clampProbability(1 - binomialLowerTail(successes - 1, trials, p));
+}
+
+double binomialTestLess(int64_t successes, int64_t trials, double p) {
+  if (successes >= trials || p <= 0) {
+    return 1;
+  }
+  if (successes < 0 || p >= 1) {
+    return 0;
+  }
+  if (successes < trials * p) {
+    return clampProbability(binomialLowerTail(successes, trials, p));
+  }
+  return clampProbability(1 - binomialUpperTail(successes + 1, trials, p));
+}
+
+int64_t TaskTierStats::total() const {
+  return std::accumulate(statusCounts.begin(), statusCounts.end(),
+                         int64_t{0});
+}
+
+unsigned computeTaskComplexityFlags(const TaskTierStats& stats,
+                                    double solvabilityThreshold,
+                                    double pValue) {
+  const int64_t valid = stats.valid();
+  const int64_t stable = stats.count(ActionStatus::STABLY_SOLVED);
+  const int64_t solved = stats.count(ActionStatus::UNSTABLY_SOLVED) + stable;
+  unsigned flags = 0;
+  if (binomialTestGreater(solved, valid, solvabilityThreshold) < pValue) {
+    flags |= kFlagGood;
+  }
+  if (binomialTestLess(solved, valid, 2 * solvabilityThreshold) < pValue) {
+    flags |= kFlagBad;
+  }
+  if (binomialTestGreater(stable, valid, solvabilityThreshold) < pValue) {
+    flags |= kFlagGoodStable;
+  }
+  if (binomialTestLess(stable, valid, 2 * solvabilityThreshold) < pValue) {
+    flags |= kFlagBadStable;
+  }
+  if (solved == 0) {
+    flags |= kFlagImpossible;
+  }
+  if (stable >= kTrivialSolvedFraction * std::max<int64_t>(stats.total(), 1)) {
+    flags |= kFlagTrivial;
+  }
+  return flags;
+}
+
+ActionStatus simulateAction(const ::task::Task& task,
+                            const ::scene::UserInput& userInput,
+                            const ActionTier& tier, int steps,
+                            const std::atomic<bool>* cancelled) {
+  ::task::Task taskWithInput = task;
+  addUserInputToScene(userInput, tier.keepSpaceAroundBodies,
+                      /*allowOcclusions=*/false, &taskWithInput.scene);
+  if (!tier.occlusionsAllowed && taskWithInput.scene.user_input_status ==
+                                     ::scene::UserInputStatus::HAD_OCCLUSIONS) {
+    return ActionStatus::INVALID_INPUT;
+  }
+  // Scenes are never recorded with a non-positive stride.
+  TaskSimulationStream stream(taskWithInput, steps, /*stride=*/0);
+  stream.setCancellationFlag(cancelled);
+  std::vector<::scene::Scene> unused;
+  stream.advance(std::numeric_limits<int>::max(), &unused);
+  return stream.isSolution() ? ActionStatus::SOLVED : ActionStatus::NOT_SOLVED;
+}
+
+std::vector<::scene::UserInput> getUserInputNeighborhood(
+    const ::scene::UserInput& userInput) {
+  std::vector<::scene::UserInput> neighbors;
+  for (const double dx : {-kNeighborShift, 0.0, kNeighborShift}) {
+    for (const double dy : {-kNeighborShift, 0.0, kNeighborShift}) {
+      if (dx == 0 && dy == 0) {
+        continue;
+      }
+      neighbors.push_back(userInput);
+      ::scene::UserInput& neighbor = neighbors.back();
+      for (auto& polygon : neighbor.polygons) {
+        for (auto& vertex : polygon.vertices) {
+          vertex.x += dx;
+          vertex.y += dy;
+        }
+      }
+      for (auto& ball : neighbor.balls) {
+        ball.position.x += dx;
+        ball.position.y += dy;
+      }
+    }
+  }
+  return neighbors;
+}
+
+ActionStatus checkSolutionStability(const ::task::Task& task,
+                                    const ::scene::UserInput& userInput,
+                                    const ActionTier& tier, int steps,
+                                    int numThreads) {
+  const std::vector<::scene::UserInput> neighbors =
+      getUserInputNeighborhood(userInput);
+  std::atomic<bool> unstable(false);
+  parallelFor(neighbors.size(),
+              numThreads > 0 ? numThreads : neighbors.size(), [&](size_t i) {
+                if (unstable) {
+                  return;
+                }
+                if (simulateAction(task, neighbors[i], tier, steps,
+                                   &unstable) == ActionStatus::NOT_SOLVED) {
+                  unstable = true;
+                }
+              });
+  return unstable ? ActionStatus::UNSTABLY_SOLVED : ActionStatus::STABLY_SOLVED;
+}
+
+std::vector<uint8_t> computeSolutionPower(
+    const std::vector<::task::Task>& tasks,
+    const std::vector<::scene::UserInput>& userInputs, const ActionTier& tier,
+    int steps, int numThreads) {
+  std::vector<uint8_t> solved(userInputs.size() * tasks.size());
+  parallelFor(solved.size(), getNumThreads(numThreads), [&](size_t i) {
+    const ActionStatus status = simulateAction(
+        tasks[i % tasks.size()], userInputs[i / tasks.size()], tier, steps);
+    solved[i] = status == ActionStatus::SOLVED;
+  });
+  return solved;
+}
+
+std::vector<ActionStatus> evaluateRankedUserInputs(
+    const ::task::Task& task,
+    const std::vector<std::optional<::scene::UserInput>>& rankedUserInputs,
+    const ActionTier& tier, int64_t maxAttempts, bool stopOnSolution,
+    int steps, int numThreads) {
+  const size_t window = getNumThreads(numThreads);
+  std::vector<ActionStatus> statuses;
+  int64_t attempts = 0;
+  size_t begin = 0;
+  while (begin < rankedUserInputs.size() && attempts < maxAttempts) {
+    // More than the number of missing attempts would be wasted even if all
+    // inputs are valid.
+    const size_t size = std::min<size_t>(
+        {window, rankedUserInputs.size() - begin,
+         static_cast<size_t>(maxAttempts - attempts)});
+    std::vector<ActionStatus> windowStatuses(size,
+                                             ActionStatus::INVALID_INPUT);
+    std::vector<std::atomic<bool>> cancelled(size);
+    std::atomic<size_t> firstSolution(size);
+    parallelFor(size, size, [&](size_t i) {
+      const auto& userInput = rankedUserInputs[begin + i];
+      if (!userInput || i > firstSolution) {
+        return;
+      }
+      windowStatuses[i] =
+          simulateAction(task, *userInput, tier, steps, &cancelled[i]);
+      if (!stopOnSolution || windowStatuses[i] != ActionStatus::SOLVED) {
+        return;
+      }
+      size_t current = firstSolution;
+      while (i < current && !firstSolution.compare_exchange_weak(current, i)) {
+      }
+      for (size_t j = i + 1; j < size; ++j) {
+        cancelled[j] = true;
+      }
+    });
+    // Everything up to the first solution was simulated to the end.
+    for (size_t i = 0; i < size && attempts < maxAttempts; ++i) {
+      statuses.push_back(windowStatuses[i]);
+      if (windowStatuses[i] == ActionStatus::INVALID_INPUT) {
+        continue;
+      }
+      ++attempts;
+      if (stopOnSolution && windowStatuses[i] == ActionStatus::SOLVED) {
+        return statuses;
+      }
+    }
+    begin += size;
+  }
+  return statuses;
+}
+
+TaskComplexityEvaluator::TaskComplexityEvaluator(
+    std::vector<::task::Task> tasks, std::vector<ActionTier> tiers,
+    ActionPoolProvider actionPoolProvider,
+    const TaskComplexityOptions& options)
+    : tasks_(std::move(tasks)),
+      tiers_(std::move(tiers)),
+      actionPoolProvider_(std::move(actionPoolProvider)),
+      options_(options),
+      stats_(tasks_.size(), std::vector<TaskTierStats>(tiers_.size())),
+      done_(tasks_.size(), std::vector<bool>(tiers_.size(), false)) {
+  if (options_.chunkSize <= 0 || options_.actionPoolSize <= 0 ||
+      options_.actionPoolSize % options_.chunkSize != 0) {
+    throw std::runtime_error(
+        "Chunk size must be positive and divide the action pool size");
+  }
+  for (size_t i = 0; i < tiers_.size(); ++i) {
+    if (tiers_[i].name == kBallTierName) {
+      ballTierIndex_ = i;
+    }
+  }
+}
+
+bool TaskComplexityEvaluator::done() const {
+  for (const auto& taskDone : done_) {
+    if (std::find(taskDone.begin(), taskDone.end(), false) != taskDone.end()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+const std::vector<std::optional<::scene::UserInput>>&
+TaskComplexityEvaluator::getActionPool(size_t tierIndex, int pool) {
+  const auto key = std::make_pair(tierIndex, pool);
+  auto it = actionPools_.find(key);
+  if (it == actionPools_.end()) {
+    auto actions = actionPoolProvider_(tierIndex, pool);
+    if (actions.size() != static_cast<size_t>(options_.actionPoolSize)) {
+      throw std::runtime_error("Action pool " + std::to_string(pool) +
+                               " has unexpected size " +
+                               std::to_string(actions.size()));
+    }
+    it = actionPools_.emplace(key, std::move(actions)).first;
+  }
+  return it->second;
+}
+
+bool TaskComplexityEvaluator::step() {
+  // Schedule one chunk for every unresolved pair. If rejectBallSolvable, the
+  // ball tier goes first.
+  std::vector<std::pair<size_t, size_t>> pairs;
+  for (size_t task = 0; task < tasks_.size(); ++task) {
+    for (size_t tier = 0; tier < tiers_.size(); ++tier) {
+      if (!done_[task][tier]) {
+        pairs.emplace_back(task, tier);
+      }
+    }
+  }
+  if (pairs.empty()) {
+    return true;
+  }
+  if (options_.rejectBallSolvable && ballTierIndex_ >= 0) {
+    std::vector<std::pair<size_t, size_t>> ballPairs;
+    std::copy_if(pairs.begin(), pairs.end(), std::back_inserter(ballPairs),
+                 [this](const auto& pair) {
+                   return static_cast<int>(pair.second) == ballTierIndex_;
+                 });
+    if (!ballPairs.empty()) {
+      pairs = std::move(ballPairs);
+    }
+  }
+
+  std::vector<Chunk> chunks;
+  for (const auto& [task, tier] : pairs) {
+    const int64_t start = stats_[task][tier].total();
+    const int pool = start / options_.actionPoolSize;
+    const size_t poolOffset = start % options_.actionPoolSize;
+    chunks.push_back(
+        Chunk{task, tier, start, &getActionPool(tier, pool), poolOffset});
+  }
+
+  const size_t chunkSize = options_.chunkSize;
+  const int numThreads = getNumThreads(options_.numThreads);
+  std::vector<ActionStatus> statuses(chunks.size() * chunkSize);
+  parallelFor(statuses.size(), numThreads, [&](size_t i) {
+    const Chunk& chunk = chunks[i / chunkSize];
+    const auto& userInput = (*chunk.pool)[chunk.poolOffset + i % chunkSize];
+    statuses[i] = userInput ? simulateAction(tasks_[chunk.taskIndex],
+                                             *userInput,
+                                             tiers_[chunk.tierIndex],
+                                             options_.steps)
+                            : ActionStatus::INVALID_INPUT;
+  });
+
+  // Stability check: all neighbors of all solved actions are simulated at
+  // once. A solution is stable if none of its neighbors is NOT_SOLVED.
+  std::vector<size_t> solved;
+  for (size_t i = 0; i < statuses.size(); ++i) {
+    if (statuses[i] == ActionStatus::SOLVED) {
+      solved.push_back(i);
+    }
+  }
+  std::vector<std::vector<::scene::UserInput>> neighborhoods;
+  neighborhoods.reserve(solved.size());
+  for (const size_t i : solved) {
+    const Chunk& chunk = chunks[i / chunkSize];
+    neighborhoods.push_back(getUserInputNeighborhood(
+        *(*chunk.pool)[chunk.poolOffset + i % chunkSize]));
+  }
+  const size_t numNeighbors =
+      neighborhoods.empty() ? 0 : neighborhoods.front().size();
+  // Once a neighbor fails, the other neighbors of the same solution are
+  // skipped or cancelled.
+  std::unique_ptr<std::atomic<bool>[]> unstable(
+      new std::atomic<bool>[solved.size()]);
+  for (size_t s = 0; s < solved.size(); ++s) {
+    unstable[s] = false;
+  }
+  std::atomic<int64_t> numNeighborSimulations(0);
+  parallelFor(solved.size() * numNeighbors, numThreads, [&](size_t i) {
+    const size_t s = i / numNeighbors;
+    if (unstable[s]) {
+      return;
+    }
+    const Chunk& chunk = chunks[solved[s] / chunkSize];
+    const ActionStatus status = simulateAction(
+        tasks_[chunk.taskIndex], neighborhoods[s][i % numNeighbors],
+        tiers_[chunk.tierIndex], options_.steps, &unstable[s]);
+    ++numNeighborSimulations;
+    if (status == ActionStatus::NOT_SOLVED) {
+      unstable[s] = true;
+    }
+  });
+  for (size_t s = 0; s < solved.size(); ++s) {
+    statuses[solved[s]] = unstable[s] ? ActionStatus::UNSTABLY_SOLVED
+                                      : ActionStatus::STABLY_SOLVED;
+  }
+  numSimulations_ += statuses.size() + numNeighborSimulations;
+
+  for (size_t c = 0; c < chunks.size(); ++c) {
+    const Chunk& chunk = chunks[c];
+    TaskTierStats& stats = stats_[chunk.taskIndex][chunk.tierIndex];
+    for (size_t j = 0; j < chunkSize; ++j) {
+      const ActionStatus status = statuses[c * chunkSize + j];
+      ++stats.statusCounts[actionStatusIndex(status)];
+      const int64_t action = chunk.start + j;
+      if (status == ActionStatus::STABLY_SOLVED &&
+          stats.solutions.size() < options_.maxSolutionsToKeep) {
+        stats.solutions.push_back(action);
+      }
+      if (status == ActionStatus::UNSTABLY_SOLVED &&
+          stats.unstableSolutions.size() < options_.maxSolutionsToKeep) {
+        stats.unstableSolutions.push_back(action);
+      }
+    }
+    updateDone(chunk.taskIndex, chunk.tierIndex);
+  }
+
+  // Drop the pools that no unresolved pair will read again.
+  for (auto it = actionPools_.begin(); it != actionPools_.end();) {
+    const auto [tier, pool] = it->first;
+    bool needed = false;
+    for (size_t task = 0; task < tasks_.size() && !needed; ++task) {
+      needed = !done_[task][tier] &&
+               stats_[task][tier].total() / options_.actionPoolSize <= pool;
+    }
+    it = needed ? std::next(it) : actionPools_.erase(it);
+  }
+  return done();
+}
+
+void TaskComplexityEvaluator::updateDone(size_t taskIndex, size_t tierIndex) {
+  const TaskTierStats& stats = stats_[taskIndex][tierIndex];
+  if (done_[taskIndex][tierIndex] ||
+      stats.valid() < options_.minValidAttempts) {
+    return;
+  }
+  const unsigned flags = computeTaskComplexityFlags(
+      stats, tiers_[tierIndex].solvabilityThreshold, options_.pValue);
+  if (!(flags & (kFlagGood | kFlagBad)) ||
+      !(flags & (kFlagGoodStable | kFlagBadStable))) {
+    return;
+  }
+  const int64_t stable = stats.count(ActionStatus::STABLY_SOLVED);
+  const int64_t solved = stats.count(ActionStatus::UNSTABLY_SOLVED) + stable;
+  if ((flags & kFlagGood) && solved < options_.minSolutions) {
+    return;
+  }
+  if ((flags & kFlagGoodStable) && stable < options_.minSolutions) {
+    return;
+  }
+  done_[taskIndex][tierIndex] = true;
+  if (options_.rejectBallSolvable &&
+      static_cast<int>(tierIndex) == ballTierIndex_ &&
+      (flags & kFlagGoodStable)) {
+    std::fill(done_[taskIndex].begin(), done_[taskIndex].end(), true);
+  }
+}
@@ -0,0 +1,217 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef TASK_COMPLEXITY_H
+#define TASK_COMPLEXITY_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gen-cpp/scene_types.h"
+#include "gen-cpp/task_types.h"
+#include "task_utils.h"
+
+// Brute-force estimation of task solvability by random search. This is a
+// native version of the evaluation loop in eval_task_complexity.py: every
+// (task, action tier) pair is simulated on consecutive random actions until a
+// binomial test decides whether the probability to solve the task with a
+// random action is above or below the tier threshold. The solutions found this
+// way are then cross-evaluated on all tasks of the template (solution power).
+
+// Mirrors phyre.SimulationStatus.
+enum class ActionStatus {
+  NOT_SOLVED = -1,
+  INVALID_INPUT = 0,
+  SOLVED = 1,
+  UNSTABLY_SOLVED = 2,
+  STABLY_SOLVED = 3,
+};
+constexpr int kNumActionStatuses = 5;
+
+inline int actionStatusIndex(ActionStatus status) {
+  return static_cast<int>(status) + 1;
+}
+
+struct ActionTier {
+  std::string name;
+  // Tasks that are likely to be solved with probability higher than this are
+  // GOOD, and tasks that are likely to be solved with probability lower than
+  // twice this are BAD.
+  double solvabilityThreshold = 0;
+  bool keepSpaceAroundBodies = false;
+  bool occlusionsAllowed = false;
+};
+
+// Mirrors eval_task_complexity.Flags.
+enum TaskComplexityFlag : unsigned {
+  kFlagGoodStable = 1 << 0,
+  kFlagGood = 1 << 1,
+  kFlagBadStable = 1 << 2,
+  kFlagBad = 1 << 3,
+  kFlagImpossible = 1 << 4,
+  // Less than 10 attempts on average.
+  kFlagTrivial = 1 << 5,
+};
+
+// One-sided exact binomial tests, i.e., scipy.stats.binom_test with
+// alternative 'greater' and 'less'.
+double binomialTestGreater(int64_t successes, int64_t trials, double p);
+double binomialTestLess(int64_t successes, int64_t trials, double p);
+
+// Statistics of a (task, action tier) pair. Solutions are indices of the
+// actions in the order they were tried.
+struct TaskTierStats {
+  std::array<int64_t, kNumActionStatuses> statusCounts = {};
+  std::vector<int64_t> solutions;
+  std::vector<int64_t> unstableSolutions;
+
+  int64_t count(ActionStatus status) const {
+    return statusCounts[actionStatusIndex(status)];
+  }
+  int64_t total() const;
+  int64_t valid() const { return total() - count(ActionStatus::INVALID_INPUT); }
+};
+
+// Runs the statistical tests of eval_task_complexity.compute_flags.
+unsigned computeTaskComplexityFlags(const TaskTierStats& stats,
+                                    double solvabilityThreshold,
+                                    double pValue = 0.05);
+
+// Simulates the user input the way ActionSimulator.simulate_action does,
+// i.e., returns INVALID_INPUT if the input occludes scene bodies and
+// occlusions are not allowed, and SOLVED or NOT_SOLVED otherwise. If cancelled
+// is set during the simulation, the simulation is stopped and NOT_SOLVED is
+// returned.
+ActionStatus simulateAction(const ::task::Task& task,
+                            const ::scene::UserInput& userInput,
+                            const ActionTier& tier, int steps = kMaxSteps,
+                            const std::atomic<bool>* cancelled = nullptr);
+
+// Copies of the user input with polygons and balls shifted by half a pixel in
+// each of the 8 directions. Points are not moved.
+std::vector<::scene::UserInput> getUserInputNeighborhood(
+    const ::scene::UserInput& userInput);
+
+// Stability check of a solution: simulates the neighborhood of the user input
+// on numThreads threads (non-positive means one thread per neighbor) and
+// returns UNSTABLY_SOLVED as soon as one of the neighbors is NOT_SOLVED. The
+// remaining neighbor simulations are cancelled. Returns STABLY_SOLVED
+// otherwise. The user input itself is assumed to solve the task.
+ActionStatus checkSolutionStability(const ::task::Task& task,
+                                    const ::scene::UserInput& userInput,
+                                    const ActionTier& tier,
+                                    int steps = kMaxSteps, int numThreads = 0);
+
+// Cross-evaluates known solutions on the tasks of a template. Returns a
+// row-major (userInputs.size() x tasks.size()) matrix with 1 where the user
+// input solves the task and 0 otherwise, including occluding inputs. The pairs
+// are simulated on numThreads threads (non-positive means
+// std::thread::hardware_concurrency()).
+std::vector<uint8_t> computeSolutionPower(
+    const std::vector<::task::Task>& tasks,
+    const std::vector<::scene::UserInput>& userInputs, const ActionTier& tier,
+    int steps = kMaxSteps, int numThreads = 0);
+
+// Evaluates ranked user inputs the way an agent does it sequentially: inputs
+// are simulated in rank order until maxAttempts of them are valid or, if
+// stopOnSolution is set, until the first one solves the task. Invalid actions
+// are represented by std::nullopt. Returns the statuses of the inputs that the
+// sequential loop would simulate, in rank order. The next numThreads inputs
+// (non-positive means std::thread::hardware_concurrency()) are simulated
+// speculatively in parallel; simulations ranked after a solution are cancelled
+// and discarded, so the result does not depend on numThreads.
+std::vector<ActionStatus> evaluateRankedUserInputs(
+    const ::task::Task& task,
+    const std::vector<std::optional<::scene::UserInput>>& rankedUserInputs,
+    const ActionTier& tier, int64_t maxAttempts, bool stopOnSolution,
+    int steps = kMaxSteps, int numThreads = 0);
+
+// Returns the user inputs of the pool-th action pool of the tier. Invalid
+// actions are represented by std::nullopt. Every pool must have
+// TaskComplexityOptions::actionPoolSize actions.
+using ActionPoolProvider =
+    std::function<std::vector<std::optional<::scene::UserInput>>(
+        size_t tierIndex, int pool)>;
+
+struct TaskComplexityOptions {
+  int64_t minValidAttempts = 10000;
+  // Number of consecutive actions simulated for every unresolved pair before
+  // the tests are re-evaluated. Must divide actionPoolSize.
+  int chunkSize = 10000;
+  int actionPoolSize = 10000;
+  double pValue = 0.05;
+  // For solvable tasks collect at least this many solutions.
+  int64_t minSolutions = 3;
+  size_t maxSolutionsToKeep = 5;
+  // Non-positive means std::thread::hardware_concurrency().
+  int numThreads = 0;
+  // If set, ball tier is evaluated first and tasks that are GOOD_STABLE for
+  // the ball tier are marked as done for all tiers.
+  bool rejectBallSolvable = false;
+  int steps = kMaxSteps;
+};
+
+// Sequential evaluation loop. Every step() simulates one chunk of actions for
+// every unresolved pair using a pool of threads. Actions with index i are
+// taken from pool i / actionPoolSize at position i % actionPoolSize, so the
+// results do not depend on the number of threads.
+class TaskComplexityEvaluator {
+ public:
+  TaskComplexityEvaluator(std::vector<::task::Task> tasks,
+                          std::vector<ActionTier> tiers,
+                          ActionPoolProvider actionPoolProvider,
+                          const TaskComplexityOptions& options);
+
+  // Returns whether all pairs are done.
+  bool step();
+  bool done() const;
+  void run() {
+    while (!step()) {
+    }
+  }
+
+  // Indexed by [taskIndex][tierIndex].
+  const std::vector<std::vector<TaskTierStats>>& stats() const {
+    return stats_;
+  }
+  bool isDone(size_t taskIndex, size_t tierIndex) const {
+    return done_[taskIndex][tierIndex];
+  }
+  int64_t numSimulations() const { return numSimulations_; }
+
+ private:
+  const std::vector<std::optional<::scene::UserInput>>& getActionPool(
+      size_t tierIndex, int pool);
+  void updateDone(size_t taskIndex, size_t tierIndex);
+
+  const std::vector<::task::Task> tasks_;
+  const std::vector<ActionTier> tiers_;
+  const ActionPoolProvider actionPoolProvider_;
+  const TaskComplexityOptions options_;
+  int ballTierIndex_ = -1;
+  std::map<std::pair<size_t, int>,
+           std::vector<std::optional<::scene::UserInput>>>
+      actionPools_;
+  std::vector<std::vector<TaskTierStats>> stats_;
+  std::vector<std::vector<bool>> done_;
+  int64_t numSimulations_ = 0;
+};
+
+#endif  // TASK_COMPLEXITY_H
@@ -18,7 +18,6 @@
 #include <cstdio>
 #include <filesystem>
 #include <fstream>
-#include <iostream>
 #include <memory>
 #include <string>
 
@@ -38,6 +37,22 @@ const std::string kTaskNameLeftTemplate = "task";
 const std::string kTaskNameRightTemplate = ":000.bin";
 const std::string kTaskNameTemplate =
     kTaskNameLeftTemplate + "%05d" + kTaskNameRightTemplate;
+
+template <class T>
+T readThriftFromPath(const std::string& file_path) {
+  if (!std::filesystem::exists(file_path)) {
+    shared::Error_message msg;
+    msg.__set_errorMsg("File doesn't not exist");
+    throw shared::Error_message(msg);
+  }
+  const int fd = open(file_path.c_str(), O_RDONLY);
+  std::shared_ptr<TFDTransport> transport(
+      new TFDTransport(fd, TFDTransport::CLOSE_ON_DESTROY));
+  std::shared_ptr<TBinaryProtocol> protocol(new TBinaryProtocol(transport));
+  T object;
+  object.read(protocol.get());
+  return object;
+}
 }  // namespace
 
 std::filesystem::path getTasksPath(const char* taskFolder) {
@@ -56,17 +71,17 @@ std::filesystem::path getTasksPath(const char* taskFolder) {
 std::vector<int32_t> listTasks(const char* taskFolder) {
   const auto task_folder = getTasksPath(taskFolder);
   std::vector<int32_t> task_ids;
-  std::cout << "Listing " << task_folder.native() << std::endl;
+  PHYRE_LOG_DEBUG << "Listing " << task_folder.native() << "\n";
   for (const auto& entry : std::filesystem::directory_iterator(task_folder)) {
     if (entry.is_regular_file()) {
-      std::cout << "Found " << entry.path() << std::endl;
+      PHYRE_LOG_DEBUG << "Found " << entry.path() << "\n";
       std::string s = entry.path().filename().native();
       s = s.substr(kTaskNameLeftTemplate.size());
       s = s.substr(0, s.size() - kTaskNameRightTemplate.size());
       task_ids.push_back(std::stoi(s));
-      std::cout << "Task id: " << std::stoi(s) << std::endl;
+      PHYRE_LOG_DEBUG << "Task id: " << task_ids.back() << "\n";
     } else {
-      std::cout << "Skipping " << entry.path() << std::endl;
+      PHYRE_LOG_DEBUG << "Skipping " << entry.path() << "\n";
     }
   }
   return task_ids;
@@ -86,19 +101,12 @@ task::Task getTaskFromId(const int32_t pTaskId, const char* taskFolder) {
 }
 
 task::Task getTaskFromPath(const std::string& file_path) {
-  std::cout << "Reading " << file_path << std::endl;
-  if (!std::filesystem::exists(file_path)) {
-    shared::Error_message msg;
-    msg.__set_errorMsg("File doesn't not exist");
-    throw shared::Error_message(msg);
-  }
-  const int fd = open(file_path.c_str(), O_RDONLY);
-  std::shared_ptr<TFDTransport> transport(
-      new TFDTransport(fd, TFDTransport::CLOSE_ON_DESTROY));
-  std::shared_ptr<TBinaryProtocol> protocol(new TBinaryProtocol(transport));
-  task::Task task;
-  task.read(protocol.get());
-  return task;
+  PHYRE_LOG_DEBUG << "Reading " << file_path << "\n";
+  return readThriftFromPath<task::Task>(file_path);
+}
+
+task::RolloutJob getRolloutJobFromPath(const std::string& file_path) {
+  return readThriftFromPath<task::RolloutJob>(file_path);
 }
 
 void dumpInputPointsToFile(const std::vector<::scene::IntVector>& input_points,
@@ -109,7 +117,7 @@ void dumpInputPointsToFile(const std::vector<::scene::IntVector>& input_points,
     outFile << pt.x << "," << pt.y << "\n";
     count++;
   }
-  Logger::DEBUG() << count << " points written to file: " << filename << "\n";
+  PHYRE_LOG_DEBUG << count << " points written to file: " << filename << "\n";
 }
 
 std::vector<::scene::IntVector> readInputPointsFromFile(
@@ -132,9 +140,8 @@ std::vector<::scene::IntVector> readInputPointsFromFile(
     }
     inFile.close();
   } else {
-    Logger::ERROR(Color_value::RED)
-        << "Unable to open test file: " << filename << "\n";
+    PHYRE_LOG_ERROR << "Unable to open test file: " << filename << "\n";
   }
-  Logger::DEBUG() << "# Input points read from file:" << count << "\n";
+  PHYRE_LOG_DEBUG << "# Input points read from file:" << count << "\n";
   return points;
 }
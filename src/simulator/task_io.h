@@ -32,6 +32,9 @@ task::Task getTaskFromId(const int32_t pTaskId,
 
 task::Task getTaskFromPath(const std::string& file_path);
 
+// Reads a serialized RolloutJob, the input of generate_rollouts.
+task::RolloutJob getRolloutJobFromPath(const std::string& file_path);
+
 void dumpInputPointsToFile(const std::vector<::scene::IntVector>& input_points,
                            const std::string& filename);
 
@@ -12,30 +12,24 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 #include "task_utils.h"
+#include "contact_graph.h"
+#include "simulation_stats.h"
 #include "task_validation.h"
 #include "thrift_box2d_conversion.h"
 
+#include <algorithm>
 #include <iostream>
+#include <limits>
 
-namespace {
-struct SimulationRequest {
-  int maxSteps;
-  int stride;
-};
-
-// Runs simulation for the scene. If task is not nullptr, is-task-solved checks
-// are performed.
-::task::TaskSimulation simulateTask(const ::scene::Scene &scene,
-                                    const SimulationRequest &request,
-                                    const ::task::Task *task) {
-  std::unique_ptr<b2WorldWithData> world = convertSceneToBox2dWorld(scene);
-
-  unsigned int continuousSolvedCount = 0;
-  std::vector<::scene::Scene> scenes;
-  std::vector<bool> solveStateList;
-  bool solved = false;
-  int step = 0;
-
+TaskSimulationStream::TaskSimulationStream(const ::task::Task &task,
+                                           const int num_steps,
+                                           const int stride)
+    : scene_(task.scene),
+      task_(&task),
+      maxSteps_(num_steps),
+      stride_(stride),
+      startTime_(std::chrono::steady_clock::now()),
+      world_(convertSceneToBox2dWorld(task.scene)) {
   // For different relations number of steps the condition should hold varies.
   // For NOT_TOUCHING relation one of three should be true:
   //   1. Objects are touching at the beginning and then not touching for
@@ -46,76 +40,289 @@ struct SimulationRequest {
   // For TOUCHING_BRIEFLY a single touching is allowed.
   // For all other relations the condition must hold for kStepsForSolution
   // consequent steps.
-  bool lookingForSolution =
-      (task == nullptr || !isTaskInSolvedState(*task, *world) ||
-       task->relationships.size() != 1 ||
-       task->relationships[0] != ::task::SpatialRelationship::NOT_TOUCHING);
-  const bool allowInstantSolution =
-      (task != nullptr && task->relationships.size() == 1 &&
-       task->relationships[0] == ::task::SpatialRelationship::TOUCHING_BRIEFLY);
-  for (; step < request.maxSteps; step++) {
-    // Instruct the world to perform a single step of simulation.
-    // It is generally best to keep the time step and iterations fixed.
-    world->Step(kTimeStep, kVelocityIterations, kPositionIterations);
-    if (request.stride > 0 && step % request.stride == 0) {
-      scenes.push_back(updateSceneFromWorld(scene, *world));
+  lookingForSolution_ =
+      (!isTaskInSolvedState(task, *world_) || task.relationships.size() != 1 ||
+       task.relationships[0] != ::task::SpatialRelationship::NOT_TOUCHING);
+  allowInstantSolution_ =
+      (task.relationships.size() == 1 &&
+       task.relationships[0] == ::task::SpatialRelationship::TOUCHING_BRIEFLY);
+}
+
+TaskSimulationStream::TaskSimulationStream(const ::scene::Scene &scene,
+                                           const int num_steps,
+                                           const int stride)
+    : scene_(scene),
+      task_(nullptr),
+      maxSteps_(num_steps),
+      stride_(stride),
+      startTime_(std::chrono::steady_clock::now()),
+      world_(convertSceneToBox2dWorld(scene)) {}
+
+TaskSimulationStream::~TaskSimulationStream() = default;
+
+void TaskSimulationStream::recordContacts(const bool withImpulses) {
+  contacts_.reset(new ContactGraphBuilder(scene_, withImpulses));
+}
+
+const ::task::ContactGraph *TaskSimulationStream::contactGraph() const {
+  return contacts_ ? &contacts_->graph() : nullptr;
+}
+
+::task::ContactGraph TaskSimulationStream::releaseContactGraph() {
+  return contacts_ ? contacts_->release() : ::task::ContactGraph();
+}
+
+bool TaskSimulationStream::step(std::vector<::scene::Scene> *scenes) {
+  // Instruct the world to perform a single step of simulation.
+  // It is generally best to keep the time step and iterations fixed.
+  world_->Step(kTimeStep, kVelocityIterations, kPositionIterations);
+  bool recorded = false;
+  if (stride_ > 0 && step_ % stride_ == 0) {
+    scenes->push_back(updateSceneFromWorld(scene_, *world_));
+    if (recordGoalDistances_ && task_ != nullptr) {
+      goalDistanceList_.push_back(getGoalDistance(*task_, *world_));
     }
-    if (task == nullptr) {
-      solveStateList.push_back(false);
-    } else {
-      solveStateList.push_back(isTaskInSolvedState(*task, *world));
-      if (solveStateList.back()) {
-        continuousSolvedCount++;
-        if (lookingForSolution) {
-          if (continuousSolvedCount >= kStepsForSolution ||
-              allowInstantSolution) {
-            solved = true;
-            break;
-          }
+    if (contacts_) {
+      contacts_->addFrame(*world_);
+    }
+    recorded = true;
+  }
+  if (task_ == nullptr) {
+    solveStateList_.push_back(false);
+  } else {
+    solveStateList_.push_back(isTaskInSolvedState(*task_, *world_));
+    if (solveStateList_.back()) {
+      continuousSolvedCount_++;
+      if (lookingForSolution_) {
+        if (continuousSolvedCount_ >= kStepsForSolution ||
+            allowInstantSolution_) {
+          solved_ = true;
+          done_ = true;
         }
-      } else {
-        lookingForSolution = true;  // Task passed through non-solved state.
-        continuousSolvedCount = 0;
       }
+    } else {
+      lookingForSolution_ = true;  // Task passed through non-solved state.
+      continuousSolvedCount_ = 0;
     }
   }
+  if (stepCallback_) {
+    stepCallback_(solveStateList_.size() - 1, *world_);
+  }
+  // The step counter is not advanced on the step that found a solution.
+  if (!done_) {
+    step_++;
+  }
+  return recorded;
+}
 
-  if (!lookingForSolution && continuousSolvedCount == solveStateList.size()) {
+void TaskSimulationStream::finish() {
+  if (!lookingForSolution_ &&
+      continuousSolvedCount_ == solveStateList_.size()) {
     // See condition 3) for NOT_TOUCHING relation above.
-    solved = true;
+    solved_ = true;
   }
+  done_ = true;
+}
 
-  {
-    std::vector<bool> stridedSolveStateList;
-    if (request.stride > 0) {
-      for (size_t i = 0; i < solveStateList.size(); i += request.stride) {
-        stridedSolveStateList.push_back(solveStateList[i]);
+int TaskSimulationStream::advance(const int max_scenes,
+                                  std::vector<::scene::Scene> *scenes) {
+  int numRecorded = 0;
+  while (!done_ && numRecorded < max_scenes) {
+    if (cancelled_ != nullptr && cancelled_->load(std::memory_order_relaxed)) {
+      wasCancelled_ = true;
+      done_ = true;
+      break;
+    }
+    if (step_ >= maxSteps_) {
+      finish();
+      break;
+    }
+    if (step(scenes)) {
+      ++numRecorded;
+    }
+  }
+  // The last recorded scene may coincide with the last step.
+  if (!done_ && step_ >= maxSteps_) {
+    finish();
+  }
+  if (done_ && !statsRecorded_ && !wasCancelled_) {
+    recordStats();
+  }
+  return numRecorded;
+}
+
+void TaskSimulationStream::recordStats() {
+  statsRecorded_ = true;
+  TerminationReason reason = TerminationReason::MAX_STEPS;
+  if (scene_.user_input_status == ::scene::UserInputStatus::HAD_OCCLUSIONS) {
+    reason = TerminationReason::OCCLUDED;
+  } else if (solved_ && step_ < maxSteps_) {
+    reason = TerminationReason::SOLVED_EARLY;
+  } else {
+    bool anyAwake = false;
+    for (const b2Body *body = world_->GetBodyList(); body != nullptr;
+         body = body->GetNext()) {
+      if (body->GetType() != b2_staticBody && body->IsAwake()) {
+        anyAwake = true;
+        break;
       }
     }
-    stridedSolveStateList.swap(solveStateList);
+    if (!anyAwake) {
+      reason = TerminationReason::QUIESCENT;
+    }
+  }
+  const auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - startTime_);
+  recordSimulationStats(reason, step_, world_->GetBodyCount(),
+                        latency.count());
+}
+
+std::vector<bool> TaskSimulationStream::stridedSolvedStateList() const {
+  std::vector<bool> stridedSolveStateList;
+  if (stride_ > 0) {
+    for (size_t i = 0; i < solveStateList_.size(); i += stride_) {
+      stridedSolveStateList.push_back(solveStateList_[i]);
+    }
   }
+  return stridedSolveStateList;
+}
 
-  ::task::TaskSimulation taskSimulation;
-  taskSimulation.__set_sceneList(scenes);
-  taskSimulation.__set_stepsSimulated(step);
-  if (task != nullptr) {
-    taskSimulation.__set_solvedStateList(solveStateList);
-    taskSimulation.__set_isSolution(solved);
+std::vector<bool> TaskSimulationStream::releaseStridedSolvedStateList() {
+  if (stride_ <= 0) {
+    return {};
+  }
+  // Compact the list in place.
+  size_t size = 0;
+  for (size_t i = 0; i < solveStateList_.size(); i += stride_) {
+    solveStateList_[size++] = solveStateList_[i];
   }
+  solveStateList_.resize(size);
+  return std::move(solveStateList_);
+}
 
+namespace {
+// Runs the stream until the end and packs all scenes into TaskSimulation.
+// Solved states are only reported if withTask is set.
+::task::TaskSimulation runToCompletion(TaskSimulationStream *stream,
+                                       const bool withTask,
+                                       const bool withGoalDistances = false) {
+  ::task::TaskSimulation taskSimulation;
+  // Scenes are written directly into the result and all other lists are moved
+  // out of the stream, so nothing is copied. __set_* methods take const
+  // references, hence the explicit __isset updates.
+  stream->advance(std::numeric_limits<int>::max(), &taskSimulation.sceneList);
+  taskSimulation.__isset.sceneList = true;
+  taskSimulation.__set_stepsSimulated(stream->stepsSimulated());
+  if (withTask) {
+    taskSimulation.solvedStateList = stream->releaseStridedSolvedStateList();
+    taskSimulation.__isset.solvedStateList = true;
+    taskSimulation.__set_isSolution(stream->isSolution());
+  }
+  if (withGoalDistances) {
+    taskSimulation.goalDistanceList = stream->releaseGoalDistanceList();
+    taskSimulation.__isset.goalDistanceList = true;
+  }
+  if (stream->contactGraph() != nullptr) {
+    taskSimulation.contactGraph = stream->releaseContactGraph();
+    taskSimulation.__isset.contactGraph = true;
+  }
   return taskSimulation;
 }
 }  // namespace
 
 std::vector<::scene::Scene> simulateScene(const ::scene::Scene &scene,
                                           const int num_steps) {
-  const SimulationRequest request{num_steps, 1};
-  const auto simulation = simulateTask(scene, request, /*task=*/nullptr);
-  return simulation.sceneList;
+  const ScopedSimulationCall call;
+  TaskSimulationStream stream(scene, num_steps);
+  auto simulation = runToCompletion(&stream, /*withTask=*/false);
+  return std::move(simulation.sceneList);
 }
 
 ::task::TaskSimulation simulateTask(const ::task::Task &task,
-                                    const int num_steps, const int stride) {
-  const SimulationRequest request{num_steps, stride};
-  return simulateTask(task.scene, request, &task);
+                                    const int num_steps, const int stride,
+                                    const bool need_goal_distances,
+                                    const ContactOutput contacts) {
+  const ScopedSimulationCall call;
+  TaskSimulationStream stream(task, num_steps, stride);
+  if (need_goal_distances) {
+    stream.recordGoalDistances();
+  }
+  if (contacts != ContactOutput::NONE) {
+    stream.recordContacts(contacts == ContactOutput::EDGES_AND_IMPULSES);
+  }
+  return runToCompletion(&stream, /*withTask=*/true, need_goal_distances);
+}
+
+::task::TaskSimulationSummary simulateTaskSummary(const ::task::Task &task,
+                                                  const int num_steps,
+                                                  const unsigned stats) {
+  const ScopedSimulationCall call;
+  ::task::TaskSimulationSummary summary;
+  int firstTouchStep = -1;
+  float minGoalDistance = std::numeric_limits<float>::max();
+  float maxUserBodySpeed = 0;
+  const bool needGoalBodies =
+      stats & (kSummaryFirstTouchStep | kSummaryMinGoalDistance);
+
+  // Scenes are never recorded with a non-positive stride.
+  TaskSimulationStream stream(task, num_steps, /*stride=*/0);
+  stream.setStepCallback([&](int step, const b2WorldWithData &world) {
+    if (needGoalBodies) {
+      const auto [body1, body2] = getGoalBodies(task, world);
+      if ((stats & kSummaryFirstTouchStep) && firstTouchStep < 0 &&
+          isTouching(*body1, *body2)) {
+        firstTouchStep = step;
+      }
+      if (stats & kSummaryMinGoalDistance) {
+        minGoalDistance =
+            std::min(minGoalDistance, getBodiesDistance(*body1, *body2));
+      }
+    }
+    if (stats & kSummaryMaxUserBodySpeed) {
+      for (const b2Body *body = world.GetBodyList(); body != nullptr;
+           body = body->GetNext()) {
+        const auto *data = static_cast<const Box2dData *>(body->GetUserData());
+        if (data != nullptr && data->object_type == Box2dData::USER) {
+          maxUserBodySpeed =
+              std::max(maxUserBodySpeed, body->GetLinearVelocity().Length());
+        }
+      }
+    }
+  });
+  std::vector<::scene::Scene> unused;
+  stream.advance(std::numeric_limits<int>::max(), &unused);
+
+  summary.__set_isSolution(stream.isSolution());
+  summary.__set_stepsSimulated(stream.stepsSimulated());
+  if (stats & kSummaryFirstTouchStep) {
+    summary.__set_firstTouchStep(firstTouchStep);
+  }
+  if (stats & kSummaryMinGoalDistance) {
+    summary.__set_minGoalDistance(minGoalDistance * PIXELS_IN_METER);
+  }
+  if (stats & kSummaryMaxUserBodySpeed) {
+    summary.__set_maxUserBodySpeed(maxUserBodySpeed * PIXELS_IN_METER);
+  }
+  if (stats & kSummaryFinalPositions) {
+    const size_t numSceneBodies = task.scene.bodies.size();
+    std::vector<::scene::Vector> positions(
+        numSceneBodies + task.scene.user_input_bodies.size());
+    std::vector<double> angles(positions.size());
+    for (const b2Body *body = stream.world().GetBodyList(); body != nullptr;
+         body = body->GetNext()) {
+      const auto *data = static_cast<const Box2dData *>(body->GetUserData());
+      if (data == nullptr || data->object_type == Box2dData::BOUNDING_BOX) {
+        continue;
+      }
+      const size_t index =
+          data->object_id +
+          (data->object_type == Box2dData::USER ? numSceneBodies : 0);
+      positions[index].__set_x(body->GetPosition().x * PIXELS_IN_METER);
+      positions[index].__set_y(body->GetPosition().y * PIXELS_IN_METER);
+      angles[index] = body->GetAngle();
+    }
+    summary.__set_finalPositions(positions);
+    summary.__set_finalAngles(angles);
+  }
+  return summary;
 }
@@ -14,6 +14,10 @@
 #ifndef TASK_UTILS_H
 #define TASK_UTILS_H
 
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
 #include <vector>
 
 #include "gen-cpp/scene_types.h"
@@ -38,16 +42,151 @@ constexpr unsigned kMaxSteps = 1000;
 std::vector<::scene::Scene> simulateScene(const ::scene::Scene& scene,
                                           const int num_steps);
 
+// What contact information to record for every returned scene.
+enum class ContactOutput { NONE, EDGES, EDGES_AND_IMPULSES };
+
 // Runs simulation for at most num_steps. The sumlation is stopped earlier if
 // the task is in the solved state for at least kStepsForSolution steps.
 // Returns every stride scene starting from the first one. Note, for big enough
 // stride there is no guarantee that the last sscene in the solved state.
-::task::TaskSimulation simulateTask(const ::task::Task& task,
-                                    const int num_steps, const int stride = 1);
+// If need_goal_distances is set, goalDistanceList has the goal distance
+// signal (see getGoalDistance) for every returned scene. If contacts is not
+// NONE, contactGraph has touching objects for every returned scene.
+::task::TaskSimulation simulateTask(
+    const ::task::Task& task, const int num_steps, const int stride = 1,
+    const bool need_goal_distances = false,
+    const ContactOutput contacts = ContactOutput::NONE);
+
+// Statistics that can be requested from simulateTaskSummary.
+constexpr unsigned kSummaryFirstTouchStep = 1 << 0;
+constexpr unsigned kSummaryMinGoalDistance = 1 << 1;
+constexpr unsigned kSummaryFinalPositions = 1 << 2;
+constexpr unsigned kSummaryMaxUserBodySpeed = 1 << 3;
+constexpr unsigned kSummaryAll =
+    kSummaryFirstTouchStep | kSummaryMinGoalDistance | kSummaryFinalPositions |
+    kSummaryMaxUserBodySpeed;
+
+// Runs simulation like simulateTask, but instead of recording scenes computes
+// the requested statistics (a combination of kSummary* flags) on every step.
+::task::TaskSimulationSummary simulateTaskSummary(
+    const ::task::Task& task, const int num_steps,
+    const unsigned stats = kSummaryAll);
+
+class b2WorldWithData;
+class ContactGraphBuilder;
+
+// Incremental version of simulateTask. The simulation is advanced on demand so
+// that callers can consume scenes in chunks instead of holding the whole
+// rollout in memory. The task (or the scene) must outlive the stream.
+class TaskSimulationStream {
+ public:
+  TaskSimulationStream(const ::task::Task& task, const int num_steps,
+                       const int stride = 1);
+  // Scene-only simulation without is-task-solved checks.
+  TaskSimulationStream(const ::scene::Scene& scene, const int num_steps,
+                       const int stride = 1);
+  ~TaskSimulationStream();
+
+  // Simulates until max_scenes more scenes are appended to scenes or the
+  // simulation terminates. Returns the number of appended scenes.
+  int advance(const int max_scenes, std::vector<::scene::Scene>* scenes);
+
+  // Receives the index of the step and the world after the step.
+  using StepCallback = std::function<void(int, const b2WorldWithData&)>;
+  // Sets a function that is called after every simulation step.
+  void setStepCallback(StepCallback callback) {
+    stepCallback_ = std::move(callback);
+  }
+
+  // Stops the simulation before the next step once *cancelled is set. A
+  // cancelled stream is done and is not a solution. Cancelled rollouts are
+  // not counted in the simulation stats. The flag must outlive the stream.
+  void setCancellationFlag(const std::atomic<bool>* cancelled) {
+    cancelled_ = cancelled;
+  }
+  bool wasCancelled() const { return wasCancelled_; }
+
+  // Computes the goal distance signal for every recorded scene. Must be
+  // called before the first advance().
+  void recordGoalDistances() { recordGoalDistances_ = true; }
+  // Collects touching objects for every recorded scene. Must be called before
+  // the first advance().
+  void recordContacts(const bool withImpulses);
+
+  // Current state of the simulation.
+  const b2WorldWithData& world() const { return *world_; }
+
+  bool done() const { return done_; }
+  // The following getters are only meaningful once done() is true.
+  bool isSolution() const { return solved_; }
+  int stepsSimulated() const { return step_; }
+  // Solved states for every stride step starting from the first one.
+  std::vector<bool> stridedSolvedStateList() const;
+  // Same as stridedSolvedStateList(), but reuses the memory of the stream. The
+  // stream must not be used afterwards.
+  std::vector<bool> releaseStridedSolvedStateList();
+  // Goal distances for every recorded scene if recordGoalDistances() was
+  // called.
+  const std::vector<double>& goalDistanceList() const {
+    return goalDistanceList_;
+  }
+  // Contacts for every recorded scene or nullptr if recordContacts() was not
+  // called.
+  const ::task::ContactGraph* contactGraph() const;
+  // Moves out recorded goal distances and contacts. The stream must not be
+  // used afterwards.
+  std::vector<double> releaseGoalDistanceList() {
+    return std::move(goalDistanceList_);
+  }
+  ::task::ContactGraph releaseContactGraph();
+
+ private:
+  // Performs a single simulation step. Returns true if a scene was recorded.
+  bool step(std::vector<::scene::Scene>* scenes);
+  void finish();
+  // Reports the finished rollout to the process-wide simulation stats.
+  void recordStats();
+
+  const ::scene::Scene& scene_;
+  const ::task::Task* task_;
+  const int maxSteps_;
+  const int stride_;
+  const std::chrono::steady_clock::time_point startTime_;
+  std::unique_ptr<b2WorldWithData> world_;
+  StepCallback stepCallback_;
+  const std::atomic<bool>* cancelled_ = nullptr;
+  bool wasCancelled_ = false;
+
+  unsigned int continuousSolvedCount_ = 0;
+  std::vector<bool> solveStateList_;
+  bool recordGoalDistances_ = false;
+  std::vector<double> goalDistanceList_;
+  std::unique_ptr<ContactGraphBuilder> contacts_;
+  bool lookingForSolution_ = true;
+  bool allowInstantSolution_ = false;
+  bool solved_ = false;
+  bool done_ = false;
+  bool statsRecorded_ = false;
+  int step_ = 0;
+};
 
 // Run simulation in parallel using worker pool of num_workers processes.
 std::vector<::task::TaskSimulation> simulateTasksInParallel(
     const std::vector<::task::Task>& tasks, const int num_workers,
     const int num_steps, const int stride = 1);
 
+// Receives the index of a task in the input batch and its simulation.
+using TaskSimulationCallback =
+    std::function<void(size_t, ::task::TaskSimulation&&)>;
+
+// Run simulation in parallel using worker pool of num_workers processes and
+// call callback for each simulation as soon as it is finished. The order of
+// the calls is not defined. All calls happen in the calling thread. If the
+// callback throws, the remaining simulations are drained and the first
+// exception is rethrown once all workers have exited.
+void simulateTasksAsCompleted(const std::vector<::task::Task>& tasks,
+                              const int num_workers, const int num_steps,
+                              const int stride,
+                              const TaskSimulationCallback& callback);
+
 #endif  // TASK_UTILS_H
@@ -13,10 +13,15 @@
 // limitations under the License.
 #include "gen-cpp/scene_types.h"
 #include "gen-cpp/task_types.h"
+#include "simulation_stats.h"
 #include "task_utils.h"
 
 #include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <exception>
 #include <iostream>
+#include <type_traits>
 #include <vector>
 
 // Multiprocessing goodies!
@@ -25,11 +30,11 @@
 #include <unistd.h>
 
 // Serialization stuff. Also mostly for multiprocessing.
-#include <thrift/protocol/TBinaryProtocol.h>
-#include <thrift/transport/TBufferTransports.h>
+#include "thrift_serialization.h"
+#include "utils/logger.h"
 
-using apache::thrift::protocol::TBinaryProtocol;
-using apache::thrift::transport::TMemoryBuffer;
+using thrift_serialization::ByteSpan;
+using thrift_serialization::serializeToSpan;
 
 namespace {
 void* sharedMalloc(int len) {
@@ -40,27 +45,6 @@ void* sharedMalloc(int len) {
 
 void sharedFree(void* p, int len) { munmap(p, len); }
 
-::scene::Scene deserialize(const std::vector<uint8_t>& serialized) {
-  std::shared_ptr<TMemoryBuffer> memoryBuffer(new TMemoryBuffer());
-  std::unique_ptr<TBinaryProtocol> protocol(new TBinaryProtocol(memoryBuffer));
-  memoryBuffer->resetBuffer(const_cast<uint8_t*>(serialized.data()),
-                            serialized.size());
-  ::scene::Scene scene;
-  scene.read(protocol.get());
-  return scene;
-}
-
-std::vector<uint8_t> serialize(const ::scene::Scene& scene) {
-  std::shared_ptr<TMemoryBuffer> memoryBuffer(new TMemoryBuffer());
-  std::unique_ptr<TBinaryProtocol> protocol(new TBinaryProtocol(memoryBuffer));
-  scene.write(protocol.get());
-
-  uint8_t* buffer;
-  uint32_t sz;
-  memoryBuffer->getBuffer(&buffer, &sz);
-  return std::vector<uint8_t>(buffer, buffer + sz);
-}
-
 struct SerializedTaskSimulation {
   uint8_t* scenes;
   uint8_t* solvedStates;
@@ -68,18 +52,76 @@ struct SerializedTaskSimulation {
   int* actualNumSteps;
   int* stepsSimulated;
 };
+
+::task::TaskSimulation readSimulation(const SerializedTaskSimulation& layout,
+                                      const size_t sceneSize) {
+  const int actualNumSteps = *layout.actualNumSteps;
+  std::vector<::scene::Scene> scenes(actualNumSteps);
+  for (int step = 0; step < actualNumSteps; ++step) {
+    // Read straight from the shared memory.
+    thrift_serialization::deserializeFrom(layout.scenes + sceneSize * step,
+                                          sceneSize, &scenes[step]);
+  }
+  std::vector<bool> solvedStates(
+      reinterpret_cast<bool*>(layout.solvedStates),
+      reinterpret_cast<bool*>(layout.solvedStates + actualNumSteps));
+  const bool solved = *layout.isSolution;
+  ::task::TaskSimulation simulation;
+  // Move instead of __set_* to avoid copying the lists.
+  simulation.sceneList = std::move(scenes);
+  simulation.__isset.sceneList = true;
+  simulation.solvedStateList = std::move(solvedStates);
+  simulation.__isset.solvedStateList = true;
+  simulation.__set_isSolution(solved);
+  simulation.__set_stepsSimulated(*layout.stepsSimulated);
+  return simulation;
+}
+
+// Reads exactly one task index from the completion pipe. Returns false on EOF,
+// i.e., once all workers have closed their ends of the pipe.
+bool readCompletedTaskId(const int fd, int32_t* taskId) {
+  uint8_t* buffer = reinterpret_cast<uint8_t*>(taskId);
+  size_t done = 0;
+  while (done < sizeof(int32_t)) {
+    const ssize_t got = read(fd, buffer + done, sizeof(int32_t) - done);
+    if (got == 0) {
+      return false;
+    } else if (got < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      std::perror("FATAL: read() from completion pipe failed");
+      exit(5);
+    }
+    done += got;
+  }
+  return true;
+}
 }  // namespace
 
 std::vector<::task::TaskSimulation> simulateTasksInParallel(
     const std::vector<::task::Task>& tasks, const int num_workers,
     const int num_steps, const int stride) {
+  std::vector<::task::TaskSimulation> simulationBatch(tasks.size());
+  simulateTasksAsCompleted(
+      tasks, num_workers, num_steps, stride,
+      [&simulationBatch](size_t index, ::task::TaskSimulation&& simulation) {
+        simulationBatch[index] = std::move(simulation);
+      });
+  return simulationBatch;
+}
+
+void simulateTasksAsCompleted(const std::vector<::task::Task>& tasks,
+                              const int num_workers, const int num_steps,
+                              const int stride,
+                              const TaskSimulationCallback& callback) {
+  const ScopedSimulationCall call;
   if (num_workers <= 0) {
     // Run single-process version.
-    std::vector<::task::TaskSimulation> simulations;
-    for (const ::task::Task& task : tasks) {
-      simulations.push_back(simulateTask(task, num_steps, stride));
+    for (size_t i = 0; i < tasks.size(); ++i) {
+      callback(i, simulateTask(tasks[i], num_steps, stride));
     }
-    return simulations;
+    return;
   }
 
   std::vector<int> pids;
@@ -100,9 +142,9 @@ std::vector<::task::TaskSimulation> simulateTasksInParallel(
   std::vector<size_t> sceneSizes;
   std::vector<size_t> bufferSizes;
   for (const auto& task : tasks) {
-    const size_t sceneSize = serialize(task.scene).size();
-    const size_t sz =
-        (sceneSize + sizeof(uint8_t)) * num_steps + sizeof(uint8_t) * 2;
+    const size_t sceneSize = serializeToSpan(task.scene).size;
+    const size_t sz = (sceneSize + sizeof(uint8_t)) * num_steps +
+                      sizeof(uint8_t) + sizeof(int) * 2;
     sceneSizes.push_back(sceneSize);
     bufferSizes.push_back(sz);
     sharedBuffers.push_back(static_cast<uint8_t*>(sharedMalloc(sz)));
@@ -113,14 +155,36 @@ std::vector<::task::TaskSimulation> simulateTasksInParallel(
     layout.actualNumSteps =
         reinterpret_cast<int*>(layout.isSolution + sizeof(bool));
     layout.stepsSimulated =
-        reinterpret_cast<int*>(layout.actualNumSteps + sizeof(int));
+        reinterpret_cast<int*>(layout.actualNumSteps + 1);
     sharedBufferLayouts.push_back(layout);
   }
 
+  // Every worker leaves the counters of its rollouts in its own slot, so that
+  // the parent can merge them into its simulation stats.
+  static_assert(std::is_trivially_copyable<SimulationStats>::value,
+                "SimulationStats must be copyable through shared memory");
+  const size_t workerStatsSize = sizeof(SimulationStats) * num_workers;
+  SimulationStats* workerStats =
+      static_cast<SimulationStats*>(sharedMalloc(workerStatsSize));
+
+  // Workers report indices of finished tasks through the pipe. Writes of
+  // less than PIPE_BUF bytes are atomic, so workers can share the pipe.
+  int completionPipe[2];
+  if (pipe(completionPipe) != 0) {
+    std::perror("FATAL: pipe() failed");
+    exit(2);
+  }
+
   for (size_t workerId = 0; workerId < num_workers; ++workerId) {
     const int pid = fork();
     if (pid == 0) {
-      // Worker. Run simulations and save to the shared buffer.
+      // Worker. Run simulations and save to the shared buffer. Workers leave
+      // with _exit() so that they do not run the atexit handlers and static
+      // destructors of the parent's state, nor flush copies of its stdio
+      // buffers.
+      close(completionPipe[0]);
+      // The counters inherited from the parent are already counted there.
+      resetSimulationStats();
       for (size_t taskId = workerId; taskId < tasks.size();
            taskId += num_workers) {
         const ::task::TaskSimulation simulation =
@@ -129,11 +193,11 @@ std::vector<::task::TaskSimulation> simulateTasksInParallel(
         const SerializedTaskSimulation& layout = sharedBufferLayouts[taskId];
         for (size_t step = 0; step < actualNumSteps; ++step) {
           const ::scene::Scene& scene = simulation.sceneList[step];
-          const std::vector<uint8_t> serializedScene = serialize(scene);
-          if (serializedScene.size() != sceneSizes[taskId]) {
-            exit(3);
+          const ByteSpan serializedScene = serializeToSpan(scene);
+          if (serializedScene.size != sceneSizes[taskId]) {
+            _exit(3);
           }
-          std::copy_n(serializedScene.data(), serializedScene.size(),
+          std::copy_n(serializedScene.data, serializedScene.size,
                       layout.scenes + sceneSizes[taskId] * step);
         }
         for (size_t step = 0; step < actualNumSteps; ++step) {
@@ -143,8 +207,15 @@ std::vector<::task::TaskSimulation> simulateTasksInParallel(
         *layout.isSolution = static_cast<uint8_t>(simulation.isSolution);
         *layout.actualNumSteps = actualNumSteps;
         *layout.stepsSimulated = simulation.stepsSimulated;
+        const int32_t completedTaskId = taskId;
+        if (write(completionPipe[1], &completedTaskId, sizeof(int32_t)) !=
+            sizeof(int32_t)) {
+          _exit(4);
+        }
       }
-      exit(0);
+      workerStats[workerId] = getSimulationStats();
+      Logger::flush();
+      _exit(0);
     } else if (pid < 0) {
       // Error.
       std::cout << "FATAL: Fork failed!" << std::endl;
@@ -154,7 +225,29 @@ std::vector<::task::TaskSimulation> simulateTasksInParallel(
       pids.push_back(pid);
     }
   }
-  for (const int pid : pids) {
+  // Only workers keep the write end open, so reading stops once all of them
+  // are gone.
+  close(completionPipe[1]);
+
+  std::exception_ptr callbackError;
+  std::vector<bool> reported(tasks.size(), false);
+  int32_t taskId;
+  while (readCompletedTaskId(completionPipe[0], &taskId)) {
+    reported[taskId] = true;
+    if (callbackError) {
+      continue;
+    }
+    try {
+      callback(taskId,
+               readSimulation(sharedBufferLayouts[taskId], sceneSizes[taskId]));
+    } catch (...) {
+      callbackError = std::current_exception();
+    }
+  }
+  close(completionPipe[0]);
+
+  for (size_t workerId = 0; workerId < pids.size(); ++workerId) {
+    const int pid = pids[workerId];
     int status;
     if (waitpid(pid, &status, 0) != -1) {
       if (WIFEXITED(status)) {
@@ -164,6 +257,7 @@ std::vector<::task::TaskSimulation> simulateTasksInParallel(
                     << std::endl;
           exit(5);
         }
+        mergeSimulationStats(workerStats[workerId]);
       } else {
         std::cout << "FATAL: Worker died unexpectedly" << std::endl;
         exit(5);
@@ -173,26 +267,15 @@ std::vector<::task::TaskSimulation> simulateTasksInParallel(
       exit(5);
     }
   }
-  std::vector<::task::TaskSimulation> simulationBatch(tasks.size());
-  for (size_t i = 0; i < simulationBatch.size(); ++i) {
-    const SerializedTaskSimulation& layout = sharedBufferLayouts[i];
-    const int actualNumSteps = *layout.actualNumSteps;
-    std::vector<::scene::Scene> scenes(actualNumSteps);
-    for (int step = 0; step < actualNumSteps; ++step) {
-      const uint8_t* start = layout.scenes + sceneSizes[i] * step;
-      scenes[step] =
-          deserialize(std::vector<uint8_t>(start, start + sceneSizes[i]));
+  for (size_t i = 0; i < tasks.size(); ++i) {
+    if (!reported[i]) {
+      std::cout << "FATAL: Worker did not report task " << i << std::endl;
+      exit(5);
     }
-    const std::vector<bool> solvedStates(
-        reinterpret_cast<bool*>(layout.solvedStates),
-        reinterpret_cast<bool*>(layout.solvedStates + actualNumSteps));
-    const bool solved = *layout.isSolution;
-    simulationBatch[i].__set_sceneList(scenes);
-    simulationBatch[i].__set_solvedStateList(solvedStates);
-    simulationBatch[i].__set_isSolution(solved);
-    simulationBatch[i].__set_stepsSimulated(*layout.stepsSimulated);
-
     sharedFree(sharedBuffers[i], bufferSizes[i]);
   }
-  return simulationBatch;
+  sharedFree(workerStats, workerStatsSize);
+  if (callbackError) {
+    std::rethrow_exception(callbackError);
+  }
 }
@@ -13,6 +13,7 @@
 // limitations under the License.
 #include "task_validation.h"
 #include <math.h>
+#include <algorithm>
 #include <stdexcept>
 #include "Box2D/Box2D.h"
 #include "geometry.h"
@@ -280,18 +281,6 @@ bool isInside(const b2Body& body, const b2Body& baseBody,
   return true;
 }
 
-bool isTouching(const b2Body& body1, const b2Body& body2) {
-  size_t body2Id = getBodyId(body2);
-  for (const b2ContactEdge* ce = body1.GetContactList(); ce; ce = ce->next) {
-    if (body2Id == getBodyId(*ce->other) &&
-        getBodyType(*ce->other) != Box2dData::USER &&
-        ce->contact->IsTouching()) {
-      return true;
-    }
-  }
-  return false;
-}
-
 bool isValidRelationship(const b2Body& body1, const b2Body& body2,
                          const ::task::SpatialRelationship::type relationship,
                          const ::scene::Shape& phantomShape) {
@@ -340,11 +329,104 @@ bool isTwoBallTouchingCase(
   if (relationships[0] != ::task::SpatialRelationship::TOUCHING) return false;
   return true;
 }
+
+// Signed distance from the point to the boundary of the polygon. Positive
+// inside.
+float signedDistanceToPolygon(const std::vector<b2Vec2>& polygon,
+                              const b2Vec2& point) {
+  const float distance =
+      sqrt(geometry::squareDistanceToPolygon(polygon, point));
+  return geometry::isInsidePolygon(polygon, point) ? distance : -distance;
+}
+
+// Minimum signed distance from points of body to the boundary of the phantom
+// shape attached to baseBody. phantomShape must be in meters.
+float getPenetrationDepth(const b2Body& body, const b2Body& baseBody,
+                          const ::scene::Shape& phantomShape) {
+  std::vector<b2Vec2> polygon;
+  for (const ::scene::Vector& v : phantomShape.polygon.vertices) {
+    polygon.emplace_back(v.x, v.y);
+  }
+  float depth = FLT_MAX;
+  for (const b2Fixture* f = body.GetFixtureList(); f; f = f->GetNext()) {
+    if (f->GetType() == b2Shape::e_circle) {
+      const b2CircleShape* circle = (b2CircleShape*)f->GetShape();
+      const b2Vec2 center =
+          baseBody.GetLocalPoint(body.GetWorldPoint(circle->m_p));
+      depth = std::min(
+          depth, signedDistanceToPolygon(polygon, center) - circle->m_radius);
+    } else if (f->GetType() == b2Shape::e_polygon) {
+      const b2PolygonShape* poly = (b2PolygonShape*)f->GetShape();
+      for (int i = 0; i < poly->m_count; i++) {
+        const b2Vec2 v =
+            baseBody.GetLocalPoint(body.GetWorldPoint(poly->m_vertices[i]));
+        depth = std::min(depth, signedDistanceToPolygon(polygon, v));
+      }
+    }
+  }
+  return depth;
+}
+
+float getDirectionalGap(const b2Body& body1, const b2Body& body2,
+                        ::task::SpatialRelationship::type relationship) {
+  const b2AABB aabb1 = getBoundingBoxForBody(body1);
+  const b2AABB aabb2 = getBoundingBoxForBody(body2);
+  switch (relationship) {
+    case ::task::SpatialRelationship::ABOVE:
+      return aabb1.lowerBound.y - aabb2.upperBound.y;
+    case ::task::SpatialRelationship::BELOW:
+      return aabb2.lowerBound.y - aabb1.upperBound.y;
+    case ::task::SpatialRelationship::LEFT_OF:
+      return aabb2.lowerBound.x - aabb1.upperBound.x;
+    case ::task::SpatialRelationship::RIGHT_OF:
+      return aabb1.lowerBound.x - aabb2.upperBound.x;
+    default:
+      return 0;
+  }
+}
 }  // namespace
 
-bool isTaskInSolvedState(const ::task::Task& task,
-                         const b2WorldWithData& world) {
-  checkTaskValidity(task);
+bool isTouching(const b2Body& body1, const b2Body& body2) {
+  size_t body2Id = getBodyId(body2);
+  for (const b2ContactEdge* ce = body1.GetContactList(); ce; ce = ce->next) {
+    if (body2Id == getBodyId(*ce->other) &&
+        getBodyType(*ce->other) != Box2dData::USER &&
+        ce->contact->IsTouching()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+float getBodiesDistance(const b2Body& body1, const b2Body& body2) {
+  float distance = FLT_MAX;
+  b2DistanceInput input;
+  input.transformA = body1.GetTransform();
+  input.transformB = body2.GetTransform();
+  input.useRadii = true;
+  for (const b2Fixture* f1 = body1.GetFixtureList(); f1; f1 = f1->GetNext()) {
+    const b2Shape* shape1 = f1->GetShape();
+    for (int child1 = 0; child1 < shape1->GetChildCount(); ++child1) {
+      input.proxyA.Set(shape1, child1);
+      for (const b2Fixture* f2 = body2.GetFixtureList(); f2;
+           f2 = f2->GetNext()) {
+        const b2Shape* shape2 = f2->GetShape();
+        for (int child2 = 0; child2 < shape2->GetChildCount(); ++child2) {
+          input.proxyB.Set(shape2, child2);
+          b2SimplexCache cache;
+          cache.count = 0;
+          b2DistanceOutput output;
+          b2Distance(&output, &cache, &input);
+          distance = std::min(distance, output.distance);
+        }
+      }
+    }
+  }
+  return distance;
+}
+
+std::pair<const b2Body*, const b2Body*> getGoalBodies(
+    const ::task::Task& task, const b2WorldWithData& world) {
   const b2Body* body1 = nullptr;
   const b2Body* body2 = nullptr;
 
@@ -374,6 +456,13 @@ bool isTaskInSolvedState(const ::task::Task& task,
   if (body1 == nullptr || body2 == nullptr) {
     throw std::runtime_error("Task body IDs not present in the scene");
   }
+  return {body1, body2};
+}
+
+bool isTaskInSolvedState(const ::task::Task& task,
+                         const b2WorldWithData& world) {
+  checkTaskValidity(task);
+  const auto [body1, body2] = getGoalBodies(task, world);
 
   const auto& thriftBody1 = task.scene.bodies[task.bodyId1];
   const auto& thriftBody2 = task.scene.bodies[task.bodyId2];
@@ -399,3 +488,33 @@ bool isTaskInSolvedState(const ::task::Task& task,
   }
   return true;
 }
+
+float getGoalDistance(const ::task::Task& task, const b2WorldWithData& world) {
+  checkTaskValidity(task);
+  if (task.relationships.empty()) {
+    return 0;
+  }
+  const auto [body1, body2] = getGoalBodies(task, world);
+  float distance = 0;
+  switch (task.relationships[0]) {
+    case ::task::SpatialRelationship::TOUCHING:
+    case ::task::SpatialRelationship::TOUCHING_BRIEFLY:
+    case ::task::SpatialRelationship::NOT_TOUCHING:
+      distance = getBodiesDistance(*body1, *body2);
+      break;
+    case ::task::SpatialRelationship::INSIDE:
+    case ::task::SpatialRelationship::NOT_INSIDE:
+      // Same condition as in isTaskInSolvedState: the relationship can only
+      // be measured against a polygonal phantom shape.
+      if (task.__isset.phantomShape && task.phantomShape.__isset.polygon) {
+        distance =
+            getPenetrationDepth(*body1, *body2, p2mShape(task.phantomShape));
+      }
+      break;
+    case ::task::SpatialRelationship::NONE:
+      break;
+    default:
+      distance = getDirectionalGap(*body1, *body2, task.relationships[0]);
+  }
+  return distance * PIXELS_IN_METER;
+}
@@ -14,10 +14,35 @@
 #ifndef TASK_VALIDATION_H
 #define TASK_VALIDATION_H
 
+#include <utility>
+
 #include "gen-cpp/task_types.h"
 #include "thrift_box2d_conversion.h"
 
 bool isTaskInSolvedState(const ::task::Task& task,
                          const b2WorldWithData& world);
 
+// Returns Box2D bodies for task.bodyId1 and task.bodyId2.
+std::pair<const b2Body*, const b2Body*> getGoalBodies(
+    const ::task::Task& task, const b2WorldWithData& world);
+
+// Whether the bodies have a touching contact. Contacts of user bodies are
+// ignored.
+bool isTouching(const b2Body& body1, const b2Body& body2);
+
+// Minimum distance in meters between shapes of the bodies computed with
+// b2Distance. Zero if the bodies overlap.
+float getBodiesDistance(const b2Body& body1, const b2Body& body2);
+
+// Continuous measure of the first task relationship in pixels:
+//  - TOUCHING, TOUCHING_BRIEFLY, NOT_TOUCHING: distance between the goal
+//    bodies;
+//  - INSIDE, NOT_INSIDE: penetration depth of the first body into the phantom
+//    shape of the second one, i.e., the smallest signed distance from the
+//    body to the phantom boundary. Positive if the body is fully inside. 0 if
+//    the phantom shape is not a polygon;
+//  - ABOVE, BELOW, LEFT_OF, RIGHT_OF: gap between the bounding boxes along
+//    the relationship axis. Positive if the relationship holds.
+float getGoalDistance(const ::task::Task& task, const b2WorldWithData& world);
+
 #endif  // TASK_VALIDATION_H
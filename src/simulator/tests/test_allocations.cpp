@@ -0,0 +1,143 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// Checks that the simulate-to-buffer pipeline does not copy bodies or scenes.
+// The test binary replaces the global allocator with one that counts
+// allocations made by the current thread.
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <limits>
+#include <new>
+#include <vector>
+
+#include "creator.h"
+#include "image_to_box2d.h"
+#include "task_utils.h"
+
+#include "gen-cpp/scene_types.h"
+#include "gen-cpp/task_types.h"
+
+namespace {
+thread_local size_t numAllocations = 0;
+}  // namespace
+
+void* operator new(size_t size) {
+  ++numAllocations;
+  if (void* ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+
+namespace {
+
+// Returns the number of allocations made by the function.
+template <class Function>
+size_t countAllocations(Function&& function) {
+  const size_t before = numAllocations;
+  function();
+  return numAllocations - before;
+}
+
+::scene::Scene buildScene(bool withPolygons) {
+  ::scene::Scene scene;
+  scene.__set_height(64);
+  scene.__set_width(64);
+  std::vector<::scene::Body> bodies = {buildCircle(10, 10, 5),
+                                       buildCircle(30, 30, 8, false)};
+  if (withPolygons) {
+    bodies.push_back(buildBox(0, 0, 64, 5, 0, false));
+    bodies.push_back(buildBox(20, 25, 10, 10));
+    // Boxes are not featurized and have no masks unless they have a type.
+    for (size_t i = bodies.size() - 2; i < bodies.size(); ++i) {
+      bodies[i].__set_shapeType(::scene::ShapeType::BAR);
+    }
+  }
+  scene.__set_bodies(bodies);
+  scene.__set_user_input_bodies(
+      std::vector<::scene::Body>{buildCircle(50, 50, 4)});
+  return scene;
+}
+
+::task::Task buildTask() {
+  ::task::Task task;
+  task.__set_scene(buildScene(/*withPolygons=*/true));
+  task.__set_bodyId1(3);
+  task.__set_bodyId2(2);
+  task.relationships.push_back(::task::SpatialRelationship::TOUCHING);
+  return task;
+}
+
+}  // namespace
+
+TEST(AllocationTest, RenderAndFeaturizeDoNotCopyBodies) {
+  const ::scene::Scene scene = buildScene(/*withPolygons=*/false);
+  const int numObjects = getNumObjectsInScene(scene);
+  std::vector<uint8_t> image(scene.height * scene.width);
+  std::vector<uint8_t> masks(numObjects * scene.height * scene.width);
+  std::vector<float> features(numObjects * kObjectFeatureSize);
+
+  // Circles are drawn without any temporary buffers, so nothing should be
+  // allocated at all.
+  EXPECT_EQ(countAllocations([&] { renderTo(scene, image.data()); }), 0);
+  EXPECT_EQ(countAllocations([&] { renderObjectMasksTo(scene, masks.data()); }),
+            0);
+  EXPECT_EQ(countAllocations([&] { featurizeScene(scene, features.data()); }),
+            0);
+}
+
+TEST(AllocationTest, MasksAllocateAsMuchAsImage) {
+  // Polygons need a few temporary vectors per shape. Masks draw every body
+  // once, exactly like the image.
+  const ::scene::Scene scene = buildScene(/*withPolygons=*/true);
+  std::vector<uint8_t> image(scene.height * scene.width);
+  std::vector<uint8_t> masks(getNumObjectsInScene(scene) * scene.height *
+                             scene.width);
+  const size_t imageAllocations =
+      countAllocations([&] { renderTo(scene, image.data()); });
+  EXPECT_GT(imageAllocations, 0);
+  EXPECT_EQ(countAllocations([&] { renderObjectMasksTo(scene, masks.data()); }),
+            imageAllocations);
+}
+
+TEST(AllocationTest, SimulateTaskDoesNotCopyScenes) {
+  const ::task::Task task = buildTask();
+  for (const int stride : {1, 10}) {
+    // Reference: drive the stream manually and keep its outputs.
+    size_t numScenes = 0;
+    const size_t streamAllocations = countAllocations([&] {
+      TaskSimulationStream stream(task, 200, stride);
+      std::vector<::scene::Scene> scenes;
+      stream.advance(std::numeric_limits<int>::max(), &scenes);
+      const std::vector<bool> solvedStates =
+          stream.releaseStridedSolvedStateList();
+      numScenes = scenes.size();
+    });
+    ASSERT_GT(numScenes, 1);
+
+    size_t numSimulatedScenes = 0;
+    const size_t simulationAllocations = countAllocations([&] {
+      const ::task::TaskSimulation simulation = simulateTask(task, 200, stride);
+      numSimulatedScenes = simulation.sceneList.size();
+    });
+    EXPECT_EQ(numSimulatedScenes, numScenes);
+    // Copying the scenes would add several allocations per scene.
+    EXPECT_LE(simulationAllocations, streamAllocations + 2)
+        << "stride=" << stride;
+  }
+}
@@ -0,0 +1,237 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <gtest/gtest.h>
+#include <math.h>
+
+#include "creator.h"
+#include "featurized_objects.h"
+#include "image_to_box2d.h"
+#include "task_utils.h"
+#include "thrift_serialization.h"
+
+#include "gen-cpp/scene_types.h"
+#include "gen-cpp/task_types.h"
+
+using scene::Body;
+using scene::Scene;
+using scene::ShapeType;
+
+namespace {
+
+Body buildBody(ShapeType::type shapeType, double diameter, float x, float y,
+               float angle, ::shared::Color::type color) {
+  Body body;
+  body.__set_position(getVector(x, y));
+  body.__set_angle(angle);
+  body.__set_shapes(buildShapesFromDiameter(shapeType, diameter));
+  body.__set_diameter(diameter);
+  body.__set_shapeType(shapeType);
+  body.__set_color(color);
+  return body;
+}
+
+Scene buildScene() {
+  Scene scene;
+  scene.__set_width(kSceneWidth);
+  scene.__set_height(kSceneHeight);
+  scene.__set_bodies(
+      {buildBody(ShapeType::BAR, 80, 50, 30, -0.2, ::shared::Color::BLACK),
+       buildBody(ShapeType::BALL, 21, 100, 100, 0, ::shared::Color::GREEN),
+       buildBody(ShapeType::STANDINGSTICKS, 60, 150, 150, M_PI / 2,
+                 ::shared::Color::GRAY)});
+  scene.__set_user_input_bodies({buildCircle(200, 60, 10)});
+  return scene;
+}
+
+std::vector<float> featurize(const Scene& scene) {
+  std::vector<float> features(getNumObjectsInScene(scene) *
+                              kObjectFeatureSize);
+  featurizeScene(scene, features.data());
+  return features;
+}
+
+std::vector<float> simulateFeatures(const std::vector<float>& features,
+                                    int numStates, int steps, int stride,
+                                    int numThreads) {
+  const int numObjects = features.size() / numStates / kObjectFeatureSize;
+  std::vector<float> result(numStates * getNumFeaturizedFrames(steps, stride) *
+                            numObjects * kObjectFeatureSize);
+  simulateFeaturizedObjectsTo(features.data(), numStates, numObjects, steps,
+                              stride, numThreads, result.data());
+  return result;
+}
+
+std::vector<uint8_t> renderScene(const Scene& scene) {
+  std::vector<uint8_t> image(scene.width * scene.height);
+  renderTo(scene, image.data());
+  return image;
+}
+
+}  // namespace
+
+TEST(FeaturizedObjectsTest, Shapes) {
+  EXPECT_EQ(buildShapesFromDiameter(ShapeType::BALL, 21)[0].circle.radius,
+            10.5);
+  EXPECT_EQ(buildShapesFromDiameter(ShapeType::BAR, 80).size(), 1);
+  EXPECT_EQ(buildShapesFromDiameter(ShapeType::JAR, 80).size(), 3);
+  EXPECT_EQ(buildShapesFromDiameter(ShapeType::STANDINGSTICKS, 80).size(), 2);
+  EXPECT_THROW(buildShapesFromDiameter(ShapeType::UNDEFINED, 80),
+               std::runtime_error);
+  // The jar is open at the top, so the center of mass is above the base.
+  EXPECT_GT(getJarCenterOfMassOffset(80), 0);
+}
+
+TEST(FeaturizedObjectsTest, RenderMatchesScene) {
+  const Scene scene = buildScene();
+  const std::vector<float> features = featurize(scene);
+  const int numObjects = features.size() / kObjectFeatureSize;
+  const Scene restored = featurizedObjectsToScene(features.data(), numObjects);
+  // The walls precede the objects.
+  EXPECT_EQ(restored.bodies.size(), 4 + 3);
+  EXPECT_EQ(restored.user_input_bodies.size(), 1);
+  EXPECT_EQ(getNumObjectsInScene(restored), numObjects);
+  EXPECT_EQ(renderScene(restored), renderScene(scene));
+}
+
+TEST(FeaturizedObjectsTest, JarPositionIsCenterOfMass) {
+  Scene scene;
+  scene.__set_width(kSceneWidth);
+  scene.__set_height(kSceneHeight);
+  const float angle = 0.3;
+  scene.__set_bodies(
+      {buildBody(ShapeType::JAR, 50, 120, 80, angle, ::shared::Color::BLUE)});
+  std::vector<float> features = featurize(scene);
+  // Shift to the center of mass as finalize_featurized_objects does.
+  const double offset = getJarCenterOfMassOffset(50);
+  features[0] -= offset * sin(angle) / kSceneWidth;
+  features[1] += offset * cos(angle) / kSceneWidth;
+  const Scene restored = featurizedObjectsToScene(features.data(), 1);
+  ASSERT_EQ(restored.bodies.size(), 4 + 1);
+  EXPECT_NEAR(restored.bodies.back().position.x, 120, 1e-3);
+  EXPECT_NEAR(restored.bodies.back().position.y, 80, 1e-3);
+}
+
+TEST(FeaturizedObjectsTest, BatchedRender) {
+  const Scene scene = buildScene();
+  const std::vector<float> frame = featurize(scene);
+  const int numObjects = frame.size() / kObjectFeatureSize;
+  constexpr int kNumFrames = 5;
+  std::vector<float> features;
+  for (int i = 0; i < kNumFrames; ++i) {
+    features.insert(features.end(), frame.begin(), frame.end());
+  }
+  const std::vector<uint8_t> expected = renderScene(scene);
+  for (const int numThreads : {1, 3}) {
+    std::vector<uint8_t> images(kNumFrames * kSceneWidth * kSceneHeight);
+    renderFeaturizedObjectsTo(features.data(), kNumFrames, numObjects,
+                              numThreads, images.data());
+    for (int i = 0; i < kNumFrames; ++i) {
+      EXPECT_TRUE(std::equal(expected.begin(), expected.end(),
+                             images.begin() + i * expected.size()));
+    }
+  }
+}
+
+TEST(FeaturizedObjectsTest, RestartMatchesContinuation) {
+  Scene scene;
+  scene.__set_width(kSceneWidth);
+  scene.__set_height(kSceneHeight);
+  Body ball =
+      buildBody(ShapeType::BALL, 20, 60, 200, 0, ::shared::Color::GREEN);
+  ball.__set_linearVelocity(getVector(30, 10));
+  ball.__set_angularVelocity(1);
+  scene.__set_bodies({ball});
+  const std::vector<float> features = featurize(scene);
+  // The ball flies freely, so restarting from its state in the middle of
+  // the simulation continues the same trajectory.
+  const std::vector<float> trajectory = simulateFeatures(features, 1, 20, 1, 1);
+  const std::vector<float> middle(trajectory.begin() + 9 * kObjectFeatureSize,
+                                  trajectory.begin() + 10 * kObjectFeatureSize);
+  const std::vector<float> restarted = simulateFeatures(middle, 1, 10, 1, 1);
+  ASSERT_EQ(restarted.size(), 10 * kObjectFeatureSize);
+  for (int i = 0; i < kObjectFeatureSize; ++i) {
+    EXPECT_NEAR(restarted[9 * kObjectFeatureSize + i],
+                trajectory[19 * kObjectFeatureSize + i], 1e-3);
+  }
+  // The initial velocity moves the ball right.
+  EXPECT_GT(trajectory[19 * kObjectFeatureSize], features[0]);
+}
+
+TEST(FeaturizedObjectsTest, BatchedSimulation) {
+  const std::vector<float> state = featurize(buildScene());
+  constexpr int kNumStates = 4;
+  std::vector<float> features;
+  for (int i = 0; i < kNumStates; ++i) {
+    features.insert(features.end(), state.begin(), state.end());
+  }
+  const std::vector<float> expected = simulateFeatures(state, 1, 30, 7, 1);
+  EXPECT_EQ(expected.size(), 5 * state.size());
+  for (const int numThreads : {1, 3}) {
+    const std::vector<float> result =
+        simulateFeatures(features, kNumStates, 30, 7, numThreads);
+    for (int i = 0; i < kNumStates; ++i) {
+      EXPECT_TRUE(std::equal(expected.begin(), expected.end(),
+                             result.begin() + i * expected.size()));
+    }
+  }
+}
+
+TEST(FeaturizedObjectsTest, SimulationRejectsInvalidArguments) {
+  EXPECT_EQ(getNumFeaturizedFrames(0, 1), 0);
+  EXPECT_EQ(getNumFeaturizedFrames(30, 7), 5);
+  EXPECT_THROW(getNumFeaturizedFrames(-1, 1), std::runtime_error);
+  EXPECT_THROW(getNumFeaturizedFrames(10, 0), std::runtime_error);
+  EXPECT_THROW(getNumFeaturizedFrames(10, -2), std::runtime_error);
+
+  const std::vector<float> state = featurize(buildScene());
+  const int numObjects = state.size() / kObjectFeatureSize;
+  std::vector<float> buffer(state.size());
+  EXPECT_THROW(simulateFeaturizedObjectsTo(state.data(), 1, numObjects, 10,
+                                           /*stride=*/0, 1, buffer.data()),
+               std::runtime_error);
+  EXPECT_THROW(simulateFeaturizedObjectsTo(state.data(), -1, numObjects, 10, 1,
+                                           1, buffer.data()),
+               std::runtime_error);
+}
+
+TEST(FeaturizedObjectsTest, InitialObservations) {
+  std::vector<Scene> scenes = {buildScene(), buildScene()};
+  scenes[1].bodies.push_back(
+      buildBody(ShapeType::JAR, 50, 120, 80, 0, ::shared::Color::BLUE));
+  std::vector<std::string> serializedTasks;
+  for (const Scene& scene : scenes) {
+    ::task::Task task;
+    task.__set_scene(scene);
+    const auto span = thrift_serialization::serializeToSpan(task);
+    serializedTasks.emplace_back(reinterpret_cast<const char*>(span.data),
+                                 span.size);
+  }
+  const size_t imageSize = kSceneWidth * kSceneHeight;
+  std::vector<uint8_t> images(scenes.size() * imageSize);
+  std::vector<std::vector<float>> objects;
+  getInitialObservationsTo(serializedTasks, 2, images.data(), &objects);
+  ASSERT_EQ(objects.size(), scenes.size());
+  for (size_t i = 0; i < scenes.size(); ++i) {
+    const std::vector<uint8_t> expected = renderScene(scenes[i]);
+    EXPECT_TRUE(std::equal(expected.begin(), expected.end(),
+                           images.begin() + i * imageSize));
+  }
+  EXPECT_EQ(objects[0], featurize(scenes[0]));
+  // The jar is shifted to the center of mass.
+  const std::vector<float> features = featurize(scenes[1]);
+  const float* jar = objects[1].data() + 3 * kObjectFeatureSize;
+  EXPECT_FLOAT_EQ(jar[0], features[3 * kObjectFeatureSize]);
+  EXPECT_FLOAT_EQ(jar[1], features[3 * kObjectFeatureSize + 1] +
+                              getJarCenterOfMassOffset(50) / kSceneWidth);
+}
@@ -0,0 +1,120 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "creator.h"
+#include "image_delta.h"
+#include "image_to_box2d.h"
+#include "task_utils.h"
+
+#include "gen-cpp/scene_types.h"
+
+using scene::Scene;
+
+TEST(ImageDeltaTest, EncodeDecode) {
+  const std::vector<std::vector<uint8_t>> frames = {
+      {0, 0, 1, 1, 2, 2},
+      {0, 0, 1, 1, 2, 2},
+      {3, 0, 1, 1, 2, 0},
+      {3, 0, 0, 1, 2, 0},
+  };
+  DeltaImageEncoder encoder(2, 3);
+  for (const auto& frame : frames) {
+    std::copy(frame.begin(), frame.end(), encoder.nextFrameBuffer());
+    encoder.addFrame();
+  }
+  const DeltaEncodedImages images = encoder.release();
+  ASSERT_EQ(images.numFrames(), 4);
+  ASSERT_EQ(images.frameOffsets, (std::vector<int64_t>{0, 0, 2, 3}));
+  ASSERT_EQ(images.changedPixels, (std::vector<int32_t>{0, 5, 2}));
+  ASSERT_EQ(images.changedValues, (std::vector<uint8_t>{3, 0, 0}));
+
+  for (int begin = 0; begin <= 4; ++begin) {
+    for (int end = begin; end <= 4; ++end) {
+      std::vector<uint8_t> decoded((end - begin) * 6);
+      decodeDeltaImages(images, begin, end, decoded.data());
+      for (int i = begin; i < end; ++i) {
+        ASSERT_TRUE(std::equal(frames[i].begin(), frames[i].end(),
+                               decoded.begin() + (i - begin) * 6))
+            << "begin=" << begin << " end=" << end << " frame=" << i;
+      }
+    }
+  }
+  EXPECT_THROW(decodeDeltaImages(images, 0, 5, nullptr), std::runtime_error);
+}
+
+TEST(ImageDeltaTest, RejectsCorruptArrays) {
+  const std::vector<uint8_t> keyframe(6, 0);
+  std::vector<uint8_t> buffer(3 * 6);
+  const auto decode = [&](const std::vector<int64_t>& frameOffsets,
+                          const std::vector<int32_t>& changedPixels) {
+    const std::vector<uint8_t> changedValues(changedPixels.size(), 1);
+    decodeDeltaImages(keyframe.data(), keyframe.size(), frameOffsets.data(),
+                      frameOffsets.size(), changedPixels.data(),
+                      changedValues.data(), changedPixels.size(), 0,
+                      frameOffsets.size(), buffer.data());
+  };
+  const auto check = [&](const std::vector<int64_t>& frameOffsets,
+                         const std::vector<int32_t>& changedPixels) {
+    checkDeltaImages(keyframe.size(), frameOffsets.data(), frameOffsets.size(),
+                     changedPixels.data(), changedPixels.size());
+  };
+
+  EXPECT_NO_THROW(decode({0, 1, 2}, {5, 0}));
+  EXPECT_NO_THROW(check({0, 1, 2}, {5, 0}));
+  // Pixels outside of the image.
+  EXPECT_THROW(decode({0, 1, 2}, {6, 0}), std::runtime_error);
+  EXPECT_THROW(decode({0, 1, 2}, {0, -1}), std::runtime_error);
+  EXPECT_THROW(check({0, 1, 2}, {0, 6}), std::runtime_error);
+  // Decreasing offsets.
+  EXPECT_THROW(decode({0, 2, 1}, {0, 1}), std::runtime_error);
+  EXPECT_THROW(check({0, 2, 1}, {0, 1}), std::runtime_error);
+  // Offsets past the changes.
+  EXPECT_THROW(decode({0, 1, 3}, {0, 1}), std::runtime_error);
+  EXPECT_THROW(check({0, 1, 3}, {0, 1}), std::runtime_error);
+  // Offsets that do not start at zero or do not cover all changes.
+  EXPECT_THROW(check({1, 1, 2}, {0, 1}), std::runtime_error);
+  EXPECT_THROW(check({0, 1, 1}, {0, 1}), std::runtime_error);
+  EXPECT_THROW(check({}, {0}), std::runtime_error);
+}
+
+TEST(ImageDeltaTest, SimulationRoundTrip) {
+  Scene scene;
+  scene.__set_width(64);
+  scene.__set_height(64);
+  scene.__set_bodies(std::vector<::scene::Body>{
+      buildBox(0, 0, 64, 5, 0, false),
+      buildBox(20, 30, 10, 10),
+  });
+  const std::vector<Scene> scenes = simulateScene(scene, 100);
+  DeltaImageEncoder encoder(scene.height, scene.width);
+  for (const Scene& frame : scenes) {
+    renderTo(frame, encoder.nextFrameBuffer());
+    encoder.addFrame();
+  }
+  const DeltaEncodedImages images = encoder.release();
+  const int imageSize = scene.height * scene.width;
+  std::vector<uint8_t> decoded(scenes.size() * imageSize);
+  decodeDeltaImages(images, 0, scenes.size(), decoded.data());
+  std::vector<uint8_t> expected(imageSize);
+  for (size_t i = 0; i < scenes.size(); ++i) {
+    renderTo(scenes[i], expected.data());
+    ASSERT_TRUE(std::equal(expected.begin(), expected.end(),
+                           decoded.begin() + i * imageSize))
+        << "frame=" << i;
+  }
+  // Only the falling box changes between frames.
+  EXPECT_LT(images.changedPixels.size(), scenes.size() * imageSize / 10);
+}
@@ -0,0 +1,134 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// DEBUG messages are compiled out in this file.
+#define PHYRE_LOG_COMPILE_LEVEL 1
+
+#include <gtest/gtest.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "utils/logger.h"
+
+namespace {
+
+class LoggerTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    Logger::set_outstream(&output);
+    Logger::set_log_level(LOG_LEVEL::DEBUG);
+  }
+
+  void TearDown() override {
+    Logger::set_outstream(&std::cout);
+    Logger::set_log_level(LOG_LEVEL::ERROR);
+  }
+
+  std::string flushedOutput() {
+    Logger::flush();
+    return output.str();
+  }
+
+  std::ostringstream output;
+};
+
+int numCalls = 0;
+
+int countCall() { return ++numCalls; }
+
+}  // namespace
+
+TEST_F(LoggerTest, WritesMessagesInOrder) {
+  std::string expected;
+  for (int i = 0; i < 100; ++i) {
+    PHYRE_LOG_INFO << "message " << i << "\n";
+    expected += "message " + std::to_string(i) + "\n";
+  }
+  Logger::INFO() << "legacy " << 1 << "\n";
+  expected += "legacy 1\n";
+  EXPECT_EQ(flushedOutput(), expected);
+}
+
+TEST_F(LoggerTest, SkipsDisabledLevels) {
+  numCalls = 0;
+  // Compiled out.
+  PHYRE_LOG_DEBUG << countCall() << "\n";
+  EXPECT_EQ(numCalls, 0);
+
+  // Disabled at run time.
+  Logger::set_log_level(LOG_LEVEL::ERROR);
+  PHYRE_LOG_INFO << countCall() << "\n";
+  EXPECT_EQ(numCalls, 0);
+
+  PHYRE_LOG_ERROR << "error " << countCall() << "\n";
+  EXPECT_EQ(numCalls, 1);
+  EXPECT_EQ(flushedOutput(), "error 1\n");
+}
+
+TEST_F(LoggerTest, KeepsOrderWithinThreads) {
+  constexpr int kNumThreads = 8;
+  constexpr int kNumMessages = 200;
+  std::vector<std::thread> threads;
+  for (int thread = 0; thread < kNumThreads; ++thread) {
+    threads.emplace_back([thread] {
+      for (int i = 0; i < kNumMessages; ++i) {
+        PHYRE_LOG_INFO << thread << " " << i << "\n";
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  std::istringstream lines(flushedOutput());
+  std::vector<int> nextMessage(kNumThreads, 0);
+  int thread, message;
+  while (lines >> thread >> message) {
+    ASSERT_GE(thread, 0);
+    ASSERT_LT(thread, kNumThreads);
+    ASSERT_EQ(message, nextMessage[thread]) << "thread=" << thread;
+    ++nextMessage[thread];
+  }
+  EXPECT_EQ(Logger::num_dropped(), 0);
+  for (int count : nextMessage) {
+    EXPECT_EQ(count, kNumMessages);
+  }
+}
+
+TEST_F(LoggerTest, WorksInForkedChild) {
+  PHYRE_LOG_INFO << "parent\n";
+  // Do not let the child flush copies of the parent's buffers.
+  std::fflush(nullptr);
+  std::cout.flush();
+  const pid_t pid = fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0) {
+    // Pending messages are left to the parent and the child has no drain
+    // thread, so its own message is written right away. Exiting normally
+    // runs the logger destructor, which must not join the missing thread.
+    const std::string before = output.str();
+    PHYRE_LOG_INFO << "child\n";
+    std::exit(output.str() == before + "child\n" ? 0 : 1);
+  }
+  int status;
+  ASSERT_EQ(waitpid(pid, &status, 0), pid);
+  ASSERT_TRUE(WIFEXITED(status));
+  EXPECT_EQ(WEXITSTATUS(status), 0);
+  EXPECT_EQ(flushedOutput(), "parent\n");
+}
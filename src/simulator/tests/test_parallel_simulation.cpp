@@ -115,3 +115,36 @@ TEST(ParallelSimulationTest, CheckConsistencyWithStride) {
         << "Discrepancy at task " << i;
   }
 }
+
+TEST(ParallelSimulationTest, CheckCompletionCallback) {
+  std::vector<Task> tasks;
+  for (int i = 0; i < 10; ++i) {
+    Task task;
+    task.__set_scene(CreateDemoScene(i));
+    task.__set_bodyId1(0);
+    task.__set_bodyId2(1);
+    task.__set_relationships(std::vector<::task::SpatialRelationship::type>{
+        ::task::SpatialRelationship::RIGHT_OF});
+    tasks.push_back(task);
+  }
+
+  const int maxSteps = 100;  // To make the test faster.
+  std::vector<TaskSimulation> groundTruthSimulation;
+  for (const Task& task : tasks) {
+    groundTruthSimulation.push_back(simulateTask(task, maxSteps));
+  }
+
+  std::vector<int> numCalls(tasks.size(), 0);
+  simulateTasksAsCompleted(
+      tasks, /*numWorkers=*/3, maxSteps, /*stride=*/1,
+      [&](size_t index, TaskSimulation&& simulation) {
+        ASSERT_LT(index, tasks.size());
+        ++numCalls[index];
+        ASSERT_EQ(groundTruthSimulation[index], simulation)
+            << "Discrepancy at task " << index;
+      });
+
+  for (size_t i = 0; i < tasks.size(); ++i) {
+    ASSERT_EQ(numCalls[i], 1) << "Wrong number of callbacks for task " << i;
+  }
+}
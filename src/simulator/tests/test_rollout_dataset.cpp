@@ -0,0 +1,368 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "creator.h"
+#include "image_to_box2d.h"
+#include "rollout_dataset.h"
+#include "rollout_generator.h"
+#include "task_utils.h"
+
+#include "gen-cpp/scene_types.h"
+#include "gen-cpp/task_types.h"
+
+using scene::Body;
+using scene::Scene;
+using task::Task;
+using task::TaskSimulation;
+
+namespace {
+
+// Reads a little-endian unsigned integer of numBytes bytes.
+uint64_t readLittleEndian(const char* data, size_t numBytes) {
+  uint64_t value = 0;
+  for (size_t i = 0; i < numBytes; ++i) {
+    value |= static_cast<uint64_t>(static_cast<uint8_t>(data[i])) << (8 * i);
+  }
+  return value;
+}
+
+Task buildTask(int height = 64) {
+  Scene scene;
+  scene.__set_width(64);
+  scene.__set_height(height);
+  scene.__set_bodies(std::vector<Body>{buildBox(10, height - 24, 10, 10),
+                                       buildBox(0, 0, 64, 5, 0, false)});
+  Task task;
+  task.__set_scene(scene);
+  task.__set_bodyId1(0);
+  task.__set_bodyId2(1);
+  task.__set_relationships(std::vector<::task::SpatialRelationship::type>{
+      ::task::SpatialRelationship::TOUCHING});
+  return task;
+}
+
+// A unique directory for the files of a test. Removed with its content.
+class TempDir {
+ public:
+  TempDir() {
+    std::string pattern =
+        (std::filesystem::temp_directory_path() / "phyre_rollouts_XXXXXX")
+            .string();
+    if (mkdtemp(pattern.data()) == nullptr) {
+      throw std::runtime_error("Cannot create a temporary directory");
+    }
+    path_ = pattern;
+  }
+  ~TempDir() { std::filesystem::remove_all(path_); }
+
+  std::string file(const std::string& name) const {
+    return (path_ / name).string();
+  }
+
+ private:
+  std::filesystem::path path_;
+};
+
+std::vector<char> readFile(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  return std::vector<char>(std::istreambuf_iterator<char>(in),
+                           std::istreambuf_iterator<char>());
+}
+
+struct IndexedColumn {
+  RolloutColumn column;
+  ColumnCodec codec;
+  uint64_t offset;
+  uint64_t size;
+};
+
+struct IndexedRollout {
+  std::string taskId;
+  int actionIndex;
+  int numFrames;
+  int numObjects;
+  int height;
+  int width;
+  std::vector<IndexedColumn> columns;
+
+  const IndexedColumn* findColumn(RolloutColumn column) const {
+    for (const IndexedColumn& entry : columns) {
+      if (entry.column == column) {
+        return &entry;
+      }
+    }
+    return nullptr;
+  }
+};
+
+// Parses the index of a dataset file.
+std::vector<IndexedRollout> readIndex(const std::vector<char>& bytes) {
+  const char* data = bytes.data();
+  size_t offset = readLittleEndian(
+      data + bytes.size() - sizeof(kRolloutDatasetMagic) - sizeof(uint64_t),
+      sizeof(uint64_t));
+  const auto read = [&](size_t numBytes) {
+    const uint64_t value = readLittleEndian(data + offset, numBytes);
+    offset += numBytes;
+    return value;
+  };
+  std::vector<IndexedRollout> rollouts(read(4));
+  for (IndexedRollout& rollout : rollouts) {
+    const size_t taskIdLength = read(2);
+    rollout.taskId.assign(data + offset, taskIdLength);
+    offset += taskIdLength;
+    rollout.actionIndex = static_cast<int32_t>(read(4));
+    rollout.numFrames = static_cast<int32_t>(read(4));
+    rollout.numObjects = static_cast<int32_t>(read(4));
+    rollout.height = static_cast<int32_t>(read(4));
+    rollout.width = static_cast<int32_t>(read(4));
+    read(4);  // stepsSimulated.
+    read(1);  // isSolution.
+    rollout.columns.resize(read(1));
+    for (IndexedColumn& column : rollout.columns) {
+      column.column = static_cast<RolloutColumn>(read(1));
+      column.codec = static_cast<ColumnCodec>(read(1));
+      column.offset = read(8);
+      column.size = read(8);
+    }
+  }
+  return rollouts;
+}
+
+// Returns the number of rollouts stored in the index of a dataset file.
+uint64_t readNumRollouts(const std::vector<char>& bytes) {
+  const uint64_t indexOffset =
+      readLittleEndian(bytes.data() + bytes.size() -
+                           sizeof(kRolloutDatasetMagic) - sizeof(uint64_t),
+                       sizeof(uint64_t));
+  EXPECT_LT(indexOffset, bytes.size());
+  return readLittleEndian(bytes.data() + indexOffset, sizeof(uint32_t));
+}
+
+}  // namespace
+
+TEST(RolloutDatasetTest, RleRoundTrip) {
+  const std::vector<uint8_t> data{0, 0, 0, 1, 1, 5, 0, 0, 0, 0, 7};
+  const std::vector<uint8_t> blob = rleEncode(data.data(), data.size());
+  // The run count is stored as a little-endian uint64 on every host.
+  const std::vector<uint8_t> numRuns(blob.begin(), blob.begin() + 8);
+  EXPECT_EQ(numRuns, (std::vector<uint8_t>{5, 0, 0, 0, 0, 0, 0, 0}));
+  EXPECT_EQ(rleDecodeUint8(blob), data);
+
+  const std::vector<uint32_t> wide{3, 3, 0xFFFFFFFF, 0xFFFFFFFF, 3};
+  EXPECT_EQ(rleDecodeUint32(rleEncode(wide.data(), wide.size())), wide);
+
+  EXPECT_EQ(rleDecodeUint8(rleEncode(data.data(), 0)).size(), 0);
+}
+
+TEST(RolloutDatasetTest, DeltaRoundTripIsLossless) {
+  const int numFrames = 4;
+  const int numObjects = 2;
+  std::vector<float> features(numFrames * numObjects * kObjectFeatureSize);
+  for (size_t i = 0; i < features.size(); ++i) {
+    // Mix of constant, growing and sign-changing values.
+    features[i] = (i % 3 == 0) ? 0.25f : (i % 3 == 1) ? i * 0.1f : -1.0f * i;
+  }
+  const std::vector<uint8_t> blob =
+      deltaEncodeFeatures(features.data(), numFrames, numObjects);
+  const std::vector<float> decoded =
+      deltaDecodeFeatures(blob, numFrames, numObjects);
+  ASSERT_EQ(decoded.size(), features.size());
+  EXPECT_EQ(std::memcmp(decoded.data(), features.data(),
+                        features.size() * sizeof(float)),
+            0);
+}
+
+TEST(RolloutDatasetTest, WriterProducesIndexedFile) {
+  const TaskSimulation simulation =
+      simulateTask(buildTask(), 50, /*stride=*/10);
+
+  const TempDir dir;
+  const std::string path = dir.file("rollouts.bin");
+  {
+    RolloutDatasetWriter writer(path);
+    writer.addSimulation("00000:000", 3, simulation, true, true, true);
+    writer.addSimulation("00000:000", 4, simulation, false, true, false);
+    EXPECT_EQ(writer.numRollouts(), 2);
+    writer.close();
+  }
+  const std::vector<char> bytes = readFile(path);
+
+  ASSERT_GT(bytes.size(), 2 * sizeof(kRolloutDatasetMagic));
+  EXPECT_EQ(std::memcmp(bytes.data(), kRolloutDatasetMagic,
+                        sizeof(kRolloutDatasetMagic)),
+            0);
+  EXPECT_EQ(std::memcmp(bytes.data() + bytes.size() -
+                            sizeof(kRolloutDatasetMagic),
+                        kRolloutDatasetMagic, sizeof(kRolloutDatasetMagic)),
+            0);
+  EXPECT_EQ(readNumRollouts(bytes), 2);
+}
+
+TEST(RolloutDatasetTest, ConcurrentAddsAreSerialized) {
+  const TaskSimulation simulation =
+      simulateTask(buildTask(), 50, /*stride=*/10);
+  const int kNumThreads = 4;
+  const int kRolloutsPerThread = 5;
+
+  const TempDir dir;
+  const std::string path = dir.file("rollouts.bin");
+  {
+    RolloutDatasetWriter writer(path);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kNumThreads; ++t) {
+      threads.emplace_back([&writer, &simulation, t]() {
+        for (int i = 0; i < kRolloutsPerThread; ++i) {
+          writer.addSimulation("00000:000", t * kRolloutsPerThread + i,
+                               simulation, true, true, true);
+        }
+      });
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+    EXPECT_EQ(writer.numRollouts(), kNumThreads * kRolloutsPerThread);
+    writer.close();
+  }
+  const std::vector<char> bytes = readFile(path);
+  ASSERT_GT(bytes.size(), 2 * sizeof(kRolloutDatasetMagic));
+  EXPECT_EQ(readNumRollouts(bytes), kNumThreads * kRolloutsPerThread);
+}
+
+TEST(RolloutDatasetTest, ResolutionResizesImagesAndMasks) {
+  const TaskSimulation simulation =
+      simulateTask(buildTask(/*height=*/42), 50, /*stride=*/10);
+  const Scene& lastScene = simulation.sceneList.back();
+  ASSERT_EQ(lastScene.width, 64);
+  ASSERT_EQ(lastScene.height, 42);
+
+  RolloutDatasetOptions options;
+  options.images = ColumnCodec::RAW;
+  options.objectMasks = ColumnCodec::RAW;
+  options.resolution = 24;
+  const TempDir dir;
+  const std::string path = dir.file("rollouts.bin");
+  {
+    RolloutDatasetWriter writer(path, options);
+    writer.addSimulation("00000:000", 3, simulation, true, false, true);
+    writer.close();
+  }
+  const std::vector<char> bytes = readFile(path);
+  const std::vector<IndexedRollout> rollouts = readIndex(bytes);
+  ASSERT_EQ(rollouts.size(), 1);
+  const IndexedRollout& rollout = rollouts[0];
+  // 42 * 24 / 64 = 15.75 is rounded to the nearest row.
+  EXPECT_EQ(rollout.width, 24);
+  EXPECT_EQ(rollout.height, 16);
+  ASSERT_EQ(rollout.numFrames, static_cast<int>(simulation.sceneList.size()));
+  ASSERT_EQ(rollout.numObjects, getNumObjectsInScene(lastScene));
+
+  const size_t planeSize = rollout.height * rollout.width;
+  const IndexedColumn* images = rollout.findColumn(RolloutColumn::IMAGES);
+  const IndexedColumn* masks = rollout.findColumn(RolloutColumn::OBJECT_MASKS);
+  ASSERT_NE(images, nullptr);
+  ASSERT_NE(masks, nullptr);
+  ASSERT_EQ(images->size, planeSize * rollout.numFrames);
+  ASSERT_EQ(masks->size, planeSize * rollout.numObjects * rollout.numFrames);
+
+  // Every stored pixel is the scene pixel nearest to its center.
+  const auto sceneOffset = [&](int y, int x) {
+    return static_cast<size_t>((2 * y + 1) * lastScene.height /
+                               (2 * rollout.height)) *
+               lastScene.width +
+           (2 * x + 1) * lastScene.width / (2 * rollout.width);
+  };
+  const size_t scenePlaneSize = lastScene.height * lastScene.width;
+  std::vector<uint8_t> image(scenePlaneSize);
+  std::vector<uint8_t> sceneMasks(scenePlaneSize * rollout.numObjects);
+  renderTo(lastScene, image.data());
+  renderObjectMasksTo(lastScene, sceneMasks.data());
+  const char* lastImage =
+      bytes.data() + images->offset + (rollout.numFrames - 1) * planeSize;
+  const char* lastMasks = bytes.data() + masks->offset +
+                          (rollout.numFrames - 1) * rollout.numObjects *
+                              planeSize;
+  for (int y = 0; y < rollout.height; ++y) {
+    for (int x = 0; x < rollout.width; ++x) {
+      const size_t pixel = y * rollout.width + x;
+      EXPECT_EQ(static_cast<uint8_t>(lastImage[pixel]),
+                image[sceneOffset(y, x)]);
+      for (int object = 0; object < rollout.numObjects; ++object) {
+        EXPECT_EQ(static_cast<uint8_t>(lastMasks[object * planeSize + pixel]),
+                  sceneMasks[object * scenePlaneSize + sceneOffset(y, x)]);
+      }
+    }
+  }
+}
+
+TEST(RolloutDatasetTest, GeneratorWritesAllShards) {
+  Task first = buildTask();
+  first.__set_taskId("00000:000");
+  Task second = buildTask(/*height=*/48);
+  second.__set_taskId("00000:001");
+
+  ::task::RolloutJob job;
+  job.__set_tasks({first, second});
+  std::vector<scene::UserInput> userInputs(3);
+  for (size_t i = 0; i < userInputs.size(); ++i) {
+    ::scene::CircleWithPosition ball;
+    ball.position.__set_x(35 + 8 * i);
+    ball.position.__set_y(30);
+    ball.__set_radius(3);
+    userInputs[i].__set_balls({ball});
+  }
+  job.__set_userInputs(userInputs);
+  job.__set_actionIndices({{0, 1, 2}, {2, 0}});
+  job.__set_actionIds({10, 11, 12});
+  job.__set_keepSpaceAroundBodies(true);
+
+  const TempDir dir;
+  RolloutGeneratorOptions options;
+  options.outputPrefix = dir.file("rollouts");
+  options.numShards = 3;
+  options.numThreads = 2;
+  options.steps = 50;
+  options.stride = 10;
+  EXPECT_EQ(generateRollouts(job, options), 5);
+
+  std::vector<std::pair<std::string, int>> written;
+  for (int shard = 0; shard < options.numShards; ++shard) {
+    const std::vector<char> bytes =
+        readFile(getShardPath(options.outputPrefix, shard, options.numShards));
+    ASSERT_GT(bytes.size(), 2 * sizeof(kRolloutDatasetMagic));
+    for (const IndexedRollout& rollout : readIndex(bytes)) {
+      EXPECT_NE(rollout.findColumn(RolloutColumn::IMAGES), nullptr);
+      EXPECT_NE(rollout.findColumn(RolloutColumn::FEATURIZED_OBJECTS), nullptr);
+      EXPECT_EQ(rollout.findColumn(RolloutColumn::OBJECT_MASKS), nullptr);
+      EXPECT_EQ(rollout.height, rollout.taskId == "00000:000" ? 64 : 48);
+      written.emplace_back(rollout.taskId, rollout.actionIndex);
+    }
+  }
+  // Shards are contiguous ranges of the (task, action) pairs in job order.
+  const std::vector<std::pair<std::string, int>> expected{
+      {"00000:000", 10}, {"00000:000", 11}, {"00000:000", 12},
+      {"00000:001", 12}, {"00000:001", 10}};
+  EXPECT_EQ(written, expected);
+}
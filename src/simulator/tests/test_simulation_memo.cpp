@@ -0,0 +1,293 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "creator.h"
+#include "simulation_memo.h"
+
+#include "gen-cpp/scene_types.h"
+#include "gen-cpp/task_types.h"
+
+using scene::UserInput;
+using task::Task;
+
+namespace {
+
+constexpr int kSteps = 100;
+const SimulationKey kTaskKey = {42, 24};
+
+// A unique directory for the files of a test. Removed with its content.
+class TempDir {
+ public:
+  TempDir() {
+    std::string pattern =
+        (std::filesystem::temp_directory_path() / "phyre_memo_XXXXXX").string();
+    if (mkdtemp(pattern.data()) == nullptr) {
+      throw std::runtime_error("Cannot create a temporary directory");
+    }
+    path_ = pattern;
+  }
+  ~TempDir() { std::filesystem::remove_all(path_); }
+
+  std::string file(const std::string& name) const {
+    return (path_ / name).string();
+  }
+
+ private:
+  std::filesystem::path path_;
+};
+
+SimulationKey key(uint64_t hash) { return {hash, hash + 1000}; }
+
+Task buildTask() {
+  scene::Scene scene;
+  scene.__set_width(256);
+  scene.__set_height(256);
+  scene.__set_bodies(
+      {buildBox(0, 0, 256, 10, 0, false), buildBox(100, 10, 20, 20)});
+  Task task;
+  task.__set_scene(scene);
+  task.__set_bodyId1(1);
+  task.__set_bodyId2(0);
+  task.__set_relationships({::task::SpatialRelationship::TOUCHING});
+  return task;
+}
+
+UserInput buildBallInput(double x, double y, double radius) {
+  ::scene::CircleWithPosition ball;
+  ball.position.__set_x(x);
+  ball.position.__set_y(y);
+  ball.__set_radius(radius);
+  UserInput userInput;
+  userInput.__set_balls({ball});
+  return userInput;
+}
+
+MemoizedSimulation buildResult(int stepsSimulated) {
+  MemoizedSimulation simulation;
+  simulation.summary.__set_isSolution(true);
+  simulation.summary.__set_stepsSimulated(stepsSimulated);
+  return simulation;
+}
+
+}  // namespace
+
+TEST(SimulationMemoTest, LruEviction) {
+  SimulationMemo memo(2);
+  memo.insert(key(1), buildResult(1));
+  memo.insert(key(2), buildResult(2));
+  ASSERT_TRUE(memo.lookup(key(1)));
+  // 2 is the least recently used now.
+  memo.insert(key(3), buildResult(3));
+  EXPECT_FALSE(memo.lookup(key(2)));
+  ASSERT_TRUE(memo.lookup(key(1)));
+  EXPECT_EQ(memo.lookup(key(3))->summary.stepsSimulated, 3);
+
+  const SimulationMemoStats stats = memo.stats();
+  EXPECT_EQ(stats.hits, 3);
+  EXPECT_EQ(stats.misses, 1);
+  EXPECT_EQ(stats.size, 2);
+
+  memo.clear();
+  EXPECT_FALSE(memo.lookup(key(1)));
+}
+
+TEST(SimulationMemoTest, FileTierPersists) {
+  const TempDir dir;
+  const std::string path = dir.file("memo");
+  {
+    SimulationMemo memo(10, path);
+    memo.insert(key(1), buildResult(7));
+    memo.insert(key(2), buildResult(8));
+  }
+  {
+    SimulationMemo memo(10, path);
+    EXPECT_EQ(memo.stats().diskSize, 2);
+    const auto simulation = memo.lookup(key(2));
+    ASSERT_TRUE(simulation);
+    EXPECT_TRUE(simulation->summary.isSolution);
+    EXPECT_EQ(simulation->summary.stepsSimulated, 8);
+    EXPECT_EQ(memo.stats().diskHits, 1);
+    // Promoted to the memory tier.
+    ASSERT_TRUE(memo.lookup(key(2)));
+    EXPECT_EQ(memo.stats().hits, 1);
+  }
+  // Drop a part of the last record.
+  std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+  {
+    SimulationMemo memo(10, path);
+    EXPECT_EQ(memo.stats().diskSize, 1);
+    EXPECT_TRUE(memo.lookup(key(1)));
+    EXPECT_FALSE(memo.lookup(key(2)));
+    memo.insert(key(2), buildResult(9));
+  }
+  {
+    SimulationMemo memo(0, path);
+    EXPECT_EQ(memo.lookup(key(2))->summary.stepsSimulated, 9);
+  }
+}
+
+TEST(SimulationMemoTest, HashCollisionIsMiss) {
+  const TempDir dir;
+  const std::string path = dir.file("memo");
+  {
+    SimulationMemo memo(10, path);
+    memo.insert({1, 2}, buildResult(7));
+    EXPECT_FALSE(memo.lookup({1, 3}));
+    // The memory tier is dropped, so the file tier is checked as well.
+    memo.clear();
+    EXPECT_FALSE(memo.lookup({1, 3}));
+    EXPECT_EQ(memo.lookup({1, 2})->summary.stepsSimulated, 7);
+    EXPECT_EQ(memo.stats().diskHits, 1);
+  }
+}
+
+TEST(SimulationMemoTest, SharedFile) {
+  const TempDir dir;
+  const std::string path = dir.file("memo");
+  {
+    SimulationMemo first(0, path);
+    SimulationMemo second(0, path);
+    first.insert(key(1), buildResult(7));
+    // Records appended by another writer are indexed on lookup.
+    EXPECT_EQ(second.lookup(key(1))->summary.stepsSimulated, 7);
+    second.insert(key(2), buildResult(8));
+    first.insert(key(3), buildResult(9));
+    EXPECT_EQ(first.lookup(key(2))->summary.stepsSimulated, 8);
+    EXPECT_EQ(second.lookup(key(3))->summary.stepsSimulated, 9);
+    EXPECT_EQ(first.stats().diskSize, 3);
+  }
+  {
+    SimulationMemo memo(0, path);
+    EXPECT_EQ(memo.stats().diskSize, 3);
+  }
+  // The version and the keys are little-endian.
+  std::ifstream in(path, std::ios::binary);
+  std::vector<char> bytes((std::istreambuf_iterator<char>(in)),
+                          std::istreambuf_iterator<char>());
+  ASSERT_GT(bytes.size(), 20);
+  EXPECT_EQ(bytes[8], static_cast<char>(kSimulationMemoVersion));
+  EXPECT_EQ(bytes[9], 0);
+  EXPECT_EQ(bytes[12], 1);
+  EXPECT_EQ(bytes[13], 0);
+  EXPECT_EQ(bytes[20], static_cast<char>(key(1).check & 0xff));
+}
+
+TEST(SimulationMemoTest, SharedAfterFork) {
+  constexpr int kNumChildren = 4;
+  constexpr int kNumInserts = 200;
+  const TempDir dir;
+  const std::string path = dir.file("memo");
+  SimulationMemo memo(0, path);
+  memo.insert(key(0), buildResult(1));
+  // The children inherit the descriptor of the memo. Each of them must lock
+  // its own open() of the file, or the writers would not exclude each other.
+  std::vector<pid_t> pids;
+  for (int child = 0; child < kNumChildren; ++child) {
+    const pid_t pid = fork();
+    ASSERT_GE(pid, 0);
+    if (pid == 0) {
+      int status = 0;
+      try {
+        for (int i = 0; i < kNumInserts; ++i) {
+          const int id = 1 + child * kNumInserts + i;
+          memo.insert(key(id), buildResult(id));
+        }
+      } catch (...) {
+        status = 1;
+      }
+      _exit(status);
+    }
+    pids.push_back(pid);
+  }
+  for (const pid_t pid : pids) {
+    int status = 0;
+    ASSERT_EQ(waitpid(pid, &status, 0), pid);
+    EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  }
+  SimulationMemo reopened(0, path);
+  EXPECT_EQ(reopened.stats().diskSize, 1 + kNumChildren * kNumInserts);
+  for (int id = 1; id <= kNumChildren * kNumInserts; ++id) {
+    const auto simulation = memo.lookup(key(id));
+    ASSERT_TRUE(simulation);
+    EXPECT_EQ(simulation->summary.stepsSimulated, id);
+  }
+}
+
+TEST(SimulationMemoTest, WrongFile) {
+  const TempDir dir;
+  const std::string path = dir.file("memo");
+  {
+    std::ofstream out(path, std::ios::binary);
+    out << "not a memo";
+  }
+  EXPECT_THROW(SimulationMemo(10, path), std::runtime_error);
+}
+
+TEST(SimulationMemoTest, SameBodiesShareResult) {
+  const Task task = buildTask();
+  SimulationMemo memo(10);
+  UserInput userInput;
+  std::vector<int> points;
+  for (int x = 150; x < 160; ++x) {
+    for (int y = 100; y < 110; ++y) {
+      points.push_back(x);
+      points.push_back(y);
+    }
+  }
+  userInput.__set_flattened_point_list(points);
+  // The same pixels listed twice produce the same body.
+  UserInput duplicated = userInput;
+  duplicated.flattened_point_list.insert(duplicated.flattened_point_list.end(),
+                                         points.begin(), points.end());
+
+  const MemoizedSimulation first = simulateTaskSummaryMemoized(
+      task, kTaskKey, userInput, false, true, kSteps, 0, &memo);
+  const MemoizedSimulation second = simulateTaskSummaryMemoized(
+      task, kTaskKey, duplicated, false, true, kSteps, 0, &memo);
+  EXPECT_EQ(memo.stats().misses, 1);
+  EXPECT_EQ(memo.stats().hits, 1);
+  EXPECT_EQ(first.summary.isSolution, second.summary.isSolution);
+  EXPECT_EQ(first.summary.stepsSimulated, second.summary.stepsSimulated);
+
+  // A different task hash is a different key.
+  const SimulationKey otherTaskKey = {kTaskKey.hash + 1, kTaskKey.check};
+  simulateTaskSummaryMemoized(task, otherTaskKey, userInput, false, true,
+                              kSteps, 0, &memo);
+  EXPECT_EQ(memo.stats().misses, 2);
+}
+
+TEST(SimulationMemoTest, SkipOccluded) {
+  const Task task = buildTask();
+  const UserInput occluding = buildBallInput(110, 20, 8);
+  const MemoizedSimulation skipped = simulateTaskSummaryMemoized(
+      task, kTaskKey, occluding, false, true, kSteps, 0, nullptr);
+  EXPECT_TRUE(skipped.hadOcclusions);
+  EXPECT_FALSE(skipped.summary.isSolution);
+  EXPECT_EQ(skipped.summary.stepsSimulated, 0);
+
+  const MemoizedSimulation simulated = simulateTaskSummaryMemoized(
+      task, kTaskKey, occluding, false, false, kSteps, 0, nullptr);
+  EXPECT_TRUE(simulated.hadOcclusions);
+  EXPECT_GT(simulated.summary.stepsSimulated, 0);
+}
@@ -0,0 +1,102 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <gtest/gtest.h>
+
+#include "creator.h"
+#include "gen-cpp/task_types.h"
+#include "simulation_stats.h"
+#include "task_utils.h"
+
+namespace {
+
+// A box that falls on the floor, which solves the TOUCHING relation.
+::task::Task buildFallingBoxTask() {
+  ::scene::Scene scene;
+  scene.__set_height(64);
+  scene.__set_width(64);
+  scene.__set_bodies(std::vector<::scene::Body>{
+      buildBox(0, 0, 64, 5, 0, false),
+      buildBox(20, 25, 10, 10),
+  });
+  ::task::Task task;
+  task.__set_scene(scene);
+  task.__set_bodyId1(1);
+  task.__set_bodyId2(0);
+  task.relationships.push_back(::task::SpatialRelationship::TOUCHING);
+  return task;
+}
+
+}  // namespace
+
+TEST(SimulationStatsTest, CountsRolloutsByTerminationReason) {
+  ::task::Task task = buildFallingBoxTask();
+  const ::scene::Scene scene = task.scene;
+
+  resetSimulationStats();
+  const task::TaskSimulation solved = simulateTask(task, 1000);
+  ASSERT_TRUE(solved.isSolution);
+  // The box is still falling after 10 steps and at rest after 1000 steps.
+  simulateScene(scene, 10);
+  simulateScene(scene, 1000);
+  task.scene.__set_user_input_status(::scene::UserInputStatus::HAD_OCCLUSIONS);
+  simulateTask(task, 10);
+
+  const SimulationStats stats = getSimulationStats(/*reset=*/true);
+  const auto count = [&](TerminationReason reason) {
+    return stats.rollouts[static_cast<int>(reason)];
+  };
+  EXPECT_EQ(count(TerminationReason::SOLVED_EARLY), 1);
+  EXPECT_EQ(count(TerminationReason::MAX_STEPS), 1);
+  EXPECT_EQ(count(TerminationReason::QUIESCENT), 1);
+  EXPECT_EQ(count(TerminationReason::OCCLUDED), 1);
+  EXPECT_EQ(stats.stepsSimulated.count, 4);
+  EXPECT_EQ(stats.stepsSimulated.sum, solved.stepsSimulated + 10 + 1000 + 10);
+  EXPECT_EQ(stats.numBodies.sum, 4 * 2);
+  // Bucket 4 holds values in [8, 16).
+  EXPECT_EQ(stats.stepsSimulated.buckets[4], 2);
+
+  EXPECT_EQ(getSimulationStats().stepsSimulated.count, 0);
+}
+
+TEST(SimulationStatsTest, RecordsOutermostCallLatency) {
+  const ::task::Task task = buildFallingBoxTask();
+  resetSimulationStats();
+  simulateTask(task, 100);
+  // A single-process batch simulates every task with simulateTask, but is
+  // counted as one call.
+  simulateTasksInParallel({task, task, task}, /*num_workers=*/0, 100);
+
+  const SimulationStats stats = getSimulationStats(/*reset=*/true);
+  EXPECT_EQ(stats.latencyMicros.count, 4);
+  EXPECT_EQ(stats.callLatencyMicros.count, 2);
+  EXPECT_GE(stats.callLatencyMicros.sum, stats.latencyMicros.sum);
+}
+
+TEST(SimulationStatsTest, MergesWorkerStats) {
+  const ::task::Task task = buildFallingBoxTask();
+  resetSimulationStats();
+  // Counted by the parent before the workers are forked. The workers must
+  // not report their copy of it again.
+  const ::task::TaskSimulation simulation = simulateTask(task, 1000);
+  simulateTasksInParallel({task, task, task}, /*num_workers=*/2, 1000);
+
+  const SimulationStats stats = getSimulationStats(/*reset=*/true);
+  EXPECT_EQ(stats.rollouts[static_cast<int>(TerminationReason::SOLVED_EARLY)],
+            4);
+  EXPECT_EQ(stats.stepsSimulated.count, 4);
+  EXPECT_EQ(stats.stepsSimulated.sum, 4 * simulation.stepsSimulated);
+  EXPECT_EQ(stats.numBodies.sum, 4 * 2);
+  EXPECT_EQ(stats.latencyMicros.count, 4);
+  EXPECT_EQ(stats.callLatencyMicros.count, 2);
+}
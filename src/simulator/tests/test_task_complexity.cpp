@@ -0,0 +1,283 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <gtest/gtest.h>
+#include <cmath>
+
+#include "creator.h"
+#include "task_complexity.h"
+
+#include "gen-cpp/scene_types.h"
+#include "gen-cpp/task_types.h"
+
+using scene::UserInput;
+using task::Task;
+
+namespace {
+
+constexpr int kPoolSize = 20;
+
+// A box resting on the ground and a static bar in the air. The box touches
+// the ground without any input and nothing can make the bar touch the ground.
+Task buildTask(bool solvable) {
+  scene::Scene scene;
+  scene.__set_width(256);
+  scene.__set_height(256);
+  scene.__set_bodies({buildBox(0, 0, 256, 10, 0, false),
+                      buildBox(100, 10, 20, 20),
+                      buildBox(50, 200, 100, 10, 0, false)});
+  Task task;
+  task.__set_scene(scene);
+  task.__set_bodyId1(solvable ? 1 : 2);
+  task.__set_bodyId2(0);
+  task.__set_relationships({::task::SpatialRelationship::TOUCHING});
+  return task;
+}
+
+UserInput buildBallInput(double x, double y, double radius) {
+  ::scene::CircleWithPosition ball;
+  ball.position.__set_x(x);
+  ball.position.__set_y(y);
+  ball.__set_radius(radius);
+  UserInput userInput;
+  userInput.__set_balls({ball});
+  return userInput;
+}
+
+// Every fifth action is invalid, every fifth occludes the ground and the rest
+// are balls in the free space.
+std::vector<std::optional<UserInput>> buildPool(int pool) {
+  std::vector<std::optional<UserInput>> actions;
+  for (int i = 0; i < kPoolSize; ++i) {
+    switch (i % 5) {
+      case 0:
+        actions.emplace_back();
+        break;
+      case 1:
+        actions.push_back(buildBallInput(30 + 10 * i, 5, 8));
+        break;
+      default:
+        actions.push_back(buildBallInput(30 + 10 * i, 100 + 10 * pool, 5));
+    }
+  }
+  return actions;
+}
+
+TaskComplexityOptions getTestOptions() {
+  TaskComplexityOptions options;
+  options.minValidAttempts = 12;
+  options.chunkSize = 10;
+  options.actionPoolSize = kPoolSize;
+  options.numThreads = 1;
+  options.steps = 200;
+  return options;
+}
+
+const ActionTier kBallTier{"ball", 0.2, false, false};
+const ActionTier kTwoBallsTier{"two_balls", 0.2, false, false};
+
+}  // namespace
+
+TEST(TaskComplexityTest, BinomialTests) {
+  // P(X >= 1) = 1 - (1 - p)^n.
+  EXPECT_NEAR(binomialTestGreater(1, 10000, 1e-5), 1 - std::exp(-0.1), 1e-6);
+  // P(X <= 0) = (1 - p)^n.
+  EXPECT_NEAR(binomialTestLess(0, 200000, 2e-5), std::exp(-4.0), 1e-6);
+  EXPECT_NEAR(binomialTestGreater(2, 4, 0.5), 11.0 / 16, 1e-12);
+  EXPECT_NEAR(binomialTestLess(2, 4, 0.5), 11.0 / 16, 1e-12);
+  EXPECT_EQ(binomialTestGreater(0, 100, 0.1), 1);
+  EXPECT_EQ(binomialTestLess(100, 100, 0.1), 1);
+  EXPECT_LT(binomialTestGreater(100, 10000, 1e-5), 1e-100);
+}
+
+TEST(TaskComplexityTest, Flags) {
+  TaskTierStats stats;
+  stats.statusCounts[actionStatusIndex(ActionStatus::NOT_SOLVED)] = 1000000;
+  stats.statusCounts[actionStatusIndex(ActionStatus::INVALID_INPUT)] = 500;
+  EXPECT_EQ(computeTaskComplexityFlags(stats, 1e-5),
+            kFlagBad | kFlagBadStable | kFlagImpossible);
+
+  stats.statusCounts[actionStatusIndex(ActionStatus::UNSTABLY_SOLVED)] = 100;
+  EXPECT_EQ(computeTaskComplexityFlags(stats, 1e-5),
+            kFlagGood | kFlagBadStable);
+
+  stats.statusCounts[actionStatusIndex(ActionStatus::STABLY_SOLVED)] = 200000;
+  EXPECT_EQ(computeTaskComplexityFlags(stats, 1e-5),
+            kFlagGood | kFlagGoodStable | kFlagTrivial);
+}
+
+TEST(TaskComplexityTest, Neighborhood) {
+  UserInput userInput = buildBallInput(10, 20, 3);
+  userInput.__set_flattened_point_list({1, 2});
+  const auto neighbors = getUserInputNeighborhood(userInput);
+  ASSERT_EQ(neighbors.size(), 8);
+  for (const UserInput& neighbor : neighbors) {
+    EXPECT_EQ(neighbor.flattened_point_list, userInput.flattened_point_list);
+    EXPECT_EQ(neighbor.balls[0].radius, 3);
+    EXPECT_GT(std::abs(neighbor.balls[0].position.x - 10) +
+                  std::abs(neighbor.balls[0].position.y - 20),
+              0);
+  }
+}
+
+TEST(TaskComplexityTest, SimulateAction) {
+  const Task task = buildTask(/*solvable=*/true);
+  EXPECT_EQ(simulateAction(task, buildBallInput(200, 100, 5), kBallTier, 200),
+            ActionStatus::SOLVED);
+  EXPECT_EQ(simulateAction(task, buildBallInput(200, 5, 8), kBallTier, 200),
+            ActionStatus::INVALID_INPUT);
+  EXPECT_EQ(simulateAction(buildTask(/*solvable=*/false),
+                           buildBallInput(200, 100, 5), kBallTier, 200),
+            ActionStatus::NOT_SOLVED);
+}
+
+TEST(TaskComplexityTest, Evaluate) {
+  int numPoolRequests = 0;
+  TaskComplexityEvaluator evaluator(
+      {buildTask(/*solvable=*/true), buildTask(/*solvable=*/false)},
+      {kBallTier},
+      [&numPoolRequests](size_t tier, int pool) {
+        ++numPoolRequests;
+        return buildPool(pool);
+      },
+      getTestOptions());
+  EXPECT_FALSE(evaluator.step());
+  EXPECT_TRUE(evaluator.step());
+  // Both tasks read the same pool.
+  EXPECT_EQ(numPoolRequests, 1);
+
+  const TaskTierStats& solvable = evaluator.stats()[0][0];
+  EXPECT_EQ(solvable.total(), 20);
+  EXPECT_EQ(solvable.count(ActionStatus::INVALID_INPUT), 8);
+  EXPECT_EQ(solvable.count(ActionStatus::STABLY_SOLVED), 12);
+  EXPECT_EQ(solvable.solutions, std::vector<int64_t>({2, 3, 4, 7, 8}));
+  EXPECT_TRUE(solvable.unstableSolutions.empty());
+
+  const TaskTierStats& impossible = evaluator.stats()[1][0];
+  EXPECT_EQ(impossible.count(ActionStatus::NOT_SOLVED), 12);
+  EXPECT_TRUE(impossible.solutions.empty());
+  EXPECT_TRUE(computeTaskComplexityFlags(
+                  impossible, kBallTier.solvabilityThreshold) &
+              kFlagImpossible);
+}
+
+TEST(TaskComplexityTest, ResultsDoNotDependOnThreads) {
+  std::vector<std::vector<TaskTierStats>> results;
+  for (const int numThreads : {1, 3}) {
+    TaskComplexityOptions options = getTestOptions();
+    options.numThreads = numThreads;
+    TaskComplexityEvaluator evaluator(
+        {buildTask(/*solvable=*/true), buildTask(/*solvable=*/false)},
+        {kBallTier, kTwoBallsTier},
+        [](size_t tier, int pool) { return buildPool(pool); }, options);
+    evaluator.run();
+    results.push_back({});
+    for (const auto& taskStats : evaluator.stats()) {
+      results.back().insert(results.back().end(), taskStats.begin(),
+                            taskStats.end());
+    }
+  }
+  ASSERT_EQ(results[0].size(), results[1].size());
+  for (size_t i = 0; i < results[0].size(); ++i) {
+    EXPECT_EQ(results[0][i].statusCounts, results[1][i].statusCounts);
+    EXPECT_EQ(results[0][i].solutions, results[1][i].solutions);
+  }
+}
+
+TEST(TaskComplexityTest, RejectBallSolvable) {
+  TaskComplexityOptions options = getTestOptions();
+  options.rejectBallSolvable = true;
+  TaskComplexityEvaluator evaluator(
+      {buildTask(/*solvable=*/true)}, {kTwoBallsTier, kBallTier},
+      [](size_t tier, int pool) { return buildPool(pool); }, options);
+  evaluator.run();
+  EXPECT_EQ(evaluator.stats()[0][1].count(ActionStatus::STABLY_SOLVED), 12);
+  // Solved by ball, so two balls are never simulated.
+  EXPECT_EQ(evaluator.stats()[0][0].total(), 0);
+  EXPECT_TRUE(evaluator.isDone(0, 0));
+}
+
+TEST(TaskComplexityTest, WrongPoolSize) {
+  TaskComplexityEvaluator evaluator(
+      {buildTask(/*solvable=*/true)}, {kBallTier},
+      [](size_t tier, int pool) {
+        return std::vector<std::optional<UserInput>>(kPoolSize - 1);
+      },
+      getTestOptions());
+  EXPECT_THROW(evaluator.step(), std::runtime_error);
+}
+
+TEST(TaskComplexityTest, SolutionPower) {
+  const std::vector<Task> tasks = {buildTask(/*solvable=*/true),
+                                   buildTask(/*solvable=*/false)};
+  const std::vector<UserInput> userInputs = {buildBallInput(200, 100, 5),
+                                             buildBallInput(200, 5, 8)};
+  for (const int numThreads : {1, 3}) {
+    EXPECT_EQ(computeSolutionPower(tasks, userInputs, kBallTier, 200,
+                                   numThreads),
+              std::vector<uint8_t>({1, 0, 0, 0}));
+  }
+}
+
+TEST(TaskComplexityTest, SolutionStability) {
+  const UserInput userInput = buildBallInput(200, 100, 5);
+  for (const int numThreads : {1, 0}) {
+    EXPECT_EQ(checkSolutionStability(buildTask(/*solvable=*/true), userInput,
+                                     kBallTier, 200, numThreads),
+              ActionStatus::STABLY_SOLVED);
+    EXPECT_EQ(checkSolutionStability(buildTask(/*solvable=*/false), userInput,
+                                     kBallTier, 200, numThreads),
+              ActionStatus::UNSTABLY_SOLVED);
+  }
+}
+
+TEST(TaskComplexityTest, CancelledSimulation) {
+  const std::atomic<bool> cancelled(true);
+  EXPECT_EQ(simulateAction(buildTask(/*solvable=*/true),
+                           buildBallInput(200, 100, 5), kBallTier, 200,
+                           &cancelled),
+            ActionStatus::NOT_SOLVED);
+}
+
+TEST(TaskComplexityTest, RankedEvaluationMatchesSequential) {
+  const Task task = buildTask(/*solvable=*/true);
+  const std::vector<std::optional<UserInput>> ranked = buildPool(0);
+  for (const bool stopOnSolution : {true, false}) {
+    for (const int64_t maxAttempts : {1, 5, 100}) {
+      std::vector<ActionStatus> expected;
+      int64_t attempts = 0;
+      for (const auto& userInput : ranked) {
+        if (attempts >= maxAttempts) {
+          break;
+        }
+        const ActionStatus status =
+            userInput ? simulateAction(task, *userInput, kBallTier, 200)
+                      : ActionStatus::INVALID_INPUT;
+        expected.push_back(status);
+        if (status == ActionStatus::INVALID_INPUT) {
+          continue;
+        }
+        ++attempts;
+        if (stopOnSolution && status == ActionStatus::SOLVED) {
+          break;
+        }
+      }
+      for (const int numThreads : {1, 4}) {
+        EXPECT_EQ(evaluateRankedUserInputs(task, ranked, kBallTier,
+                                           maxAttempts, stopOnSolution, 200,
+                                           numThreads),
+                  expected);
+      }
+    }
+  }
+}
@@ -0,0 +1,82 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <limits>
+#include <vector>
+
+#include "creator.h"
+#include "gen-cpp/task_types.h"
+#include "simulation_stats.h"
+#include "task_utils.h"
+
+namespace {
+
+// A box that falls on the floor, which solves the TOUCHING relation.
+::task::Task buildFallingBoxTask() {
+  ::scene::Scene scene;
+  scene.__set_height(64);
+  scene.__set_width(64);
+  scene.__set_bodies(std::vector<::scene::Body>{
+      buildBox(0, 0, 64, 5, 0, false),
+      buildBox(20, 25, 10, 10),
+  });
+  ::task::Task task;
+  task.__set_scene(scene);
+  task.__set_bodyId1(1);
+  task.__set_bodyId2(0);
+  task.relationships.push_back(::task::SpatialRelationship::TOUCHING);
+  return task;
+}
+
+}  // namespace
+
+TEST(TaskSimulationStreamTest, ChunksMatchSimulateTask) {
+  const ::task::Task task = buildFallingBoxTask();
+  const ::task::TaskSimulation expected = simulateTask(task, 1000, 7);
+
+  TaskSimulationStream stream(task, 1000, 7);
+  std::vector<::scene::Scene> scenes;
+  while (!stream.done()) {
+    const size_t before = scenes.size();
+    const int appended = stream.advance(3, &scenes);
+    EXPECT_LE(appended, 3);
+    EXPECT_EQ(scenes.size(), before + appended);
+  }
+  EXPECT_EQ(scenes, expected.sceneList);
+  EXPECT_EQ(stream.isSolution(), expected.isSolution);
+  EXPECT_EQ(stream.stepsSimulated(), expected.stepsSimulated);
+  EXPECT_EQ(stream.stridedSolvedStateList(), expected.solvedStateList);
+}
+
+TEST(TaskSimulationStreamTest, CancellationFlagStopsSimulation) {
+  const ::task::Task task = buildFallingBoxTask();
+  resetSimulationStats();
+  std::atomic<bool> cancelled(false);
+  TaskSimulationStream stream(task, 1000, /*stride=*/0);
+  stream.setCancellationFlag(&cancelled);
+  stream.setStepCallback([&cancelled](int step, const b2WorldWithData&) {
+    if (step == 10) {
+      cancelled = true;
+    }
+  });
+  std::vector<::scene::Scene> scenes;
+  stream.advance(std::numeric_limits<int>::max(), &scenes);
+  EXPECT_TRUE(stream.done());
+  EXPECT_TRUE(stream.wasCancelled());
+  EXPECT_FALSE(stream.isSolution());
+  EXPECT_EQ(stream.stepsSimulated(), 11);
+  EXPECT_EQ(getSimulationStats().stepsSimulated.count, 0);
+}
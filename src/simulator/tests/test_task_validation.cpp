@@ -63,3 +63,172 @@ TEST(TaskTest, SimulateTouchingRelation) {
         << "The empty solutions is expected to be invalid for TOUCHING";
   }
 }
+
+TEST(TaskTest, SimulateTaskSummaryMatchesFullSimulation) {
+  const std::vector<int32_t> taskIds = listTasks(kTestTaskFolder);
+
+  for (const int32_t task_id : taskIds) {
+    const task::Task task = getTaskFromId(task_id, kTestTaskFolder);
+    const task::TaskSimulation simulation = simulateTask(task, 1000);
+    const task::TaskSimulationSummary summary =
+        simulateTaskSummary(task, 1000);
+    EXPECT_EQ(summary.isSolution, simulation.isSolution) << task_id;
+    EXPECT_EQ(summary.stepsSimulated, simulation.stepsSimulated) << task_id;
+    EXPECT_GE(summary.minGoalDistance, 0) << task_id;
+    EXPECT_GE(summary.maxUserBodySpeed, 0) << task_id;
+
+    const ::scene::Scene& lastScene = simulation.sceneList.back();
+    ASSERT_EQ(summary.finalPositions.size(),
+              lastScene.bodies.size() + lastScene.user_input_bodies.size());
+    for (size_t i = 0; i < lastScene.bodies.size(); ++i) {
+      EXPECT_NEAR(summary.finalPositions[i].x, lastScene.bodies[i].position.x,
+                  1e-3);
+      EXPECT_NEAR(summary.finalPositions[i].y, lastScene.bodies[i].position.y,
+                  1e-3);
+      EXPECT_NEAR(summary.finalAngles[i], lastScene.bodies[i].angle, 1e-5);
+    }
+  }
+}
+
+TEST(TaskTest, SimulateTaskSummaryTouching) {
+  ::scene::Scene scene;
+  scene.__set_height(64);
+  scene.__set_width(64);
+  // A box falls on the floor from the height of 20 pixels.
+  scene.__set_bodies(std::vector<::scene::Body>{
+      buildBox(0, 0, 64, 5, 0, false),
+      buildBox(20, 25, 10, 10),
+  });
+  ::task::Task task;
+  task.__set_scene(scene);
+  task.__set_bodyId1(1);
+  task.__set_bodyId2(0);
+  task.relationships.push_back(::task::SpatialRelationship::TOUCHING);
+
+  const task::TaskSimulationSummary summary = simulateTaskSummary(
+      task, 1000, kSummaryFirstTouchStep | kSummaryMinGoalDistance);
+  EXPECT_TRUE(summary.isSolution);
+  EXPECT_GT(summary.firstTouchStep, 0);
+  EXPECT_LT(summary.firstTouchStep, summary.stepsSimulated);
+  EXPECT_NEAR(summary.minGoalDistance, 0, 0.1);
+  EXPECT_FALSE(summary.__isset.finalPositions);
+  EXPECT_FALSE(summary.__isset.maxUserBodySpeed);
+}
+
+TEST(TaskTest, SimulateTaskGoalDistances) {
+  ::scene::Scene scene;
+  scene.__set_height(64);
+  scene.__set_width(64);
+  // A box falls on the floor from the height of 20 pixels.
+  scene.__set_bodies(std::vector<::scene::Body>{
+      buildBox(0, 0, 64, 5, 0, false),
+      buildBox(20, 25, 10, 10),
+  });
+  ::task::Task task;
+  task.__set_scene(scene);
+  task.__set_bodyId1(1);
+  task.__set_bodyId2(0);
+  task.relationships.push_back(::task::SpatialRelationship::TOUCHING);
+
+  const task::TaskSimulation simulation =
+      simulateTask(task, 1000, /*stride=*/1, /*need_goal_distances=*/true);
+  ASSERT_TRUE(simulation.__isset.goalDistanceList);
+  const std::vector<double>& distances = simulation.goalDistanceList;
+  ASSERT_EQ(distances.size(), simulation.sceneList.size());
+  EXPECT_NEAR(distances[0], 20, 0.5);
+  EXPECT_TRUE(simulation.isSolution);
+  EXPECT_NEAR(distances.back(), 0, 0.1);
+
+  task.relationships[0] = ::task::SpatialRelationship::ABOVE;
+  const task::TaskSimulation above =
+      simulateTask(task, 1000, /*stride=*/1, /*need_goal_distances=*/true);
+  EXPECT_NEAR(above.goalDistanceList[0], 20, 0.5);
+  EXPECT_FALSE(simulateTask(task, 10).__isset.goalDistanceList);
+}
+
+TEST(TaskTest, SimulateTaskInsideGoalDistances) {
+  ::scene::Scene scene;
+  scene.__set_height(64);
+  scene.__set_width(64);
+  // A box rests on the floor inside the phantom area above the floor.
+  scene.__set_bodies(std::vector<::scene::Body>{
+      buildBox(0, 0, 64, 5, 0, false),
+      buildBox(20, 5, 10, 10),
+  });
+  ::scene::Polygon polygon;
+  polygon.__set_vertices({getVector(10, 0), getVector(40, 0), getVector(40, 30),
+                          getVector(10, 30)});
+  ::scene::Shape phantomShape;
+  phantomShape.__set_polygon(polygon);
+  ::task::Task task;
+  task.__set_scene(scene);
+  task.__set_bodyId1(1);
+  task.__set_bodyId2(0);
+  task.__set_phantomShape(phantomShape);
+  task.relationships.push_back(::task::SpatialRelationship::INSIDE);
+
+  // The lower corners of the box are 5 pixels away from the bottom edge of
+  // the phantom shape.
+  const task::TaskSimulation inside =
+      simulateTask(task, 1000, /*stride=*/1, /*need_goal_distances=*/true);
+  EXPECT_TRUE(inside.isSolution);
+  ASSERT_TRUE(inside.__isset.goalDistanceList);
+  EXPECT_NEAR(inside.goalDistanceList[0], 5, 0.5);
+  EXPECT_NEAR(inside.goalDistanceList.back(), 5, 0.5);
+
+  // The same signal is reported for NOT_INSIDE.
+  task.relationships[0] = ::task::SpatialRelationship::NOT_INSIDE;
+  const task::TaskSimulation notInside =
+      simulateTask(task, 10, /*stride=*/1, /*need_goal_distances=*/true);
+  EXPECT_FALSE(notInside.isSolution);
+  EXPECT_NEAR(notInside.goalDistanceList[0], 5, 0.5);
+
+  // A phantom shape without a polygon is not measured.
+  ::scene::Circle circle;
+  circle.__set_radius(30);
+  ::scene::Shape circleShape;
+  circleShape.__set_circle(circle);
+  task.__set_phantomShape(circleShape);
+  const task::TaskSimulation circlePhantom =
+      simulateTask(task, 10, /*stride=*/1, /*need_goal_distances=*/true);
+  for (const double distance : circlePhantom.goalDistanceList) {
+    EXPECT_EQ(distance, 0);
+  }
+}
+
+TEST(TaskTest, SimulateTaskContactGraph) {
+  ::scene::Scene scene;
+  scene.__set_height(64);
+  scene.__set_width(64);
+  // A box falls on the floor from the height of 20 pixels.
+  scene.__set_bodies(std::vector<::scene::Body>{
+      buildBox(0, 0, 64, 5, 0, false),
+      buildBox(20, 25, 10, 10),
+  });
+  ::task::Task task;
+  task.__set_scene(scene);
+  task.__set_bodyId1(1);
+  task.__set_bodyId2(0);
+  task.relationships.push_back(::task::SpatialRelationship::TOUCHING);
+
+  const task::TaskSimulation simulation =
+      simulateTask(task, 1000, /*stride=*/1, /*need_goal_distances=*/false,
+                   ContactOutput::EDGES_AND_IMPULSES);
+  ASSERT_TRUE(simulation.__isset.contactGraph);
+  const task::ContactGraph& graph = simulation.contactGraph;
+  ASSERT_EQ(graph.frameOffsets.size(), simulation.sceneList.size() + 1);
+  ASSERT_EQ(graph.edges.size(), 2 * graph.normalImpulses.size());
+  EXPECT_EQ(graph.frameOffsets.back(), graph.normalImpulses.size());
+  for (size_t i = 0; i < simulation.sceneList.size(); ++i) {
+    const int numEdges = graph.frameOffsets[i + 1] - graph.frameOffsets[i];
+    // The only possible contact is between the floor and the box.
+    EXPECT_EQ(numEdges, simulation.solvedStateList[i] ? 1 : 0);
+    if (numEdges == 1) {
+      EXPECT_EQ(graph.edges[2 * graph.frameOffsets[i]], 0);
+      EXPECT_EQ(graph.edges[2 * graph.frameOffsets[i] + 1], 1);
+    }
+  }
+  // The box rests on the floor at the end.
+  EXPECT_GT(graph.normalImpulses.back(), 0);
+  EXPECT_FALSE(simulateTask(task, 10).__isset.contactGraph);
+}
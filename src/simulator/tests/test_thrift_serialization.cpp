@@ -0,0 +1,82 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <gtest/gtest.h>
+
+#include <thrift/transport/TTransportException.h>
+
+#include "creator.h"
+#include "task_utils.h"
+#include "thrift_serialization.h"
+
+#include "gen-cpp/scene_types.h"
+#include "gen-cpp/task_types.h"
+
+using scene::Body;
+using scene::Scene;
+using task::Task;
+using task::TaskSimulation;
+
+namespace {
+
+Task buildTask() {
+  Scene scene;
+  scene.__set_width(256);
+  scene.__set_height(256);
+  scene.__set_bodies(std::vector<Body>{buildBox(50, 100, 20, 20),
+                                       buildCircle(120, 150, 10),
+                                       buildBox(0, 0, 256, 5, 0, false)});
+  Task task;
+  task.__set_scene(scene);
+  task.__set_bodyId1(0);
+  task.__set_bodyId2(2);
+  task.relationships.push_back(::task::SpatialRelationship::TOUCHING);
+  return task;
+}
+
+}  // namespace
+
+TEST(SerializationTest, RoundTrip) {
+  const Task task = buildTask();
+  const TaskSimulation simulation = simulateTask(task, 100, /*stride=*/10);
+
+  const std::vector<uint8_t> serializedTask =
+      thrift_serialization::serialize(task);
+  // The span points to a thread-local buffer that is reused by the next call.
+  const thrift_serialization::ByteSpan span =
+      thrift_serialization::serializeToSpan(simulation);
+  ASSERT_EQ(thrift_serialization::deserialize<TaskSimulation>(span),
+            simulation);
+  ASSERT_EQ(thrift_serialization::deserialize<Task>(serializedTask.data(),
+                                                    serializedTask.size()),
+            task);
+}
+
+TEST(SerializationTest, TruncatedInputReleasesBuffer) {
+  const Task task = buildTask();
+  std::vector<uint8_t> serializedTask = thrift_serialization::serialize(task);
+  std::vector<uint8_t> truncated(serializedTask.begin(),
+                                 serializedTask.begin() +
+                                     serializedTask.size() / 2);
+  EXPECT_THROW(thrift_serialization::deserialize<Task>(truncated.data(),
+                                                       truncated.size()),
+               ::apache::thrift::transport::TTransportException);
+  // The reader must not point to the freed bytes after the exception.
+  truncated.clear();
+  truncated.shrink_to_fit();
+  EXPECT_EQ(
+      thrift_serialization::detail::getReader().buffer->available_read(), 0);
+  EXPECT_EQ(thrift_serialization::deserialize<Task>(serializedTask.data(),
+                                                    serializedTask.size()),
+            task);
+}
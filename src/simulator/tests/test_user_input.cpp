@@ -260,6 +260,35 @@ TEST(RenderTest, CircleRendering_Huge) {
   }
 }
 
+TEST(RenderTest, RgbRendering) {
+  ::scene::Scene scene;
+  scene.__set_height(7);
+  scene.__set_width(6);
+  scene.__set_bodies({buildBox(1, 1, 2, 3)});
+  scene.__set_user_input_bodies({buildCircle(4.5, 5.5, 1)});
+  std::vector<uint8_t> codes(scene.width * scene.height);
+  renderTo(scene, codes.data());
+  for (const int numChannels : {3, 4}) {
+    std::vector<uint8_t> rgb(codes.size() * numChannels);
+    renderRgbTo(scene, numChannels, rgb.data());
+    // Rows are stored from the top, colors are from phyre.vis.WAD_COLORS.
+    for (int y = 0; y < scene.height; ++y) {
+      for (int x = 0; x < scene.width; ++x) {
+        const uint8_t* pixel =
+            &rgb[((scene.height - 1 - y) * scene.width + x) * numChannels];
+        const bool isRed = codes[y * scene.width + x] == 1;
+        EXPECT_EQ(pixel[0], isRed ? 0xf3 : 255);
+        EXPECT_EQ(pixel[1], isRed ? 0x4f : 255);
+        EXPECT_EQ(pixel[2], isRed ? 0x46 : 255);
+        if (numChannels == 4) {
+          EXPECT_EQ(pixel[3], 255);
+        }
+      }
+    }
+  }
+  EXPECT_THROW(renderRgbTo(scene, 2, codes.data()), std::runtime_error);
+}
+
 TEST(CleanUpPointsTest, EmptySceneEmptyInput) {
   const auto cleanPoints = cleanUpPoints({}, {}, 100, 100);
   ASSERT_EQ(cleanPoints.size(), 0);
@@ -405,7 +434,7 @@ TEST(CleanUpPointsTest, CircleAndFullInput) {
   }
 }
 
-TEST(AddUserInputTest, DISABLED_AddPoints) {
+TEST(AddUserInputTest, AddPoints) {
   ::scene::Scene scene;
   scene.__set_height(7);
   scene.__set_width(6);
@@ -426,6 +455,85 @@ TEST(AddUserInputTest, DISABLED_AddPoints) {
   ASSERT_EQ(good_input, true);
 }
 
+TEST(AddUserInputTest, AddPointsAsNonConvexBody) {
+  // L-shaped input must become a single body covering exactly the points.
+  const int height = 20, width = 20;
+  ::scene::UserInput user_input;
+  std::vector<int> expected(height * width, 0);
+  for (int y = 2; y < 10; ++y) {
+    for (int x = 2; x < 10; ++x) {
+      if (x < 4 || y < 4) {
+        user_input.flattened_point_list.push_back(x);
+        user_input.flattened_point_list.push_back(y);
+        expected[y * width + x] = 1;
+      }
+    }
+  }
+
+  std::vector<::scene::Body> user_bodies;
+  bool good_input = mergeUserInputIntoScene(
+      user_input, {},
+      /*keep_space_around_bodies=*/true, /*allow_occlusions=*/false, height,
+      width, &user_bodies);
+  ASSERT_EQ(good_input, true);
+  ASSERT_EQ(user_bodies.size(), 1);
+  ASSERT_GE(user_bodies[0].shapes.size(), 2);
+  const auto img = render(user_bodies, height, width);
+  ASSERT_EQ(img.values, expected);
+}
+
+TEST(AddUserInputTest, AddPointsAcrossBody) {
+  // A horizontal stroke across a vertical bar is split in two.
+  const int height = 40, width = 40;
+  const std::vector<::scene::Body> bodies = {buildBox(15, 0, 5, 30)};
+  ::scene::UserInput user_input;
+  for (int x = 0; x < width; ++x) {
+    for (int y = 18; y < 21; ++y) {
+      user_input.flattened_point_list.push_back(x);
+      user_input.flattened_point_list.push_back(y);
+    }
+  }
+
+  std::vector<::scene::Body> user_bodies;
+  bool good_input = mergeUserInputIntoScene(
+      user_input, bodies,
+      /*keep_space_around_bodies=*/true, /*allow_occlusions=*/false, height,
+      width, &user_bodies);
+  ASSERT_EQ(good_input, false);
+  ASSERT_EQ(user_bodies.size(), 2);
+  const auto user_img = render(user_bodies, height, width);
+  const auto scene_img = render(bodies, height, width);
+  for (size_t i = 0; i < user_img.values.size(); ++i) {
+    ASSERT_FALSE(user_img.values[i] != 0 && scene_img.values[i] != 0)
+        << "User bodies occlude the scene at pixel " << i;
+  }
+
+  user_bodies.clear();
+  good_input = mergeUserInputIntoScene(
+      user_input, bodies,
+      /*keep_space_around_bodies=*/true, /*allow_occlusions=*/true, height,
+      width, &user_bodies);
+  ASSERT_EQ(user_bodies.size(), 1);
+}
+
+TEST(AddUserInputTest, AddPointsKeepsFirstComponents) {
+  ::scene::UserInput user_input;
+  for (size_t i = 0; i < kMaxUserObjects + 5; ++i) {
+    user_input.flattened_point_list.push_back(2 * i);
+    user_input.flattened_point_list.push_back(5);
+  }
+
+  std::vector<::scene::Body> user_bodies;
+  bool good_input = mergeUserInputIntoScene(
+      user_input, {},
+      /*keep_space_around_bodies=*/true, /*allow_occlusions=*/false,
+      /*height=*/10, /*width=*/100, &user_bodies);
+  ASSERT_EQ(good_input, false);
+  ASSERT_EQ(user_bodies.size(), kMaxUserObjects);
+  // Components are kept in the order of the input.
+  ASSERT_LT(user_bodies.back().position.x, 2 * kMaxUserObjects);
+}
+
 TEST(AddUserInputTest, AddRectangle) {
   ::scene::Scene scene;
   scene.__set_height(7);
@@ -590,3 +698,26 @@ TEST(WrapAngleTest, TestAngles) {
   ASSERT_TRUE(abs(wrapAngleRadians(medNeg) - (0.8 * 2. * M_PI)) < 1e-6);
   ASSERT_TRUE(abs(wrapAngleRadians(largeNeg) - (0.3 * 2. * M_PI)) < 1e-6);
 }
+
+TEST(MaskEncodingTest, PackMaskBits) {
+  const std::vector<uint8_t> mask = {0, 3, 0, 0, 0, 0, 0, 1, 5, 0, 2};
+  std::vector<uint8_t> packed(2);
+  packMaskBits(mask.data(), mask.size(), packed.data());
+  ASSERT_EQ(packed[0], 0b01000001);
+  ASSERT_EQ(packed[1], 0b10100000);
+}
+
+TEST(MaskEncodingTest, MaskBoundingBox) {
+  std::vector<uint8_t> mask(4 * 5, 0);
+  MaskBox box = getMaskBoundingBox(mask.data(), 4, 5);
+  ASSERT_EQ(box.height, 0);
+  ASSERT_EQ(box.width, 0);
+
+  mask[1 * 5 + 3] = 1;
+  mask[2 * 5 + 1] = 1;
+  box = getMaskBoundingBox(mask.data(), 4, 5);
+  ASSERT_EQ(box.row, 1);
+  ASSERT_EQ(box.column, 1);
+  ASSERT_EQ(box.height, 2);
+  ASSERT_EQ(box.width, 3);
+}
@@ -96,6 +96,14 @@ b2BodyDef convertThriftBodyToBox2dBodyDef(const ::scene::Body& pThriftBody) {
 
   if (pThriftBody.bodyType == ::scene::BodyType::DYNAMIC) {
     bodyDef.type = b2_dynamicBody;
+    // Scenes restored from a simulation carry the velocities of the bodies.
+    if (pThriftBody.__isset.linearVelocity) {
+      bodyDef.linearVelocity.Set(p2m(pThriftBody.linearVelocity.x),
+                                 p2m(pThriftBody.linearVelocity.y));
+    }
+    if (pThriftBody.__isset.angularVelocity) {
+      bodyDef.angularVelocity = pThriftBody.angularVelocity;
+    }
   }
   return bodyDef;
 }
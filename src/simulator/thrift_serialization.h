@@ -0,0 +1,126 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// Serialization of Thrift objects with the binary protocol.
+//
+// All helpers use TBinaryProtocolT<TMemoryBuffer>, i.e., the protocol is
+// templated on the concrete transport. Together with Thrift code generated
+// with the "templates" option this makes all protocol and transport calls
+// non-virtual. Protocols and buffers are kept in thread-local storage and
+// reused, so a call does not allocate anything besides the output.
+#ifndef THRIFT_SERIALIZATION_H
+#define THRIFT_SERIALIZATION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+
+namespace thrift_serialization {
+
+using Buffer = ::apache::thrift::transport::TMemoryBuffer;
+using Protocol = ::apache::thrift::protocol::TBinaryProtocolT<Buffer>;
+
+// Non-owning view of serialized bytes.
+struct ByteSpan {
+  const uint8_t* data;
+  size_t size;
+};
+
+namespace detail {
+
+struct ProtocolWithBuffer {
+  ProtocolWithBuffer()
+      : buffer(std::make_shared<Buffer>()), protocol(buffer) {}
+
+  std::shared_ptr<Buffer> buffer;
+  Protocol protocol;
+};
+
+// Separate instances for reading and writing so that an object can be
+// deserialized from a span returned by serializeToSpan.
+inline ProtocolWithBuffer& getReader() {
+  thread_local ProtocolWithBuffer reader;
+  return reader;
+}
+
+inline ProtocolWithBuffer& getWriter() {
+  thread_local ProtocolWithBuffer writer;
+  return writer;
+}
+
+// Detaches the reader from a borrowed buffer on scope exit, so that no
+// dangling pointer is kept even if reading throws.
+class ReaderGuard {
+ public:
+  explicit ReaderGuard(ProtocolWithBuffer& reader) : reader_(reader) {}
+  ~ReaderGuard() { reader_.buffer->resetBuffer(nullptr, 0, Buffer::OBSERVE); }
+
+  ReaderGuard(const ReaderGuard&) = delete;
+  ReaderGuard& operator=(const ReaderGuard&) = delete;
+
+ private:
+  ProtocolWithBuffer& reader_;
+};
+
+}  // namespace detail
+
+// Reads object from a borrowed buffer. The bytes are not copied. Throws
+// TTransportException if the buffer is truncated.
+template <class T>
+void deserializeFrom(const uint8_t* data, const size_t size, T* object) {
+  detail::ProtocolWithBuffer& reader = detail::getReader();
+  const detail::ReaderGuard guard(reader);
+  reader.buffer->resetBuffer(const_cast<uint8_t*>(data),
+                             static_cast<uint32_t>(size), Buffer::OBSERVE);
+  object->read(&reader.protocol);
+}
+
+template <class T>
+T deserialize(const uint8_t* data, const size_t size) {
+  T object;
+  deserializeFrom(data, size, &object);
+  return object;
+}
+
+template <class T>
+T deserialize(const ByteSpan& span) {
+  return deserialize<T>(span.data, span.size);
+}
+
+// Writes object into a thread-local buffer and returns a view of it. The view
+// is valid until the next call to serializeToSpan in the same thread.
+template <class T>
+ByteSpan serializeToSpan(const T& object) {
+  detail::ProtocolWithBuffer& writer = detail::getWriter();
+  // Keeps the memory allocated by the previous calls.
+  writer.buffer->resetBuffer();
+  object.write(&writer.protocol);
+  uint8_t* data;
+  uint32_t size;
+  writer.buffer->getBuffer(&data, &size);
+  return ByteSpan{data, size};
+}
+
+template <class T>
+std::vector<uint8_t> serialize(const T& object) {
+  const ByteSpan span = serializeToSpan(object);
+  return std::vector<uint8_t>(span.data, span.data + span.size);
+}
+
+}  // namespace thrift_serialization
+
+#endif  // THRIFT_SERIALIZATION_H
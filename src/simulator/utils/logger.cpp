@@ -13,12 +13,262 @@
 // limitations under the License.
 #include "logger.h"
 
+#include <pthread.h>
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
 using namespace std;
 
-LOG_LEVEL Logger::mLogLevel = LOG_LEVEL::ERROR;
+std::atomic<int> Logger::mLogLevel(LOG_LEVEL::ERROR);
 std::ostream* Logger::mOutStream = &(std::cout);
 bool Logger::mColorEnabled = true;
 
+namespace {
+
+// Single producer single consumer queue of formatted messages. The owning
+// thread pushes, the backend drains under its own mutex.
+class MessageRing {
+ public:
+  bool push(std::string&& message) {
+    const size_t tail = mTail.load(std::memory_order_relaxed);
+    if (tail - mHead.load(std::memory_order_acquire) == kCapacity) {
+      return false;
+    }
+    mSlots[tail % kCapacity] = std::move(message);
+    mTail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  template <class Function>
+  void drain(Function&& function) {
+    size_t head = mHead.load(std::memory_order_relaxed);
+    const size_t tail = mTail.load(std::memory_order_acquire);
+    for (; head != tail; ++head) {
+      std::string& slot = mSlots[head % kCapacity];
+      function(slot);
+      slot.clear();
+      mHead.store(head + 1, std::memory_order_release);
+    }
+  }
+
+ private:
+  static constexpr size_t kCapacity = 1024;
+  std::array<std::string, kCapacity> mSlots;
+  std::atomic<size_t> mHead{0};
+  std::atomic<size_t> mTail{0};
+};
+
+constexpr auto kDrainPeriod = std::chrono::milliseconds(10);
+
+// Messages are formatted into a thread local stream to avoid constructing one
+// per message.
+thread_local std::ostringstream localStream;
+thread_local bool localStreamInUse = false;
+
+}  // namespace
+
+// Owns the ring buffers of all threads and the thread that drains them.
+class LogBackend {
+ public:
+  static LogBackend& get() {
+    static LogBackend backend;
+    return backend;
+  }
+
+  void submit(std::string&& message) {
+    if (!localRing().push(std::move(message))) {
+      mNumDropped.fetch_add(1, std::memory_order_relaxed);
+    }
+    // The drain thread does not survive fork(), so a child writes messages
+    // right away.
+    if (mForkedChild) {
+      drain();
+    }
+  }
+
+  // Writes all pending messages. Safe to call from any thread.
+  void drain() {
+    std::lock_guard<std::mutex> drainLock(mDrainMutex);
+    std::vector<std::shared_ptr<MessageRing>> rings;
+    {
+      std::lock_guard<std::mutex> lock(mRegistryMutex);
+      rings = mRings;
+    }
+    std::ostream& out = *Logger::mOutStream;
+    for (const auto& ring : rings) {
+      ring->drain([&](const std::string& message) { out << message; });
+    }
+    const size_t dropped = mNumDropped.load(std::memory_order_relaxed);
+    if (dropped != mNumReportedDropped) {
+      out << "Logger: dropped " << dropped - mNumReportedDropped
+          << " messages\n";
+      mNumReportedDropped = dropped;
+    }
+  }
+
+  void flush() {
+    drain();
+    std::lock_guard<std::mutex> drainLock(mDrainMutex);
+    Logger::mOutStream->flush();
+  }
+
+  size_t numDropped() const {
+    return mNumDropped.load(std::memory_order_relaxed);
+  }
+
+ private:
+  LogBackend() {
+    mThread = std::make_unique<std::thread>([this] { run(); });
+    sInstance.store(this);
+    static std::once_flag registerOnce;
+    std::call_once(registerOnce, [] {
+      pthread_atfork(&LogBackend::prepareFork, &LogBackend::parentAfterFork,
+                     &LogBackend::childAfterFork);
+    });
+  }
+
+  ~LogBackend() {
+    sInstance.store(nullptr);
+    if (mForkedChild) {
+      flush();
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mStopMutex);
+      mStop = true;
+    }
+    mStopCondition.notify_one();
+    mThread->join();
+    flush();
+  }
+
+  // The mutexes are held across fork() so that the child gets them in a
+  // consistent state. The order matches the one of run() and drain().
+  static void prepareFork() {
+    LogBackend* backend = sInstance.load();
+    if (backend != nullptr) {
+      backend->mStopMutex.lock();
+      backend->mDrainMutex.lock();
+      backend->mRegistryMutex.lock();
+    }
+  }
+
+  static void parentAfterFork() {
+    LogBackend* backend = sInstance.load();
+    if (backend != nullptr) {
+      backend->mRegistryMutex.unlock();
+      backend->mDrainMutex.unlock();
+      backend->mStopMutex.unlock();
+    }
+  }
+
+  // Only the forking thread exists in the child. Pending messages are left
+  // to the parent, and the handle of the drain thread is leaked since there
+  // is no thread to join or detach.
+  static void childAfterFork() {
+    LogBackend* backend = sInstance.load();
+    if (backend != nullptr) {
+      for (const auto& ring : backend->mRings) {
+        ring->drain([](const std::string&) {});
+      }
+      backend->mNumReportedDropped =
+          backend->mNumDropped.load(std::memory_order_relaxed);
+      backend->mThread.release();
+      backend->mForkedChild = true;
+      backend->mRegistryMutex.unlock();
+      backend->mDrainMutex.unlock();
+      backend->mStopMutex.unlock();
+    }
+  }
+
+  void run() {
+    std::unique_lock<std::mutex> lock(mStopMutex);
+    while (!mStopCondition.wait_for(lock, kDrainPeriod,
+                                    [this] { return mStop; })) {
+      drain();
+    }
+  }
+
+  MessageRing& localRing() {
+    // The registry keeps the ring alive after the thread exits until the
+    // process ends, so that no message is lost.
+    thread_local std::shared_ptr<MessageRing> ring = [this] {
+      auto newRing = std::make_shared<MessageRing>();
+      std::lock_guard<std::mutex> lock(mRegistryMutex);
+      mRings.push_back(newRing);
+      return newRing;
+    }();
+    return *ring;
+  }
+
+  std::mutex mRegistryMutex;
+  std::vector<std::shared_ptr<MessageRing>> mRings;
+  std::mutex mDrainMutex;
+  std::atomic<size_t> mNumDropped{0};
+  size_t mNumReportedDropped = 0;
+  std::mutex mStopMutex;
+  std::condition_variable mStopCondition;
+  bool mStop = false;
+  // Set in a child process after fork(), where mThread does not exist.
+  bool mForkedChild = false;
+  std::unique_ptr<std::thread> mThread;
+  static std::atomic<LogBackend*> sInstance;
+};
+
+std::atomic<LogBackend*> LogBackend::sInstance{nullptr};
+
+void Logger::set_outstream(std::ostream* pStream) {
+  flush();
+  mOutStream = pStream;
+  mColorEnabled = pStream->rdbuf() == std::cout.rdbuf();
+}
+
+void Logger::flush() { LogBackend::get().flush(); }
+
+size_t Logger::num_dropped() { return LogBackend::get().numDropped(); }
+
+Logger::Message::Message(LOG_LEVEL level, Color_value color)
+    : mStream(nullptr), mColor(color), mOwnsStream(false) {
+  if (!Logger::is_enabled(level)) {
+    return;
+  }
+  // A message logged while formatting another one gets its own stream.
+  if (localStreamInUse) {
+    mStream = new std::ostringstream();
+    mOwnsStream = true;
+  } else {
+    localStreamInUse = true;
+    mStream = &localStream;
+    mStream->str("");
+  }
+  if (mColorEnabled) {
+    // Only display color values if printing on standard out
+    *mStream << getColorHexString(mColor);
+  }
+}
+
+Logger::Message::~Message() {
+  if (mStream == nullptr) {
+    return;
+  }
+  if (mColorEnabled && mColor != Color_value::DEFAULT) {
+    *mStream << getColorHexString(Color_value::COLOR_END);
+  }
+  LogBackend::get().submit(mStream->str());
+  if (mOwnsStream) {
+    delete mStream;
+  } else {
+    localStreamInUse = false;
+  }
+}
+
 std::string getColorHexString(const Color_value& color) {
   switch (color) {
     case Color_value::RED:
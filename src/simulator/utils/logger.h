@@ -14,13 +14,37 @@
 #ifndef LOGGER_H
 #define LOGGER_H
 
+#include <atomic>
+#include <cstddef>
 #include <iostream>
-#include <mutex>
+#include <sstream>
 #include <string>
 using namespace std;
 
 enum LOG_LEVEL { ERROR = 0, INFO = 1, DEBUG = 2 };
 
+// Messages with a level above PHYRE_LOG_COMPILE_LEVEL are removed at compile
+// time by the PHYRE_LOG* macros, including evaluation of their arguments.
+#ifndef PHYRE_LOG_COMPILE_LEVEL
+#ifdef NDEBUG
+#define PHYRE_LOG_COMPILE_LEVEL 1  // INFO
+#else
+#define PHYRE_LOG_COMPILE_LEVEL 2  // DEBUG
+#endif
+#endif
+
+// Logs a message if the level is enabled both at compile time and at run
+// time. The arguments are not evaluated otherwise. Usage:
+//   PHYRE_LOG_DEBUG << "Simulated " << steps << " steps\n";
+#define PHYRE_LOG_COLOR(level, color)                                       \
+  if ((level) > PHYRE_LOG_COMPILE_LEVEL || !Logger::is_enabled(level)) { \
+  } else                                                                \
+    Logger::Message((level), (color))
+#define PHYRE_LOG(level) PHYRE_LOG_COLOR(level, Color_value::DEFAULT)
+#define PHYRE_LOG_ERROR PHYRE_LOG_COLOR(LOG_LEVEL::ERROR, Color_value::RED)
+#define PHYRE_LOG_INFO PHYRE_LOG(LOG_LEVEL::INFO)
+#define PHYRE_LOG_DEBUG PHYRE_LOG(LOG_LEVEL::DEBUG)
+
 // Color values for printing
 enum Color_value {
   DEFAULT = 0,
@@ -35,12 +59,23 @@ std::string getColorHexString(const Color_value& color);
 LOG_LEVEL StrToLogLevel(const std::string& str);
 std::string LogLevelToString(const LOG_LEVEL pLogLevel);
 
-// Threadsafe implementation of Logging using Singleton design pattern
+// Asynchronous logger.
+//
+// A message is formatted by the calling thread and pushed into a lock-free
+// ring buffer owned by that thread. A background thread drains all buffers
+// into the output stream, so logging never blocks on I/O. Messages of a single
+// thread keep their order, messages of different threads may interleave. If a
+// buffer is full, the message is dropped and the number of dropped messages
+// is reported on the next drain.
+//
+// The logger can be used in a child process after fork(). Messages pending at
+// fork time are written by the parent only, and the child writes its own
+// messages synchronously as it has no drain thread.
 class Logger {
  private:
-  static LOG_LEVEL mLogLevel;  // singleton
+  static std::atomic<int> mLogLevel;
   // Allows to write in any outstream like cout or file
-  static std::ostream* mOutStream;  // singleton
+  static std::ostream* mOutStream;
   static bool mColorEnabled;
 
   // default makes sure these methods are created by only compiler
@@ -50,96 +85,69 @@ class Logger {
   Logger(const Logger&) = delete;
   Logger& operator=(const Logger&) = delete;
 
+  friend class LogBackend;
+
  public:
   static void set_log_level(LOG_LEVEL pLogLevel = LOG_LEVEL::ERROR) {
-    // "Block static" is the only instance and is thread safe in c++11
-    //   Guaranteed to be lazy initialized
-    //   Guaranteed that it will be destroyed correctly
-    static LOG_LEVEL logLevel = pLogLevel;
-    mLogLevel = logLevel;
+    mLogLevel.store(pLogLevel, std::memory_order_relaxed);
   }
 
-  static void set_outstream(std::ostream* pStream = &(std::cout)) {
-    static std::ostream* outStream = pStream;
-    mOutStream = outStream;
-    if (outStream->rdbuf() != std::cout.rdbuf()) {
-      mColorEnabled = false;
-    }
+  // Must not be called concurrently with logging. Pending messages are written
+  // to the previous stream.
+  static void set_outstream(std::ostream* pStream = &(std::cout));
+
+  static LOG_LEVEL get_log_level() {
+    return static_cast<LOG_LEVEL>(mLogLevel.load(std::memory_order_relaxed));
   }
 
-  static LOG_LEVEL get_log_level() { return mLogLevel; }
+  static bool is_enabled(LOG_LEVEL pLogLevel) {
+    return pLogLevel <= mLogLevel.load(std::memory_order_relaxed);
+  }
 
-  class Error {
-   private:
-    Color_value mColor;
+  // Blocks until all messages logged so far by any thread are written and
+  // flushes the output stream.
+  static void flush();
 
-   public:
-    Error() { mColor = Color_value::DEFAULT; }
-    Error(const Color_value& color) { mColor = color; }
-    template <typename T>
-    Error& operator<<(const T& data) {
-      if (LOG_LEVEL::ERROR <= mLogLevel) {
-        if (mColorEnabled) {
-          // Only display color values if printing on standard out
-          *mOutStream << getColorHexString(mColor) << data
-                      << getColorHexString(Color_value::COLOR_END);
-        } else {
-          *mOutStream << data;
-        }
-      }
-      return *this;
-    }
-  };
-  class Info {
-   private:
-    Color_value mColor;
+  // Total number of messages dropped because of full buffers.
+  static size_t num_dropped();
 
+  // Collects a single message and submits it on destruction, i.e., at the end
+  // of the full expression for temporaries.
+  class Message {
    public:
-    Info() { mColor = Color_value::DEFAULT; }
-    Info(const Color_value& color) { mColor = color; }
+    Message(LOG_LEVEL level, Color_value color = Color_value::DEFAULT);
+    ~Message();
+    Message(const Message&) = delete;
+    Message& operator=(const Message&) = delete;
+
     template <typename T>
-    Info& operator<<(const T& data) {
-      if (LOG_LEVEL::INFO <= mLogLevel) {
-        if (mColorEnabled) {
-          // Only display color values if printing on standard out
-          *mOutStream << getColorHexString(mColor) << data
-                      << getColorHexString(Color_value::COLOR_END);
-        } else {
-          *mOutStream << data;
-        }
+    Message& operator<<(const T& data) {
+      if (mStream != nullptr) {
+        *mStream << data;
       }
       return *this;
     }
-  };
-  class Debug {
+
    private:
+    // Thread local buffer or nullptr if the level is disabled.
+    std::ostringstream* mStream;
     Color_value mColor;
-
-   public:
-    Debug() { mColor = Color_value::DEFAULT; }
-    Debug(const Color_value& color) { mColor = color; }
-    template <typename T>
-    Debug& operator<<(const T& data) {
-      if (LOG_LEVEL::DEBUG <= mLogLevel) {
-        if (mColorEnabled) {
-          // Only display color values if printing on standard out
-          *mOutStream << getColorHexString(mColor) << data
-                      << getColorHexString(Color_value::COLOR_END);
-        } else {
-          *mOutStream << data;
-        }
-      }
-      return *this;
-    }
+    bool mOwnsStream;
   };
 
- public:
-  static Error ERROR() { return Error(); }
-  static Error ERROR(const Color_value& color) { return Error(color); }
-  static Info INFO() { return Info(); }
-  static Info INFO(const Color_value& color) { return Info(color); }
-  static Debug DEBUG() { return Debug(); }
-  static Debug DEBUG(const Color_value& color) { return Debug(color); }
+  // Unlike PHYRE_LOG* macros, the arguments of these are always evaluated.
+  static Message ERROR() { return Message(LOG_LEVEL::ERROR); }
+  static Message ERROR(const Color_value& color) {
+    return Message(LOG_LEVEL::ERROR, color);
+  }
+  static Message INFO() { return Message(LOG_LEVEL::INFO); }
+  static Message INFO(const Color_value& color) {
+    return Message(LOG_LEVEL::INFO, color);
+  }
+  static Message DEBUG() { return Message(LOG_LEVEL::DEBUG); }
+  static Message DEBUG(const Color_value& color) {
+    return Message(LOG_LEVEL::DEBUG, color);
+  }
 };
 
 #endif  // LOGGER_H
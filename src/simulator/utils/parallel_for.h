@@ -0,0 +1,73 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef UTILS_PARALLEL_FOR_H
+#define UTILS_PARALLEL_FOR_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Non-positive numThreads means std::thread::hardware_concurrency().
+inline int getNumThreads(int numThreads) {
+  return numThreads > 0
+             ? numThreads
+             : std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Runs body(i) for every i in [0, n) on numThreads threads. The first
+// exception is rethrown after all threads are joined.
+template <typename Body>
+void parallelFor(size_t n, int numThreads, const Body& body) {
+  numThreads = std::max(1, std::min<int>(numThreads, n));
+  if (numThreads == 1) {
+    for (size_t i = 0; i < n; ++i) {
+      body(i);
+    }
+    return;
+  }
+  std::atomic<size_t> next(0);
+  std::mutex mutex;
+  std::exception_ptr error;
+  const auto worker = [&]() {
+    for (size_t i = next++; i < n; i = next++) {
+      try {
+        body(i);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+        // Stop handing out work to all workers.
+        next = n;
+        return;
+      }
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int i = 0; i < numThreads; ++i) {
+    threads.emplace_back(worker);
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+#endif  // UTILS_PARALLEL_FOR_H